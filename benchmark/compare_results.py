@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Compare two storage benchmark result files.
+
+Usage: compare_results.py BASELINE.json CURRENT.json [--threshold PERCENT]
+
+Prints every metric of every operation with the change in percent and exits
+with status 1 if a CPU time, heap peak or I/O metric grew more than the
+threshold (default 10 %).
+"""
+import argparse
+import json
+import sys
+
+METRICS = ("cpu_us", "allocs", "heap_peak_bytes", "read_bytes", "write_bytes", "payload_bytes")
+# Payload growth is a format change, not a regression of the code
+CHECKED = ("cpu_us", "allocs", "heap_peak_bytes", "read_bytes", "write_bytes")
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get("label", ""), {(r["op"], r["sensors"], r["samples"]): r for r in data["results"]}
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) * 100.0 / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0)
+    args = parser.parse_args()
+
+    base_label, base = load(args.baseline)
+    cur_label, cur = load(args.current)
+    print(f"baseline: {base_label or args.baseline}  current: {cur_label or args.current}")
+    print(f"{'op':12} {'sensors':>8} {'samples':>8} {'metric':16} {'baseline':>12} {'current':>12} {'change':>9}")
+
+    regressions = 0
+    for key in sorted(base.keys() & cur.keys()):
+        for metric in METRICS:
+            old, new = base[key][metric], cur[key][metric]
+            pct = change(old, new)
+            flag = ""
+            if metric in CHECKED and pct > args.threshold:
+                flag = " !"
+                regressions += 1
+            print(f"{key[0]:12} {key[1]:8} {key[2]:8} {metric:16} {old:12.0f} {new:12.0f} {pct:8.1f}%{flag}")
+
+    for key in sorted(base.keys() ^ cur.keys()):
+        print(f"{key[0]:12} {key[1]:8} {key[2]:8} only in {'baseline' if key in base else 'current'}")
+
+    if regressions:
+        print(f"{regressions} metrics grew more than {args.threshold:.0f} %")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
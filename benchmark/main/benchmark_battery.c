@@ -0,0 +1,86 @@
+// benchmark_battery.c
+// Battery measurement filter and discharge table against the fake ADC.
+#include "benchmark_battery.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "battery_monitor.h"
+#include "battery_model.h"
+
+#define BATTERY_MIN_MV          3300
+#define BATTERY_MAX_MV          4200
+#define BATTERY_STEP_MV         25
+#define BATTERY_TOLERANCE_MV    30      // Allowed error of the filtered voltage
+#define BATTERY_CACHED_READS    100     // battery_monitor_read() calls of a cycle with many samples
+
+// The level must not rise when the voltage falls and must stay within 0-100
+static int check_table(void) {
+    int errors = 0;
+    int previous = 100;
+    for (uint32_t mv = 4400; mv >= 3000; mv -= 5) {
+        int level = battery_model_level(mv);
+        if (level < 0 || level > 100 || level > previous) {
+            printf("Battery level %d at %lu mV after %d\n", level, (unsigned long)mv, previous);
+            errors++;
+        }
+        previous = level;
+    }
+    if (battery_model_level(4200) != 100 || battery_model_level(3300) != 0) {
+        printf("Battery table does not end at 100 and 0 %%\n");
+        errors++;
+    }
+    return errors;
+}
+
+esp_err_t benchmark_battery_run(cJSON *result) {
+    int noise_mv = getenv("BENCH_BATTERY_NOISE_MV") ? atoi(getenv("BENCH_BATTERY_NOISE_MV")) : 20;
+    int spikes = getenv("BENCH_BATTERY_SPIKES") ? atoi(getenv("BENCH_BATTERY_SPIKES")) : 5;
+    int failures = check_table();
+    uint32_t max_error_mv = 0;
+    uint32_t samples = 0;
+    uint32_t cached_samples = 0;
+    int points = 0;
+
+    for (uint32_t mv = BATTERY_MIN_MV; mv <= BATTERY_MAX_MV; mv += BATTERY_STEP_MV) {
+        battery_monitor_sim_set(mv, noise_mv, spikes);
+        uint32_t before = battery_monitor_sim_reads();
+        if (battery_monitor_update() != ESP_OK) {
+            failures++;
+            continue;
+        }
+        uint32_t measured = battery_monitor_sim_reads();
+        samples = measured - before;
+
+        // The rest of the cycle reads the cached measurement
+        battery_info_t info = { 0 };
+        for (int i = 0; i < BATTERY_CACHED_READS; i++) {
+            battery_monitor_read(&info);
+        }
+        cached_samples += battery_monitor_sim_reads() - measured;
+
+        uint32_t error_mv = (info.voltage_mv > mv) ? info.voltage_mv - mv : mv - info.voltage_mv;
+        if (error_mv > max_error_mv) {
+            max_error_mv = error_mv;
+        }
+        if (error_mv > BATTERY_TOLERANCE_MV) {
+            printf("Battery %lu mV measured as %lu mV\n", (unsigned long)mv, (unsigned long)info.voltage_mv);
+            failures++;
+        }
+        points++;
+    }
+    if (cached_samples != 0) {
+        printf("Cached battery reads took %lu ADC samples\n", (unsigned long)cached_samples);
+        failures++;
+    }
+
+    cJSON_AddNumberToObject(result, "noise_mv", noise_mv);
+    cJSON_AddNumberToObject(result, "spike_percent", spikes);
+    cJSON_AddNumberToObject(result, "voltages", points);
+    cJSON_AddNumberToObject(result, "max_error_mv", max_error_mv);
+    cJSON_AddNumberToObject(result, "adc_samples_per_cycle", samples);
+    cJSON_AddNumberToObject(result, "adc_samples_cached", cached_samples);
+    cJSON_AddNumberToObject(result, "failures", failures);
+    printf("Battery: %d voltages, noise %d mV, %d %% spikes, max error %lu mV, %lu ADC samples per cycle, "
+           "%d failures\n", points, noise_mv, spikes, (unsigned long)max_error_mv, (unsigned long)samples, failures);
+    return failures ? ESP_FAIL : ESP_OK;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Battery measurement test with the fake ADC
+ *
+ * Checks that the discharge table is monotonic and bounded, then measures
+ * simulated batteries from 3.3 V to 4.2 V with noise and spikes at the ADC
+ * pin and compares the filtered voltage with the set one. Reading the
+ * battery again in the same cycle must not touch the ADC.
+ *
+ * Environment: BENCH_BATTERY_NOISE_MV (default 20), BENCH_BATTERY_SPIKES
+ * (percent of the raw samples, default 5).
+ *
+ * @param result Object for the errors and the ADC sample counts
+ * @return esp_err_t ESP_OK if every check passed
+ */
+esp_err_t benchmark_battery_run(cJSON *result);
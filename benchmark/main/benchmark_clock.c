@@ -0,0 +1,22 @@
+// benchmark_clock.c
+// time() of the linked code, linked with -Wl,--wrap=time so the benchmark
+// can move the wall clock without changing the system time.
+#include "benchmark_clock.h"
+
+time_t __real_time(time_t *tloc);
+
+static time_t s_fake_time = 0;
+
+void benchmark_clock_set(time_t time) {
+    s_fake_time = time;
+}
+
+time_t __wrap_time(time_t *tloc) {
+    if (s_fake_time == 0) {
+        return __real_time(tloc);
+    }
+    if (tloc != NULL) {
+        *tloc = s_fake_time;
+    }
+    return s_fake_time;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <time.h>
+
+/**
+ * @brief Set the time returned by time() to the linked code
+ *
+ * Used to store samples at chosen wall clock times, e.g. around midnight
+ * and the daylight saving time changes.
+ *
+ * @param time Time to return, 0 returns the real time again
+ */
+void benchmark_clock_set(time_t time);
@@ -0,0 +1,143 @@
+// benchmark_encoder.cpp
+// Schema encoder side of the encoder benchmark.
+#include "benchmark_encoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "time_manager.h"
+#include "firestore_schema.hpp"
+
+// Value of a Firestore field, NULL if missing
+static const cJSON *field_value(const cJSON *fields, const char *name, const char *type) {
+    return cJSON_GetObjectItem(cJSON_GetObjectItem(fields, name), type);
+}
+
+// String value of a Firestore field, NULL if missing
+static const char *field_string(const cJSON *fields, const char *name) {
+    const cJSON *value = field_value(fields, name, "stringValue");
+    return cJSON_IsString(value) ? value->valuestring : NULL;
+}
+
+// Number of a string, integer or double field
+static double field_number(const cJSON *fields, const char *name) {
+    const cJSON *value = field_value(fields, name, "doubleValue");
+    if (cJSON_IsNumber(value)) {
+        return value->valuedouble;
+    }
+    const char *text = field_string(fields, name);
+    if (text == NULL) {
+        value = field_value(fields, name, "integerValue");
+        text = cJSON_IsString(value) ? value->valuestring : NULL;
+    }
+    return text ? strtod(text, NULL) : 0;
+}
+
+// Time of a timestampValue (UTC) or stringValue (local time) field
+static time_t field_time(const cJSON *fields, const char *name) {
+    time_t time = 0;
+    const cJSON *value = field_value(fields, name, "timestampValue");
+    if (cJSON_IsString(value) && time_manager_parse_rfc3339(value->valuestring, &time) == ESP_OK) {
+        return time;
+    }
+    const char *text = field_string(fields, name);
+    time = text ? parse_timestamp_for_firebase(text) : (time_t)-1;
+    return time != (time_t)-1 ? time : 0;
+}
+
+// Measurements array of a document
+static const cJSON *document_values(const cJSON *fields) {
+    return cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(fields, "measurements"), "arrayValue"),
+                               "values");
+}
+
+size_t benchmark_encoder_document(char *buffer, size_t size, const ruuvi_measurement_t *measurements, int count,
+                                  uint32_t battery_voltage_mv, int battery_level) {
+    if (count <= 0) {
+        return 0;
+    }
+    firestore::sample *samples = static_cast<firestore::sample *>(malloc(count * sizeof(firestore::sample)));
+    if (samples == NULL) {
+        return 0;
+    }
+
+    // The document creation reads the time, the samples carry their own, as in json_helper.c
+    char day[11] = {0};
+    char time_str[32];
+    if (time_manager_get_formatted_time(time_str, sizeof(time_str)) != ESP_OK) {
+        strcpy(time_str, "Time not available");
+    }
+    strncpy(day, time_str, 10);
+    for (int i = 0; i < count; i++) {
+        samples[i] = { measurements[i].temperature, measurements[i].humidity,
+                       static_cast<time_t>(measurements[i].timestamp_ms / 1000) };
+    }
+
+    size_t length = firestore::encode_document(buffer, size, measurements[0].mac_address, day, battery_voltage_mv,
+                                               battery_level, samples, count);
+    free(samples);
+    return length;
+}
+
+esp_err_t benchmark_encoder_verify(const char *expected, const ruuvi_measurement_t *measurements, int count,
+                                   uint32_t battery_voltage_mv, int battery_level) {
+    // The day is taken from the cJSON document, it is formatted by time_manager
+    cJSON *doc = cJSON_Parse(expected);
+    const char *day = field_string(cJSON_GetObjectItem(doc, "fields"), "day");
+    firestore::sample *samples = static_cast<firestore::sample *>(malloc(count * sizeof(firestore::sample)));
+    size_t size = strlen(expected) + 1;
+    char *buffer = static_cast<char *>(malloc(size));
+
+    esp_err_t ret = ESP_FAIL;
+    if (day != NULL && samples != NULL && buffer != NULL) {
+        for (int i = 0; i < count; i++) {
+            samples[i] = { measurements[i].temperature, measurements[i].humidity,
+                           static_cast<time_t>(measurements[i].timestamp_ms / 1000) };
+        }
+        size_t length = firestore::encode_document(buffer, size, measurements[0].mac_address, day,
+                                                   battery_voltage_mv, battery_level, samples, count);
+        ret = (length == size - 1 && memcmp(buffer, expected, length) == 0) ? ESP_OK : ESP_FAIL;
+    }
+    free(samples);
+    free(buffer);
+    cJSON_Delete(doc);
+    return ret;
+}
+
+esp_err_t benchmark_encoder_trace(const char *text, int *samples, size_t *string_bytes, size_t *typed_bytes) {
+    cJSON *doc = cJSON_Parse(text);
+    const cJSON *fields = cJSON_GetObjectItem(doc, "fields");
+    const cJSON *values = document_values(fields);
+    const char *tag_id = field_string(fields, "tag_id");
+    const char *day = field_string(fields, "day");
+    if (tag_id == NULL || day == NULL || !cJSON_IsArray(values)) {
+        cJSON_Delete(doc);
+        return ESP_FAIL;
+    }
+
+    int count = cJSON_GetArraySize(values);
+    firestore::sample *trace = static_cast<firestore::sample *>(malloc((count + 1) * sizeof(firestore::sample)));
+    // The string format is the larger one, twice the stored size is enough for both
+    size_t size = 2 * strlen(text) + 1024;
+    char *buffer = static_cast<char *>(malloc(size));
+    esp_err_t ret = (trace != NULL && buffer != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+    for (int i = 0; ret == ESP_OK && i < count; i++) {
+        const cJSON *sample_fields = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetArrayItem(values, i),
+                                                                              "mapValue"), "fields");
+        trace[i] = { static_cast<float>(field_number(sample_fields, "t")),
+                     static_cast<float>(field_number(sample_fields, "h")), field_time(sample_fields, "ts") };
+    }
+    if (ret == ESP_OK) {
+        uint32_t battery_voltage_mv = static_cast<uint32_t>(field_number(fields, "battery_voltage"));
+        int battery_level = static_cast<int>(field_number(fields, "battery_level"));
+        *samples = count;
+        *string_bytes = firestore::encode_document<false>(buffer, size, tag_id, day, battery_voltage_mv,
+                                                          battery_level, trace, count);
+        *typed_bytes = firestore::encode_document<true>(buffer, size, tag_id, day, battery_voltage_mv,
+                                                        battery_level, trace, count);
+        ret = (*string_bytes > 0 && *typed_bytes > 0) ? ESP_OK : ESP_FAIL;
+    }
+    free(trace);
+    free(buffer);
+    cJSON_Delete(doc);
+    return ret;
+}
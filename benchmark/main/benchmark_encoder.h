@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+#include "sensors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Encode a sensor document with the compile-time schema encoder
+ *
+ * Reads the day and the time of every measurement like json_helper.c does.
+ *
+ * @param buffer Buffer for the JSON text
+ * @param size Size of the buffer
+ * @param measurements Measurements of one sensor
+ * @param count Number of measurements
+ * @param battery_voltage_mv Battery voltage in millivolts
+ * @param battery_level Battery level percentage
+ * @return size_t Length of the text, 0 if the buffer was too small
+ */
+size_t benchmark_encoder_document(char *buffer, size_t size, const ruuvi_measurement_t *measurements, int count,
+                                  uint32_t battery_voltage_mv, int battery_level);
+
+/**
+ * @brief Check that the schema encoder gives the same bytes as cJSON
+ *
+ * @param expected Document printed with cJSON_PrintUnformatted()
+ * @param measurements Measurements the document was built from
+ * @param count Number of measurements
+ * @param battery_voltage_mv Battery voltage in millivolts
+ * @param battery_level Battery level percentage
+ * @return esp_err_t ESP_OK if the output is identical, ESP_FAIL otherwise
+ */
+esp_err_t benchmark_encoder_verify(const char *expected, const ruuvi_measurement_t *measurements, int count,
+                                   uint32_t battery_voltage_mv, int battery_level);
+
+/**
+ * @brief Re-encode a stored sensor document in the string and in the typed format
+ *
+ * Accepts documents in either format, e.g. sensor files copied from a device.
+ *
+ * @param text Stored document
+ * @param samples Pointer to store the number of measurements
+ * @param string_bytes Pointer to store the size in the string format
+ * @param typed_bytes Pointer to store the size in the typed format
+ * @return esp_err_t ESP_OK on success, ESP_FAIL if the document could not be read
+ */
+esp_err_t benchmark_encoder_trace(const char *text, int *samples, size_t *string_bytes, size_t *typed_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,175 @@
+// benchmark_energy.c
+// Host test of the energy ledger estimator on synthetic discharge traces.
+#include "benchmark_energy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "energy_model.h"
+#include "battery_model.h"
+#include "config_manager.h"
+
+#define ENERGY_DEFAULT_DAYS     90
+#define ENERGY_SCAN_S           3.0     // BLE scan of every cycle
+#define ENERGY_UPLOAD_S         65.0    // Modem time of a daily upload
+#define ENERGY_NOISE_MV         10.0    // Noise of the simulated rest voltage
+
+#define CYCLE_S                 ((double)TRIGGER_INTERVAL / SECONDS_IN_MICROS)
+#define CYCLES_PER_DAY          ((int)(24 * 3600 / CYCLE_S))
+
+// Discharge trace: error of the current estimates and solar input
+typedef struct {
+    const char *name;
+    double current_bias;        // Real current / estimated current - 1
+    double solar_peak_ma;       // Midday charge current, 0 for none
+    double start_level;         // Percent
+} energy_trace_t;
+
+static const energy_trace_t s_traces[] = {
+    { "exact",     0.00, 0.0, 100.0 },
+    { "under_est", 0.25, 0.0, 100.0 },
+    { "over_est", -0.20, 0.0,  80.0 },
+    { "solar",     0.10, 2.0,  60.0 },
+};
+
+// Squared error sums of one estimator
+typedef struct {
+    double sum_sq;
+    double max_abs;
+} error_stat_t;
+
+// Integer hash, the same noise for every estimator
+static uint32_t trace_hash(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Rest voltage of a level, the inverse of the discharge table with noise
+static uint32_t trace_voltage(double level, int cycle, uint32_t seed) {
+    uint32_t mv = 3300;
+    while (mv < 4200 && battery_model_level(mv) < level) {
+        mv++;
+    }
+    // Sum of uniform values, roughly normal
+    double noise = 0.0;
+    for (int i = 0; i < 4; i++) {
+        noise += (double)(trace_hash((uint32_t)(cycle * 4 + i), seed) % 2001) / 1000.0 - 1.0;
+    }
+    return (uint32_t)(mv + noise * ENERGY_NOISE_MV * 0.866);
+}
+
+// Solar charge of a cycle in mAh
+static double trace_harvest_mah(const energy_trace_t *trace, int cycle) {
+    double hour = fmod((double)cycle / CYCLES_PER_DAY, 1.0) * 24.0;
+    if (trace->solar_peak_ma <= 0.0 || hour < 6.0 || hour >= 18.0) {
+        return 0.0;
+    }
+    return trace->solar_peak_ma * sin(M_PI * (hour - 6.0) / 12.0) * CYCLE_S / 3600.0;
+}
+
+// Estimated charge of a cycle from the phase currents, like phase_profiler and the ledger
+static double counted_mah(int cycle) {
+    double mah = ENERGY_SCAN_S * (PHASE_CURRENT_CPU_MA + PHASE_CURRENT_RADIO_MA) / 3600.0;
+    if (cycle % SEND_DATA_CYCLE == SEND_DATA_CYCLE - 1) {
+        mah += ENERGY_UPLOAD_S * (PHASE_CURRENT_CPU_MA + PHASE_CURRENT_MODEM_MA) / 3600.0;
+    }
+    return mah + CYCLE_S * ENERGY_SLEEP_CURRENT_UA / 1000.0 / 3600.0;
+}
+
+static void error_add(error_stat_t *stat, double error) {
+    stat->sum_sq += error * error;
+    if (fabs(error) > stat->max_abs) {
+        stat->max_abs = fabs(error);
+    }
+}
+
+// Replay one trace with the counting, the voltage and the fused estimate
+static bool replay(cJSON *traces, const energy_trace_t *trace, int days, uint32_t seed) {
+    energy_model_params_t params;
+    energy_model_default_params(&params);
+    double capacity = params.capacity_mah;
+    double charge = trace->start_level * capacity / 100.0;
+
+    energy_estimate_t fused;
+    energy_estimate_t counted;
+    uint32_t first_mv = trace_voltage(trace->start_level, 0, seed);
+    energy_model_init(&params, &fused, first_mv);
+    energy_model_init(&params, &counted, first_mv);
+
+    error_stat_t fused_error = { 0 };
+    error_stat_t counted_error = { 0 };
+    error_stat_t voltage_error = { 0 };
+    double true_used = 0.0;
+    int cycles = 0;
+
+    for (int cycle = 1; cycle < days * CYCLES_PER_DAY && charge > 0.0; cycle++) {
+        double estimated = counted_mah(cycle);
+        double used = estimated * (1.0 + trace->current_bias);
+        charge += trace_harvest_mah(trace, cycle) - used;
+        charge = (charge > capacity) ? capacity : charge;
+        true_used += used;
+
+        double level = charge * 100.0 / capacity;
+        uint32_t voltage_mv = trace_voltage(level, cycle, seed);
+
+        energy_model_consume(&params, &fused, (float)estimated, (uint32_t)CYCLE_S);
+        energy_model_correct(&params, &fused, voltage_mv);
+        energy_model_consume(&params, &counted, (float)estimated, (uint32_t)CYCLE_S);
+
+        error_add(&fused_error, energy_model_level(&params, &fused) - level);
+        error_add(&counted_error, energy_model_level(&params, &counted) - level);
+        error_add(&voltage_error, battery_model_level(voltage_mv) - level);
+        cycles++;
+    }
+
+    double fused_rms = sqrt(fused_error.sum_sq / cycles);
+    double counted_rms = sqrt(counted_error.sum_sq / cycles);
+    double voltage_rms = sqrt(voltage_error.sum_sq / cycles);
+    double true_daily = true_used * CYCLES_PER_DAY / cycles;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "trace", trace->name);
+    cJSON_AddNumberToObject(item, "cycles", cycles);
+    cJSON_AddNumberToObject(item, "fused_rms_percent", fused_rms);
+    cJSON_AddNumberToObject(item, "fused_max_percent", fused_error.max_abs);
+    cJSON_AddNumberToObject(item, "counted_rms_percent", counted_rms);
+    cJSON_AddNumberToObject(item, "voltage_rms_percent", voltage_rms);
+    cJSON_AddNumberToObject(item, "daily_mah", fused.daily_mah);
+    cJSON_AddNumberToObject(item, "true_daily_mah", true_daily);
+    cJSON_AddNumberToObject(item, "corrected_mah", fused.corrected_mah);
+    cJSON_AddNumberToObject(item, "days_left", energy_model_days_left(&fused));
+    cJSON_AddItemToArray(traces, item);
+
+    printf("%-10s %7d %9.2f %9.2f %11.2f %11.2f %9.1f %9.1f %10.1f\n", trace->name, cycles, fused_rms,
+           fused_error.max_abs, counted_rms, voltage_rms, fused.daily_mah, true_daily, fused.corrected_mah);
+
+    bool ok = fused_rms <= counted_rms && fused_rms <= voltage_rms;
+    if (!ok) {
+        printf("Fused estimate of trace %s is worse than a single source\n", trace->name);
+    }
+    return ok;
+}
+
+esp_err_t benchmark_energy_run(cJSON *traces) {
+    int days = getenv("BENCH_ENERGY_DAYS") ? atoi(getenv("BENCH_ENERGY_DAYS")) : ENERGY_DEFAULT_DAYS;
+    uint32_t seed = getenv("BENCH_ENERGY_SEED") ? (uint32_t)atoi(getenv("BENCH_ENERGY_SEED")) : 1;
+    if (days <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    printf("\nEnergy estimator: %d days, level error in percent\n", days);
+    printf("%-10s %7s %9s %9s %11s %11s %9s %9s %10s\n", "trace", "cycles", "fused", "fused_max", "counted",
+           "voltage", "mAh/day", "true/day", "corrected");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(s_traces) / sizeof(s_traces[0]); i++) {
+        if (!replay(traces, &s_traces[i], days, seed)) {
+            ok = false;
+        }
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief State of charge estimator on synthetic discharge traces
+ *
+ * Runs the energy model over months of wake cycles in which the real
+ * current differs from the phase estimates and, in some traces, a solar
+ * panel charges the cell. The rest voltage comes from the discharge table
+ * with noise. The fused estimate is compared with counting only and with
+ * the voltage only; the run fails if the fused level error is larger than
+ * the error of either source.
+ *
+ * Environment: BENCH_ENERGY_DAYS (default 90), BENCH_ENERGY_SEED.
+ *
+ * @param traces Array for one result object per trace
+ * @return esp_err_t ESP_OK if the fused estimate was the best in every trace
+ */
+esp_err_t benchmark_energy_run(cJSON *traces);
@@ -0,0 +1,188 @@
+// benchmark_faults.c
+// Host replay of the wake cycle failure handling under modem outages.
+#include "benchmark_faults.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "config_manager.h"
+
+#define FAULT_DEFAULT_DAYS      60
+#define FAULT_DEFAULT_SENSORS   4
+#define FAULT_SCAN_S            3.0     // BLE scan of every cycle
+#define FAULT_CONNECT_S         45.0    // Modem boot, attach, PPP and NTP on a good link
+#define FAULT_UPLOAD_S          20.0    // Upload and report of one send cycle
+#define FAULT_FAIL_S            35.0    // Modem answers with errors until the SIM and network retries give up
+#define FAULT_HANG_S            300.0   // Modem does not answer, every AT command runs into its 3 x 10 s timeout
+#define FAULT_RESTART_DELAY_S   10.0    // Delay before esp_restart() of the restart policy
+#define FAULT_REBOOT_S          3.0     // Boot, NVS and storage initialization after a restart
+#define FAULT_ABORT_S           10.0    // An aborted AT command still runs into its timeout
+#define FAULT_TRANSIENT_DIV     10      // Failures outside an outage, rate / 10 % of the attempts
+
+#define CYCLE_S                 ((double)TRIGGER_INTERVAL / SECONDS_IN_MICROS)
+#define CONNECT_BUDGET_S        (STAGE_BUDGET_CONNECT_MS / 1000.0)
+
+static const int s_outage_rates[] = { 0, 5, 20 };
+
+typedef enum {
+    FAULT_POLICY_RESTART,
+    FAULT_POLICY_DEADLINE,
+} fault_policy_t;
+
+typedef enum {
+    ATTEMPT_OK,
+    ATTEMPT_FAIL,
+    ATTEMPT_HANG,
+} attempt_t;
+
+// Result of one policy and outage rate
+typedef struct {
+    const char *name;
+    int outage_rate;
+    double awake_s;
+    double modem_s;
+    int64_t samples;
+    int64_t lost_samples;
+    int uploads;
+    int failed_connects;
+    int reboots;
+} fault_result_t;
+
+// Integer hash, the traces are the same for every policy
+static uint32_t trace_hash(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Outcome of a connect attempt at a time, outages last whole hours
+static attempt_t trace_attempt(double t, int rate, uint32_t seed) {
+    uint32_t hour = (uint32_t)(t / 3600.0);
+    uint32_t second = (uint32_t)t;
+    bool outage = trace_hash(hour, seed) % 100 < (uint32_t)rate;
+    bool transient = trace_hash(second, seed + 1) % (100 * FAULT_TRANSIENT_DIV) < (uint32_t)rate;
+    if (!outage && !transient) {
+        return ATTEMPT_OK;
+    }
+    return (trace_hash(second, seed + 2) & 1) ? ATTEMPT_HANG : ATTEMPT_FAIL;
+}
+
+// Modem on time of a failed attempt
+static double attempt_duration(attempt_t attempt, fault_policy_t policy) {
+    if (attempt == ATTEMPT_FAIL) {
+        return FAULT_FAIL_S;
+    }
+    if (policy == FAULT_POLICY_DEADLINE && CONNECT_BUDGET_S + FAULT_ABORT_S < FAULT_HANG_S) {
+        return CONNECT_BUDGET_S + FAULT_ABORT_S;
+    }
+    return FAULT_HANG_S;
+}
+
+// Replay all cycles with one policy
+static void replay(fault_result_t *r, fault_policy_t policy, int days, int sensors, uint32_t seed) {
+    int total_cycles = (int)(days * 24 * 3600 / CYCLE_S);
+    int pending_cycles = 0;
+    bool skip_scan = false;
+    double t = 0.0;
+
+    for (int cycle = 0; cycle < total_cycles; cycle++) {
+        double wake = cycle * CYCLE_S;
+        r->samples += sensors;
+
+        // The device is still in a restart loop at this wake
+        if (t > wake) {
+            r->lost_samples += sensors;
+            continue;
+        }
+        t = wake;
+
+        // The error flag of the restart policy skips the collection of one cycle
+        if (skip_scan) {
+            skip_scan = false;
+            r->lost_samples += sensors;
+        } else {
+            t += FAULT_SCAN_S;
+            r->awake_s += FAULT_SCAN_S;
+            pending_cycles++;
+        }
+
+        if (pending_cycles < SEND_DATA_CYCLE) {
+            continue;
+        }
+
+        for (;;) {
+            attempt_t attempt = trace_attempt(t, r->outage_rate, seed);
+            if (attempt == ATTEMPT_OK) {
+                double duration = FAULT_CONNECT_S + FAULT_UPLOAD_S;
+                t += duration;
+                r->awake_s += duration;
+                r->modem_s += duration;
+                r->uploads++;
+                pending_cycles = 0;
+                break;
+            }
+
+            double duration = attempt_duration(attempt, policy);
+            t += duration;
+            r->awake_s += duration;
+            r->modem_s += duration;
+            r->failed_connects++;
+            if (policy == FAULT_POLICY_DEADLINE) {
+                // The data stays stored, the next cycle sends it
+                break;
+            }
+
+            // unsuccessful_init(): modem off, 10 s delay, restart and the same send cycle again
+            t += FAULT_RESTART_DELAY_S + FAULT_REBOOT_S;
+            r->awake_s += FAULT_RESTART_DELAY_S + FAULT_REBOOT_S;
+            r->reboots++;
+            skip_scan = true;
+        }
+    }
+}
+
+// Add a result to the results and print it
+static void report_result(cJSON *faults, const fault_result_t *r, int days) {
+    double lost_pct = r->samples ? r->lost_samples * 100.0 / r->samples : 0.0;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "policy", r->name);
+    cJSON_AddNumberToObject(item, "outage_rate", r->outage_rate);
+    cJSON_AddNumberToObject(item, "awake_s_per_day", r->awake_s / days);
+    cJSON_AddNumberToObject(item, "modem_s_per_day", r->modem_s / days);
+    cJSON_AddNumberToObject(item, "lost_samples", (double)r->lost_samples);
+    cJSON_AddNumberToObject(item, "lost_percent", lost_pct);
+    cJSON_AddNumberToObject(item, "uploads", r->uploads);
+    cJSON_AddNumberToObject(item, "failed_connects", r->failed_connects);
+    cJSON_AddNumberToObject(item, "reboots", r->reboots);
+    cJSON_AddItemToArray(faults, item);
+
+    printf("%-9s %6d%% %10.1f %10.1f %8lld %6.2f%% %8d %7d %8d\n", r->name, r->outage_rate, r->awake_s / days,
+           r->modem_s / days, (long long)r->lost_samples, lost_pct, r->uploads, r->failed_connects, r->reboots);
+}
+
+esp_err_t benchmark_faults_run(cJSON *faults) {
+    int days = getenv("BENCH_FAULT_DAYS") ? atoi(getenv("BENCH_FAULT_DAYS")) : FAULT_DEFAULT_DAYS;
+    int sensors = getenv("BENCH_FAULT_SENSORS") ? atoi(getenv("BENCH_FAULT_SENSORS")) : FAULT_DEFAULT_SENSORS;
+    uint32_t seed = getenv("BENCH_FAULT_SEED") ? (uint32_t)atoi(getenv("BENCH_FAULT_SEED")) : 1;
+    if (days <= 0 || sensors <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    printf("\nModem fault replay: %d days, %d sensors, upload every %d cycles\n", days, sensors, SEND_DATA_CYCLE);
+    printf("%-9s %7s %10s %10s %8s %7s %8s %7s %8s\n", "policy", "outage", "awake_s/d", "modem_s/d", "lost",
+           "lost", "uploads", "failed", "reboots");
+    for (size_t i = 0; i < sizeof(s_outage_rates) / sizeof(s_outage_rates[0]); i++) {
+        fault_result_t restart = { .name = "restart", .outage_rate = s_outage_rates[i] };
+        fault_result_t deadline = { .name = "deadline", .outage_rate = s_outage_rates[i] };
+        replay(&restart, FAULT_POLICY_RESTART, days, sensors, seed);
+        replay(&deadline, FAULT_POLICY_DEADLINE, days, sensors, seed);
+        report_result(faults, &restart, days);
+        report_result(faults, &deadline, days);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Replay wake cycles with injected modem failures
+ *
+ * Compares the restart policy the firmware used before the stage deadlines
+ * with the deadline supervisor of cycle_pipeline. Modem outages come from
+ * a hashed trace of hours, during an outage a connect attempt either fails
+ * with an error or hangs without answers. The restart policy waits 10 s,
+ * restarts and tries again until the modem comes up, wakes that fall into
+ * the restart loop lose their samples and the first wake after it skips
+ * the scan. The deadline policy gives up after the failure or the connect
+ * budget, keeps the data and tries again in the next send cycle.
+ *
+ * Every policy runs with the outage rates 0, 5 and 20 % of the hours.
+ *
+ * Environment: BENCH_FAULT_DAYS, BENCH_FAULT_SENSORS, BENCH_FAULT_SEED.
+ *
+ * @param faults Array for one result object per policy and outage rate
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the environment is invalid
+ */
+esp_err_t benchmark_faults_run(cJSON *faults);
@@ -0,0 +1,588 @@
+// benchmark_fs.c
+// SPIFFS and LittleFS cores on file-backed flash images, driven with the
+// file pattern of storage.c.
+#include "benchmark_fs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "config_manager.h"
+
+#if BENCH_FS_CORES
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "lfs.h"
+
+#define FS_PARTITION_SIZE       (1024 * 1024)   // storage partition in partitions.csv
+#define FS_SECTOR_SIZE          4096
+#define FS_PAGE_SIZE            256             // CONFIG_SPIFFS_PAGE_SIZE and the program page of the flash
+#define FS_MAX_FILES            5               // max_files of storage_fs_spiffs.c
+
+// Flash timing, typical datasheet values of the module flash
+#define FLASH_READ_NS_PER_BYTE  50              // 40 MHz DIO
+#define FLASH_PROGRAM_US        700             // One page
+#define FLASH_ERASE_US          45000           // One sector
+
+// Workload of storage.c
+#define FS_DEFAULT_SENSORS      4
+#define FS_DEFAULT_DAYS         3
+#define FS_MAX_SENSORS          32
+#define FS_MAX_DAYS             30
+#define FS_CYCLES_PER_DAY       (int)(24LL * 3600 * SECONDS_IN_MICROS / TRIGGER_INTERVAL)
+#define FS_SAMPLE_BYTES         180             // One typed Firestore sample in the day document
+#define FS_DOC_HEADER_BYTES     64
+#define FS_DOC_MAX_BYTES        (FS_DOC_HEADER_BYTES + SEND_DATA_CYCLE * FS_SAMPLE_BYTES + 4)
+#define FS_LOG_PATH             "/debug_log.bin"
+#define FS_LOG_HEADER_BYTES     16              // storage_log_file_header_t
+#define FS_LOG_RECORD_BYTES     32              // storage_log_record_t
+#define FS_LOG_CAPACITY         256
+#define FS_LOG_RECORDS_PER_WAKE 4
+#define FS_SYNC_PATH            "/.sync"
+
+// Image file with the program and erase rules of NOR flash
+typedef struct {
+    int fd;
+    uint8_t *data;
+    uint64_t read_bytes;
+    uint64_t program_bytes;
+    uint64_t program_pages;
+    uint64_t erases;
+} flash_image_t;
+
+typedef enum {
+    FS_REPLACE,     // fopen "w"
+    FS_APPEND,      // fopen "a"
+    FS_PATCH,       // fopen "r+", write at an offset up to the end of the file
+} fs_write_mode_t;
+
+// File operations of a core, the VFS of ESP-IDF adds nothing that touches the flash
+typedef struct {
+    const char *name;
+    bool (*mount)(flash_image_t *image, bool format);
+    void (*unmount)(void);
+    bool (*write)(const char *path, fs_write_mode_t mode, uint32_t offset, const void *data, size_t size);
+    long (*read)(const char *path, void *buffer, size_t size);
+    bool (*remove)(const char *path);
+    size_t (*used)(void);
+    void (*gc)(size_t size);    // NULL if the file system collects while it writes, as in storage_fs.h
+} fs_backend_t;
+
+// Results of one backend
+typedef struct {
+    int64_t format_ns;
+    int64_t mount_ns;
+    int64_t mount_max_ns;
+    int mounts;
+    int64_t append_ns;
+    int64_t append_max_ns;
+    int appends;
+    int64_t read_ns;
+    uint64_t read_bytes;
+    uint64_t written_bytes;     // Bytes passed to the file system
+    uint64_t programmed_bytes;  // Bytes programmed into the flash
+    uint64_t erases;
+    size_t used_max;
+    int errors;
+} fs_result_t;
+
+// CPU time of the host and flash time of the counted accesses
+typedef struct {
+    int64_t cpu_ns;
+    int64_t flash_ns;
+} fs_clock_t;
+
+static bool image_open(flash_image_t *image, const char *path) {
+    memset(image, 0, sizeof(*image));
+    image->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (image->fd < 0 || ftruncate(image->fd, FS_PARTITION_SIZE) != 0) {
+        return false;
+    }
+    image->data = mmap(NULL, FS_PARTITION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0);
+    if (image->data == MAP_FAILED) {
+        image->data = NULL;
+        return false;
+    }
+    memset(image->data, 0xFF, FS_PARTITION_SIZE);
+    return true;
+}
+
+static void image_close(flash_image_t *image) {
+    if (image->data != NULL) {
+        munmap(image->data, FS_PARTITION_SIZE);
+    }
+    if (image->fd >= 0) {
+        close(image->fd);
+    }
+}
+
+static bool flash_read(flash_image_t *image, uint32_t addr, void *buffer, uint32_t size) {
+    if ((uint64_t)addr + size > FS_PARTITION_SIZE) {
+        return false;
+    }
+    memcpy(buffer, image->data + addr, size);
+    image->read_bytes += size;
+    return true;
+}
+
+// Programming only clears bits, the time is per page touched
+static bool flash_program(flash_image_t *image, uint32_t addr, const void *data, uint32_t size) {
+    if ((uint64_t)addr + size > FS_PARTITION_SIZE || size == 0) {
+        return size == 0;
+    }
+    const uint8_t *bytes = data;
+    for (uint32_t i = 0; i < size; i++) {
+        image->data[addr + i] &= bytes[i];
+    }
+    image->program_bytes += size;
+    image->program_pages += (addr + size - 1) / FS_PAGE_SIZE - addr / FS_PAGE_SIZE + 1;
+    return true;
+}
+
+static bool flash_erase(flash_image_t *image, uint32_t addr, uint32_t size) {
+    if (addr % FS_SECTOR_SIZE != 0 || size % FS_SECTOR_SIZE != 0 || (uint64_t)addr + size > FS_PARTITION_SIZE) {
+        return false;
+    }
+    memset(image->data + addr, 0xFF, size);
+    image->erases += size / FS_SECTOR_SIZE;
+    return true;
+}
+
+static int64_t flash_time_ns(const flash_image_t *image) {
+    return (int64_t)(image->read_bytes * FLASH_READ_NS_PER_BYTE + image->program_pages * FLASH_PROGRAM_US * 1000 +
+                     image->erases * FLASH_ERASE_US * 1000);
+}
+
+static int64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static fs_clock_t clock_start(const flash_image_t *image) {
+    return (fs_clock_t){ .cpu_ns = thread_cpu_ns(), .flash_ns = flash_time_ns(image) };
+}
+
+static int64_t clock_elapsed_ns(const fs_clock_t *start, const flash_image_t *image) {
+    return (thread_cpu_ns() - start->cpu_ns) + (flash_time_ns(image) - start->flash_ns);
+}
+
+// -------------------- SPIFFS -------------------- //
+
+#define SPIFFS_FDS_SIZE     (FS_MAX_FILES * sizeof(spiffs_fd))
+#define SPIFFS_CACHE_SIZE   (sizeof(spiffs_cache) + FS_MAX_FILES * (sizeof(spiffs_cache_page) + FS_PAGE_SIZE))
+
+// Buffer sizes as esp_spiffs.c allocates them
+static spiffs s_spiffs;
+static spiffs_config s_spiffs_config;
+static uint32_t s_spiffs_work[2 * FS_PAGE_SIZE / sizeof(uint32_t)];
+static uint32_t s_spiffs_fds[(SPIFFS_FDS_SIZE + 3) / 4];
+static uint32_t s_spiffs_cache[(SPIFFS_CACHE_SIZE + 3) / 4];
+
+static s32_t spiffs_hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+    return flash_read(fs->user_data, addr, dst, size) ? SPIFFS_OK : SPIFFS_ERR_INTERNAL;
+}
+
+static s32_t spiffs_hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+    return flash_program(fs->user_data, addr, src, size) ? SPIFFS_OK : SPIFFS_ERR_INTERNAL;
+}
+
+static s32_t spiffs_hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+    return flash_erase(fs->user_data, addr, size) ? SPIFFS_OK : SPIFFS_ERR_INTERNAL;
+}
+
+// Mount like esp_vfs_spiffs_register() with format_if_mount_failed
+static bool spiffs_bench_mount(flash_image_t *image, bool format) {
+    s_spiffs_config = (spiffs_config){
+        .hal_read_f = spiffs_hal_read,
+        .hal_write_f = spiffs_hal_write,
+        .hal_erase_f = spiffs_hal_erase,
+        .phys_size = FS_PARTITION_SIZE,
+        .phys_addr = 0,
+        .phys_erase_block = FS_SECTOR_SIZE,
+        .log_block_size = FS_SECTOR_SIZE,
+        .log_page_size = FS_PAGE_SIZE,
+    };
+    s_spiffs.user_data = image;
+    s32_t res = SPIFFS_mount(&s_spiffs, &s_spiffs_config, (u8_t *)s_spiffs_work, (u8_t *)s_spiffs_fds,
+                             sizeof(s_spiffs_fds), s_spiffs_cache, sizeof(s_spiffs_cache), NULL);
+    if (res != SPIFFS_OK && format) {
+        SPIFFS_unmount(&s_spiffs);
+        res = SPIFFS_format(&s_spiffs);
+        if (res == SPIFFS_OK) {
+            res = SPIFFS_mount(&s_spiffs, &s_spiffs_config, (u8_t *)s_spiffs_work, (u8_t *)s_spiffs_fds,
+                               sizeof(s_spiffs_fds), s_spiffs_cache, sizeof(s_spiffs_cache), NULL);
+        }
+    }
+    return res == SPIFFS_OK;
+}
+
+static void spiffs_bench_unmount(void) {
+    SPIFFS_unmount(&s_spiffs);
+}
+
+static bool spiffs_bench_write(const char *path, fs_write_mode_t mode, uint32_t offset, const void *data,
+                               size_t size) {
+    spiffs_flags flags = SPIFFS_O_CREAT | SPIFFS_O_WRONLY;
+    if (mode == FS_REPLACE) {
+        flags |= SPIFFS_O_TRUNC;
+    } else if (mode == FS_APPEND) {
+        flags |= SPIFFS_O_APPEND;
+    } else {
+        flags = SPIFFS_O_CREAT | SPIFFS_O_RDWR;
+    }
+    spiffs_file file = SPIFFS_open(&s_spiffs, path, flags, 0);
+    if (file < 0) {
+        return false;
+    }
+    bool ok = (mode != FS_PATCH || SPIFFS_lseek(&s_spiffs, file, (s32_t)offset, SPIFFS_SEEK_SET) >= 0) &&
+              SPIFFS_write(&s_spiffs, file, (void *)data, (s32_t)size) == (s32_t)size;
+    return SPIFFS_close(&s_spiffs, file) == SPIFFS_OK && ok;
+}
+
+static long spiffs_bench_read(const char *path, void *buffer, size_t size) {
+    spiffs_file file = SPIFFS_open(&s_spiffs, path, SPIFFS_O_RDONLY, 0);
+    if (file < 0) {
+        return -1;
+    }
+    s32_t length = SPIFFS_read(&s_spiffs, file, buffer, (s32_t)size);
+    SPIFFS_close(&s_spiffs, file);
+    return length == SPIFFS_ERR_END_OF_OBJECT ? 0 : (long)length;
+}
+
+static bool spiffs_bench_remove(const char *path) {
+    return SPIFFS_remove(&s_spiffs, path) == SPIFFS_OK;
+}
+
+static size_t spiffs_bench_used(void) {
+    u32_t total = 0;
+    u32_t used = 0;
+    return SPIFFS_info(&s_spiffs, &total, &used) == SPIFFS_OK ? used : 0;
+}
+
+static void spiffs_bench_gc(size_t size) {
+    SPIFFS_gc(&s_spiffs, (u32_t)size);
+}
+
+static const fs_backend_t s_spiffs_backend = {
+    .name = "spiffs",
+    .mount = spiffs_bench_mount,
+    .unmount = spiffs_bench_unmount,
+    .write = spiffs_bench_write,
+    .read = spiffs_bench_read,
+    .remove = spiffs_bench_remove,
+    .used = spiffs_bench_used,
+    .gc = spiffs_bench_gc,
+};
+
+// -------------------- LittleFS -------------------- //
+
+static lfs_t s_lfs;
+static struct lfs_config s_lfs_config;
+
+static int lfs_hal_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    return flash_read(c->context, block * c->block_size + off, buffer, size) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_hal_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer,
+                        lfs_size_t size) {
+    return flash_program(c->context, block * c->block_size + off, buffer, size) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_hal_erase(const struct lfs_config *c, lfs_block_t block) {
+    return flash_erase(c->context, block * c->block_size, c->block_size) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_hal_sync(const struct lfs_config *c) {
+    return LFS_ERR_OK;
+}
+
+// Sizes are the defaults of the joltwallet/littlefs Kconfig
+static bool lfs_bench_mount(flash_image_t *image, bool format) {
+    s_lfs_config = (struct lfs_config){
+        .context = image,
+        .read = lfs_hal_read,
+        .prog = lfs_hal_prog,
+        .erase = lfs_hal_erase,
+        .sync = lfs_hal_sync,
+        .read_size = 128,
+        .prog_size = 128,
+        .block_size = FS_SECTOR_SIZE,
+        .block_count = FS_PARTITION_SIZE / FS_SECTOR_SIZE,
+        .block_cycles = 512,
+        .cache_size = 512,
+        .lookahead_size = 128,
+    };
+    int err = lfs_mount(&s_lfs, &s_lfs_config);
+    if (err != LFS_ERR_OK && format) {
+        err = lfs_format(&s_lfs, &s_lfs_config);
+        if (err == LFS_ERR_OK) {
+            err = lfs_mount(&s_lfs, &s_lfs_config);
+        }
+    }
+    return err == LFS_ERR_OK;
+}
+
+static void lfs_bench_unmount(void) {
+    lfs_unmount(&s_lfs);
+}
+
+static bool lfs_bench_write(const char *path, fs_write_mode_t mode, uint32_t offset, const void *data, size_t size) {
+    int flags = LFS_O_WRONLY | LFS_O_CREAT | (mode == FS_APPEND ? LFS_O_APPEND : LFS_O_TRUNC);
+    if (mode == FS_PATCH) {
+        flags = LFS_O_RDWR | LFS_O_CREAT;
+    }
+    lfs_file_t file;
+    if (lfs_file_open(&s_lfs, &file, path, flags) < 0) {
+        return false;
+    }
+    bool ok = (mode != FS_PATCH || lfs_file_seek(&s_lfs, &file, (lfs_soff_t)offset, LFS_SEEK_SET) >= 0) &&
+              lfs_file_write(&s_lfs, &file, data, (lfs_size_t)size) == (lfs_ssize_t)size;
+    return lfs_file_close(&s_lfs, &file) == LFS_ERR_OK && ok;
+}
+
+static long lfs_bench_read(const char *path, void *buffer, size_t size) {
+    lfs_file_t file;
+    if (lfs_file_open(&s_lfs, &file, path, LFS_O_RDONLY) < 0) {
+        return -1;
+    }
+    lfs_ssize_t length = lfs_file_read(&s_lfs, &file, buffer, (lfs_size_t)size);
+    lfs_file_close(&s_lfs, &file);
+    return (long)length;
+}
+
+static bool lfs_bench_remove(const char *path) {
+    return lfs_remove(&s_lfs, path) == LFS_ERR_OK;
+}
+
+static size_t lfs_bench_used(void) {
+    lfs_ssize_t blocks = lfs_fs_size(&s_lfs);
+    return blocks > 0 ? (size_t)blocks * FS_SECTOR_SIZE : 0;
+}
+
+static const fs_backend_t s_lfs_backend = {
+    .name = "littlefs",
+    .mount = lfs_bench_mount,
+    .unmount = lfs_bench_unmount,
+    .write = lfs_bench_write,
+    .read = lfs_bench_read,
+    .remove = lfs_bench_remove,
+    .used = lfs_bench_used,
+    .gc = NULL,
+};
+
+// -------------------- Workload -------------------- //
+
+static void document_path(char *path, size_t size, int sensor, int day) {
+    snprintf(path, size, "/s%012x_2025%02d%02d.json", 0xC0FFEE00 + sensor, 1 + day / 28, 1 + day % 28);
+}
+
+// Day document of a sensor with its samples, each sample has the same size
+static size_t document(char *out, int sensor, int day, int samples) {
+    size_t length = (size_t)snprintf(out, FS_DOC_HEADER_BYTES + 1, "{\"fields\":{\"sensor\":\"%012x\",\"day\":%03d,\"samples\":[",
+                                     0xC0FFEE00 + sensor, day);
+    memset(out + length, ' ', FS_DOC_HEADER_BYTES - length);
+    length = FS_DOC_HEADER_BYTES;
+    for (int i = 0; i < samples; i++) {
+        char *sample = out + length;
+        int n = snprintf(sample, FS_SAMPLE_BYTES, "{\"t\":%d,\"temperature\":%d.%02d,\"humidity\":%d.%d,\"pressure\":%d",
+                         day * FS_CYCLES_PER_DAY + i, 18 + (i * 7 + sensor) % 9, (i * 37) % 100, 40 + i % 30, i % 10,
+                         99000 + i * 13 % 2000);
+        memset(sample + n, ' ', FS_SAMPLE_BYTES - 2 - n);
+        sample[FS_SAMPLE_BYTES - 2] = '}';
+        sample[FS_SAMPLE_BYTES - 1] = ',';
+        length += FS_SAMPLE_BYTES;
+    }
+    memcpy(out + length, "]}}", 3);
+    return length + 3;
+}
+
+static void add_time(int64_t *sum, int64_t *max, int *count, int64_t ns) {
+    *sum += ns;
+    *count += 1;
+    if (ns > *max) {
+        *max = ns;
+    }
+}
+
+// One sample per sensor: read the day document, write it back with the sample, sync like storage_save_measurement()
+static void store_samples(const fs_backend_t *fs, flash_image_t *image, fs_result_t *result, int sensors, int day,
+                          int (*samples)[FS_MAX_DAYS], char *expected, char *buffer) {
+    char path[40];
+    for (int s = 0; s < sensors; s++) {
+        fs_clock_t start = clock_start(image);
+        if (fs->gc != NULL && fs->used() > FS_PARTITION_SIZE * 9 / 10) {
+            fs->gc(4096);
+        }
+        document_path(path, sizeof(path), s, day);
+        size_t old_length = document(expected, s, day, samples[s][day]);
+        if (samples[s][day] > 0 && (fs->read(path, buffer, FS_DOC_MAX_BYTES) != (long)old_length ||
+                                    memcmp(buffer, expected, old_length) != 0)) {
+            result->errors++;
+        }
+        samples[s][day]++;
+        size_t length = document(expected, s, day, samples[s][day]);
+        if (!fs->write(path, FS_REPLACE, 0, expected, length) ||
+            !fs->write(FS_SYNC_PATH, FS_REPLACE, 0, "sync", 4) || !fs->remove(FS_SYNC_PATH)) {
+            result->errors++;
+        }
+        add_time(&result->append_ns, &result->append_max_ns, &result->appends, clock_elapsed_ns(&start, image));
+        result->written_bytes += length + 4;
+    }
+}
+
+// Records of a wake at the head of the ring, then the header, like storage_log_flush()
+static void flush_log(const fs_backend_t *fs, fs_result_t *result, uint32_t *head) {
+    uint8_t records[FS_LOG_RECORDS_PER_WAKE * FS_LOG_RECORD_BYTES];
+    uint8_t header[FS_LOG_HEADER_BYTES] = { 'L', 'O', 'G', '1' };
+    for (int i = 0; i < FS_LOG_RECORDS_PER_WAKE; i++) {
+        uint32_t slot = (*head)++ % FS_LOG_CAPACITY;
+        memset(records, (int)(*head & 0xFF), sizeof(records));
+        if (!fs->write(FS_LOG_PATH, FS_PATCH, FS_LOG_HEADER_BYTES + slot * FS_LOG_RECORD_BYTES, records,
+                       FS_LOG_RECORD_BYTES)) {
+            result->errors++;
+        }
+    }
+    memcpy(header + 8, head, sizeof(*head));
+    if (!fs->write(FS_LOG_PATH, FS_PATCH, 0, header, sizeof(header))) {
+        result->errors++;
+    }
+    result->written_bytes += FS_LOG_RECORDS_PER_WAKE * FS_LOG_RECORD_BYTES + sizeof(header);
+}
+
+// Every document is read, checked and removed, the read time is the upload read path
+static void upload(const fs_backend_t *fs, flash_image_t *image, fs_result_t *result, int sensors, int days,
+                   int (*samples)[FS_MAX_DAYS], char *expected, char *buffer) {
+    char path[40];
+    for (int s = 0; s < sensors; s++) {
+        for (int d = 0; d < days; d++) {
+            if (samples[s][d] == 0) {
+                continue;
+            }
+            document_path(path, sizeof(path), s, d);
+            size_t length = document(expected, s, d, samples[s][d]);
+            fs_clock_t start = clock_start(image);
+            long read = fs->read(path, buffer, FS_DOC_MAX_BYTES);
+            result->read_ns += clock_elapsed_ns(&start, image);
+            if (read != (long)length || memcmp(buffer, expected, length) != 0 || !fs->remove(path)) {
+                result->errors++;
+            }
+            result->read_bytes += length;
+            samples[s][d] = 0;
+        }
+    }
+}
+
+// Days of wake cycles on a fresh image
+static bool run_backend(const fs_backend_t *fs, fs_result_t *result, int sensors, int days) {
+    char image_path[32];
+    snprintf(image_path, sizeof(image_path), "fs_%s.img", fs->name);
+    flash_image_t image = { .fd = -1 };
+    char *expected = malloc(FS_DOC_MAX_BYTES + 1);
+    char *buffer = malloc(FS_DOC_MAX_BYTES + 1);
+    int (*samples)[FS_MAX_DAYS] = calloc(FS_MAX_SENSORS, sizeof(*samples));
+    bool ok = expected != NULL && buffer != NULL && samples != NULL && image_open(&image, image_path);
+
+    memset(result, 0, sizeof(*result));
+    fs_clock_t start = clock_start(&image);
+    ok = ok && fs->mount(&image, true);
+    result->format_ns = ok ? clock_elapsed_ns(&start, &image) : 0;
+    const uint8_t log_header[FS_LOG_HEADER_BYTES] = { 'L', 'O', 'G', '1' };
+    if (ok && !fs->write(FS_LOG_PATH, FS_REPLACE, 0, log_header, sizeof(log_header))) {
+        result->errors++;
+    }
+
+    uint32_t log_head = 0;
+    for (int cycle = 0; ok && cycle < days * FS_CYCLES_PER_DAY; cycle++) {
+        // Every wake is a boot that mounts the partition again
+        fs->unmount();
+        start = clock_start(&image);
+        ok = fs->mount(&image, false);
+        add_time(&result->mount_ns, &result->mount_max_ns, &result->mounts, clock_elapsed_ns(&start, &image));
+
+        store_samples(fs, &image, result, sensors, cycle / FS_CYCLES_PER_DAY, samples, expected, buffer);
+        flush_log(fs, result, &log_head);
+        size_t used = fs->used();
+        if (used > result->used_max) {
+            result->used_max = used;
+        }
+        if (cycle % SEND_DATA_CYCLE == SEND_DATA_CYCLE - 1) {
+            upload(fs, &image, result, sensors, days, samples, expected, buffer);
+        }
+    }
+    if (ok) {
+        fs->unmount();
+    }
+    result->programmed_bytes = image.program_bytes;
+    result->erases = image.erases;
+    image_close(&image);
+    free(expected);
+    free(buffer);
+    free(samples);
+    return ok && result->errors == 0;
+}
+
+static void report_result(cJSON *results, const char *name, const fs_result_t *r, int sensors, int days) {
+    double mount_ms = r->mounts ? r->mount_ns / 1e6 / r->mounts : 0.0;
+    double append_ms = r->appends ? r->append_ns / 1e6 / r->appends : 0.0;
+    double read_kbps = r->read_ns > 0 ? r->read_bytes / 1024.0 / (r->read_ns / 1e9) : 0.0;
+    double amplification = r->written_bytes ? (double)r->programmed_bytes / (double)r->written_bytes : 0.0;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "backend", name);
+    cJSON_AddNumberToObject(item, "sensors", sensors);
+    cJSON_AddNumberToObject(item, "days", days);
+    cJSON_AddNumberToObject(item, "format_ms", r->format_ns / 1e6);
+    cJSON_AddNumberToObject(item, "mount_ms", mount_ms);
+    cJSON_AddNumberToObject(item, "mount_max_ms", r->mount_max_ns / 1e6);
+    cJSON_AddNumberToObject(item, "append_ms", append_ms);
+    cJSON_AddNumberToObject(item, "append_max_ms", r->append_max_ns / 1e6);
+    cJSON_AddNumberToObject(item, "read_kbps", read_kbps);
+    cJSON_AddNumberToObject(item, "written_bytes", (double)r->written_bytes);
+    cJSON_AddNumberToObject(item, "programmed_bytes", (double)r->programmed_bytes);
+    cJSON_AddNumberToObject(item, "write_amplification", amplification);
+    cJSON_AddNumberToObject(item, "erases", (double)r->erases);
+    cJSON_AddNumberToObject(item, "used_max_bytes", (double)r->used_max);
+    cJSON_AddNumberToObject(item, "errors", r->errors);
+    cJSON_AddItemToArray(results, item);
+
+    printf("%-9s %9.1f %9.2f %9.2f %9.2f %9.2f %9.0f %7.2f %7llu %9zu\n", name, r->format_ns / 1e6, mount_ms,
+           r->mount_max_ns / 1e6, append_ms, r->append_max_ns / 1e6, read_kbps, amplification,
+           (unsigned long long)r->erases, r->used_max);
+}
+#endif // BENCH_FS_CORES
+
+esp_err_t benchmark_fs_run(cJSON *results) {
+#if BENCH_FS_CORES
+    int sensors = getenv("BENCH_FS_SENSORS") ? atoi(getenv("BENCH_FS_SENSORS")) : FS_DEFAULT_SENSORS;
+    int days = getenv("BENCH_FS_DAYS") ? atoi(getenv("BENCH_FS_DAYS")) : FS_DEFAULT_DAYS;
+    if (sensors < 1 || sensors > FS_MAX_SENSORS || days < 1 || days > FS_MAX_DAYS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    printf("\nStorage backends: %d sensors, %d days, upload every %d wakes, 1 MB image\n", sensors, days,
+           SEND_DATA_CYCLE);
+    printf("%-9s %9s %9s %9s %9s %9s %9s %7s %7s %9s\n", "backend", "format_ms", "mount_ms", "mount_max", "append_ms",
+           "append_max", "read_kB/s", "amplif", "erases", "used_max");
+    static const fs_backend_t *const backends[] = { &s_spiffs_backend, &s_lfs_backend };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        fs_result_t result;
+        bool backend_ok = run_backend(backends[i], &result, sensors, days);
+        report_result(results, backends[i]->name, &result, sensors, days);
+        if (!backend_ok) {
+            printf("Storage backend %s failed with %d errors\n", backends[i]->name, result.errors);
+            ok = false;
+        }
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+#else
+    (void)results;
+    printf("\nStorage backends: SPIFFS or LittleFS sources not found at build time, skipped\n");
+    return ESP_OK;
+#endif
+}
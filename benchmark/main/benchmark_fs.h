@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Storage backends on file-backed flash images
+ *
+ * Runs the SPIFFS and the LittleFS core with the configuration of the
+ * device on a 1 MB image file (fs_spiffs.img, fs_littlefs.img) with NOR
+ * flash semantics. The workload is the one of storage.c: every wake mounts
+ * the partition, rewrites the day document of each sensor with one more
+ * sample, creates and removes the sync file and writes the log ring; every
+ * SEND_DATA_CYCLE wakes the documents are read and removed. Reports the
+ * mount time, the time to append a sample, the read throughput of the
+ * upload and the write amplification (flash bytes programmed per byte
+ * written). Times are the host CPU time of the core plus the flash time of
+ * the counted reads, page programs and sector erases. The run fails if a
+ * read document differs from the written one.
+ *
+ * Environment: BENCH_FS_SENSORS (default 4), BENCH_FS_DAYS (default 3).
+ *
+ * @param results Array for one result object per backend
+ * @return esp_err_t ESP_OK if all checks passed or the file system sources were not found
+ */
+esp_err_t benchmark_fs_run(cJSON *results);
@@ -0,0 +1,80 @@
+// benchmark_heap.c
+// Heap accounting through the linker's --wrap option. The usable size of
+// every block is counted, so the numbers include the allocator rounding.
+// Blocks allocated inside libc (e.g. by strdup) are not counted when they
+// are created, which makes the current usage slightly low but keeps the
+// peak above the start usage correct for the measured code.
+#include "benchmark_heap.h"
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static int64_t s_current = 0;
+static int64_t s_peak = 0;
+static int64_t s_start = 0;
+static int64_t s_allocs = 0;
+
+// Add to the current usage and track the peak
+static void account(int64_t delta) {
+    int64_t current = __atomic_add_fetch(&s_current, delta, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&s_peak, __ATOMIC_RELAXED);
+    while (current > peak &&
+           !__atomic_compare_exchange_n(&s_peak, &peak, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if (ptr != NULL) {
+        account((int64_t)malloc_usable_size(ptr));
+        __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    if (ptr != NULL) {
+        account((int64_t)malloc_usable_size(ptr));
+        __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t old_size = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr != NULL) {
+        account((int64_t)malloc_usable_size(new_ptr) - (int64_t)old_size);
+        __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+    } else if (size == 0) {
+        account(-(int64_t)old_size);
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) {
+        account(-(int64_t)malloc_usable_size(ptr));
+    }
+    __real_free(ptr);
+}
+
+void benchmark_heap_reset_peak(void) {
+    s_start = __atomic_load_n(&s_current, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_peak, s_start, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_allocs, 0, __ATOMIC_RELAXED);
+}
+
+int64_t benchmark_heap_peak(void) {
+    return __atomic_load_n(&s_peak, __ATOMIC_RELAXED) - s_start;
+}
+
+int64_t benchmark_heap_allocs(void) {
+    return __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+}
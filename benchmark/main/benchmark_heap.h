@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Start a heap measurement, the peak is reset to the current usage
+ */
+void benchmark_heap_reset_peak(void);
+
+/**
+ * @brief Highest heap usage since benchmark_heap_reset_peak() above the usage at that time
+ *
+ * @return int64_t Peak in bytes
+ */
+int64_t benchmark_heap_peak(void);
+
+/**
+ * @brief Allocations since benchmark_heap_reset_peak()
+ *
+ * @return int64_t Number of malloc, calloc and realloc calls
+ */
+int64_t benchmark_heap_allocs(void);
@@ -0,0 +1,940 @@
+// benchmark_main.c
+// Benchmark of the measurement storage and upload path on the Linux target.
+//
+// For every combination of sensor count and stored sample count the store is
+// filled and these operations are measured:
+//   json_add    parse a stored document, add one measurement and print it (no file I/O)
+//   upload_read list the sensor files and prepare their commit requests
+//   save        storage_save_measurement() for one more sample of every sensor
+//   encode_cjson  build each document from scratch with json_helper and print it
+//   encode_schema the same documents with the compile-time schema encoder
+// json_add and save build the documents in the JSON arena like the firmware,
+// json_add_heap and save_heap run the same code with the arena disabled. The
+// schema encoder output is checked against cJSON for every configuration.
+//
+// upload_commit runs BENCH_UPLOAD_CYCLES uploads of one day through a mock
+// Firestore and checks that every sample ends up in the day documents exactly
+// once, also when a request is repeated. It reports the bytes sent per cycle,
+// upload_full the bytes a PATCH of the whole day document would send instead.
+//
+// partition stores samples at UTC times around local midnight and the
+// daylight saving time changes, checks the local day of every sample and
+// that one upload per sensor puts each sample in the document of its day.
+//
+// The upload pipeline test (benchmark_pipeline.c) uploads one send cycle of
+// 1 to 16 sensors with the serial loop and with the reader task pipeline of
+// firebase_api against the mock Firestore with a simulated round trip, its
+// results are in "pipeline".
+//
+// The send scheduler replay (benchmark_schedule.c) compares upload policies
+// over months of simulated wake cycles, its results are in "schedules".
+//
+// The modem fault replay (benchmark_faults.c) compares the restart on a
+// modem failure with the stage deadlines under injected outages, its
+// results are in "faults".
+//
+// The battery test (benchmark_battery.c) measures simulated batteries
+// through the fake ADC with noise and spikes and checks the discharge
+// table, its results are in "battery".
+//
+// The energy estimator test (benchmark_energy.c) runs the state of charge
+// estimator of the energy ledger on synthetic discharge traces, its results
+// are in "energy".
+//
+// The wake planner test (benchmark_wake.c) replays wake cycles on a drifting
+// RTC and compares the fixed interval with the slot planner, its results are
+// in "wake".
+//
+// The time table test (benchmark_time.cpp) measures the conversions of the
+// Finland time table and of the libc time zone, its results are in "time".
+//
+// The storage backend test (benchmark_fs.c) runs the sensor file workload
+// on SPIFFS and LittleFS flash images, its results are in "storage_backends".
+//
+// The pass/fail checks of the system state, the cycle resume points, the
+// time table and the delta updates are in host_tests/.
+//
+// BENCH_SUITES selects the suites by name (comma separated, default all):
+// storage (the operations above), upload, partition, pipeline, schedule,
+// faults, battery, energy, wake, time and fs.
+//
+// With BENCH_TRACE set to a directory of sensor files copied from a device,
+// trace_string and trace_typed give the payload size of the recorded
+// documents in the string and in the typed Firestore format.
+//
+// Each result has the CPU time of the benchmark thread, the heap allocation
+// count, the heap peak above the start of the operation, the bytes read and
+// written through the file system and the payload size (documents printed,
+// uploaded or stored). The results are written as JSON for
+// benchmark/compare_results.py.
+//
+// Environment: BENCH_SUITES, BENCH_SENSORS and BENCH_SAMPLES (comma separated
+// lists), BENCH_OUTPUT (result file), BENCH_LABEL (e.g. the git commit),
+// BENCH_TRACE, BENCH_UPLOAD_SENSORS, BENCH_UPLOAD_CYCLES and the
+// BENCH_PIPELINE_*, BENCH_SCHEDULE_*, BENCH_FAULT_*, BENCH_BATTERY_*, BENCH_ENERGY_*,
+// BENCH_WAKE_*, BENCH_TIME_* and BENCH_FS_* variables.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <math.h>
+#include "esp_log.h"
+#include "cJSON.h"
+#include "storage.h"
+#include "json_helper.h"
+#include "time_manager.h"
+#include "firebase_api.h"
+#include "battery_monitor.h"
+#include "json_arena.h"
+#include "benchmark_heap.h"
+#include "benchmark_encoder.h"
+#include "mock_firestore.h"
+#include "benchmark_clock.h"
+#include "benchmark_schedule.h"
+#include "benchmark_faults.h"
+#include "benchmark_battery.h"
+#include "benchmark_energy.h"
+#include "benchmark_wake.h"
+#include "benchmark_time.h"
+#include "benchmark_fs.h"
+#include "benchmark_pipeline.h"
+#include "config_manager.h"
+
+static const char *TAG = "benchmark";
+
+#define BENCH_DEFAULT_SENSORS   "1,16,256"
+#define BENCH_DEFAULT_SAMPLES   "1,10,100,1000"
+#define BENCH_DEFAULT_OUTPUT    "benchmark_results.json"
+#define BENCH_MAX_VALUES        16
+#define BENCH_UPLOAD_BUFFER     (512 * 1024)    // Large enough for 1000 samples, the device uses 18 KB
+#define BENCH_BATTERY_MV        4000
+#define BENCH_BATTERY_LEVEL     90
+#define BENCH_UPLOAD_SENSORS    4
+#define BENCH_UPLOAD_CYCLES     4               // Uploads per day, SEND_DATA_CYCLE samples in total
+
+// Counters at the start of an operation
+typedef struct {
+    int64_t cpu_ns;
+    int64_t read_bytes;
+    int64_t write_bytes;
+} bench_snapshot_t;
+
+// Result of one operation
+typedef struct {
+    const char *op;
+    int sensors;
+    int samples;
+    int calls;
+    int64_t cpu_us;
+    int64_t allocs;
+    int64_t heap_peak;
+    int64_t read_bytes;
+    int64_t write_bytes;
+    int64_t payload_bytes;
+} bench_result_t;
+
+static int64_t s_io_overhead_read = 0;  // Bytes read by the snapshot itself
+static char *s_upload_buffer = NULL;
+
+// CPU time of the calling thread
+static int64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Bytes read and written by the process, from /proc/self/io
+static void process_io(int64_t *read_bytes, int64_t *write_bytes) {
+    *read_bytes = 0;
+    *write_bytes = 0;
+    FILE *f = fopen("/proc/self/io", "r");
+    if (f == NULL) {
+        return;
+    }
+    char line[64];
+    long long value;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "rchar: %lld", &value) == 1) {
+            *read_bytes = value;
+        } else if (sscanf(line, "wchar: %lld", &value) == 1) {
+            *write_bytes = value;
+        }
+    }
+    fclose(f);
+}
+
+static void op_begin(bench_snapshot_t *snapshot) {
+    process_io(&snapshot->read_bytes, &snapshot->write_bytes);
+    benchmark_heap_reset_peak();
+    snapshot->cpu_ns = thread_cpu_ns();
+}
+
+static void op_end(const bench_snapshot_t *snapshot, bench_result_t *result) {
+    result->cpu_us = (thread_cpu_ns() - snapshot->cpu_ns) / 1000;
+    result->allocs = benchmark_heap_allocs();
+    result->heap_peak = benchmark_heap_peak();
+    int64_t read_bytes, write_bytes;
+    process_io(&read_bytes, &write_bytes);
+    result->read_bytes = read_bytes - snapshot->read_bytes - s_io_overhead_read;
+    result->write_bytes = write_bytes - snapshot->write_bytes;
+}
+
+// Parse a comma separated list of positive integers
+static int parse_list(const char *env_name, const char *default_value, int *values) {
+    const char *text = getenv(env_name);
+    if (text == NULL) {
+        text = default_value;
+    }
+    int count = 0;
+    while (*text != '\0' && count < BENCH_MAX_VALUES) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text) {
+            break;
+        }
+        if (value > 0) {
+            values[count++] = (int)value;
+        }
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+// Measurement of a benchmark sensor
+static void make_measurement(ruuvi_measurement_t *measurement, int sensor, int sample) {
+    snprintf(measurement->mac_address, sizeof(measurement->mac_address), "BE:4C:00:00:%02X:%02X",
+             (sensor >> 8) & 0xFF, sensor & 0xFF);
+    measurement->temperature = 20.0f + (float)(sample % 100) * 0.01f;
+    measurement->humidity = 45.0f + (float)(sensor % 50) * 0.1f;
+    measurement->timestamp_ms = (int64_t)time(NULL) * 1000;
+}
+
+// Read a whole file into a new buffer
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (text != NULL) {
+        text[fread(text, 1, size, f)] = '\0';
+    }
+    fclose(f);
+    return text;
+}
+
+// Total size of the sensor files
+static int64_t stored_bytes(void) {
+    char **files = NULL;
+    int count = 0;
+    int64_t total = 0;
+    if (storage_get_sensor_files(&files, &count) != ESP_OK) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(files[i], &st) == 0) {
+            total += st.st_size;
+        }
+    }
+    storage_free_sensor_files(files, count);
+    return total;
+}
+
+// Delete all sensor files
+static void clear_store(void) {
+    char **files = NULL;
+    int count = 0;
+    if (storage_get_sensor_files(&files, &count) != ESP_OK) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        unlink(files[i]);
+    }
+    storage_free_sensor_files(files, count);
+}
+
+// Fill the store with samples measurements for each sensor
+static esp_err_t fill_store(int sensors, int samples) {
+    clear_store();
+
+    // The first sample creates the file through the storage component
+    ruuvi_measurement_t measurement;
+    for (int s = 0; s < sensors; s++) {
+        make_measurement(&measurement, s, 0);
+        esp_err_t ret = storage_save_measurement(&measurement);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    if (samples == 1) {
+        return ESP_OK;
+    }
+
+    // The rest are added in memory, one save per sample would take O(n^2)
+    char **files = NULL;
+    int count = 0;
+    esp_err_t ret = storage_get_sensor_files(&files, &count);
+    for (int i = 0; ret == ESP_OK && i < count; i++) {
+        char *text = read_file(files[i]);
+        cJSON *doc = text ? cJSON_Parse(text) : NULL;
+        free(text);
+        if (doc == NULL) {
+            ret = ESP_FAIL;
+            break;
+        }
+        for (int n = 1; n < samples; n++) {
+            make_measurement(&measurement, i, n);
+            json_helper_add_measurement_to_firestore(doc, &measurement);
+        }
+        text = cJSON_PrintUnformatted(doc);
+        cJSON_Delete(doc);
+
+        FILE *f = fopen(files[i], "w");
+        if (text == NULL || f == NULL) {
+            ret = ESP_FAIL;
+        } else {
+            fputs(text, f);
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+        free(text);
+    }
+    storage_free_sensor_files(files, count);
+    return ret;
+}
+
+// Parse, add one measurement and print each stored document, one arena scope per document
+static void bench_json_add(bench_result_t *result, bool arena) {
+    char **files = NULL;
+    int count = 0;
+    storage_get_sensor_files(&files, &count);
+
+    // Documents are loaded before the measurement, only the JSON work is measured
+    char **texts = calloc(count, sizeof(char *));
+    char (*macs)[18] = calloc(count, sizeof(*macs));
+    char (*days)[11] = calloc(count, sizeof(*days));
+    for (int i = 0; texts != NULL && macs != NULL && days != NULL && i < count; i++) {
+        texts[i] = read_file(files[i]);
+        storage_get_sensor_mac(files[i], macs[i], sizeof(macs[i]));
+        storage_get_sensor_day(files[i], days[i], sizeof(days[i]));
+    }
+
+    json_arena_set_enabled(arena);
+    bench_snapshot_t snapshot;
+    op_begin(&snapshot);
+    for (int i = 0; texts != NULL && macs != NULL && days != NULL && i < count; i++) {
+        ruuvi_measurement_t measurement;
+        make_measurement(&measurement, i, result->samples);
+
+        json_arena_begin();
+        cJSON *doc = texts[i] ? cJSON_Parse(texts[i]) : NULL;
+        doc = json_helper_create_or_update_firestore_document(doc, macs[i], days[i], BENCH_BATTERY_MV, BENCH_BATTERY_LEVEL);
+        json_helper_add_measurement_to_firestore(doc, &measurement);
+        char *out = cJSON_PrintUnformatted(doc);
+        cJSON_Delete(doc);
+        if (out != NULL) {
+            result->payload_bytes += strlen(out);
+            cJSON_free(out);
+        }
+        json_arena_end();
+        result->calls++;
+    }
+    op_end(&snapshot, result);
+    json_arena_set_enabled(true);
+
+    for (int i = 0; texts != NULL && i < count; i++) {
+        free(texts[i]);
+    }
+    free(texts);
+    free(macs);
+    free(days);
+    storage_free_sensor_files(files, count);
+}
+
+// Prepare every sensor file for upload like the upload reader task does
+static void bench_upload_read(bench_result_t *result) {
+    bench_snapshot_t snapshot;
+    op_begin(&snapshot);
+
+    char **files = NULL;
+    int count = 0;
+    storage_get_sensor_files(&files, &count);
+    for (int i = 0; i < count;) {
+        size_t length;
+        int used = 1;
+        if (firebase_prepare_commit(&files[i], count - i, s_upload_buffer, BENCH_UPLOAD_BUFFER,
+                                    &length, &used) == ESP_OK) {
+            result->payload_bytes += length;
+        }
+        result->calls++;
+        i += used;
+    }
+    storage_free_sensor_files(files, count);
+
+    op_end(&snapshot, result);
+}
+
+// Store one more measurement for every sensor
+static void bench_save(bench_result_t *result, bool arena) {
+    json_arena_set_enabled(arena);
+    bench_snapshot_t snapshot;
+    op_begin(&snapshot);
+    for (int s = 0; s < result->sensors; s++) {
+        ruuvi_measurement_t measurement;
+        make_measurement(&measurement, s, result->samples);
+        if (storage_save_measurement(&measurement) == ESP_OK) {
+            result->calls++;
+        }
+    }
+    op_end(&snapshot, result);
+    json_arena_set_enabled(true);
+    result->payload_bytes = stored_bytes();
+}
+
+// Measurements of every sensor, sensors * samples entries
+static ruuvi_measurement_t *make_measurements(int sensors, int samples) {
+    ruuvi_measurement_t *measurements = calloc((size_t)sensors * samples, sizeof(ruuvi_measurement_t));
+    for (int s = 0; measurements != NULL && s < sensors; s++) {
+        for (int n = 0; n < samples; n++) {
+            make_measurement(&measurements[(size_t)s * samples + n], s, n);
+        }
+    }
+    return measurements;
+}
+
+// Print a new document of one sensor with json_helper, the caller frees it with cJSON_free()
+static char *print_cjson_document(const ruuvi_measurement_t *measurements, int samples) {
+    cJSON *doc = json_helper_create_or_update_firestore_document(NULL, measurements[0].mac_address, NULL,
+                                                                 BENCH_BATTERY_MV, BENCH_BATTERY_LEVEL);
+    for (int n = 0; n < samples; n++) {
+        json_helper_add_measurement_to_firestore(doc, (ruuvi_measurement_t *)&measurements[n]);
+    }
+    char *out = cJSON_PrintUnformatted(doc);
+    cJSON_Delete(doc);
+    return out;
+}
+
+// Build every document from scratch in memory with cJSON or the schema encoder
+static void bench_encode(bench_result_t *result, bool schema) {
+    ruuvi_measurement_t *measurements = make_measurements(result->sensors, result->samples);
+    if (measurements == NULL) {
+        return;
+    }
+
+    bench_snapshot_t snapshot;
+    op_begin(&snapshot);
+    for (int s = 0; s < result->sensors; s++) {
+        const ruuvi_measurement_t *sensor = &measurements[(size_t)s * result->samples];
+        if (schema) {
+            result->payload_bytes += benchmark_encoder_document(s_upload_buffer, BENCH_UPLOAD_BUFFER, sensor,
+                                                                result->samples, BENCH_BATTERY_MV,
+                                                                BENCH_BATTERY_LEVEL);
+        } else {
+            json_arena_begin();
+            char *out = print_cjson_document(sensor, result->samples);
+            if (out != NULL) {
+                result->payload_bytes += strlen(out);
+                cJSON_free(out);
+            }
+            json_arena_end();
+        }
+        result->calls++;
+    }
+    op_end(&snapshot, result);
+    free(measurements);
+}
+
+// Check that the schema encoder output is identical to cJSON
+static esp_err_t verify_encoder(int samples) {
+    ruuvi_measurement_t *measurements = make_measurements(1, samples);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    char *expected = (measurements != NULL) ? print_cjson_document(measurements, samples) : NULL;
+    if (expected != NULL) {
+        ret = benchmark_encoder_verify(expected, measurements, samples, BENCH_BATTERY_MV, BENCH_BATTERY_LEVEL);
+        cJSON_free(expected);
+    }
+    free(measurements);
+    return ret;
+}
+
+// Add a result to the JSON array and print it
+static void report(cJSON *results, const bench_result_t *r) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "op", r->op);
+    cJSON_AddNumberToObject(item, "sensors", r->sensors);
+    cJSON_AddNumberToObject(item, "samples", r->samples);
+    cJSON_AddNumberToObject(item, "calls", r->calls);
+    cJSON_AddNumberToObject(item, "cpu_us", (double)r->cpu_us);
+    cJSON_AddNumberToObject(item, "allocs", (double)r->allocs);
+    cJSON_AddNumberToObject(item, "heap_peak_bytes", (double)r->heap_peak);
+    cJSON_AddNumberToObject(item, "read_bytes", (double)r->read_bytes);
+    cJSON_AddNumberToObject(item, "write_bytes", (double)r->write_bytes);
+    cJSON_AddNumberToObject(item, "payload_bytes", (double)r->payload_bytes);
+    cJSON_AddItemToArray(results, item);
+
+    printf("%-14s %8d %8d %12lld %10lld %12lld %12lld %12lld %12lld\n", r->op, r->sensors, r->samples,
+           (long long)r->cpu_us, (long long)r->allocs, (long long)r->heap_peak, (long long)r->read_bytes,
+           (long long)r->write_bytes, (long long)r->payload_bytes);
+}
+
+// Payload size of recorded sensor documents in the string and in the typed format
+static esp_err_t bench_trace(cJSON *results, const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        printf("Failed to open trace directory %s\n", path);
+        return ESP_FAIL;
+    }
+    // Recorded local times are read in the device time zone
+    time_manager_set_finland_timezone();
+
+    bench_result_t string_result = { .op = "trace_string" };
+    bench_result_t typed_result = { .op = "trace_typed" };
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *ext = strrchr(entry->d_name, '.');
+        if (ext == NULL || strcmp(ext, ".json") != 0) {
+            continue;
+        }
+        char file[512];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        char *text = read_file(file);
+        int samples = 0;
+        size_t string_bytes = 0;
+        size_t typed_bytes = 0;
+        if (text == NULL || benchmark_encoder_trace(text, &samples, &string_bytes, &typed_bytes) != ESP_OK) {
+            printf("Skipping trace file %s\n", file);
+            free(text);
+            continue;
+        }
+        free(text);
+        string_result.sensors++;
+        string_result.samples += samples;
+        string_result.payload_bytes += string_bytes;
+        string_result.calls++;
+        typed_result.sensors++;
+        typed_result.samples += samples;
+        typed_result.payload_bytes += typed_bytes;
+        typed_result.calls++;
+    }
+    closedir(dir);
+    if (string_result.payload_bytes == 0) {
+        printf("No sensor documents in %s\n", path);
+        return ESP_FAIL;
+    }
+
+    report(results, &string_result);
+    report(results, &typed_result);
+    printf("Typed values: %lld -> %lld bytes (%+.1f %%)\n", (long long)string_result.payload_bytes,
+           (long long)typed_result.payload_bytes,
+           (typed_result.payload_bytes - string_result.payload_bytes) * 100.0 / string_result.payload_bytes);
+    return ESP_OK;
+}
+
+// Measurement number index of a sensor, the temperature makes every sample of the day unique
+static void make_upload_measurement(ruuvi_measurement_t *measurement, int sensor, int index) {
+    make_measurement(measurement, sensor, 0);
+    measurement->temperature = -40.0f + (float)(index % 12000) * 0.01f;
+}
+
+// Upload every sensor file to the mock like send_all_sensor_measurements_to_firebase()
+static esp_err_t upload_to_mock(bench_result_t *result, char **replay) {
+    char **files = NULL;
+    int count = 0;
+    esp_err_t ret = storage_get_sensor_files(&files, &count);
+    for (int i = 0; ret == ESP_OK && i < count;) {
+        size_t length = 0;
+        int used = 1;
+        ret = firebase_prepare_commit(&files[i], count - i, s_upload_buffer, BENCH_UPLOAD_BUFFER, &length, &used);
+        if (ret == ESP_OK) {
+            ret = mock_firestore_commit(s_upload_buffer, length);
+        }
+        if (ret == ESP_OK && replay != NULL && *replay == NULL) {
+            *replay = strndup(s_upload_buffer, length);
+        }
+        result->payload_bytes += length;
+        result->calls++;
+        for (int n = i; n < i + used; n++) {
+            unlink(files[n]);
+        }
+        i += used;
+    }
+    storage_free_sensor_files(files, count);
+    return ret;
+}
+
+// Check that every document holds all samples of the day once and in order
+static esp_err_t check_mock_documents(int sensors, int samples) {
+    if (mock_firestore_count() != sensors) {
+        printf("Mock Firestore has %d documents, expected %d\n", mock_firestore_count(), sensors);
+        return ESP_FAIL;
+    }
+    for (int d = 0; d < sensors; d++) {
+        const cJSON *values = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(
+            mock_firestore_fields(d), "measurements"), "arrayValue"), "values");
+        if (cJSON_GetArraySize(values) != samples) {
+            printf("Document %d has %d samples, expected %d\n", d, cJSON_GetArraySize(values), samples);
+            return ESP_FAIL;
+        }
+        int index = 0;
+        const cJSON *sample;
+        cJSON_ArrayForEach(sample, values) {
+            const cJSON *t = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(sample, "mapValue"),
+                                                                     "fields"), "t");
+            const cJSON *number = cJSON_GetObjectItem(t, "doubleValue");
+            const cJSON *text = cJSON_GetObjectItem(t, "stringValue");
+            double value = cJSON_IsNumber(number) ? number->valuedouble
+                         : cJSON_IsString(text) ? strtod(text->valuestring, NULL) : NAN;
+            ruuvi_measurement_t expected;
+            make_upload_measurement(&expected, 0, index++);
+            if (!(fabs(value - expected.temperature) < 0.006)) {
+                printf("Document %d sample %d is %.2f, expected %.2f\n", d, index - 1, value, expected.temperature);
+                return ESP_FAIL;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// One day of uploads through the mock Firestore, reports the bytes of every cycle
+static esp_err_t bench_upload(cJSON *results) {
+    int sensors = getenv("BENCH_UPLOAD_SENSORS") ? atoi(getenv("BENCH_UPLOAD_SENSORS")) : BENCH_UPLOAD_SENSORS;
+    int cycles = getenv("BENCH_UPLOAD_CYCLES") ? atoi(getenv("BENCH_UPLOAD_CYCLES")) : BENCH_UPLOAD_CYCLES;
+    if (sensors <= 0 || cycles <= 0 || cycles > SEND_DATA_CYCLE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int per_cycle = SEND_DATA_CYCLE / cycles;
+
+    clear_store();
+    mock_firestore_reset();
+    char *replay = NULL;
+    esp_err_t ret = ESP_OK;
+    for (int cycle = 0; ret == ESP_OK && cycle < cycles; cycle++) {
+        for (int n = 0; ret == ESP_OK && n < per_cycle; n++) {
+            for (int s = 0; ret == ESP_OK && s < sensors; s++) {
+                ruuvi_measurement_t measurement;
+                make_upload_measurement(&measurement, s, cycle * per_cycle + n);
+                ret = storage_save_measurement(&measurement);
+            }
+        }
+
+        bench_result_t commit = { .op = "upload_commit", .sensors = sensors, .samples = (cycle + 1) * per_cycle };
+        if (ret == ESP_OK) {
+            ret = upload_to_mock(&commit, &replay);
+        }
+        bench_result_t full = { .op = "upload_full", .sensors = sensors, .samples = commit.samples };
+        for (int d = 0; d < mock_firestore_count(); d++) {
+            full.payload_bytes += mock_firestore_document_size(d);
+            full.calls++;
+        }
+        report(results, &commit);
+        report(results, &full);
+    }
+
+    // A repeated request, e.g. after a lost response, must not add samples
+    if (ret == ESP_OK && replay != NULL) {
+        ret = mock_firestore_commit(replay, strlen(replay));
+    }
+    if (ret == ESP_OK) {
+        ret = check_mock_documents(sensors, cycles * per_cycle);
+    }
+    if (ret != ESP_OK) {
+        printf("Upload through the mock Firestore failed: %s\n", esp_err_to_name(ret));
+    }
+    free(replay);
+    mock_firestore_reset();
+    clear_store();
+    return ret;
+}
+
+// UTC times around local midnight and the daylight saving time changes with their local day
+static const struct {
+    time_t time;
+    const char *day;
+} PARTITION_CASES[] = {
+    { 1736891999, "2025-01-14" },   // 2025-01-14T21:59:59Z, 23:59:59 EET
+    { 1736892000, "2025-01-15" },   // 2025-01-14T22:00:00Z, midnight EET
+    { 1743285599, "2025-03-29" },   // 2025-03-29T21:59:59Z, last second before the spring day
+    { 1743285600, "2025-03-30" },   // 2025-03-29T22:00:00Z, midnight EET of the 23 hour day
+    { 1743296400, "2025-03-30" },   // 2025-03-30T01:00:00Z, 04:00 EEST right after the change
+    { 1743368399, "2025-03-30" },   // 2025-03-30T20:59:59Z, 23:59:59 EEST
+    { 1743368400, "2025-03-31" },   // 2025-03-30T21:00:00Z, midnight EEST
+    { 1761425999, "2025-10-25" },   // 2025-10-25T20:59:59Z, 23:59:59 EEST
+    { 1761426000, "2025-10-26" },   // 2025-10-25T21:00:00Z, midnight EEST of the 25 hour day
+    { 1761438600, "2025-10-26" },   // 2025-10-26T00:30:00Z, 03:30 EEST before the change
+    { 1761442200, "2025-10-26" },   // 2025-10-26T01:30:00Z, the repeated 03:30 in EET
+    { 1761515999, "2025-10-26" },   // 2025-10-26T21:59:59Z, 23:59:59 EET
+    { 1761516000, "2025-10-27" },   // 2025-10-26T22:00:00Z, midnight EET
+};
+#define PARTITION_CASE_COUNT    (sizeof(PARTITION_CASES) / sizeof(PARTITION_CASES[0]))
+#define PARTITION_DAYS          8   // Distinct days in PARTITION_CASES
+
+// Check that a document holds the samples of its own day
+static esp_err_t check_partition_document(int index) {
+    const char *name = mock_firestore_name(index);
+    const cJSON *fields = mock_firestore_fields(index);
+    const cJSON *day = cJSON_GetObjectItem(cJSON_GetObjectItem(fields, "day"), "stringValue");
+    const cJSON *tag = cJSON_GetObjectItem(cJSON_GetObjectItem(fields, "tag_id"), "stringValue");
+    const char *id = name ? strrchr(name, '/') : NULL;
+    if (id == NULL || !cJSON_IsString(day) || !cJSON_IsString(tag)) {
+        printf("Document %d is incomplete\n", index);
+        return ESP_FAIL;
+    }
+
+    // Document ID is "<day>_<MAC>" and must match the fields
+    char expected_id[64];
+    json_helper_generate_document_id(day->valuestring, tag->valuestring, expected_id, sizeof(expected_id));
+    if (strcmp(id + 1, expected_id) != 0) {
+        printf("Document %s has day %s and tag %s\n", id + 1, day->valuestring, tag->valuestring);
+        return ESP_FAIL;
+    }
+
+    int expected = 0;
+    for (size_t c = 0; c < PARTITION_CASE_COUNT; c++) {
+        expected += (strcmp(PARTITION_CASES[c].day, day->valuestring) == 0);
+    }
+    const cJSON *values = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(
+        fields, "measurements"), "arrayValue"), "values");
+    if (cJSON_GetArraySize(values) != expected) {
+        printf("Document %s has %d samples, expected %d\n", id + 1, cJSON_GetArraySize(values), expected);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Samples around midnight and the daylight saving time changes go to the documents of their local day
+static esp_err_t bench_partition(cJSON *results) {
+    const int sensors = 2;
+    esp_err_t ret = ESP_OK;
+
+    for (size_t c = 0; c < PARTITION_CASE_COUNT; c++) {
+        char day[11];
+        if (time_manager_get_local_day(PARTITION_CASES[c].time, day, sizeof(day)) != ESP_OK ||
+            strcmp(day, PARTITION_CASES[c].day) != 0) {
+            printf("Local day of %lld is %s, expected %s\n", (long long)PARTITION_CASES[c].time, day,
+                   PARTITION_CASES[c].day);
+            ret = ESP_FAIL;
+        }
+    }
+
+    clear_store();
+    mock_firestore_reset();
+    for (size_t c = 0; ret == ESP_OK && c < PARTITION_CASE_COUNT; c++) {
+        benchmark_clock_set(PARTITION_CASES[c].time);
+        for (int s = 0; ret == ESP_OK && s < sensors; s++) {
+            ruuvi_measurement_t measurement;
+            make_upload_measurement(&measurement, s, (int)c);
+            ret = storage_save_measurement(&measurement);
+        }
+    }
+    benchmark_clock_set(0);
+
+    bench_result_t partition = { .op = "partition", .sensors = sensors, .samples = PARTITION_CASE_COUNT };
+    if (ret == ESP_OK) {
+        ret = upload_to_mock(&partition, NULL);
+    }
+    report(results, &partition);
+
+    // The days of a sensor are sent together, UPLOAD_MAX_BATCH_FILES per request
+    int commits = sensors * ((PARTITION_DAYS + UPLOAD_MAX_BATCH_FILES - 1) / UPLOAD_MAX_BATCH_FILES);
+    if (ret == ESP_OK && (mock_firestore_count() != sensors * PARTITION_DAYS || mock_firestore_commits() != commits)) {
+        printf("Mock Firestore has %d documents from %d commits, expected %d from %d\n", mock_firestore_count(),
+               mock_firestore_commits(), sensors * PARTITION_DAYS, commits);
+        ret = ESP_FAIL;
+    }
+    for (int d = 0; ret == ESP_OK && d < mock_firestore_count(); d++) {
+        ret = check_partition_document(d);
+    }
+    if (ret != ESP_OK) {
+        printf("Partitioning by local day failed: %s\n", esp_err_to_name(ret));
+    }
+    mock_firestore_reset();
+    clear_store();
+    return ret;
+}
+
+// Write the results file
+static esp_err_t write_results(cJSON *root) {
+    const char *path = getenv("BENCH_OUTPUT");
+    if (path == NULL) {
+        path = BENCH_DEFAULT_OUTPUT;
+    }
+    char *text = cJSON_Print(root);
+    FILE *f = fopen(path, "w");
+    if (text == NULL || f == NULL) {
+        free(text);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return ESP_FAIL;
+    }
+    fputs(text, f);
+    fclose(f);
+    free(text);
+    printf("Results written to %s\n", path);
+    return ESP_OK;
+}
+
+// The sample matrix: every operation for every sensor and sample count
+static esp_err_t bench_storage(cJSON *results) {
+    int sensors[BENCH_MAX_VALUES];
+    int samples[BENCH_MAX_VALUES];
+    int sensor_count = parse_list("BENCH_SENSORS", BENCH_DEFAULT_SENSORS, sensors);
+    int sample_count = parse_list("BENCH_SAMPLES", BENCH_DEFAULT_SAMPLES, samples);
+
+    printf("%-14s %8s %8s %12s %10s %12s %12s %12s %12s\n", "op", "sensors", "samples", "cpu_us",
+           "allocs", "heap_peak", "read", "written", "payload");
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < sensor_count; i++) {
+        for (int j = 0; j < sample_count; j++) {
+            if (fill_store(sensors[i], samples[j]) != ESP_OK) {
+                printf("Failed to fill store with %d sensors, %d samples\n", sensors[i], samples[j]);
+                continue;
+            }
+
+            bench_result_t json_add = { .op = "json_add", .sensors = sensors[i], .samples = samples[j] };
+            bench_json_add(&json_add, true);
+            report(results, &json_add);
+
+            bench_result_t json_add_heap = { .op = "json_add_heap", .sensors = sensors[i], .samples = samples[j] };
+            bench_json_add(&json_add_heap, false);
+            report(results, &json_add_heap);
+
+            bench_result_t upload_read = { .op = "upload_read", .sensors = sensors[i], .samples = samples[j] };
+            bench_upload_read(&upload_read);
+            report(results, &upload_read);
+
+            // Both save runs add a sample, the heap run is measured at samples + 1
+            bench_result_t save = { .op = "save", .sensors = sensors[i], .samples = samples[j] };
+            bench_save(&save, true);
+            report(results, &save);
+
+            bench_result_t save_heap = { .op = "save_heap", .sensors = sensors[i], .samples = samples[j] + 1 };
+            bench_save(&save_heap, false);
+            report(results, &save_heap);
+
+            bench_result_t encode_cjson = { .op = "encode_cjson", .sensors = sensors[i], .samples = samples[j] };
+            bench_encode(&encode_cjson, false);
+            report(results, &encode_cjson);
+
+            bench_result_t encode_schema = { .op = "encode_schema", .sensors = sensors[i], .samples = samples[j] };
+            bench_encode(&encode_schema, true);
+            report(results, &encode_schema);
+
+            if (verify_encoder(samples[j]) != ESP_OK) {
+                printf("Schema encoder output differs from cJSON with %d samples\n", samples[j]);
+                ret = ESP_FAIL;
+            }
+        }
+    }
+    clear_store();
+    return ret;
+}
+
+// A suite and the member of the results file it fills
+typedef struct {
+    const char *name;
+    const char *key;
+    bool array;                     // The suite fills an array, otherwise an object
+    esp_err_t (*run)(cJSON *result);
+} bench_suite_t;
+
+static const bench_suite_t s_suites[] = {
+    { "storage",   "results",          true,  bench_storage },
+    { "upload",    "results",          true,  bench_upload },
+    { "partition", "results",          true,  bench_partition },
+    { "pipeline",  "pipeline",         true,  benchmark_pipeline_run },
+    { "schedule",  "schedules",        true,  benchmark_schedule_run },
+    { "faults",    "faults",           true,  benchmark_faults_run },
+    { "battery",   "battery",          false, benchmark_battery_run },
+    { "energy",    "energy",           true,  benchmark_energy_run },
+    { "wake",      "wake",             true,  benchmark_wake_run },
+    { "time",      "time",             false, benchmark_time_run },
+    { "fs",        "storage_backends", true,  benchmark_fs_run },
+};
+
+// Check whether a suite is in the comma separated BENCH_SUITES list, all run without it
+static bool suite_selected(const char *name) {
+    const char *list = getenv("BENCH_SUITES");
+    if (list == NULL || *list == '\0') {
+        return true;
+    }
+    size_t length = strlen(name);
+    for (const char *item = list; item != NULL; item = strchr(item, ',')) {
+        item += (*item == ',') ? 1 : 0;
+        if (strncmp(item, name, length) == 0 && (item[length] == ',' || item[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Member of the results file, shared by the suites with the same key
+static cJSON *suite_result(cJSON *root, const bench_suite_t *suite) {
+    cJSON *result = cJSON_GetObjectItem(root, suite->key);
+    if (result != NULL) {
+        return result;
+    }
+    return suite->array ? cJSON_AddArrayToObject(root, suite->key) : cJSON_AddObjectToObject(root, suite->key);
+}
+
+void app_main(void)
+{
+    ESP_ERROR_CHECK(json_arena_init());
+    ESP_ERROR_CHECK(battery_monitor_init());
+    ESP_ERROR_CHECK(storage_init());
+    s_upload_buffer = malloc(BENCH_UPLOAD_BUFFER);
+    if (s_upload_buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate upload buffer");
+        exit(1);
+    }
+
+    // Logging would be counted as written bytes
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    // Bytes read by the snapshot of /proc/self/io
+    bench_snapshot_t snapshot;
+    bench_result_t calibration = {0};
+    op_begin(&snapshot);
+    op_end(&snapshot, &calibration);
+    s_io_overhead_read = calibration.read_bytes;
+
+    cJSON *root = cJSON_CreateObject();
+    const char *label = getenv("BENCH_LABEL");
+    cJSON_AddStringToObject(root, "label", label ? label : "");
+    cJSON_AddNumberToObject(root, "timestamp", (double)time(NULL));
+    cJSON *results = cJSON_AddArrayToObject(root, "results");
+
+    bool checks_ok = true;
+    for (size_t i = 0; i < sizeof(s_suites) / sizeof(s_suites[0]); i++) {
+        const bench_suite_t *suite = &s_suites[i];
+        if (!suite_selected(suite->name)) {
+            continue;
+        }
+        if (suite->run(suite_result(root, suite)) != ESP_OK) {
+            printf("Suite %s failed\n", suite->name);
+            checks_ok = false;
+        }
+    }
+
+    const char *trace = getenv("BENCH_TRACE");
+    if (trace != NULL && bench_trace(results, trace) != ESP_OK) {
+        checks_ok = false;
+    }
+
+    esp_err_t ret = write_results(root);
+    if (!checks_ok) {
+        ret = ESP_FAIL;
+    }
+    cJSON_Delete(root);
+    free(s_upload_buffer);
+    exit(ret == ESP_OK ? 0 : 1);
+}
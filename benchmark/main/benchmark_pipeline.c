@@ -0,0 +1,230 @@
+// benchmark_pipeline.c
+// Wall clock time of the upload of a send cycle. firebase_api runs unchanged,
+// its requests end in the https_client_request() wrapper below
+// (-Wl,--wrap=https_client_request), which waits for the simulated round
+// trip and applies the commit to the mock Firestore.
+#include "benchmark_pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "https_client.h"
+#include "firebase_api.h"
+#include "storage.h"
+#include "mock_firestore.h"
+#include "benchmark_clock.h"
+#include "config_manager.h"
+
+#define PIPELINE_DEFAULT_SENSORS    "1,2,4,8,16"
+#define PIPELINE_DEFAULT_LATENCY_MS 300
+#define PIPELINE_MAX_COUNTS         16
+#define PIPELINE_SAMPLES            (SEND_DATA_CYCLE / 4)   // Samples of a sensor in one upload
+#define PIPELINE_BUFFER             (32 * 1024)             // Request buffer of the serial loop
+
+static uint32_t s_latency_ms = 0;
+
+// Firestore requests of firebase_api: simulated round trip, then the mock applies the commit
+esp_err_t __wrap_https_client_request(https_client_handle_t handle, const https_client_request_t *request,
+                                      https_client_response_t *response) {
+    int64_t start = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(s_latency_ms));
+    esp_err_t ret = mock_firestore_commit(request->body, request->body_len);
+    if (response != NULL) {
+        response->status_code = (ret == ESP_OK) ? 200 : 400;
+        response->response_len = 0;
+        response->duration_us = esp_timer_get_time() - start;
+    }
+    return ESP_OK;
+}
+
+// Result of one sensor count
+typedef struct {
+    int sensors;
+    int requests;
+    int64_t serial_us;
+    int64_t pipeline_us;
+    int64_t prepare_us;     // Reading and encoding in the serial run
+} pipeline_result_t;
+
+static int parse_counts(int *counts) {
+    const char *text = getenv("BENCH_PIPELINE_SENSORS");
+    if (text == NULL) {
+        text = PIPELINE_DEFAULT_SENSORS;
+    }
+    int count = 0;
+    while (*text != '\0' && count < PIPELINE_MAX_COUNTS) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text) {
+            break;
+        }
+        if (value > 0) {
+            counts[count++] = (int)value;
+        }
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static void clear_files(void) {
+    char **files = NULL;
+    int count = 0;
+    if (storage_get_sensor_files(&files, &count) != ESP_OK) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        unlink(files[i]);
+    }
+    storage_free_sensor_files(files, count);
+}
+
+// One send cycle of samples for every sensor, stored like the firmware does
+static esp_err_t store_cycle(int sensors) {
+    clear_files();
+    ruuvi_measurement_t measurement;
+    for (int n = 0; n < PIPELINE_SAMPLES; n++) {
+        for (int s = 0; s < sensors; s++) {
+            snprintf(measurement.mac_address, sizeof(measurement.mac_address), "BE:4C:00:01:%02X:%02X",
+                     (s >> 8) & 0xFF, s & 0xFF);
+            measurement.temperature = 18.0f + (float)n * 0.01f;
+            measurement.humidity = 40.0f + (float)(s % 50) * 0.1f;
+            measurement.timestamp_ms = (int64_t)time(NULL) * 1000 + n;
+            esp_err_t ret = storage_save_measurement(&measurement);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+// The upload loop before the pipeline: read and encode a sensor, send it, then the next one
+static esp_err_t upload_serial(char *buffer, pipeline_result_t *result) {
+    char **files = NULL;
+    int count = 0;
+    esp_err_t ret = storage_get_sensor_files(&files, &count);
+    for (int i = 0; ret == ESP_OK && i < count;) {
+        size_t length = 0;
+        int used = 1;
+        int64_t start = esp_timer_get_time();
+        ret = firebase_prepare_commit(&files[i], count - i, buffer, PIPELINE_BUFFER, &length, &used);
+        result->prepare_us += esp_timer_get_time() - start;
+        if (ret == ESP_OK) {
+            ret = firebase_commit(buffer, length);
+        }
+        for (int n = i; ret == ESP_OK && n < i + used; n++) {
+            unlink(files[n]);
+        }
+        i += used;
+    }
+    storage_free_sensor_files(files, count);
+    return ret;
+}
+
+// Every sensor has one document with all samples of the cycle
+static esp_err_t check_documents(int sensors) {
+    if (mock_firestore_count() != sensors) {
+        printf("Mock Firestore has %d documents, expected %d\n", mock_firestore_count(), sensors);
+        return ESP_FAIL;
+    }
+    for (int d = 0; d < sensors; d++) {
+        const cJSON *values = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(
+            mock_firestore_fields(d), "measurements"), "arrayValue"), "values");
+        if (cJSON_GetArraySize(values) != PIPELINE_SAMPLES) {
+            printf("Document %d has %d samples, expected %d\n", d, cJSON_GetArraySize(values), PIPELINE_SAMPLES);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+// Upload one sensor count with both loops
+static esp_err_t run_count(int sensors, char *buffer, pipeline_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    result->sensors = sensors;
+
+    mock_firestore_reset();
+    esp_err_t ret = store_cycle(sensors);
+    if (ret == ESP_OK) {
+        int64_t start = esp_timer_get_time();
+        ret = upload_serial(buffer, result);
+        result->serial_us = esp_timer_get_time() - start;
+        result->requests = mock_firestore_commits();
+    }
+    if (ret == ESP_OK) {
+        ret = check_documents(sensors);
+    }
+
+    mock_firestore_reset();
+    if (ret == ESP_OK) {
+        ret = store_cycle(sensors);
+    }
+    if (ret == ESP_OK) {
+        int64_t start = esp_timer_get_time();
+        ret = send_all_sensor_measurements_to_firebase();
+        result->pipeline_us = esp_timer_get_time() - start;
+        if (ret == ESP_OK && mock_firestore_commits() != result->requests) {
+            printf("Pipeline sent %d requests, the serial loop %d\n", mock_firestore_commits(), result->requests);
+            ret = ESP_FAIL;
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = check_documents(sensors);
+    }
+    mock_firestore_reset();
+    clear_files();
+    return ret;
+}
+
+esp_err_t benchmark_pipeline_run(cJSON *pipeline) {
+    int counts[PIPELINE_MAX_COUNTS];
+    int count = parse_counts(counts);
+    const char *latency = getenv("BENCH_PIPELINE_LATENCY_MS");
+    s_latency_ms = latency ? (uint32_t)atoi(latency) : PIPELINE_DEFAULT_LATENCY_MS;
+
+    // The JWT is created here, outside the measured uploads
+    benchmark_clock_set(0);
+    if (firebase_init() != ESP_OK) {
+        printf("Failed to initialize the Firebase API\n");
+        return ESP_FAIL;
+    }
+    char *buffer = malloc(PIPELINE_BUFFER);
+    if (buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    printf("\nUpload pipeline: %d samples per sensor, %lu ms per request, %d requests in flight\n",
+           PIPELINE_SAMPLES, (unsigned long)s_latency_ms, UPLOAD_MAX_IN_FLIGHT);
+    printf("%8s %9s %11s %12s %11s %7s\n", "sensors", "requests", "serial_ms", "pipeline_ms", "prepare_ms", "saved");
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < count && ret == ESP_OK; i++) {
+        pipeline_result_t r;
+        ret = run_count(counts[i], buffer, &r);
+        if (ret != ESP_OK) {
+            printf("Upload of %d sensors failed: %s\n", counts[i], esp_err_to_name(ret));
+            break;
+        }
+        double saved = (r.serial_us > 0) ? (r.serial_us - r.pipeline_us) * 100.0 / r.serial_us : 0.0;
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "sensors", r.sensors);
+        cJSON_AddNumberToObject(item, "samples", PIPELINE_SAMPLES);
+        cJSON_AddNumberToObject(item, "requests", r.requests);
+        cJSON_AddNumberToObject(item, "latency_ms", s_latency_ms);
+        cJSON_AddNumberToObject(item, "serial_ms", r.serial_us / 1000.0);
+        cJSON_AddNumberToObject(item, "pipeline_ms", r.pipeline_us / 1000.0);
+        cJSON_AddNumberToObject(item, "prepare_ms", r.prepare_us / 1000.0);
+        cJSON_AddItemToArray(pipeline, item);
+
+        printf("%8d %9d %11.1f %12.1f %11.1f %6.1f%%\n", r.sensors, r.requests, r.serial_us / 1000.0,
+               r.pipeline_us / 1000.0, r.prepare_us / 1000.0, saved);
+    }
+
+    free(buffer);
+    return ret;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Cycle time of the upload pipeline against the number of sensors
+ *
+ * Stores one send cycle of samples for every sensor and uploads it twice:
+ * once with the serial loop the firmware used before the pipeline (read
+ * and encode a sensor, send it, then the next one) and once with
+ * send_all_sensor_measurements_to_firebase(), whose reader task prepares
+ * the next requests while the current one is sent. Both use the real
+ * firebase_api code, https_client_request() is replaced by the mock
+ * Firestore with a simulated round trip time. Reports the wall clock time
+ * of both runs and the time spent reading and encoding, and fails if a
+ * run does not leave every sample in the mock Firestore.
+ *
+ * Environment: BENCH_PIPELINE_SENSORS (comma separated list),
+ * BENCH_PIPELINE_LATENCY_MS (round trip of one request).
+ *
+ * @param pipeline Array for one result object per sensor count
+ * @return esp_err_t ESP_OK if every upload was complete
+ */
+esp_err_t benchmark_pipeline_run(cJSON *pipeline);
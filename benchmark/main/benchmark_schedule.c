@@ -0,0 +1,245 @@
+// benchmark_schedule.c
+// Host replay of the send scheduler over months of wake cycles.
+#include "benchmark_schedule.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "send_scheduler.h"
+#include "config_manager.h"
+
+#define SCHEDULE_DEFAULT_DAYS       120
+#define SCHEDULE_DEFAULT_SENSORS    4
+#define SCHEDULE_SAMPLE_BYTES       115     // Stored bytes of one typed sample
+#define SCHEDULE_CAPACITY_MAH       2000.0
+#define SCHEDULE_START_LEVEL        50      // Battery % at the start of the replay
+#define SCHEDULE_SCAN_MS            3000    // BLE scan of every cycle
+#define SCHEDULE_SLEEP_MA           0.15    // Deep sleep with the modem powered off
+#define SCHEDULE_MODEM_BOOT_MS      45000   // Modem boot, attach, PPP, NTP and TLS on a good link
+#define SCHEDULE_MAX_POLICIES       3
+
+#define CYCLE_S                     ((double)TRIGGER_INTERVAL / SECONDS_IN_MICROS)
+#define CYCLES_PER_DAY              ((int)(24 * 3600 / CYCLE_S))
+
+// Result of one policy
+typedef struct {
+    const char *name;
+    send_scheduler_params_t params;
+    int uploads;
+    int failed;
+    int decisions[SEND_DECISION_FULL + 1];
+    double upload_mah;
+    double total_mah;
+    double latency_cycles;      // Sum over the uploaded samples
+    int64_t samples;
+    int max_latency_cycles;
+    double min_level;
+} schedule_policy_t;
+
+// Integer hash of the cycle number, the traces are the same for every policy
+static uint32_t trace_hash(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Signal quality of a cycle: weekly weather, a daily swing and noise, no network in 2 % of the cycles
+static int trace_csq(int cycle, uint32_t seed) {
+    double day = (double)cycle / CYCLES_PER_DAY;
+    uint32_t h = trace_hash((uint32_t)cycle, seed);
+    if (h % 100 < 2) {
+        return 99;
+    }
+    double csq = 16.0 + 6.0 * sin(2.0 * M_PI * day / 7.0) + 3.0 * sin(2.0 * M_PI * day) +
+                 (double)(h % 11) - 5.0;
+    return (csq < 0) ? 0 : (csq > 31) ? 31 : (int)csq;
+}
+
+// Solar charge of a cycle in mAh, the peak current changes over a 60 day period
+static double trace_harvest_mah(int cycle) {
+    double day = (double)cycle / CYCLES_PER_DAY;
+    double hour = fmod(day, 1.0) * 24.0;
+    if (hour < 6.0 || hour >= 18.0) {
+        return 0.0;
+    }
+    double peak_ma = 0.3 + 4.0 * (0.5 + 0.5 * sin(2.0 * M_PI * day / 60.0));
+    return peak_ma * sin(M_PI * (hour - 6.0) / 12.0) * CYCLE_S / 3600.0;
+}
+
+// Modem on time of an upload, a weak signal slows the attach and the transfer
+static uint32_t upload_duration_ms(int csq, uint32_t bytes) {
+    if (csq == 99 || csq < 3) {
+        return 2 * SCHEDULE_MODEM_BOOT_MS;  // No network, the attach times out
+    }
+    double attach_ms = SCHEDULE_MODEM_BOOT_MS + ((csq < 10) ? (10 - csq) * 6000.0 : 0.0);
+    double bytes_per_s = 500.0 + csq * 400.0;
+    return (uint32_t)(attach_ms + bytes * 1000.0 / bytes_per_s);
+}
+
+// Charge in mAh for a duration at a current
+static double charge_mah(double duration_ms, double current_ma) {
+    return duration_ms * current_ma / 3600000.0;
+}
+
+// Replay all cycles with one policy
+static void replay(schedule_policy_t *policy, int days, int sensors, uint32_t seed) {
+    double battery_mah = SCHEDULE_CAPACITY_MAH * SCHEDULE_START_LEVEL / 100.0;
+    uint32_t cycles = 0;
+    uint32_t pending_bytes = 0;
+    uint32_t upload_ms = 0;
+    int recorded_csq = 99;
+    policy->min_level = 100.0;
+
+    for (int cycle = 0; cycle < days * CYCLES_PER_DAY; cycle++) {
+        // Scan, sleep and solar charge are the same for every policy
+        double used = charge_mah(SCHEDULE_SCAN_MS, PHASE_CURRENT_CPU_MA + PHASE_CURRENT_RADIO_MA) +
+                      charge_mah(CYCLE_S * 1000.0, SCHEDULE_SLEEP_MA);
+        battery_mah += trace_harvest_mah(cycle) - used;
+        policy->total_mah += used;
+
+        cycles++;
+        pending_bytes += sensors * SCHEDULE_SAMPLE_BYTES;
+
+        double level = battery_mah * 100.0 / SCHEDULE_CAPACITY_MAH;
+        const send_scheduler_input_t input = {
+            .cycles = cycles,
+            .pending_bytes = pending_bytes,
+            .battery_level = (int)level,
+            .csq = recorded_csq,
+            .upload_ms = upload_ms,
+        };
+        send_decision_t decision = send_scheduler_decide(&policy->params, &input);
+        policy->decisions[decision]++;
+
+        if (SEND_DECISION_IS_SEND(decision)) {
+            int csq = trace_csq(cycle, seed);
+            uint32_t duration = upload_duration_ms(csq, pending_bytes);
+            double upload = charge_mah(duration, PHASE_CURRENT_CPU_MA + PHASE_CURRENT_MODEM_MA);
+            battery_mah -= upload;
+            policy->upload_mah += upload;
+            policy->total_mah += upload;
+            recorded_csq = csq;
+
+            if (csq == 99 || csq < 3) {
+                policy->failed++;
+            } else {
+                // Every pending cycle is delivered now, the oldest waited cycles - 1
+                policy->uploads++;
+                policy->latency_cycles += (double)cycles * (cycles - 1) / 2.0 * sensors;
+                policy->samples += (int64_t)cycles * sensors;
+                if ((int)cycles - 1 > policy->max_latency_cycles) {
+                    policy->max_latency_cycles = cycles - 1;
+                }
+                upload_ms = upload_ms ? (upload_ms * 3 + duration) / 4 : duration;
+                cycles = 0;
+                pending_bytes = 0;
+            }
+        }
+
+        battery_mah = (battery_mah < 0) ? 0 : (battery_mah > SCHEDULE_CAPACITY_MAH) ? SCHEDULE_CAPACITY_MAH
+                                                                                  : battery_mah;
+        level = battery_mah * 100.0 / SCHEDULE_CAPACITY_MAH;
+        if (level < policy->min_level) {
+            policy->min_level = level;
+        }
+    }
+}
+
+// Apply "key=value,..." overrides with the NVS keys of the tunables
+static esp_err_t parse_params(const char *text, send_scheduler_params_t *params) {
+    char *copy = strdup(text);
+    esp_err_t ret = (copy != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+    char *save = NULL;
+    for (char *item = copy ? strtok_r(copy, ",", &save) : NULL; ret == ESP_OK && item != NULL;
+         item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        if (eq == NULL) {
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+        }
+        *eq = '\0';
+        uint32_t value = (uint32_t)strtoul(eq + 1, NULL, 10);
+        ret = ESP_ERR_INVALID_ARG;
+#define SCHEDULE_PARSE_PARAM(field, key, default_value) \
+        if (strcmp(item, key) == 0) { params->field = value; ret = ESP_OK; }
+        SEND_SCHEDULER_PARAMS(SCHEDULE_PARSE_PARAM)
+#undef SCHEDULE_PARSE_PARAM
+        if (ret != ESP_OK) {
+            printf("Unknown scheduler parameter %s\n", item);
+        }
+    }
+    free(copy);
+    return ret;
+}
+
+// Add the result of a policy to the results and print it
+static void report_policy(cJSON *schedules, const schedule_policy_t *p) {
+    double hours_per_cycle = CYCLE_S / 3600.0;
+    double mean_latency_h = p->samples ? p->latency_cycles / p->samples * hours_per_cycle : 0.0;
+    double max_latency_h = p->max_latency_cycles * hours_per_cycle;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "policy", p->name);
+    cJSON_AddNumberToObject(item, "uploads", p->uploads);
+    cJSON_AddNumberToObject(item, "failed_uploads", p->failed);
+    cJSON_AddNumberToObject(item, "early_uploads", p->decisions[SEND_DECISION_EARLY]);
+    cJSON_AddNumberToObject(item, "deferred_cycles", p->decisions[SEND_DECISION_DEFER_BATTERY]);
+    cJSON_AddNumberToObject(item, "upload_mah", p->upload_mah);
+    cJSON_AddNumberToObject(item, "total_mah", p->total_mah);
+    cJSON_AddNumberToObject(item, "mean_latency_h", mean_latency_h);
+    cJSON_AddNumberToObject(item, "max_latency_h", max_latency_h);
+    cJSON_AddNumberToObject(item, "min_battery_level", p->min_level);
+    cJSON_AddItemToArray(schedules, item);
+
+    printf("%-10s %8d %7d %6d %9d %11.1f %10.1f %10.1f %9.1f %9.1f\n", p->name, p->uploads, p->failed,
+           p->decisions[SEND_DECISION_EARLY], p->decisions[SEND_DECISION_DEFER_BATTERY], p->upload_mah,
+           p->total_mah, mean_latency_h, max_latency_h, p->min_level);
+}
+
+esp_err_t benchmark_schedule_run(cJSON *schedules) {
+    int days = getenv("BENCH_SCHEDULE_DAYS") ? atoi(getenv("BENCH_SCHEDULE_DAYS")) : SCHEDULE_DEFAULT_DAYS;
+    int sensors = getenv("BENCH_SCHEDULE_SENSORS") ? atoi(getenv("BENCH_SCHEDULE_SENSORS"))
+                                                   : SCHEDULE_DEFAULT_SENSORS;
+    uint32_t seed = getenv("BENCH_SCHEDULE_SEED") ? (uint32_t)atoi(getenv("BENCH_SCHEDULE_SEED")) : 1;
+    if (days <= 0 || sensors <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    schedule_policy_t policies[SCHEDULE_MAX_POLICIES] = {
+        { .name = "fixed" },
+        { .name = "adaptive" },
+        { .name = "tuned" },
+    };
+    int count = 2;
+
+    // The fixed policy only has the deadline, like the firmware before the scheduler
+    send_scheduler_default_params(&policies[0].params);
+    policies[0].params.early_bytes = UINT32_MAX;
+    policies[0].params.full_bytes = UINT32_MAX;
+    policies[0].params.low_battery = 0;
+    policies[0].params.critical_battery = 0;
+    send_scheduler_default_params(&policies[1].params);
+
+    const char *tuned = getenv("BENCH_SCHEDULE_PARAMS");
+    if (tuned != NULL) {
+        send_scheduler_default_params(&policies[2].params);
+        if (parse_params(tuned, &policies[2].params) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        count = 3;
+    }
+
+    printf("\nSend scheduler replay: %d days, %d sensors\n", days, sensors);
+    printf("%-10s %8s %7s %6s %9s %11s %10s %10s %9s %9s\n", "policy", "uploads", "failed", "early",
+           "deferred", "upload_mAh", "total_mAh", "mean_lat_h", "max_lat_h", "min_batt");
+    for (int i = 0; i < count; i++) {
+        replay(&policies[i], days, sensors, seed);
+        report_policy(schedules, &policies[i]);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Replay months of wake cycles through the send scheduler
+ *
+ * Every policy sees the same synthetic signal quality and solar charge
+ * traces. Uploads cost modem time that grows with the pending bytes and a
+ * weak signal, so policies are compared on the charge they spend on uploads
+ * and on the latency of the samples. The fixed policy uploads every
+ * SEND_DATA_CYCLE cycles like the firmware did before the scheduler.
+ *
+ * Environment: BENCH_SCHEDULE_DAYS, BENCH_SCHEDULE_SENSORS, BENCH_SCHEDULE_SEED
+ * and BENCH_SCHEDULE_PARAMS ("key=value,..." with the NVS keys of
+ * SEND_SCHEDULER_PARAMS, adds a tuned policy).
+ *
+ * @param schedules Array for one result object per policy
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the environment is invalid
+ */
+esp_err_t benchmark_schedule_run(cJSON *schedules);
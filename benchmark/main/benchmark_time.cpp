@@ -0,0 +1,97 @@
+// benchmark_time.cpp
+// Time per conversion of the Finland time table and of the libc time zone.
+// The table is checked against libc by host_tests/main/test_time.cpp.
+#include "benchmark_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "time_manager.h"
+#include "time_zone.hpp"
+
+#define TIME_DEFAULT_ITERATIONS 1000000
+
+static int64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// ns per local time text of the table and of localtime_r() + strftime()
+static void measure_format(long iterations, double *table_ns, double *libc_ns) {
+    char text[32];
+    unsigned sink = 0;
+    time_t base = 1735689600;   // 2025-01-01
+    int64_t start = thread_cpu_ns();
+    for (long i = 0; i < iterations; i++) {
+        tz::format_local(base + i * 613, text, sizeof(text));
+        sink += (unsigned char)text[18];
+    }
+    *table_ns = (double)(thread_cpu_ns() - start) / iterations;
+
+    start = thread_cpu_ns();
+    for (long i = 0; i < iterations; i++) {
+        struct tm tm;
+        time_t t = base + i * 613;
+        localtime_r(&t, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+        sink += (unsigned char)text[18];
+    }
+    *libc_ns = (double)(thread_cpu_ns() - start) / iterations;
+    if (sink == 1) {
+        printf("\n");   // Keeps the loops from being optimized away
+    }
+}
+
+// ns per parsed local time of the table and of strptime() + mktime()
+static void measure_parse(long iterations, double *table_ns, double *libc_ns) {
+    static const char *const texts[] = { "2025-01-01 12:00:00", "2025-07-15 08:30:15", "2025-10-26 03:30:00",
+                                         "2031-03-30 04:00:01" };
+    const size_t count = sizeof(texts) / sizeof(texts[0]);
+    int64_t sink = 0;
+    int64_t start = thread_cpu_ns();
+    for (long i = 0; i < iterations; i++) {
+        int64_t utc = 0;
+        tz::parse_local(texts[i % count], &utc);
+        sink += utc;
+    }
+    *table_ns = (double)(thread_cpu_ns() - start) / iterations;
+
+    start = thread_cpu_ns();
+    for (long i = 0; i < iterations; i++) {
+        struct tm tm = {};
+        strptime(texts[i % count], "%Y-%m-%d %H:%M:%S", &tm);
+        tm.tm_isdst = -1;
+        sink += mktime(&tm);
+    }
+    *libc_ns = (double)(thread_cpu_ns() - start) / iterations;
+    if (sink == 1) {
+        printf("\n");
+    }
+}
+
+esp_err_t benchmark_time_run(cJSON *result) {
+    long iterations = getenv("BENCH_TIME_ITERATIONS") ? atol(getenv("BENCH_TIME_ITERATIONS"))
+                                                       : TIME_DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The reference is the libc time zone of the firmware TZ string
+    time_manager_set_finland_timezone();
+
+    double format_table_ns = 0, format_libc_ns = 0, parse_table_ns = 0, parse_libc_ns = 0;
+    measure_format(iterations, &format_table_ns, &format_libc_ns);
+    measure_parse(iterations, &parse_table_ns, &parse_libc_ns);
+
+    cJSON_AddNumberToObject(result, "format_table_ns", format_table_ns);
+    cJSON_AddNumberToObject(result, "format_libc_ns", format_libc_ns);
+    cJSON_AddNumberToObject(result, "parse_table_ns", parse_table_ns);
+    cJSON_AddNumberToObject(result, "parse_libc_ns", parse_libc_ns);
+
+    printf("\nTime table against libc, %ld conversions\n", iterations);
+    printf("%-8s %10s %10s\n", "ns/op", "table", "libc");
+    printf("%-8s %10.1f %10.1f\n", "format", format_table_ns, format_libc_ns);
+    printf("%-8s %10.1f %10.1f\n", "parse", parse_table_ns, parse_libc_ns);
+    return ESP_OK;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Time per conversion of the Finland time table and of libc
+ *
+ * Measures formatting the local time and parsing it with time_zone.hpp and
+ * with localtime_r() + strftime() and strptime() + mktime() under the
+ * firmware TZ string. The table is checked against libc by the host tests.
+ *
+ * Environment: BENCH_TIME_ITERATIONS (timed conversions, default 1000000).
+ *
+ * @param result Object for the ns per conversion
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_ARG for a bad iteration count
+ */
+esp_err_t benchmark_time_run(cJSON *result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,217 @@
+// benchmark_wake.c
+// Host replay of the wake planner against a drifting RTC slow clock.
+#include "benchmark_wake.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "wake_model.h"
+#include "config_manager.h"
+
+#define WAKE_DEFAULT_DAYS       30
+#define WAKE_EPOCH_S            1735689600LL    // 2025-01-01, the real time at power-on
+#define WAKE_SCAN_S             8.0             // Boot, BLE scan and storage of a normal cycle
+#define WAKE_SEND_S             120.0           // Modem, upload and report of a send cycle
+#define WAKE_OVERRUN_S          900.0           // A send cycle that retries until its stage deadlines
+#define WAKE_OVERRUN_EVERY      5               // Every 5th send cycle overruns
+#define WAKE_LEARN_DAYS         2               // Syncs before the drift is learned, not scored
+#define WAKE_OLD_COMPENSATION_S 4.16666         // Fudge constant of the fixed interval
+
+#define US                      1000000LL
+#define INTERVAL_S              ((double)TRIGGER_INTERVAL / SECONDS_IN_MICROS)
+
+// Drift of the RTC: real sleep / requested sleep - 1
+typedef struct {
+    const char *name;
+    double drift_ppm;           // Mean drift
+    double daily_ppm;           // Amplitude of the day and night temperature swing
+} wake_trace_t;
+
+static const wake_trace_t s_traces[] = {
+    { "slow_rtc",   15000.0,    0.0 },
+    { "fast_rtc",  -20000.0,    0.0 },
+    { "thermal",     8000.0, 3000.0 },
+};
+
+typedef enum {
+    WAKE_POLICY_FIXED,
+    WAKE_POLICY_SLOTS,
+} wake_policy_t;
+
+// Result of one policy on one trace
+typedef struct {
+    const char *policy;
+    int wakes;
+    int scored;
+    double offset_sum_s;        // Distance of the wakes from the grid
+    double offset_max_s;
+    double interval_sum_sq;     // Deviation of the wake intervals from INTERVAL_S
+    int short_sleeps;           // Sleeps shorter than WAKE_MIN_SLEEP_MS
+    uint32_t skipped;           // Slots reported as skipped
+    uint32_t unreported;        // Grid slots without a wake that were not reported as skipped
+    int32_t drift_ppm;          // Learned drift
+} wake_result_t;
+
+// Integer hash, the same awake times for every policy
+static uint32_t trace_hash(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Drift at a real time of day
+static double trace_drift(const wake_trace_t *trace, double t_s) {
+    return (trace->drift_ppm + trace->daily_ppm * sin(2.0 * M_PI * t_s / 86400.0)) / 1e6;
+}
+
+// Awake time of a cycle
+static double cycle_awake_s(int cycle, uint32_t seed) {
+    double awake = WAKE_SCAN_S + (trace_hash((uint32_t)cycle, seed) % 4000) / 1000.0;
+    if (cycle % SEND_DATA_CYCLE == 0) {
+        awake += ((cycle / SEND_DATA_CYCLE) % WAKE_OVERRUN_EVERY == WAKE_OVERRUN_EVERY - 1) ?
+                 WAKE_OVERRUN_S : WAKE_SEND_S;
+    }
+    return awake;
+}
+
+// Real time that passes during a requested sleep, the drift is integrated in 1 minute steps
+static double real_sleep_s(const wake_trace_t *trace, double t_s, double sleep_s) {
+    double real = 0.0;
+    while (sleep_s > 0.0) {
+        double step = (sleep_s > 60.0) ? 60.0 : sleep_s;
+        double stretched = step * (1.0 + trace_drift(trace, t_s + real));
+        real += stretched;
+        sleep_s -= step;
+    }
+    return real;
+}
+
+static double grid_offset_s(double t_s) {
+    return t_s - round(t_s / INTERVAL_S) * INTERVAL_S;
+}
+
+// Replay a trace with one policy. The real time is t, the system clock is
+// t + clock_error; the error grows with every sleep and is cleared by a sync.
+static void replay(wake_result_t *r, const wake_trace_t *trace, wake_policy_t policy, int days, uint32_t seed) {
+    wake_model_params_t params;
+    wake_model_default_params(&params);
+    wake_model_t model;
+    wake_model_init(&model);
+
+    double t = (double)WAKE_EPOCH_S;
+    double clock_error = -t;        // The system clock starts at 0 after a power-on
+    double end = t + days * 86400.0;
+    double learned_after = t + WAKE_LEARN_DAYS * 86400.0 + INTERVAL_S * SEND_DATA_CYCLE;
+    double last_wake = 0.0;
+    int64_t last_index = 0;
+    uint32_t last_skipped = 0;
+
+    for (int cycle = 0; t < end; cycle++) {
+        r->wakes++;
+        if (t >= learned_after) {
+            double offset = fabs(grid_offset_s(t));
+            r->offset_sum_s += offset;
+            if (offset > r->offset_max_s) {
+                r->offset_max_s = offset;
+            }
+            double interval = t - last_wake;
+            if (interval < 1.5 * INTERVAL_S) {
+                r->interval_sum_sq += (interval - INTERVAL_S) * (interval - INTERVAL_S);
+            }
+            int64_t gap = (int64_t)round(t / INTERVAL_S) - last_index - 1;
+            if (policy == WAKE_POLICY_SLOTS && gap != (int64_t)last_skipped) {
+                r->unreported++;
+            }
+            r->scored++;
+        }
+        last_wake = t;
+        last_index = (int64_t)round(t / INTERVAL_S);
+
+        // Send cycles sync the time early in the cycle, network time has whole seconds
+        double awake = cycle_awake_s(cycle, seed);
+        if (cycle % SEND_DATA_CYCLE == 0) {
+            double sync_t = t + awake / 2.0;
+            int64_t network_us = (int64_t)floor(sync_t) * US;
+            if (policy == WAKE_POLICY_SLOTS) {
+                wake_model_sync(&params, &model, (int64_t)((sync_t + clock_error) * US), network_us);
+            }
+            clock_error = (double)network_us / US - sync_t;
+        }
+        t += awake;
+
+        double sleep_s;
+        if (policy == WAKE_POLICY_SLOTS) {
+            wake_plan_t plan;
+            wake_model_plan(&params, &model, (int64_t)((t + clock_error) * US), &plan);
+            sleep_s = (double)plan.sleep_us / US;
+            r->skipped += plan.skipped;
+            last_skipped = plan.skipped;
+        } else {
+            sleep_s = INTERVAL_S - awake + WAKE_OLD_COMPENSATION_S;
+            sleep_s = (sleep_s < 0.0) ? 0.0 : sleep_s;
+        }
+        if (sleep_s * 1000.0 < WAKE_MIN_SLEEP_MS) {
+            r->short_sleeps++;
+        }
+
+        double real = real_sleep_s(trace, t, sleep_s);
+        clock_error -= real - sleep_s;
+        t += real;
+    }
+    r->drift_ppm = model.drift_ppm;
+}
+
+// Add a result to the results and print it
+static void report_result(cJSON *traces, const wake_trace_t *trace, const wake_result_t *r, int days) {
+    double mean = r->scored ? r->offset_sum_s / r->scored : 0.0;
+    double spread = r->scored ? sqrt(r->interval_sum_sq / r->scored) : 0.0;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "trace", trace->name);
+    cJSON_AddStringToObject(item, "policy", r->policy);
+    cJSON_AddNumberToObject(item, "wakes_per_day", (double)r->wakes / days);
+    cJSON_AddNumberToObject(item, "mean_offset_s", mean);
+    cJSON_AddNumberToObject(item, "max_offset_s", r->offset_max_s);
+    cJSON_AddNumberToObject(item, "interval_spread_s", spread);
+    cJSON_AddNumberToObject(item, "short_sleeps", r->short_sleeps);
+    cJSON_AddNumberToObject(item, "skipped_slots", r->skipped);
+    cJSON_AddNumberToObject(item, "learned_ppm", r->drift_ppm);
+    cJSON_AddItemToArray(traces, item);
+
+    printf("%-9s %-6s %9.1f %9.2f %9.2f %9.2f %6d %8lu %8ld %8.0f\n", trace->name, r->policy,
+           (double)r->wakes / days, mean, r->offset_max_s, spread, r->short_sleeps, (unsigned long)r->skipped,
+           (long)r->drift_ppm, trace->drift_ppm);
+}
+
+esp_err_t benchmark_wake_run(cJSON *traces) {
+    int days = getenv("BENCH_WAKE_DAYS") ? atoi(getenv("BENCH_WAKE_DAYS")) : WAKE_DEFAULT_DAYS;
+    uint32_t seed = getenv("BENCH_WAKE_SEED") ? (uint32_t)atoi(getenv("BENCH_WAKE_SEED")) : 1;
+    if (days <= WAKE_LEARN_DAYS + 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    printf("\nWake planner: %d days, offsets from the %.0f s grid after %d days of learning\n", days, INTERVAL_S,
+           WAKE_LEARN_DAYS);
+    printf("%-9s %-6s %9s %9s %9s %9s %6s %8s %8s %8s\n", "trace", "policy", "wakes/d", "offset_s", "max_s",
+           "spread_s", "short", "skipped", "ppm", "true_ppm");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(s_traces) / sizeof(s_traces[0]); i++) {
+        wake_result_t fixed = { .policy = "fixed" };
+        wake_result_t slots = { .policy = "slots" };
+        replay(&fixed, &s_traces[i], WAKE_POLICY_FIXED, days, seed);
+        replay(&slots, &s_traces[i], WAKE_POLICY_SLOTS, days, seed);
+        report_result(traces, &s_traces[i], &fixed, days);
+        report_result(traces, &s_traces[i], &slots, days);
+
+        if (slots.offset_sum_s >= fixed.offset_sum_s || slots.short_sleeps > 0 || slots.unreported > 0) {
+            printf("Wake planner check failed on trace %s\n", s_traces[i].name);
+            ok = false;
+        }
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
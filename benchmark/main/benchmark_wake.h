@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Wake planner on a simulated drifting RTC
+ *
+ * Replays days of wake cycles with a slow clock that is off by a constant
+ * or temperature dependent drift, daily time syncs with 1 s resolution and
+ * send cycles that overrun their slot. The old fixed interval with the
+ * compensation constant is compared with the slot planner by the distance
+ * of the wakes from the 10 minute grid and the spread of the intervals. The
+ * run fails if the planner is not closer to the grid after the first day,
+ * sleeps less than WAKE_MIN_SLEEP_MS or loses a slot it did not report.
+ *
+ * Environment: BENCH_WAKE_DAYS (default 30), BENCH_WAKE_SEED.
+ *
+ * @param traces Array for one result object per drift trace and policy
+ * @return esp_err_t ESP_OK if all checks passed
+ */
+esp_err_t benchmark_wake_run(cJSON *traces);
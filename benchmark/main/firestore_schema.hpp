@@ -0,0 +1,495 @@
+// firestore_schema.hpp
+// Compile-time Firestore document encoder.
+//
+// The shape of the sensor document is described once as a constexpr schema.
+// The key names and the Firestore value wrapping between two values are
+// merged into string fragments at compile time, so encoding a document is a
+// sequence of memcpys and number formatting. The output is byte for byte the
+// same as cJSON_PrintUnformatted() of the document built by json_helper.c,
+// in the typed and in the string format selected by FIRESTORE_TYPED_VALUES.
+//
+// Only the encoder benchmark uses it, to measure what the cJSON tree costs.
+// The firmware keeps json_helper.c: storage_save_measurement() parses the
+// stored document to add a sample, and the commit path rewrites the stored
+// text in place without encoding it again.
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <tuple>
+#include <utility>
+#include "config_manager.h"
+#include "time_zone.hpp"
+
+namespace firestore {
+
+// Fixed size string usable in constant expressions
+template <std::size_t N>
+struct literal {
+    char data[N + 1] = {};
+
+    constexpr literal() = default;
+    constexpr literal(const char (&text)[N + 1]) {
+        for (std::size_t i = 0; i < N; i++) {
+            data[i] = text[i];
+        }
+    }
+
+    static constexpr std::size_t size() { return N; }
+};
+
+template <std::size_t N>
+literal(const char (&)[N]) -> literal<N - 1>;
+
+template <std::size_t A, std::size_t B>
+constexpr literal<A + B> operator+(const literal<A> &a, const literal<B> &b) {
+    literal<A + B> result;
+    for (std::size_t i = 0; i < A; i++) {
+        result.data[i] = a.data[i];
+    }
+    for (std::size_t i = 0; i < B; i++) {
+        result.data[A + i] = b.data[i];
+    }
+    return result;
+}
+
+// Firestore value types, the text around the value
+struct string_kind {
+    static constexpr auto open = literal("{\"stringValue\":\"");
+    static constexpr auto close = literal("\"}");
+};
+
+struct integer_kind {      // int64 is sent as a string
+    static constexpr auto open = literal("{\"integerValue\":\"");
+    static constexpr auto close = literal("\"}");
+};
+
+struct double_kind {
+    static constexpr auto open = literal("{\"doubleValue\":");
+    static constexpr auto close = literal("}");
+};
+
+struct timestamp_kind {    // RFC 3339 in UTC
+    static constexpr auto open = literal("{\"timestampValue\":\"");
+    static constexpr auto close = literal("\"}");
+};
+
+// Schema nodes
+
+// Field with a single Firestore value
+template <std::size_t N, typename Kind>
+struct value_field {
+    literal<N> name;
+};
+
+// Field with a Firestore arrayValue of map values
+template <std::size_t N, typename Element>
+struct array_field {
+    literal<N> name;
+    Element element;
+};
+
+// Map of fields, the document root or an array element
+template <typename... Fields>
+struct map_node {
+    std::tuple<Fields...> fields;
+};
+
+template <std::size_t N>
+constexpr auto string(const char (&name)[N]) {
+    return value_field<N - 1, string_kind>{literal<N - 1>(name)};
+}
+
+template <std::size_t N>
+constexpr auto integer(const char (&name)[N]) {
+    return value_field<N - 1, integer_kind>{literal<N - 1>(name)};
+}
+
+template <std::size_t N>
+constexpr auto number(const char (&name)[N]) {
+    return value_field<N - 1, double_kind>{literal<N - 1>(name)};
+}
+
+template <std::size_t N>
+constexpr auto timestamp(const char (&name)[N]) {
+    return value_field<N - 1, timestamp_kind>{literal<N - 1>(name)};
+}
+
+template <std::size_t N, typename Element>
+constexpr auto array(const char (&name)[N], const Element &element) {
+    return array_field<N - 1, Element>{literal<N - 1>(name), element};
+}
+
+template <typename... Fields>
+constexpr auto map(const Fields &...fields) {
+    return map_node<Fields...>{std::make_tuple(fields...)};
+}
+
+// Text before the value of a field
+template <std::size_t N, typename Kind>
+constexpr auto field_open(const value_field<N, Kind> &field) {
+    return literal("\"") + field.name + literal("\":") + Kind::open;
+}
+
+template <std::size_t N, typename Element>
+constexpr auto field_open(const array_field<N, Element> &field) {
+    return literal("\"") + field.name + literal("\":{\"arrayValue\":{\"values\":[");
+}
+
+// Text after the value of a field
+template <std::size_t N, typename Kind>
+constexpr auto field_close(const value_field<N, Kind> &) {
+    return Kind::close;
+}
+
+template <std::size_t N, typename Element>
+constexpr auto field_close(const array_field<N, Element> &) {
+    return literal("]}}");
+}
+
+// Static text in front of value I of a map, the last one closes the map
+template <std::size_t I, typename Tuple, std::size_t O, std::size_t C>
+constexpr auto fragment(const Tuple &fields, const literal<O> &open, const literal<C> &close) {
+    constexpr std::size_t count = std::tuple_size_v<Tuple>;
+    if constexpr (I == 0) {
+        return open + field_open(std::get<0>(fields));
+    } else if constexpr (I == count) {
+        return field_close(std::get<I - 1>(fields)) + close;
+    } else {
+        return field_close(std::get<I - 1>(fields)) + literal(",") + field_open(std::get<I>(fields));
+    }
+}
+
+template <typename Map, std::size_t O, std::size_t C, std::size_t... I>
+constexpr auto make_fragments(const Map &node, const literal<O> &open, const literal<C> &close,
+                              std::index_sequence<I...>) {
+    return std::make_tuple(fragment<I>(node.fields, open, close)...);
+}
+
+// All fragments of a map, one more than it has fields
+template <typename... Fields, std::size_t O, std::size_t C>
+constexpr auto fragments(const map_node<Fields...> &node, const literal<O> &open, const literal<C> &close) {
+    return make_fragments(node, open, close, std::make_index_sequence<sizeof...(Fields) + 1>{});
+}
+
+// Sensor document schemas, field order as created by json_helper.c
+
+// Typed values
+inline constexpr auto typed_sample_schema = map(number("t"), number("h"), timestamp("ts"));
+inline constexpr auto typed_document_schema =
+    map(string("tag_id"), string("day"), integer("battery_voltage"), integer("battery_level"),
+        array("measurements", typed_sample_schema));
+
+// Everything as a string, for consumers of the old format
+inline constexpr auto string_sample_schema = map(string("t"), string("h"), string("ts"));
+inline constexpr auto string_document_schema =
+    map(string("tag_id"), string("day"), string("battery_voltage"), string("battery_level"),
+        array("measurements", string_sample_schema));
+
+inline constexpr auto sample_open = literal("{\"mapValue\":{\"fields\":{");
+inline constexpr auto sample_close = literal("}}}");
+inline constexpr auto document_open = literal("{\"fields\":{");
+inline constexpr auto document_close = literal("}}");
+
+inline constexpr auto typed_sample_fragments = fragments(typed_sample_schema, sample_open, sample_close);
+inline constexpr auto typed_document_fragments = fragments(typed_document_schema, document_open, document_close);
+inline constexpr auto string_sample_fragments = fragments(string_sample_schema, sample_open, sample_close);
+inline constexpr auto string_document_fragments = fragments(string_document_schema, document_open, document_close);
+
+// Values
+
+// Text with two decimals ("20.10"), rounded like json_helper.c
+struct fixed2 {
+    float value;
+};
+
+// Number rounded to two decimals, printed like cJSON prints doubles ("20.1")
+struct decimal2 {
+    float value;
+};
+
+// Time as RFC 3339 in UTC ("2025-01-01T10:00:00Z")
+struct utc_time {
+    std::time_t value;
+};
+
+// Local time as "YYYY-MM-DD HH:MM:SS" in the Finland time zone of time_zone.hpp
+struct local_time {
+    std::time_t value;
+};
+
+// Buffer writer, stops writing when the buffer is full
+class writer {
+public:
+    writer(char *buffer, std::size_t size) : m_buffer(buffer), m_size(size) {}
+
+    template <std::size_t N>
+    void put(const literal<N> &text) {
+        put(text.data, N);
+    }
+
+    void put(const char *data, std::size_t length) {
+        if (m_length + length >= m_size) {
+            m_overflow = true;
+            return;
+        }
+        std::memcpy(m_buffer + m_length, data, length);
+        m_length += length;
+    }
+
+    void put(char c) { put(&c, 1); }
+
+    // String value with the escapes of cJSON
+    void put_value(const char *text) {
+        if (text == nullptr) {
+            return;
+        }
+        const char *run = text;
+        for (const char *p = text; *p != '\0'; p++) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            put(run, p - run);
+            run = p + 1;
+            char escape[7];
+            switch (c) {
+                case '"':  put("\\\"", 2); break;
+                case '\\': put("\\\\", 2); break;
+                case '\b': put("\\b", 2); break;
+                case '\f': put("\\f", 2); break;
+                case '\n': put("\\n", 2); break;
+                case '\r': put("\\r", 2); break;
+                case '\t': put("\\t", 2); break;
+                default:
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    put(escape, 6);
+                    break;
+            }
+        }
+        put(run, std::strlen(run));
+    }
+
+    void put_value(fixed2 number) {
+        float rounded = std::round(number.value * 100);
+        // Large and non-finite values take the printf path of json_helper.c
+        if (!(std::fabs(rounded) < 1e7f)) {
+            char text[32];
+            int length = std::snprintf(text, sizeof(text), "%.2f", rounded / 100);
+            put(text, length > 0 ? static_cast<std::size_t>(length) : 0);
+            return;
+        }
+        uint32_t hundredths = static_cast<uint32_t>(std::fabs(rounded));
+        char text[16];
+        char *p = text + sizeof(text);
+        *--p = static_cast<char>('0' + hundredths % 10);
+        *--p = static_cast<char>('0' + hundredths / 10 % 10);
+        *--p = '.';
+        p = digits(p, hundredths / 100);
+        if (std::signbit(rounded)) {
+            *--p = '-';
+        }
+        put(p, text + sizeof(text) - p);
+    }
+
+    void put_value(decimal2 number) {
+        double rounded = std::round(static_cast<double>(number.value) * 100);
+        // Up to 15 digits %1.15g gives the exact decimal, beyond that print like cJSON does
+        if (!(std::fabs(rounded) < 1e15)) {
+            put_cjson_number(rounded / 100);
+            return;
+        }
+        uint64_t hundredths = static_cast<uint64_t>(std::fabs(rounded));
+        char text[24];
+        char *p = text + sizeof(text);
+        unsigned fraction = static_cast<unsigned>(hundredths % 100);
+        if (fraction != 0) {
+            if (fraction % 10 != 0) {
+                *--p = static_cast<char>('0' + fraction % 10);
+            }
+            *--p = static_cast<char>('0' + fraction / 10);
+            *--p = '.';
+        }
+        p = digits(p, hundredths / 100);
+        // -0 is printed as the integer 0
+        if (rounded < 0) {
+            *--p = '-';
+        }
+        put(p, text + sizeof(text) - p);
+    }
+
+    void put_value(utc_time time) {
+        char text[24];
+        put(text, tz::format_rfc3339(static_cast<int64_t>(time.value), text, sizeof(text)));
+    }
+
+    void put_value(local_time time) {
+        char text[24];
+        put(text, tz::format_local(static_cast<int64_t>(time.value), text, sizeof(text)));
+    }
+
+    void put_value(uint32_t number) {
+        char text[16];
+        char *p = digits(text + sizeof(text), number);
+        put(p, text + sizeof(text) - p);
+    }
+
+    void put_value(int number) {
+        char text[16];
+        uint32_t magnitude = number < 0 ? 0u - static_cast<uint32_t>(number) : static_cast<uint32_t>(number);
+        char *p = digits(text + sizeof(text), magnitude);
+        if (number < 0) {
+            *--p = '-';
+        }
+        put(p, text + sizeof(text) - p);
+    }
+
+    // Nested values, e.g. the elements of an array
+    template <typename Encode, typename = decltype(std::declval<Encode &>()(std::declval<writer &>()))>
+    void put_value(Encode &&encode) {
+        encode(*this);
+    }
+
+    // Terminate the text, returns its length or 0 if the buffer was too small
+    std::size_t finish() {
+        if (m_overflow || m_size == 0) {
+            if (m_size > 0) {
+                m_buffer[0] = '\0';
+            }
+            return 0;
+        }
+        m_buffer[m_length] = '\0';
+        return m_length;
+    }
+
+    std::size_t length() const { return m_length; }
+    bool overflow() const { return m_overflow; }
+
+private:
+    // Double as printed by cJSON: non-finite as null, else 15 digits if they read back equal
+    void put_cjson_number(double value) {
+        char text[32];
+        int length;
+        if (std::isnan(value) || std::isinf(value)) {
+            length = std::snprintf(text, sizeof(text), "null");
+        } else {
+            length = std::snprintf(text, sizeof(text), "%1.15g", value);
+            double test = 0;
+            bool same = std::sscanf(text, "%lg", &test) == 1 &&
+                        std::fabs(test - value) <= std::fmax(std::fabs(test), std::fabs(value)) * DBL_EPSILON;
+            if (!same) {
+                length = std::snprintf(text, sizeof(text), "%1.17g", value);
+            }
+        }
+        put(text, length > 0 ? static_cast<std::size_t>(length) : 0);
+    }
+
+    // Decimal digits written backwards in front of end
+    static char *digits(char *end, uint64_t number) {
+        do {
+            *--end = static_cast<char>('0' + number % 10);
+            number /= 10;
+        } while (number != 0);
+        return end;
+    }
+
+    char *m_buffer;
+    std::size_t m_size;
+    std::size_t m_length = 0;
+    bool m_overflow = false;
+};
+
+// Write the fragments of a map with one value between each pair
+template <typename Fragments, std::size_t... I, typename... Values>
+void encode_fields(writer &out, const Fragments &frags, std::index_sequence<I...>, Values &&...values) {
+    static_assert(std::tuple_size_v<Fragments> == sizeof...(Values) + 1, "one value per schema field");
+    ((out.put(std::get<I>(frags)), out.put_value(std::forward<Values>(values))), ...);
+    out.put(std::get<sizeof...(Values)>(frags));
+}
+
+template <typename Fragments, typename... Values>
+void encode_map(writer &out, const Fragments &frags, Values &&...values) {
+    encode_fields(out, frags, std::index_sequence_for<Values...>{}, std::forward<Values>(values)...);
+}
+
+// One measurement of the document
+struct sample {
+    float temperature;
+    float humidity;
+    std::time_t time;
+};
+
+// Write one element of the measurements array
+template <bool Typed = FIRESTORE_TYPED_VALUES>
+void encode_sample(writer &out, const sample &s) {
+    if constexpr (Typed) {
+        encode_map(out, typed_sample_fragments, decimal2{s.temperature}, decimal2{s.humidity}, utc_time{s.time});
+    } else {
+        encode_map(out, string_sample_fragments, fixed2{s.temperature}, fixed2{s.humidity}, local_time{s.time});
+    }
+}
+
+// Write a whole sensor document
+template <bool Typed = FIRESTORE_TYPED_VALUES>
+void encode_document(writer &out, const char *tag_id, const char *day, uint32_t battery_voltage_mv,
+                     int battery_level, const sample *samples, std::size_t count) {
+    auto measurements = [&](writer &w) {
+        for (std::size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                w.put(',');
+            }
+            encode_sample<Typed>(w, samples[i]);
+        }
+    };
+    if constexpr (Typed) {
+        encode_map(out, typed_document_fragments, tag_id, day, battery_voltage_mv, battery_level, measurements);
+    } else {
+        encode_map(out, string_document_fragments, tag_id, day, battery_voltage_mv, battery_level, measurements);
+    }
+}
+
+/**
+ * @brief Encode a sensor document into a buffer
+ *
+ * @tparam Typed Typed Firestore values, the string format of older consumers if false
+ * @param buffer Buffer for the JSON text
+ * @param size Size of the buffer
+ * @param tag_id MAC address of the tag
+ * @param day Date as YYYY-MM-DD
+ * @param battery_voltage_mv Battery voltage in millivolts
+ * @param battery_level Battery level percentage
+ * @param samples Measurements in storage order
+ * @param count Number of measurements
+ * @return std::size_t Length of the text, 0 if the buffer was too small
+ */
+template <bool Typed = FIRESTORE_TYPED_VALUES>
+std::size_t encode_document(char *buffer, std::size_t size, const char *tag_id, const char *day,
+                            uint32_t battery_voltage_mv, int battery_level, const sample *samples,
+                            std::size_t count) {
+    writer out(buffer, size);
+    encode_document<Typed>(out, tag_id, day, battery_voltage_mv, battery_level, samples, count);
+    return out.finish();
+}
+
+/**
+ * @brief Encode one element of the measurements array into a buffer
+ *
+ * @tparam Typed Typed Firestore values, the string format of older consumers if false
+ * @param buffer Buffer for the JSON text
+ * @param size Size of the buffer
+ * @param s Measurement
+ * @return std::size_t Length of the text, 0 if the buffer was too small
+ */
+template <bool Typed = FIRESTORE_TYPED_VALUES>
+std::size_t encode_sample(char *buffer, std::size_t size, const sample &s) {
+    writer out(buffer, size);
+    encode_sample<Typed>(out, s);
+    return out.finish();
+}
+
+} // namespace firestore
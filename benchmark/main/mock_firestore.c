@@ -0,0 +1,195 @@
+// mock_firestore.c
+// In-memory Firestore that applies commit requests, used to check the merge
+// semantics of the upload and the bytes it sends.
+#include "mock_firestore.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct {
+    char *name;
+    cJSON *fields;
+} mock_document_t;
+
+static mock_document_t *s_documents = NULL;
+static int s_count = 0;
+static int s_commits = 0;
+
+void mock_firestore_reset(void) {
+    for (int i = 0; i < s_count; i++) {
+        free(s_documents[i].name);
+        cJSON_Delete(s_documents[i].fields);
+    }
+    free(s_documents);
+    s_documents = NULL;
+    s_count = 0;
+    s_commits = 0;
+}
+
+// Document by name, created empty if it does not exist
+static mock_document_t *get_document(const char *name) {
+    for (int i = 0; i < s_count; i++) {
+        if (strcmp(s_documents[i].name, name) == 0) {
+            return &s_documents[i];
+        }
+    }
+    mock_document_t *documents = realloc(s_documents, (s_count + 1) * sizeof(mock_document_t));
+    if (documents == NULL) {
+        return NULL;
+    }
+    s_documents = documents;
+    mock_document_t *doc = &s_documents[s_count++];
+    doc->name = strdup(name);
+    doc->fields = cJSON_CreateObject();
+    return doc;
+}
+
+// Check if a field path is listed in the update mask
+static bool in_mask(const cJSON *paths, const char *path) {
+    const cJSON *item;
+    cJSON_ArrayForEach(item, paths) {
+        if (cJSON_IsString(item) && strcmp(item->valuestring, path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Set the masked fields, a masked field missing from the update is deleted
+static esp_err_t apply_update(mock_document_t *doc, const cJSON *fields, const cJSON *mask) {
+    if (mask == NULL) {
+        cJSON_Delete(doc->fields);
+        doc->fields = cJSON_Duplicate(fields, true);
+        return ESP_OK;
+    }
+    const cJSON *paths = cJSON_GetObjectItem(mask, "fieldPaths");
+    const cJSON *field;
+    cJSON_ArrayForEach(field, fields) {
+        if (!in_mask(paths, field->string)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    const cJSON *path;
+    cJSON_ArrayForEach(path, paths) {
+        cJSON_DeleteItemFromObject(doc->fields, path->valuestring);
+        const cJSON *value = cJSON_GetObjectItem(fields, path->valuestring);
+        if (value != NULL) {
+            cJSON_AddItemToObject(doc->fields, path->valuestring, cJSON_Duplicate(value, true));
+        }
+    }
+    return ESP_OK;
+}
+
+// Append the values that are not in the array yet, a field that is not an array is replaced
+static esp_err_t apply_append(mock_document_t *doc, const char *path, const cJSON *values) {
+    cJSON *field = cJSON_GetObjectItem(doc->fields, path);
+    cJSON *array_value = cJSON_GetObjectItem(field, "arrayValue");
+    if (array_value == NULL) {
+        cJSON_DeleteItemFromObject(doc->fields, path);
+        field = cJSON_AddObjectToObject(doc->fields, path);
+        array_value = cJSON_AddObjectToObject(field, "arrayValue");
+    }
+    // Firestore leaves out "values" for an empty array
+    cJSON *array = cJSON_GetObjectItem(array_value, "values");
+    if (array == NULL) {
+        array = cJSON_AddArrayToObject(array_value, "values");
+    }
+
+    const cJSON *value;
+    cJSON_ArrayForEach(value, values) {
+        bool present = false;
+        const cJSON *element;
+        cJSON_ArrayForEach(element, array) {
+            if (cJSON_Compare(element, value, true)) {
+                present = true;
+                break;
+            }
+        }
+        if (!present) {
+            cJSON_AddItemToArray(array, cJSON_Duplicate(value, true));
+        }
+    }
+    return ESP_OK;
+}
+
+// Apply one write of a commit
+static esp_err_t apply_write(const cJSON *write) {
+    const cJSON *update = cJSON_GetObjectItem(write, "update");
+    const cJSON *name = cJSON_GetObjectItem(update, "name");
+    const cJSON *fields = cJSON_GetObjectItem(update, "fields");
+    const cJSON *mask = cJSON_GetObjectItem(write, "updateMask");
+    const cJSON *transforms = cJSON_GetObjectItem(write, "updateTransforms");
+    if (!cJSON_IsString(name) || strncmp(name->valuestring, "projects/", 9) != 0 ||
+        (fields != NULL && !cJSON_IsObject(fields))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // A field can not be both updated and transformed
+    const cJSON *transform;
+    cJSON_ArrayForEach(transform, transforms) {
+        const cJSON *path = cJSON_GetObjectItem(transform, "fieldPath");
+        const cJSON *append = cJSON_GetObjectItem(transform, "appendMissingElements");
+        if (!cJSON_IsString(path) || append == NULL ||
+            (mask != NULL && in_mask(cJSON_GetObjectItem(mask, "fieldPaths"), path->valuestring))) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    mock_document_t *doc = get_document(name->valuestring);
+    if (doc == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = apply_update(doc, fields, mask);
+    cJSON_ArrayForEach(transform, transforms) {
+        if (ret == ESP_OK) {
+            ret = apply_append(doc, cJSON_GetObjectItem(transform, "fieldPath")->valuestring,
+                               cJSON_GetObjectItem(cJSON_GetObjectItem(transform, "appendMissingElements"),
+                                                   "values"));
+        }
+    }
+    return ret;
+}
+
+esp_err_t mock_firestore_commit(const char *body, size_t length) {
+    cJSON *request = cJSON_ParseWithLength(body, length);
+    const cJSON *writes = cJSON_GetObjectItem(request, "writes");
+    esp_err_t ret = cJSON_IsArray(writes) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    const cJSON *write;
+    cJSON_ArrayForEach(write, writes) {
+        if (ret == ESP_OK) {
+            ret = apply_write(write);
+        }
+    }
+    cJSON_Delete(request);
+    if (ret == ESP_OK) {
+        s_commits++;
+    }
+    return ret;
+}
+
+int mock_firestore_count(void) {
+    return s_count;
+}
+
+int mock_firestore_commits(void) {
+    return s_commits;
+}
+
+const char *mock_firestore_name(int index) {
+    return (index >= 0 && index < s_count) ? s_documents[index].name : NULL;
+}
+
+const cJSON *mock_firestore_fields(int index) {
+    return (index >= 0 && index < s_count) ? s_documents[index].fields : NULL;
+}
+
+size_t mock_firestore_document_size(int index) {
+    const cJSON *fields = mock_firestore_fields(index);
+    char *text = fields ? cJSON_PrintUnformatted(fields) : NULL;
+    if (text == NULL) {
+        return 0;
+    }
+    size_t size = strlen("{\"fields\":}") + strlen(text);
+    cJSON_free(text);
+    return size;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Remove all documents from the mock
+ */
+void mock_firestore_reset(void);
+
+/**
+ * @brief Apply a Firestore commit request like the server does
+ *
+ * Supports update writes with an update mask and appendMissingElements
+ * transforms, the parts of the commit API the firmware uses. Requests the
+ * server would reject, e.g. an update field missing from the mask, fail.
+ *
+ * @param body Commit request
+ * @param length Length of the request
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the request is invalid
+ */
+esp_err_t mock_firestore_commit(const char *body, size_t length);
+
+/**
+ * @brief Number of documents in the mock
+ *
+ * @return int Number of documents
+ */
+int mock_firestore_count(void);
+
+/**
+ * @brief Number of commit requests applied since mock_firestore_reset()
+ *
+ * @return int Number of commits
+ */
+int mock_firestore_commits(void);
+
+/**
+ * @brief Name of a document
+ *
+ * @param index Document index, 0 to mock_firestore_count() - 1
+ * @return const char* Full document name owned by the mock, NULL if index is out of range
+ */
+const char *mock_firestore_name(int index);
+
+/**
+ * @brief Fields of a document
+ *
+ * @param index Document index, 0 to mock_firestore_count() - 1
+ * @return const cJSON* Fields object owned by the mock, NULL if index is out of range
+ */
+const cJSON *mock_firestore_fields(int index);
+
+/**
+ * @brief Size of a whole document as sent by a PATCH of all its fields
+ *
+ * @param index Document index
+ * @return size_t Size in bytes
+ */
+size_t mock_firestore_document_size(int index);
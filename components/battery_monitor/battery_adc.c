@@ -0,0 +1,74 @@
+// battery_adc.c
+// ADC oneshot backend of the battery monitor
+#include "battery_adc.h"
+#include "esp_log.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+
+#define BAT_ADC_UNIT        ADC_UNIT_1
+#define BAT_ADC_CHANNEL     ADC_CHANNEL_7  // GPIO 35
+#define BAT_ADC_ATTEN       ADC_ATTEN_DB_12
+#define BAT_ADC_BITWIDTH    ADC_BITWIDTH_12
+
+static const char *TAG = "BATTERY_ADC";
+
+static adc_oneshot_unit_handle_t adc1_handle;
+static adc_cali_handle_t cali_handle = NULL;
+
+// Calibration from the eFuse values, curve fitting on the newer chips and line fitting on the ESP32
+static esp_err_t battery_cali_init(void) {
+    esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t cali_config = {
+        .unit_id = BAT_ADC_UNIT,
+        .chan = BAT_ADC_CHANNEL,
+        .atten = BAT_ADC_ATTEN,
+        .bitwidth = BAT_ADC_BITWIDTH,
+    };
+    ret = adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_line_fitting_config_t cali_config = {
+        .unit_id = BAT_ADC_UNIT,
+        .atten = BAT_ADC_ATTEN,
+        .bitwidth = BAT_ADC_BITWIDTH,
+    };
+    ret = adc_cali_create_scheme_line_fitting(&cali_config, &cali_handle);
+#endif
+    return ret;
+}
+
+esp_err_t battery_adc_init(void) {
+    // ADC initialization
+    adc_oneshot_unit_init_cfg_t init_config = {
+        .unit_id = BAT_ADC_UNIT,
+    };
+    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &adc1_handle));
+    
+    // Channel configuration
+    adc_oneshot_chan_cfg_t config = {
+        .bitwidth = BAT_ADC_BITWIDTH,
+        .atten = BAT_ADC_ATTEN,
+    };
+    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, BAT_ADC_CHANNEL, &config));
+    
+    // Without eFuse values the readings use the linear scale
+    esp_err_t ret = battery_cali_init();
+    if (ret != ESP_OK) {
+        cali_handle = NULL;
+        ESP_LOGW(TAG, "ADC calibration not available (%s), using the linear scale", esp_err_to_name(ret));
+    }
+    return ESP_OK;
+}
+
+esp_err_t battery_adc_read_raw(int *raw) {
+    return adc_oneshot_read(adc1_handle, BAT_ADC_CHANNEL, raw);
+}
+
+esp_err_t battery_adc_raw_to_mv(int raw, int *pin_mv) {
+    if (cali_handle != NULL) {
+        return adc_cali_raw_to_voltage(cali_handle, raw, pin_mv);
+    }
+    *pin_mv = raw * BAT_ADC_FULL_MV / BAT_ADC_MAX_RAW;
+    return ESP_OK;
+}
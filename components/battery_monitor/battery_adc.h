@@ -0,0 +1,36 @@
+// battery_adc.h
+// ADC backend of the battery monitor. The ADC oneshot driver on the device,
+// a simulated discharge curve in the Linux target build.
+#pragma once
+
+#include "esp_err.h"
+
+#define BAT_ADC_MAX_RAW     4095    // 12-bit reading
+#define BAT_ADC_FULL_MV     3300    // Voltage at BAT_ADC_MAX_RAW without calibration
+
+/**
+ * @brief Initialize the battery ADC channel and its calibration
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t battery_adc_init(void);
+
+/**
+ * @brief Read the raw value of the battery ADC channel
+ *
+ * @param raw Pointer to store the raw value (0 - BAT_ADC_MAX_RAW)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t battery_adc_read_raw(int *raw);
+
+/**
+ * @brief Convert a raw value to the voltage at the ADC pin
+ *
+ * Uses the eFuse calibration of the chip when it is available, otherwise
+ * the linear BAT_ADC_FULL_MV / BAT_ADC_MAX_RAW scale.
+ *
+ * @param raw Raw value, may be an average of several readings
+ * @param pin_mv Pointer to store the voltage in millivolts
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t battery_adc_raw_to_mv(int raw, int *pin_mv);
@@ -0,0 +1,77 @@
+// battery_adc_sim.c
+// Fake battery ADC for the Linux target. The battery starts at SIM_BATTERY_MV
+// (default 4000 mV) and drops by SIM_BATTERY_DROP_UV microvolts per reading.
+// SIM_BATTERY_NOISE_MV adds noise at the pin and SIM_BATTERY_SPIKE_PERCENT
+// turns that share of the readings into full scale or zero spikes.
+#include "battery_adc.h"
+#include "battery_monitor.h"
+#include "esp_log.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+static const char *TAG = "BATTERY_SIM";
+
+static int64_t s_battery_uv = 0;
+static int64_t s_drop_uv = 0;
+static int s_noise_mv = 0;
+static int s_spike_percent = 0;
+static uint32_t s_noise_state = 1;
+static uint32_t s_reads = 0;
+
+// Read an integer from the environment
+static long env_long(const char *name, long default_value) {
+    const char *value = getenv(name);
+    return value ? strtol(value, NULL, 10) : default_value;
+}
+
+// Deterministic noise source, the same readings on every run
+static uint32_t noise_next(void) {
+    s_noise_state = s_noise_state * 1664525u + 1013904223u;
+    return s_noise_state >> 8;
+}
+
+esp_err_t battery_adc_init(void) {
+    if (s_battery_uv == 0) {
+        s_battery_uv = env_long("SIM_BATTERY_MV", 4000) * 1000;
+        s_drop_uv = env_long("SIM_BATTERY_DROP_UV", 1);
+        s_noise_mv = (int)env_long("SIM_BATTERY_NOISE_MV", 0);
+        s_spike_percent = (int)env_long("SIM_BATTERY_SPIKE_PERCENT", 0);
+        ESP_LOGI(TAG, "Simulated battery at %lld mV", (long long)(s_battery_uv / 1000));
+    }
+    return ESP_OK;
+}
+
+esp_err_t battery_adc_read_raw(int *raw) {
+    // The divider halves the battery voltage at the ADC pin
+    int64_t pin_mv = s_battery_uv / 2000;
+    if (s_noise_mv > 0) {
+        pin_mv += (int64_t)(noise_next() % (2 * s_noise_mv + 1)) - s_noise_mv;
+    }
+    int value = (int)(pin_mv * BAT_ADC_MAX_RAW / BAT_ADC_FULL_MV);
+    value = (value < 0) ? 0 : (value > BAT_ADC_MAX_RAW) ? BAT_ADC_MAX_RAW : value;
+    if (s_spike_percent > 0 && (int)(noise_next() % 100) < s_spike_percent) {
+        value = (noise_next() & 1) ? BAT_ADC_MAX_RAW : 0;
+    }
+    *raw = value;
+
+    s_battery_uv -= s_drop_uv;
+    s_reads++;
+    return ESP_OK;
+}
+
+esp_err_t battery_adc_raw_to_mv(int raw, int *pin_mv) {
+    *pin_mv = raw * BAT_ADC_FULL_MV / BAT_ADC_MAX_RAW;
+    return ESP_OK;
+}
+
+void battery_monitor_sim_set(uint32_t battery_mv, int noise_mv, int spike_percent) {
+    s_battery_uv = (int64_t)battery_mv * 1000;
+    s_drop_uv = 0;
+    s_noise_mv = noise_mv;
+    s_spike_percent = spike_percent;
+    s_noise_state = 1;
+}
+
+uint32_t battery_monitor_sim_reads(void) {
+    return s_reads;
+}
@@ -0,0 +1,79 @@
+// battery_model.c
+// Median filter and Li-ion discharge table of the battery monitor
+#include "battery_model.h"
+
+// Open circuit voltage of a Li-ion cell at rest and the remaining charge,
+// BATTERY_CURVE(mv, percent) in falling voltage order
+#define BATTERY_CURVE(X) \
+    X(4200, 100) \
+    X(4150,  95) \
+    X(4110,  90) \
+    X(4080,  85) \
+    X(4020,  80) \
+    X(3980,  75) \
+    X(3950,  70) \
+    X(3910,  65) \
+    X(3870,  60) \
+    X(3850,  55) \
+    X(3840,  50) \
+    X(3820,  45) \
+    X(3800,  40) \
+    X(3790,  35) \
+    X(3770,  30) \
+    X(3750,  25) \
+    X(3730,  20) \
+    X(3710,  15) \
+    X(3690,  10) \
+    X(3610,   5) \
+    X(3300,   0)
+
+typedef struct {
+    uint16_t mv;
+    uint8_t percent;
+} curve_point_t;
+
+static const curve_point_t s_curve[] = {
+#define CURVE_POINT(mv, percent) { mv, percent },
+    BATTERY_CURVE(CURVE_POINT)
+#undef CURVE_POINT
+};
+
+#define CURVE_POINTS (sizeof(s_curve) / sizeof(s_curve[0]))
+
+// Insertion sort, then the mean of the middle half
+uint32_t battery_model_filter(uint32_t *values, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        uint32_t value = values[i];
+        size_t j = i;
+        while (j > 0 && values[j - 1] > value) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+
+    size_t first = count / 4;
+    size_t last = count - count / 4;
+    uint64_t sum = 0;
+    for (size_t i = first; i < last; i++) {
+        sum += values[i];
+    }
+    return (uint32_t)((sum + (last - first) / 2) / (last - first));
+}
+
+// Linear interpolation between the two table points around the voltage
+int battery_model_level(uint32_t voltage_mv) {
+    if (voltage_mv >= s_curve[0].mv) {
+        return s_curve[0].percent;
+    }
+    for (size_t i = 1; i < CURVE_POINTS; i++) {
+        const curve_point_t *high = &s_curve[i - 1];
+        const curve_point_t *low = &s_curve[i];
+        if (voltage_mv >= low->mv) {
+            uint32_t span_mv = high->mv - low->mv;
+            uint32_t above_mv = voltage_mv - low->mv;
+            return low->percent + (int)((above_mv * (high->percent - low->percent) + span_mv / 2) / span_mv);
+        }
+    }
+    return s_curve[CURVE_POINTS - 1].percent;
+}
@@ -1,61 +1,67 @@
 #include "battery_monitor.h"
+#include <stdbool.h>
 #include "esp_log.h"
-#include "esp_adc/adc_oneshot.h"
+#include "battery_adc.h"
+#include "battery_model.h"
 
 static const char *TAG = "BATTERY";
 
-#define BAT_ADC_UNIT        ADC_UNIT_1
-#define BAT_ADC_CHANNEL     ADC_CHANNEL_7  // GPIO 35
-#define BAT_ADC_ATTEN       ADC_ATTEN_DB_12
-#define BAT_ADC_BITWIDTH    ADC_BITWIDTH_12
-#define BATT_MIN_MV         3300        // Minimum voltage (3V)
-#define BATT_MAX_MV         4050        // Maximum voltage (4.05V)
+#define BATT_SAMPLES        64          // Raw ADC samples of one measurement
+#define BATT_DIVIDER        2           // The 1:1 voltage divider halves the battery voltage
 
-static adc_oneshot_unit_handle_t adc1_handle;
+// Measurement of this cycle
+static battery_info_t s_battery;
+static bool s_measured = false;
 
 esp_err_t battery_monitor_init(void) {
     // ADC initialization
-    adc_oneshot_unit_init_cfg_t init_config = {
-        .unit_id = BAT_ADC_UNIT,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &adc1_handle));
-    
-    // Channel configuration
-    adc_oneshot_chan_cfg_t config = {
-        .bitwidth = BAT_ADC_BITWIDTH,
-        .atten = BAT_ADC_ATTEN,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, BAT_ADC_CHANNEL, &config));
-    
+    ESP_ERROR_CHECK(battery_adc_init());
+
     ESP_LOGI(TAG, "Battery monitor initialized");
     return ESP_OK;
 }
 
+esp_err_t battery_monitor_update(void) {
+    uint32_t samples[BATT_SAMPLES];
+    for (int i = 0; i < BATT_SAMPLES; i++) {
+        int raw;
+        esp_err_t ret = battery_adc_read_raw(&raw);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Battery ADC read failed: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        samples[i] = (uint32_t)raw;
+    }
+
+    // Spikes are dropped before the averaging, the calibration is applied once to the result
+    int pin_mv;
+    esp_err_t ret = battery_adc_raw_to_mv((int)battery_model_filter(samples, BATT_SAMPLES), &pin_mv);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Battery ADC conversion failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_battery.voltage_mv = (pin_mv > 0) ? (uint32_t)pin_mv * BATT_DIVIDER : 0;
+    s_battery.level = battery_model_level(s_battery.voltage_mv);
+    s_measured = true;
+
+    ESP_LOGI(TAG, "Battery: %lu mV, Level: %d%%", (unsigned long)s_battery.voltage_mv, s_battery.level);
+    return ESP_OK;
+}
+
 esp_err_t battery_monitor_read(battery_info_t *info) {
     if (info == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    
-    // Read ADC value
-    int adc_raw;
-    ESP_ERROR_CHECK(adc_oneshot_read(adc1_handle, BAT_ADC_CHANNEL, &adc_raw));
-    
-    // Simple conversion without calibration (approximate)
-    // For ADC_ATTEN_DB_11 maximum value is approximately 3.3V
-    uint32_t voltage_mv = (adc_raw * 3300) / 4095;
-    
-    // Multiply by 2 if using a 1:1 voltage divider
-    voltage_mv *= 2;
-    
-    // Calculate battery percentage
-    int percent = (voltage_mv - BATT_MIN_MV) * 100 / (BATT_MAX_MV - BATT_MIN_MV);
-    if (percent < 0) percent = 0;
-    if (percent > 100) percent = 100;
-    
-    // Fill the structure
-    info->voltage_mv = voltage_mv;
-    info->level = percent;
-    
-    ESP_LOGI(TAG, "Battery: %lu mV, Level: %d%%", voltage_mv, percent);
+
+    // Measured once per cycle, later calls get the same values
+    if (!s_measured) {
+        esp_err_t ret = battery_monitor_update();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    *info = s_battery;
     return ESP_OK;
-} 
\ No newline at end of file
+}
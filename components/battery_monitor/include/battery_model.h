@@ -0,0 +1,40 @@
+// battery_model.h
+// Filtering and charge model of the battery measurement. Plain integer math
+// without driver calls, so the host benchmark runs it against a fake ADC.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Median filter of a set of readings
+ *
+ * Sorts the readings and returns the mean of the middle half, the
+ * median band. Spikes in up to a quarter of the readings on either side do
+ * not move the result and the averaging keeps the oversampling gain.
+ *
+ * @param values Readings, sorted by the call
+ * @param count Number of readings, at least 1
+ * @return uint32_t Filtered value
+ */
+uint32_t battery_model_filter(uint32_t *values, size_t count);
+
+/**
+ * @brief Battery level of a Li-ion cell at rest
+ *
+ * Interpolates the open circuit voltage table of a single Li-ion cell. The
+ * curve is flat between 3.75 V and 3.95 V, so a linear map would put the
+ * middle of the charge too low.
+ *
+ * @param voltage_mv Battery voltage in millivolts
+ * @return int Level in percent (0-100)
+ */
+int battery_model_level(uint32_t voltage_mv);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <stdint.h>
 #include "esp_err.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,14 +23,48 @@ typedef struct {
  */
 esp_err_t battery_monitor_init(void);
 
+/**
+ * @brief Measure the battery for this cycle
+ *
+ * Takes 64 ADC samples, averages the middle half of them, converts the
+ * result with the ADC calibration and the level with the Li-ion discharge
+ * table. Called once per wake cycle before the modem draws current.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t battery_monitor_update(void);
+
 /**
  * @brief Read current battery status
+ *
+ * Returns the measurement of battery_monitor_update(), the first call
+ * measures if the cycle has not done it yet.
  * 
  * @param info Pointer to structure to store battery information
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t battery_monitor_read(battery_info_t *info);
 
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Set the simulated battery
+ *
+ * The voltage stays constant until the next call.
+ *
+ * @param battery_mv Battery voltage in millivolts
+ * @param noise_mv Noise amplitude at the ADC pin in millivolts
+ * @param spike_percent Share of raw samples replaced by a full scale or zero spike
+ */
+void battery_monitor_sim_set(uint32_t battery_mv, int noise_mv, int spike_percent);
+
+/**
+ * @brief Raw ADC samples taken since the start
+ *
+ * @return uint32_t Number of samples
+ */
+uint32_t battery_monitor_sim_reads(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif 
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef CONFIG_MANAGER_H
 #define CONFIG_MANAGER_H
 
+#include "sdkconfig.h"
+
 // Global logging definitions
 #define DISCORD_LOGGING true
 #define SYSTEM_LOGGING false
@@ -9,6 +11,88 @@
 #define SECONDS_IN_MICROS 1000000ULL
 #define SEND_DATA_CYCLE 144  // For testing 3
 #define TRIGGER_INTERVAL    (600 * SECONDS_IN_MICROS) // defined in seconds (600 seconds)
-#define COMPENSATION_INTERVAL    (4.16666 * SECONDS_IN_MICROS)
+
+// Wake planner, wakes are aligned to multiples of TRIGGER_INTERVAL since the epoch
+#define WAKE_MIN_SLEEP_MS 10000             // A slot closer than this after the cycle is skipped
+#define WAKE_DRIFT_MIN_SLEEP_S (6 * 3600)   // Sleep between time syncs before the drift is measured, the network time has 1 s steps
+#define WAKE_DRIFT_MAX_PPM 50000            // The 150 kHz RC oscillator is within 5 %, more is a clock jump
+#define WAKE_DRIFT_WEIGHT 4                 // Moving average over about 4 time syncs
+
+// Send scheduler defaults, each one can be overridden in the "scheduler" NVS namespace
+#define SCHED_MIN_CYCLES 36                 // Earliest early upload (6 hours)
+#define SCHED_EARLY_BYTES (32 * 1024)       // Pending bytes that allow an early upload on a good link
+#define SCHED_FULL_BYTES (512 * 1024)       // Pending bytes that force an upload (half of the 1 MB SPIFFS)
+#define SCHED_GOOD_CSQ 18                   // AT+CSQ at or above this is a good link (about -77 dBm)
+#define SCHED_LOW_BATTERY 30                // Battery % below which uploads are stretched
+#define SCHED_CRITICAL_BATTERY 10           // Battery % below which only a full file is uploaded
+#define SCHED_LOW_BATTERY_FACTOR 3          // Upload interval multiplier on a low battery
+#define SCHED_EXPENSIVE_UPLOAD_MS 90000     // Average upload time above which the link is treated as poor
+
+// Upload pipeline
+#define UPLOAD_MAX_IN_FLIGHT 2  // Sensor files read ahead of the upload (file buffers in memory)
+#define UPLOAD_MAX_BATCH_FILES 4  // Day files of one sensor sent in one commit request
+
+// Firestore document format
+#define FIRESTORE_TYPED_VALUES 1        // doubleValue/integerValue/timestampValue, 0 keeps stringValue for older consumers
+
+// JSON arena
+#define JSON_ARENA_CHUNK_SIZE 4096      // Arena grows in chunks of this size, larger blocks get their own chunk
+
+// Discord log delivery
+#define DISCORD_MESSAGE_LIMIT 2000      // Discord message length limit in characters
+#define DISCORD_LOG_MAX_MESSAGES 8      // Log messages sent per cycle, the rest waits for the next cycle
+#define DISCORD_LOG_MAX_WAIT_MS 15000   // Longest rate limit wait accepted before giving up for this cycle
+
+// Firmware update, the delta is downloaded in range requests over several send cycles
+#define OTA_CHECK_INTERVAL_S (24 * 3600)    // Time between checks for a delta of the running image
+#define OTA_RANGE_BYTES (16 * 1024)         // Delta bytes per range request, a failed request repeats at most this
+#define OTA_CYCLE_BYTES (256 * 1024)        // Delta bytes per send cycle, the rest resumes in the next one
+
+// Wake cycle stage budgets, a stage is aborted when its budget runs out and the
+// task watchdog restarts the device if the stage has not returned after the grace time
+#define STAGE_BUDGET_SCAN_MS 45000          // Three scan attempts of 10 seconds
+#define STAGE_BUDGET_PERSIST_MS 5000
+#define STAGE_BUDGET_DECIDE_MS 5000
+#define STAGE_BUDGET_CONNECT_MS 120000      // Modem boot, SIM check, registration and PPP
+#define STAGE_BUDGET_SYNC_TIME_MS 20000
+#define STAGE_BUDGET_UPLOAD_MS 240000
+#define STAGE_BUDGET_REPORT_MS 60000
+#define STAGE_BUDGET_OTA_MS 180000          // OTA_CYCLE_BYTES over a slow link
+#define STAGE_BUDGET_LOGS_MS 120000
+#define STAGE_BUDGET_SLEEP_MS 20000         // Modem power down and log flush
+#define STAGE_WATCHDOG_GRACE_MS 30000       // An aborted AT command can still take 3 x 10 seconds
+
+// Dynamic frequency scaling, the power profiles choose the frequency within the range
+#define POWER_MAX_FREQ_MHZ 240          // RSA signing, TLS handshakes and JSON encoding
+#define POWER_MIN_FREQ_MHZ 40           // Waits for BLE advertisements and modem responses
+
+// Phase profiler current estimates
+#define PHASE_CURRENT_CPU_MA 30         // ESP32 at 80 MHz with radio off
+#define PHASE_CURRENT_RADIO_MA 100      // BLE scanning, on top of the CPU
+#define PHASE_CURRENT_MODEM_MA 150      // A7670E average with LTE data, on top of the CPU
+
+// Energy ledger
+#define BATTERY_CAPACITY_MAH 2000           // Nominal capacity of the cell
+#define ENERGY_SLEEP_CURRENT_UA 150         // Deep sleep with the modem powered off
+#define ENERGY_CURRENT_ERROR_PERCENT 20     // Error of the phase current estimates
+#define ENERGY_DRIFT_MAH_PER_HOUR 3         // Uncounted charge per hour: solar input and self discharge
+#define ENERGY_VOLTAGE_SIGMA_MV 15          // Error of the rest voltage: ADC, load and temperature
+#define ENERGY_NVS_INTERVAL 36              // Cycles between the NVS copies of the ledger
+
+// Host simulation: the scan waits and the simulated BLE and modem delays run this many times
+// faster than on the device, the SIM_TIME_SCALE environment variable overrides it (1 is real time)
+#define SIM_TIME_SCALE 100
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <stdint.h>
+#include <stdlib.h>
+
+// Real milliseconds of a wait on the simulated clock
+static inline uint32_t sim_scaled_ms(uint32_t ms) {
+    const char *env = getenv("SIM_TIME_SCALE");
+    long scale = env ? atol(env) : SIM_TIME_SCALE;
+    return (scale > 1) ? (uint32_t)(ms / scale) : ms;
+}
+#endif
 
 #endif /* CONFIG_MANAGER_H */ 
\ No newline at end of file
@@ -0,0 +1,217 @@
+// components/cycle_pipeline/cycle_pipeline.c
+#include "cycle_pipeline.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "system_states.h"
+#include "storage.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#endif
+
+static const char *TAG = "CYCLE";
+
+static const char *const s_stage_names[CYCLE_STAGE_COUNT] = {
+    [CYCLE_STAGE_NONE] = "none",
+#define CYCLE_STAGE_NAME(id, stored, name, flags, budget_ms) [id] = name,
+    CYCLE_STAGES(CYCLE_STAGE_NAME)
+#undef CYCLE_STAGE_NAME
+};
+
+static const uint8_t s_stage_flags[CYCLE_STAGE_COUNT] = {
+#define CYCLE_STAGE_FLAGS(id, stored, name, flags, budget_ms) [id] = (flags),
+    CYCLE_STAGES(CYCLE_STAGE_FLAGS)
+#undef CYCLE_STAGE_FLAGS
+};
+
+static const uint32_t s_stage_budgets[CYCLE_STAGE_COUNT] = {
+#define CYCLE_STAGE_BUDGET(id, stored, name, flags, budget_ms) [id] = (budget_ms),
+    CYCLE_STAGES(CYCLE_STAGE_BUDGET)
+#undef CYCLE_STAGE_BUDGET
+};
+
+// Execution order, the stored IDs are not in order
+static const cycle_stage_t s_stage_order[] = {
+#define CYCLE_STAGE_ORDER(id, stored, name, flags, budget_ms) id,
+    CYCLE_STAGES(CYCLE_STAGE_ORDER)
+#undef CYCLE_STAGE_ORDER
+};
+#define CYCLE_STAGE_RUN_COUNT   (int)(sizeof(s_stage_order) / sizeof(s_stage_order[0]))
+
+// Position of a stage in the execution order from 1, 0 for no stage and unused IDs
+static uint8_t s_stage_position[CYCLE_STAGE_COUNT];
+
+// Deadline of the running stage
+static TimerHandle_t s_deadline_timer = NULL;
+static void (*volatile s_abort)(void) = NULL;
+static volatile bool s_expired = false;
+
+// Budget ran out, ask the stage to return
+static void deadline_expired(TimerHandle_t timer) {
+    s_expired = true;
+    void (*abort)(void) = s_abort;
+    if (abort != NULL) {
+        abort();
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+// Task watchdog timeout, a stage that ignores its deadline restarts the device
+static void watchdog_configure(uint32_t timeout_ms) {
+    esp_task_wdt_config_t config = {
+        .timeout_ms = timeout_ms,
+        .idle_core_mask = (1 << portNUM_PROCESSORS) - 1,
+        .trigger_panic = true,
+    };
+    esp_err_t ret = esp_task_wdt_reconfigure(&config);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        ret = esp_task_wdt_init(&config);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Task watchdog not configured: %s", esp_err_to_name(ret));
+    }
+}
+
+// The previous cycle was ended by a watchdog or a crash
+static bool reset_by_watchdog(void) {
+    switch (esp_reset_reason()) {
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_WDT:
+        case ESP_RST_PANIC:
+            return true;
+        default:
+            return false;
+    }
+}
+#endif
+
+// Arm the deadline and the watchdog for a stage
+static void supervisor_start(cycle_stage_t stage, void (*abort)(void)) {
+    s_expired = false;
+    s_abort = abort;
+    if (s_deadline_timer == NULL) {
+        s_deadline_timer = xTimerCreate("cycle_deadline", pdMS_TO_TICKS(s_stage_budgets[stage]),
+                                        pdFALSE, NULL, deadline_expired);
+    }
+    if (s_deadline_timer == NULL ||
+        xTimerChangePeriod(s_deadline_timer, pdMS_TO_TICKS(s_stage_budgets[stage]), portMAX_DELAY) != pdPASS) {
+        ESP_LOGW(TAG, "Stage %s runs without a deadline", s_stage_names[stage]);
+    }
+#if !CONFIG_IDF_TARGET_LINUX
+    watchdog_configure(s_stage_budgets[stage] + STAGE_WATCHDOG_GRACE_MS);
+    esp_task_wdt_reset();
+#endif
+}
+
+// Disarm the deadline, returns true if the stage ran out of its budget
+static bool supervisor_stop(void) {
+    if (s_deadline_timer != NULL) {
+        xTimerStop(s_deadline_timer, portMAX_DELAY);
+    }
+    s_abort = NULL;
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_task_wdt_reset();
+#endif
+    return s_expired;
+}
+
+bool cycle_stage_expired(void) {
+    return s_expired;
+}
+
+const char *cycle_stage_name(cycle_stage_t stage) {
+    return ((unsigned)stage < CYCLE_STAGE_COUNT && s_stage_names[stage] != NULL) ? s_stage_names[stage] : "none";
+}
+
+bool cycle_stage_pending(const cycle_context_t *ctx, cycle_stage_t stage) {
+    return s_stage_position[stage] >= s_stage_position[ctx->resumed] || (s_stage_flags[stage] & CYCLE_SESSION);
+}
+
+// Skip the stages finished before the reset and the ones that are not needed
+static bool stage_runs(const cycle_stage_ops_t *ops, const cycle_context_t *ctx, cycle_stage_t stage,
+                       bool skip_resumed) {
+    if (stage == ctx->resumed) {
+        return !skip_resumed;
+    }
+    if (!cycle_stage_pending(ctx, stage)) {
+        return false;
+    }
+    return ops->needed == NULL || ops->needed(ctx);
+}
+
+esp_err_t cycle_pipeline_run(const cycle_stage_ops_t ops[CYCLE_STAGE_COUNT], cycle_context_t *ctx) {
+    for (int i = 0; i < CYCLE_STAGE_RUN_COUNT; i++) {
+        s_stage_position[s_stage_order[i]] = (uint8_t)(i + 1);
+    }
+
+    uint8_t flags = 0;
+    uint8_t resumed = system_state_get_stage(&flags);
+    bool skip_resumed = false;
+
+    // An ID of another firmware that this one does not have starts the cycle over
+    ctx->resumed = (resumed < CYCLE_STAGE_COUNT && s_stage_position[resumed] != 0) ? (cycle_stage_t)resumed
+                                                                                   : CYCLE_STAGE_NONE;
+    ctx->flags = (ctx->resumed != CYCLE_STAGE_NONE) ? flags : 0;
+    ctx->stage = CYCLE_STAGE_NONE;
+    if (ctx->resumed != CYCLE_STAGE_NONE) {
+        ESP_LOGW(TAG, "Resuming at stage %s, flags 0x%02x", cycle_stage_name(ctx->resumed), ctx->flags);
+        storage_log(LOG_STAGE_RESUME, ctx->resumed, ctx->flags);
+#if !CONFIG_IDF_TARGET_LINUX
+        // The stage hung past its watchdog, running it again would hang again
+        skip_resumed = reset_by_watchdog() && ctx->resumed != CYCLE_STAGE_SLEEP;
+#endif
+        if (skip_resumed) {
+            ESP_LOGW(TAG, "Skipping stage %s, it was stopped by the watchdog", cycle_stage_name(ctx->resumed));
+            storage_log(LOG_STAGE_SKIPPED, ctx->resumed, ctx->flags);
+            ctx->flags |= CYCLE_FLAG_ERROR;
+        }
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_task_wdt_add(NULL);
+#endif
+
+    for (int i = 0; i < CYCLE_STAGE_RUN_COUNT; i++) {
+        cycle_stage_t stage = s_stage_order[i];
+        if (!stage_runs(&ops[stage], ctx, stage, skip_resumed)) {
+            continue;
+        }
+
+        // Resume point of this stage, committed before the stages that power the modem
+        ctx->stage = stage;
+        system_state_set_stage((uint8_t)stage, ctx->flags);
+        if ((s_stage_flags[stage] & CYCLE_DURABLE) && system_state_checkpoint() != ESP_OK) {
+            ESP_LOGW(TAG, "Stage %s starts without a stored resume point", s_stage_names[stage]);
+        }
+
+        ESP_LOGI(TAG, "Stage %s", s_stage_names[stage]);
+        TickType_t started = xTaskGetTickCount();
+        supervisor_start(stage, ops[stage].abort);
+        esp_err_t ret = ops[stage].run(ctx);
+        if (supervisor_stop()) {
+            uint32_t elapsed_ms = (uint32_t)((xTaskGetTickCount() - started) * portTICK_PERIOD_MS);
+            ESP_LOGW(TAG, "Stage %s aborted after %lu ms, budget %lu ms", s_stage_names[stage],
+                     (unsigned long)elapsed_ms, (unsigned long)s_stage_budgets[stage]);
+            storage_log(LOG_STAGE_TIMEOUT, stage, elapsed_ms, s_stage_budgets[stage]);
+            ctx->flags |= CYCLE_FLAG_ERROR;
+        } else if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Stage %s failed: %s", s_stage_names[stage], esp_err_to_name(ret));
+            storage_log(LOG_STAGE_FAILED, stage, ret);
+            ctx->flags |= CYCLE_FLAG_ERROR;
+        }
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_task_wdt_delete(NULL);
+    watchdog_configure(CONFIG_ESP_TASK_WDT_TIMEOUT_S * 1000);
+#endif
+
+    ctx->stage = CYCLE_STAGE_NONE;
+    system_state_set_stage(CYCLE_STAGE_NONE, 0);
+    return system_state_checkpoint();
+}
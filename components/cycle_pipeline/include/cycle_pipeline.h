@@ -0,0 +1,131 @@
+#ifndef CYCLE_PIPELINE_H
+#define CYCLE_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "config_manager.h"
+
+// Stage flags
+#define CYCLE_DURABLE   0x01    // The resume point is committed to NVS before the stage runs
+#define CYCLE_SESSION   0x02    // The result is lost on a reset, runs again after a resume if needed
+
+/**
+ * @brief Stages of a wake cycle in execution order
+ *
+ * CYCLE_STAGE(id, stored ID, name, flags, budget in ms). When a stage starts, its
+ * stored ID and the cycle flags are saved in the system state. After a reset the
+ * cycle resumes at the interrupted stage. Earlier stages are skipped, except
+ * session stages that a later stage needs. The stored IDs survive firmware
+ * updates: stages can be reordered, a new stage takes the next unused ID and
+ * the ID of a removed stage is not reused. A stored ID that the running
+ * firmware does not know starts the cycle from the beginning.
+ *
+ * The RTC copy of the system state keeps the resume point over a software
+ * reset. Durable stages power the modem, which can brown out the device,
+ * so the resume point is also committed to NVS. A stage that is interrupted
+ * by a power loss after a later non-durable stage starts, resumes at the
+ * last durable stage.
+ *
+ * A stage that runs out of its budget is aborted and the cycle continues
+ * with the next stages. If it does not return within
+ * STAGE_WATCHDOG_GRACE_MS, the task watchdog restarts the device and the
+ * resumed cycle skips the stage.
+ */
+#define CYCLE_STAGES(CYCLE_STAGE) \
+    CYCLE_STAGE(CYCLE_STAGE_SCAN,      1,  "scan",      0,                             STAGE_BUDGET_SCAN_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_PERSIST,   2,  "persist",   0,                             STAGE_BUDGET_PERSIST_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_DECIDE,    3,  "decide",    0,                             STAGE_BUDGET_DECIDE_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_CONNECT,   4,  "connect",   CYCLE_DURABLE | CYCLE_SESSION, STAGE_BUDGET_CONNECT_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_SYNC_TIME, 5,  "sync_time", CYCLE_SESSION,                 STAGE_BUDGET_SYNC_TIME_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_UPLOAD,    6,  "upload",    0,                             STAGE_BUDGET_UPLOAD_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_REPORT,    7,  "report",    0,                             STAGE_BUDGET_REPORT_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_OTA,       10, "ota",       0,                             STAGE_BUDGET_OTA_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_LOGS,      8,  "logs",      CYCLE_DURABLE,                 STAGE_BUDGET_LOGS_MS) \
+    CYCLE_STAGE(CYCLE_STAGE_SLEEP,     9,  "sleep",     0,                             STAGE_BUDGET_SLEEP_MS)
+
+/**
+ * @brief Stage IDs as stored, 0 means no stage
+ */
+typedef enum {
+    CYCLE_STAGE_NONE = 0,
+#define CYCLE_STAGE_ID(id, stored, name, flags, budget_ms) id = stored,
+    CYCLE_STAGES(CYCLE_STAGE_ID)
+#undef CYCLE_STAGE_ID
+} cycle_stage_t;
+
+// Size of the tables indexed by the stage ID, one more than the highest ID
+typedef union {
+#define CYCLE_STAGE_SLOT(id, stored, name, flags, budget_ms) char id[stored + 1];
+    CYCLE_STAGES(CYCLE_STAGE_SLOT)
+#undef CYCLE_STAGE_SLOT
+} cycle_stage_slots_t;
+#define CYCLE_STAGE_COUNT   ((int)sizeof(cycle_stage_slots_t))
+
+// Cycle flags, stored with the stage
+#define CYCLE_FLAG_SEND     0x01    // The stored data is uploaded in this cycle
+#define CYCLE_FLAG_SENT     0x02    // Stored data was sent
+#define CYCLE_FLAG_ERROR    0x04    // A stage failed, the logs are sent
+
+/**
+ * @brief State of the running cycle
+ */
+typedef struct {
+    uint8_t flags;              // CYCLE_FLAG_*
+    cycle_stage_t resumed;      // Stage interrupted by a reset, CYCLE_STAGE_NONE in a normal cycle
+    cycle_stage_t stage;        // Stage running
+} cycle_context_t;
+
+/**
+ * @brief Implementation of a stage
+ */
+typedef struct {
+    bool (*needed)(const cycle_context_t *ctx);     // NULL if the stage always runs
+    esp_err_t (*run)(cycle_context_t *ctx);         // Failure sets CYCLE_FLAG_ERROR
+    void (*abort)(void);                            // Called from the timer task when the budget runs out, may be NULL
+} cycle_stage_ops_t;
+
+/**
+ * @brief Run the stages of one wake cycle
+ *
+ * The interrupted stage always runs again, the others when they are
+ * needed. At the end the resume point is cleared and the system state is
+ * committed.
+ *
+ * @param ops Implementation of every stage, indexed by the stage ID. The
+ *            stages run in the order of CYCLE_STAGES.
+ * @param ctx Cycle state, filled by this function
+ * @return esp_err_t ESP_OK on success, error of the final commit otherwise
+ */
+esp_err_t cycle_pipeline_run(const cycle_stage_ops_t ops[CYCLE_STAGE_COUNT], cycle_context_t *ctx);
+
+/**
+ * @brief Check whether the running stage has used up its budget
+ *
+ * Long loops of a stage check this to give up in time.
+ *
+ * @return bool true if the stage should return
+ */
+bool cycle_stage_expired(void);
+
+/**
+ * @brief Check whether a stage can still run in this cycle
+ *
+ * After a resume the stages that run before the interrupted one were
+ * finished before the reset, except the session stages.
+ *
+ * @param ctx Cycle state
+ * @param stage Stage ID
+ * @return bool true if the stage runs when it is needed
+ */
+bool cycle_stage_pending(const cycle_context_t *ctx, cycle_stage_t stage);
+
+/**
+ * @brief Name of a stage for logs
+ *
+ * @param stage Stage ID
+ * @return const char* Name, "none" for CYCLE_STAGE_NONE and unknown IDs
+ */
+const char *cycle_stage_name(cycle_stage_t stage);
+
+#endif /* CYCLE_PIPELINE_H */
@@ -3,10 +3,15 @@
 #include "discord_config.h"
 #include "storage.h"
 #include "esp_http_client.h"
-#include "lwip/sockets.h"
+#include "https_client.h"
 #include "esp_log.h"
 #include "cJSON.h"
 #include "esp_tls.h"
+#include "config_manager.h"
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <stdlib.h>
 
 static const char *TAG = "discord_api";
 #define ESP_TLS_VER_TLS_1_2 0x0303 /* TLS 1.2 */
@@ -17,52 +22,56 @@ static struct {
     const char* channel_id{nullptr};
 } s_config;
 
+// Pooled Discord connection
+static https_client_handle_t s_discord = nullptr;
+
 static const discord_config_t config = {
     .bot_token = DISCORD_BOT_TOKEN,
     .channel_id = DISCORD_CHANNEL_ID
 };
 
-static esp_err_t discord_http_event_handler(esp_http_client_event_t *evt)
-{
-    switch (evt->event_id) {
-    case HTTP_EVENT_ERROR:
-        ESP_LOGE(TAG, "HTTP_EVENT_ERROR");
-        break;
-    case HTTP_EVENT_ON_CONNECTED:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_CONNECTED");
-        break;
-    case HTTP_EVENT_HEADERS_SENT:
-        ESP_LOGI(TAG, "HTTP_EVENT_HEADERS_SENT");
-        break;
-    case HTTP_EVENT_ON_HEADER:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_HEADER");
-        break;
-    case HTTP_EVENT_ON_DATA:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA");
-        break;
-    case HTTP_EVENT_ON_FINISH:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_FINISH");
-        break;
-    case HTTP_EVENT_DISCONNECTED:
-        ESP_LOGI(TAG, "HTTP_EVENT_DISCONNECTED");
-        break;
-    case HTTP_EVENT_REDIRECT:
-        ESP_LOGI(TAG, "HTTP_EVENT_REDIRECT");
-        break;
-    }
-    return ESP_OK;
-}
-
 esp_err_t discord_init(void) {
     ESP_LOGI(TAG, "Initializing Discord API for channel %s", config.channel_id);
     
+    // Get the pooled connection to Discord
+    https_client_host_config_t host_config = {};
+    host_config.host = DISCORD_HOST;
+    host_config.cert_pem = discord_root_cert;
+    host_config.rx_buffer_size = 2048;
+    host_config.tx_buffer_size = 2048;
+    host_config.timeout_ms = 10000;
+    
+    esp_err_t err = https_client_open(&host_config, &s_discord);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open Discord connection");
+        return err;
+    }
+
     s_config.bot_token = config.bot_token;
     s_config.channel_id = config.channel_id;
 
     return ESP_OK;
 }
 
+// Parse the rate limit headers of a response
+static void rate_limit_header_cb(void *ctx, const char *key, const char *value) {
+    discord_rate_limit_t *rate_limit = static_cast<discord_rate_limit_t *>(ctx);
+    
+    // Reset-After and Retry-After are given in seconds with a fraction
+    if (strcasecmp(key, "X-RateLimit-Remaining") == 0) {
+        rate_limit->remaining = atoi(value);
+    } else if (strcasecmp(key, "X-RateLimit-Reset-After") == 0) {
+        rate_limit->reset_after_ms = static_cast<uint32_t>(strtof(value, nullptr) * 1000.0f);
+    } else if (strcasecmp(key, "Retry-After") == 0) {
+        rate_limit->retry_after_ms = static_cast<uint32_t>(strtof(value, nullptr) * 1000.0f);
+    }
+}
+
 esp_err_t discord_send_message(const char *message) {
+    return discord_send_message_ex(message, nullptr);
+}
+
+esp_err_t discord_send_message_ex(const char *message, discord_rate_limit_t *rate_limit) {
     if (s_config.bot_token == NULL || s_config.channel_id == NULL) {
         ESP_LOGE(TAG, "Discord API not initialized inside discord_send_message");
         return ESP_ERR_INVALID_STATE;
@@ -80,16 +89,16 @@ esp_err_t discord_send_message(const char *message) {
     }
     
     // Note: Discord has a 2000 character limit for messages
-    // For longer messages use send_large_message_in_chunks in discord_tasks.c
+    // Logs are split below the limit by send_logs_with_task_retries in discord_tasks.c
     size_t msg_len = strlen(message);
-    if (msg_len > 2000) {
-        ESP_LOGW(TAG, "Message length (%d) exceeds Discord limit of 2000 characters. It may be truncated.", 
-                 msg_len);
+    if (msg_len > DISCORD_MESSAGE_LIMIT) {
+        ESP_LOGW(TAG, "Message length (%d) exceeds Discord limit of %d characters. It may be rejected.", 
+                 msg_len, DISCORD_MESSAGE_LIMIT);
     }
 
     // URL construction for API endpoint
     char url[128];
-    snprintf(url, sizeof(url), "https://discord.com/api/v10/channels/%s/messages", s_config.channel_id);
+    snprintf(url, sizeof(url), "https://%s/api/v10/channels/%s/messages", DISCORD_HOST, s_config.channel_id);
 
     ESP_LOGI(TAG, "Trying to connect to URL: %s", url);
 
@@ -119,76 +128,50 @@ esp_err_t discord_send_message(const char *message) {
     post_data_len = strlen(post_data);
     ESP_LOGI(TAG, "JSON data length: %d", post_data_len);
 
-    // HTTP client configuration
-    esp_http_client_config_t config = {};
-    config.url = url;
-    config.method = HTTP_METHOD_POST;
-    config.transport_type = HTTP_TRANSPORT_OVER_SSL;
-    config.cert_pem = discord_root_cert;
-    config.event_handler = discord_http_event_handler;
-    config.timeout_ms = 10000;
-    config.buffer_size = 2048;
-    config.port = 443;  // HTTPS port
-    config.tls_version = ESP_HTTP_CLIENT_TLS_VER_ANY;
-    
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (client == NULL) {
-        ESP_LOGE(TAG, "Failed to initialize HTTP client");
-        free(post_data);
-        cJSON_Delete(root);
-        return ESP_FAIL;
-    }
-
-    // Headers setup - protection from errors when setting headers
-    esp_err_t header_err = ESP_OK;
-    header_err = esp_http_client_set_header(client, "Content-Type", "application/json");
-    if (header_err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set Content-Type header: %s", esp_err_to_name(header_err));
-        free(post_data);
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
-    }
-    
     char auth_header[128];
     snprintf(auth_header, sizeof(auth_header), "Bot %s", s_config.bot_token);
-    header_err = esp_http_client_set_header(client, "Authorization", auth_header);
-    if (header_err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set Authorization header: %s", esp_err_to_name(header_err));
-        free(post_data);
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
-    }
-
-    // POST request sending with additional check
-    esp_err_t post_err = esp_http_client_set_post_field(client, post_data, post_data_len);
-    if (post_err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set post field: %s", esp_err_to_name(post_err));
-        free(post_data);
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
-    }
+    const https_client_header_t headers[] = {
+        {"Content-Type", "application/json"},
+        {"Authorization", auth_header},
+    };
+
+    https_client_request_t request = {};
+    request.method = HTTP_METHOD_POST;
+    request.url = url;
+    request.headers = headers;
+    request.header_count = sizeof(headers) / sizeof(headers[0]);
+    request.body = post_data;
+    request.body_len = post_data_len;
+    
+    discord_rate_limit_t limit = {};
+    limit.remaining = -1;
+    request.on_header = rate_limit_header_cb;
+    request.header_ctx = &limit;
     
     // Performing the request with exception protection
+    https_client_response_t response = {};
     esp_err_t err;
     try {
-        err = esp_http_client_perform(client);
+        err = https_client_request(s_discord, &request, &response);
     } catch (...) {
         ESP_LOGE(TAG, "Exception occurred during HTTP request");
         free(post_data);
         cJSON_Delete(root);
-        esp_http_client_cleanup(client);
         return ESP_FAIL;
     }
 
     if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
+        int status_code = response.status_code;
         ESP_LOGI(TAG, "HTTP POST Status = %d", status_code);
         
         if (status_code == 200 || status_code == 204) {
             ESP_LOGI(TAG, "Message sent successfully");
+        } else if (status_code == 429) {
+            ESP_LOGW(TAG, "Rate limited, retry after %" PRIu32 " ms", limit.retry_after_ms);
+            if (limit.retry_after_ms == 0) {
+                limit.retry_after_ms = (limit.reset_after_ms > 0) ? limit.reset_after_ms : 1000;
+            }
+            err = ESP_ERR_INVALID_STATE;
         } else {
             ESP_LOGE(TAG, "Failed to send message, status code: %d", status_code);
             err = ESP_FAIL;
@@ -197,10 +180,13 @@ esp_err_t discord_send_message(const char *message) {
         ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
     }
 
+    if (rate_limit != nullptr) {
+        *rate_limit = limit;
+    }
+
     // Freeing up resources
     free(post_data);
     cJSON_Delete(root);
-    esp_http_client_cleanup(client);
     
     return err;
 }
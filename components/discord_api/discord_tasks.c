@@ -11,15 +11,17 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "discord_api.h"
+#include "storage.h"
+#include "config_manager.h"
+#include "phase_profiler.h"
 
 static const char *TAG = "DISCORD_TASKS";
 
 // Function to clear log file
 esp_err_t clear_discord_logs(void) {
-    const char* LOG_FILE = "/spiffs/debug_log.txt";
     ESP_LOGI(TAG, "Clearing log file");
     
-    if (unlink(LOG_FILE) == 0) {
+    if (storage_clear_logs() == ESP_OK) {
         ESP_LOGI(TAG, "Log file cleared successfully");
         return ESP_OK;
     } else {
@@ -30,7 +32,7 @@ esp_err_t clear_discord_logs(void) {
 
 // Discord message sending task structure
 typedef struct {
-    char message[4096]; 
+    char *message;
     SemaphoreHandle_t done_semaphore;
     esp_err_t result;
 } discord_task_data_t;
@@ -42,7 +44,9 @@ static void discord_send_task(void *pvParameters) {
     ESP_LOGI(TAG, "Discord send task started, message length: %d", strlen(task_data->message));
     
     // Send the message
+    phase_begin(PHASE_DISCORD);
     task_data->result = discord_send_message(task_data->message);
+    phase_end(PHASE_DISCORD);
     
     // Signal completion
     xSemaphoreGive(task_data->done_semaphore);
@@ -69,17 +73,14 @@ esp_err_t discord_send_message_safe(const char *message) {
     }
     
     // Copy message to task data
-    size_t msg_len = strlen(message);
-    size_t max_copy = sizeof(task_data->message) - 1;
-    
-    if (msg_len > max_copy) {
-        ESP_LOGW(TAG, "Message length (%zu) exceeds buffer size (%zu), will be truncated", 
-                  msg_len, max_copy);
+    task_data->message = strdup(message);
+    if (task_data->message == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for message");
+        vSemaphoreDelete(task_data->done_semaphore);
+        free(task_data);
+        return ESP_ERR_NO_MEM;
     }
     
-    strncpy(task_data->message, message, max_copy);
-    task_data->message[max_copy] = '\0'; // Ensure null terminator
-    
     // Create task with larger stack
     BaseType_t task_created = xTaskCreate(
         discord_send_task,
@@ -93,6 +94,7 @@ esp_err_t discord_send_message_safe(const char *message) {
     if (task_created != pdPASS) {
         ESP_LOGE(TAG, "Failed to create Discord send task");
         vSemaphoreDelete(task_data->done_semaphore);
+        free(task_data->message);
         free(task_data);
         return ESP_ERR_NO_MEM;
     }
@@ -116,6 +118,7 @@ esp_err_t discord_send_message_safe(const char *message) {
     
     // Clean up
     vSemaphoreDelete(task_data->done_semaphore);
+    free(task_data->message);
     free(task_data);
     
     return result;
@@ -139,39 +142,203 @@ esp_err_t send_measurements_with_task_retries(const char* measurements, int max_
     return ret;
 }
 
-// Function to send logs with retries using a separate task
-esp_err_t send_logs_with_task_retries(int max_retries) {
+#define LOG_WINDOW_RECORDS 32    // Log records read from flash at a time
+
+// Log shipping task structure
+typedef struct {
+    int max_retries;
+    SemaphoreHandle_t done_semaphore;
+    esp_err_t result;
+} discord_log_task_data_t;
+
+// Send one log message, waiting for the rate limit and backing off on failures
+static esp_err_t send_log_message(const char *message, int max_retries, uint32_t *wait_ms) {
     esp_err_t ret = ESP_FAIL;
     
-    // Logs receiving - using the external function from storage component
-    extern char* storage_get_logs(void);
-    char* logs = storage_get_logs();
-    if (logs == NULL) {
-        ESP_LOGW(TAG, "No logs to send (NULL returned)");
-        return ESP_OK; 
+    for (int i = 0; i < max_retries; i++) {
+        // Wait scheduled by the rate limit or by the previous failure
+        if (*wait_ms > 0) {
+            if (*wait_ms > DISCORD_LOG_MAX_WAIT_MS) {
+                ESP_LOGW(TAG, "Rate limit wait of %lu ms is too long, keeping logs for the next cycle",
+                         (unsigned long)*wait_ms);
+                return ESP_ERR_TIMEOUT;
+            }
+            vTaskDelay(pdMS_TO_TICKS(*wait_ms));
+            *wait_ms = 0;
+        }
+        
+        discord_rate_limit_t rate_limit = { .remaining = -1 };
+        ret = discord_send_message_ex(message, &rate_limit);
+        if (ret == ESP_OK) {
+            // Bucket is empty, the next message has to wait for the reset
+            if (rate_limit.remaining == 0) {
+                *wait_ms = rate_limit.reset_after_ms;
+            }
+            return ESP_OK;
+        }
+        
+        if (ret == ESP_ERR_INVALID_STATE && rate_limit.retry_after_ms > 0) {
+            *wait_ms = rate_limit.retry_after_ms;
+        } else {
+            *wait_ms = 1000UL << i;
+        }
+        ESP_LOGI(TAG, "Failed to send logs, retrying in %lu ms (%d/%d)", (unsigned long)*wait_ms, i+1, max_retries);
     }
     
-    ESP_LOGI(TAG, "Retrieved logs: length=%d bytes", strlen(logs));
+    return ret;
+}
+
+// Ship the stored log in messages below the Discord limit
+static esp_err_t ship_logs(int max_retries) {
+    storage_log_flush();
     
-    for (int i = 0; i < max_retries; i++) {
-        // Sending logs using task 
-        ret = discord_send_message_safe(logs);
-        if (ret == ESP_OK) {
-            // Clearing the log file after successful sending
-            ESP_LOGI(TAG, "Successfully sent logs");
-            ret = clear_discord_logs();
+    uint32_t seq, end_seq;
+    if (storage_log_get_range(&seq, &end_seq) != ESP_OK || seq == end_seq) {
+        ESP_LOGW(TAG, "No logs to send");
+        return ESP_OK;
+    }
+    
+    ESP_LOGI(TAG, "Sending %lu log records", (unsigned long)(end_seq - seq));
+    
+    storage_log_record_t *window = malloc(LOG_WINDOW_RECORDS * sizeof(storage_log_record_t));
+    char *message = malloc(DISCORD_MESSAGE_LIMIT + 1);
+    if (window == NULL || message == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for logs");
+        free(window);
+        free(message);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    uint32_t wait_ms = 0;
+    size_t window_count = 0;
+    size_t window_pos = 0;
+    int sent = 0;
+    
+    while (seq != end_seq && sent < DISCORD_LOG_MAX_MESSAGES) {
+        // Fill the message with whole lines, msg_end is the first record not included
+        uint32_t msg_end = seq;
+        size_t len = 0;
+        message[0] = '\0';
+        
+        while (msg_end != end_seq) {
+            // Keep a whole text message in the window unless the log ends earlier
+            if (window_count - window_pos < STORAGE_LOG_MAX_TEXT_RECORDS &&
+                msg_end + (window_count - window_pos) != end_seq) {
+                uint32_t first_seq;
+                ret = storage_log_read(msg_end, window, LOG_WINDOW_RECORDS, &window_count, &first_seq);
+                if (ret != ESP_OK || window_count == 0) {
+                    break;
+                }
+                msg_end = first_seq;
+                window_pos = 0;
+            }
+            
+            size_t used = 0;
+            int line_len = storage_log_decode_line(&window[window_pos], window_count - window_pos, &used,
+                                                   message + len, DISCORD_MESSAGE_LIMIT + 1 - len);
+            if (line_len < 0) {
+                if (len > 0) {
+                    break;  // Message is full
+                }
+                used = 1;   // Single line longer than a message, skip its record
+                line_len = 0;
+            }
+            
+            len += line_len;
+            window_pos += used;
+            msg_end += used;
+        }
+        message[len] = '\0';
+        
+        if (ret != ESP_OK) {
+            break;
+        }
+        
+        if (len > 0) {
+            ret = send_log_message(message, max_retries, &wait_ms);
             if (ret != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to clear logs after successful sending");
+                break;
             }
-            free(logs);
-            return ESP_OK;
+            sent++;
         }
         
-        ESP_LOGI(TAG, "Failed to send logs, retrying (%d/%d)", i+1, max_retries);
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Drop only the delivered records, the rest stays for the next attempt
+        storage_log_consume(msg_end);
+        seq = msg_end;
     }
     
-    ESP_LOGE(TAG, "Failed to send logs after %d retries", max_retries);
-    free(logs);
+    if (ret == ESP_OK && seq != end_seq) {
+        ESP_LOGW(TAG, "Message limit reached, %lu log records left for the next cycle",
+                 (unsigned long)(end_seq - seq));
+    }
+    ESP_LOGI(TAG, "Sent %d log messages", sent);
+    
+    free(window);
+    free(message);
     return ret;
 }
+
+// Task for shipping logs with a larger stack
+static void discord_log_task(void *pvParameters) {
+    discord_log_task_data_t *task_data = (discord_log_task_data_t *)pvParameters;
+    
+    phase_begin(PHASE_DISCORD);
+    task_data->result = ship_logs(task_data->max_retries);
+    phase_end(PHASE_DISCORD);
+    
+    // Signal completion
+    xSemaphoreGive(task_data->done_semaphore);
+    vTaskDelete(NULL);
+}
+
+// Function to send logs with retries using a separate task
+esp_err_t send_logs_with_task_retries(int max_retries) {
+    discord_log_task_data_t *task_data = malloc(sizeof(discord_log_task_data_t));
+    if (task_data == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for task data");
+        return ESP_ERR_NO_MEM;
+    }
+    
+    task_data->max_retries = max_retries;
+    task_data->result = ESP_FAIL;
+    task_data->done_semaphore = xSemaphoreCreateBinary();
+    if (task_data->done_semaphore == NULL) {
+        ESP_LOGE(TAG, "Failed to create semaphore");
+        free(task_data);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    BaseType_t task_created = xTaskCreate(
+        discord_log_task,
+        "discord_log_task",
+        12288,
+        task_data,
+        5,
+        NULL
+    );
+    
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create Discord log task");
+        vSemaphoreDelete(task_data->done_semaphore);
+        free(task_data);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Same per-message budget as discord_send_message_safe
+    if (xSemaphoreTake(task_data->done_semaphore, pdMS_TO_TICKS(30000 * DISCORD_LOG_MAX_MESSAGES)) != pdTRUE) {
+        ESP_LOGE(TAG, "Discord log task timeout");
+        // Don't free task_data as the task might still be using it
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    esp_err_t result = task_data->result;
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send logs: %s", esp_err_to_name(result));
+    }
+    
+    vSemaphoreDelete(task_data->done_semaphore);
+    free(task_data);
+    
+    return result;
+}
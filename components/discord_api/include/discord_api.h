@@ -2,6 +2,7 @@
 #define DISCORD_API_H
 
 #include "esp_err.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,15 @@ typedef struct {
     const char* channel_id; // Channel ID
 } discord_config_t;
 
+/**
+ * @brief Rate limit state reported by Discord in the response headers
+ */
+typedef struct {
+    int remaining;          // Requests left in the current bucket, -1 if not reported
+    uint32_t reset_after_ms; // Time until the bucket resets
+    uint32_t retry_after_ms; // Wait time requested by a 429 response, 0 if not limited
+} discord_rate_limit_t;
+
 /**
  * @brief Initialize Discord API with default configuration
  * 
@@ -30,6 +40,15 @@ esp_err_t discord_init(void);
  */
 esp_err_t discord_send_message(const char *message);
 
+/**
+ * @brief Send message to Discord channel and report the rate limit state
+ * 
+ * @param message Message to send (at most DISCORD_MESSAGE_LIMIT characters)
+ * @param rate_limit Pointer to store the rate limit state (may be NULL)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if the request was rate limited
+ */
+esp_err_t discord_send_message_ex(const char *message, discord_rate_limit_t *rate_limit);
+
 /**
  * @brief Send message to Discord channel using a separate task with larger stack
  * 
@@ -57,7 +76,11 @@ esp_err_t send_measurements_with_task_retries(const char* measurements, int max_
 /**
  * @brief Send logs to Discord channel using a separate task with larger stack
  * 
- * @param max_retries Maximum number of retries
+ * The stored log is split on line boundaries into messages below the Discord
+ * limit and sent over the pooled connection. Each acknowledged message removes
+ * its records from the log, so unsent lines are kept for the next cycle.
+ * 
+ * @param max_retries Maximum number of retries per message
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t send_logs_with_task_retries(int max_retries);
@@ -1,4 +1,5 @@
 #pragma once
 
 #define DISCORD_BOT_TOKEN ""
-#define DISCORD_CHANNEL_ID ""
\ No newline at end of file
+#define DISCORD_CHANNEL_ID ""
+#define DISCORD_HOST "discord.com"
@@ -0,0 +1,157 @@
+/**
+ * @file energy_ledger.c
+ * @brief Charge counting of the wake cycles fused with the battery voltage
+ *
+ * Every cycle adds the phase profiler estimate of the awake time and the
+ * sleep current to the ledger, then the rest voltage corrects the state of
+ * charge (energy_model.c). The ledger lives in RTC memory and a copy is
+ * written to NVS every ENERGY_NVS_INTERVAL cycles, so a power loss costs at
+ * most that many cycles of counting.
+ */
+
+#include "energy_ledger.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "config_manager.h"
+
+static const char *TAG = "energy_ledger";
+
+#define LEDGER_NAMESPACE    "energy"
+#define LEDGER_KEY          "ledger"
+#define LEDGER_MAGIC        0x454E4731  // "ENG1"
+
+// Ledger as kept in RTC memory and NVS
+typedef struct {
+    uint32_t magic;
+    energy_estimate_t estimate;
+    uint32_t checksum;
+} ledger_record_t;
+
+static energy_model_params_t s_params;
+RTC_NOINIT_ATTR static ledger_record_t s_ledger;
+
+// FNV-1a over the record without the checksum
+static uint32_t record_checksum(const ledger_record_t *record) {
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(ledger_record_t, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool record_valid(const ledger_record_t *record) {
+    return record->magic == LEDGER_MAGIC && record->checksum == record_checksum(record);
+}
+
+// Copy the ledger to NVS
+static esp_err_t ledger_save(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(LEDGER_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, LEDGER_KEY, &s_ledger, sizeof(s_ledger));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+// Load the ledger
+esp_err_t energy_ledger_init(void) {
+    energy_model_default_params(&s_params);
+    if (record_valid(&s_ledger)) {
+        return ESP_OK;
+    }
+
+    // Power-on: the last NVS copy, a new device starts with the first cycle
+    memset(&s_ledger, 0, sizeof(s_ledger));
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(LEDGER_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK) {
+        return (ret == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : ret;
+    }
+    ledger_record_t record;
+    size_t length = sizeof(record);
+    ret = nvs_get_blob(handle, LEDGER_KEY, &record, &length);
+    nvs_close(handle);
+    if (ret == ESP_OK && length == sizeof(record) && record_valid(&record)) {
+        s_ledger = record;
+        ESP_LOGI(TAG, "Ledger restored from NVS, %lu cycles", (unsigned long)record.estimate.cycles);
+    } else if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Stored ledger is invalid, starting a new one");
+    }
+    return ESP_OK;
+}
+
+// Add a cycle to the ledger
+esp_err_t energy_ledger_cycle_end(float awake_mah, uint32_t awake_ms, uint32_t sleep_ms,
+                                  const battery_info_t *battery) {
+    if (!record_valid(&s_ledger)) {
+        if (battery == NULL) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        s_ledger.magic = LEDGER_MAGIC;
+        energy_model_init(&s_params, &s_ledger.estimate, battery->voltage_mv);
+    }
+
+    energy_estimate_t *estimate = &s_ledger.estimate;
+    float sleep_mah = (float)sleep_ms * ENERGY_SLEEP_CURRENT_UA / 1000.0f / 3600000.0f;
+    energy_model_consume(&s_params, estimate, awake_mah + sleep_mah, (awake_ms + sleep_ms) / 1000);
+    if (battery != NULL) {
+        energy_model_correct(&s_params, estimate, battery->voltage_mv);
+    }
+    s_ledger.checksum = record_checksum(&s_ledger);
+
+    ESP_LOGI(TAG, "Charge ~%.0f mAh (%d%%), %.1f mAh/day", estimate->charge_mah,
+             energy_model_level(&s_params, estimate), estimate->daily_mah);
+
+    if (estimate->cycles % ENERGY_NVS_INTERVAL == 1) {
+        esp_err_t ret = ledger_save();
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save the ledger: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t energy_ledger_get(energy_estimate_t *estimate) {
+    if (estimate == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!record_valid(&s_ledger)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *estimate = s_ledger.estimate;
+    return ESP_OK;
+}
+
+// Format the ledger as text
+esp_err_t energy_ledger_format_summary(char *buffer, size_t buffer_size) {
+    if (buffer == NULL || buffer_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buffer[0] = '\0';
+    if (!record_valid(&s_ledger)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const energy_estimate_t *estimate = &s_ledger.estimate;
+    float days_left = energy_model_days_left(estimate);
+    snprintf(buffer, buffer_size,
+             "Energy: ~%.0f mAh left (%d%%, +/-%.0f mAh), %.1f mAh/day, ~%.0f days without charging\n"
+             "Ledger: %.1f mAh used in %lu cycles over %.1f days, voltage corrections %+.1f mAh",
+             estimate->charge_mah, energy_model_level(&s_params, estimate), sqrtf(estimate->variance),
+             estimate->daily_mah, (days_left < 0.0f) ? 0.0f : days_left, estimate->used_mah,
+             (unsigned long)estimate->cycles, estimate->elapsed_s / 86400.0f, estimate->corrected_mah);
+    return ESP_OK;
+}
@@ -0,0 +1,103 @@
+// energy_model.c
+// Counted charge fused with the voltage based level, a one state Kalman filter
+#include "energy_model.h"
+#include "battery_model.h"
+#include "config_manager.h"
+
+#define SECONDS_PER_DAY         86400.0f
+#define SLOPE_SPAN_MV           20          // Half width of the window for the table slope
+#define LEVEL_FLOOR_PERCENT     1.0f        // Resolution of the level
+#define LEVEL_CLIPPED_PERCENT   10.0f       // Error of a level at the end of the table, it is only a bound
+
+// Default tunables
+void energy_model_default_params(energy_model_params_t *params) {
+    params->capacity_mah = BATTERY_CAPACITY_MAH;
+    params->current_error = ENERGY_CURRENT_ERROR_PERCENT / 100.0f;
+    params->drift_mah_per_h = ENERGY_DRIFT_MAH_PER_HOUR;
+    params->voltage_sigma_mv = ENERGY_VOLTAGE_SIGMA_MV;
+}
+
+// Variance of the charge derived from a voltage, from the slope of the discharge table
+static float voltage_variance(const energy_model_params_t *params, uint32_t voltage_mv, int level) {
+    float sigma_percent;
+    if (level <= 0 || level >= 100) {
+        sigma_percent = LEVEL_CLIPPED_PERCENT;
+    } else {
+        uint32_t low_mv = (voltage_mv > SLOPE_SPAN_MV) ? voltage_mv - SLOPE_SPAN_MV : 0;
+        float slope = (float)(battery_model_level(voltage_mv + SLOPE_SPAN_MV) - battery_model_level(low_mv)) /
+                      (2.0f * SLOPE_SPAN_MV);
+        sigma_percent = params->voltage_sigma_mv * slope;
+        if (sigma_percent < LEVEL_FLOOR_PERCENT) {
+            sigma_percent = LEVEL_FLOOR_PERCENT;
+        }
+    }
+    float sigma_mah = sigma_percent * params->capacity_mah / 100.0f;
+    return sigma_mah * sigma_mah;
+}
+
+// Start from the voltage
+void energy_model_init(const energy_model_params_t *params, energy_estimate_t *estimate, uint32_t voltage_mv) {
+    int level = battery_model_level(voltage_mv);
+    *estimate = (energy_estimate_t) {
+        .charge_mah = level * params->capacity_mah / 100.0f,
+        .variance = voltage_variance(params, voltage_mv, level),
+        .daily_mah = -1.0f,
+    };
+}
+
+// Prediction step: counted consumption, the uncertainty grows with the charge and the time
+void energy_model_consume(const energy_model_params_t *params, energy_estimate_t *estimate, float used_mah,
+                          uint32_t duration_s) {
+    float hours = duration_s / 3600.0f;
+    float counted_error = params->current_error * used_mah;
+
+    estimate->charge_mah -= used_mah;
+    if (estimate->charge_mah < 0.0f) {
+        estimate->charge_mah = 0.0f;
+    }
+    estimate->variance += counted_error * counted_error + params->drift_mah_per_h * params->drift_mah_per_h * hours;
+    estimate->used_mah += used_mah;
+    estimate->elapsed_s += duration_s;
+    estimate->cycles++;
+
+    // Moving average with a time constant of about a day
+    if (duration_s > 0) {
+        float per_day = used_mah * SECONDS_PER_DAY / duration_s;
+        float weight = duration_s / SECONDS_PER_DAY;
+        if (estimate->daily_mah < 0.0f || weight > 1.0f) {
+            estimate->daily_mah = per_day;
+        } else {
+            estimate->daily_mah += weight * (per_day - estimate->daily_mah);
+        }
+    }
+}
+
+// Update step: the voltage based charge pulls the estimate by the Kalman gain
+void energy_model_correct(const energy_model_params_t *params, energy_estimate_t *estimate, uint32_t voltage_mv) {
+    int level = battery_model_level(voltage_mv);
+    float measured_mah = level * params->capacity_mah / 100.0f;
+    float measured_variance = voltage_variance(params, voltage_mv, level);
+
+    float gain = estimate->variance / (estimate->variance + measured_variance);
+    float correction = gain * (measured_mah - estimate->charge_mah);
+    estimate->charge_mah += correction;
+    if (estimate->charge_mah > params->capacity_mah) {
+        estimate->charge_mah = params->capacity_mah;
+    } else if (estimate->charge_mah < 0.0f) {
+        estimate->charge_mah = 0.0f;
+    }
+    estimate->corrected_mah += correction;
+    estimate->variance *= 1.0f - gain;
+}
+
+int energy_model_level(const energy_model_params_t *params, const energy_estimate_t *estimate) {
+    int level = (int)(estimate->charge_mah * 100.0f / params->capacity_mah + 0.5f);
+    return (level < 0) ? 0 : (level > 100) ? 100 : level;
+}
+
+float energy_model_days_left(const energy_estimate_t *estimate) {
+    if (estimate->daily_mah <= 0.0f) {
+        return -1.0f;
+    }
+    return estimate->charge_mah / estimate->daily_mah;
+}
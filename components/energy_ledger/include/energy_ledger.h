@@ -0,0 +1,60 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "battery_monitor.h"
+#include "energy_model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load the energy ledger
+ *
+ * The ledger is kept in RTC memory over deep sleep and copied to NVS every
+ * ENERGY_NVS_INTERVAL cycles, after a power loss it continues from the
+ * last copy.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t energy_ledger_init(void);
+
+/**
+ * @brief Add a wake cycle and the following sleep to the ledger
+ *
+ * Counts the estimated charge of the cycle and of the sleep at
+ * ENERGY_SLEEP_CURRENT_UA, then corrects the state of charge with the
+ * battery voltage of the cycle. The first cycle starts the ledger from the
+ * voltage.
+ *
+ * @param awake_mah Estimated charge of the awake time, from the phase profiler
+ * @param awake_ms Awake time of the cycle
+ * @param sleep_ms Deep sleep time until the next cycle
+ * @param battery Battery measurement of the cycle, NULL if it failed
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t energy_ledger_cycle_end(float awake_mah, uint32_t awake_ms, uint32_t sleep_ms,
+                                  const battery_info_t *battery);
+
+/**
+ * @brief Current estimate of the ledger
+ *
+ * @param estimate Pointer to store the estimate
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND before the first cycle
+ */
+esp_err_t energy_ledger_get(energy_estimate_t *estimate);
+
+/**
+ * @brief Format the ledger as text for the daily report
+ *
+ * @param buffer Buffer for the summary
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND before the first cycle
+ */
+esp_err_t energy_ledger_format_summary(char *buffer, size_t buffer_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+// energy_model.h
+// State of charge estimator of the energy ledger. Plain C without driver
+// calls, so the host benchmark runs it on synthetic discharge traces.
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Estimator tunables
+ */
+typedef struct {
+    float capacity_mah;         // Nominal capacity of the cell
+    float current_error;        // Relative error of the counted charge (0.2 = 20 %)
+    float drift_mah_per_h;      // Uncounted charge per hour: solar input and self discharge
+    float voltage_sigma_mv;     // Error of a rest voltage measurement
+} energy_model_params_t;
+
+/**
+ * @brief Estimated charge of the battery and the consumption ledger
+ */
+typedef struct {
+    float charge_mah;           // Estimated remaining charge
+    float variance;             // Variance of charge_mah in mAh^2
+    float used_mah;             // Counted consumption since the ledger started
+    float corrected_mah;        // Sum of the voltage corrections, positive when the battery gained charge
+    float daily_mah;            // Counted consumption per day, moving average over about a day
+    uint32_t elapsed_s;         // Time covered by the ledger
+    uint32_t cycles;            // Wake cycles counted
+} energy_estimate_t;
+
+/**
+ * @brief Default tunables from config_manager.h
+ *
+ * @param params Tunables to fill
+ */
+void energy_model_default_params(energy_model_params_t *params);
+
+/**
+ * @brief Start an estimate from a rest voltage measurement
+ *
+ * @param params Tunables
+ * @param estimate Estimate to initialize
+ * @param voltage_mv Battery voltage in millivolts
+ */
+void energy_model_init(const energy_model_params_t *params, energy_estimate_t *estimate, uint32_t voltage_mv);
+
+/**
+ * @brief Count the charge of a wake cycle and the following sleep
+ *
+ * Lowers the charge by the counted consumption and widens the variance by
+ * the current error and the uncounted drift of the duration.
+ *
+ * @param params Tunables
+ * @param estimate Estimate to update
+ * @param used_mah Counted charge of the cycle
+ * @param duration_s Duration of the cycle including the sleep
+ */
+void energy_model_consume(const energy_model_params_t *params, energy_estimate_t *estimate, float used_mah,
+                          uint32_t duration_s);
+
+/**
+ * @brief Correct the estimate with a rest voltage measurement
+ *
+ * The voltage is converted with the discharge table. Its weight follows
+ * the slope of the table, on the flat middle of the curve a millivolt is
+ * several percent of charge and the counted charge is trusted more.
+ *
+ * @param params Tunables
+ * @param estimate Estimate to update
+ * @param voltage_mv Battery voltage in millivolts
+ */
+void energy_model_correct(const energy_model_params_t *params, energy_estimate_t *estimate, uint32_t voltage_mv);
+
+/**
+ * @brief Estimated battery level
+ *
+ * @param params Tunables
+ * @param estimate Estimate
+ * @return int Level in percent (0-100)
+ */
+int energy_model_level(const energy_model_params_t *params, const energy_estimate_t *estimate);
+
+/**
+ * @brief Days until the battery is empty at the counted consumption
+ *
+ * Solar input is not counted, so this is the time without any charging.
+ *
+ * @param estimate Estimate
+ * @return float Days left, negative if the consumption is not known yet
+ */
+float energy_model_days_left(const energy_estimate_t *estimate);
+
+#ifdef __cplusplus
+}
+#endif
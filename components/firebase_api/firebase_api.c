@@ -5,6 +5,9 @@
 #include "firebase_cert.h"
 #include "time_manager.h"
 #include "json_helper.h"
+#include "https_client.h"
+#include "config_manager.h"
+#include "phase_profiler.h"
 
 /**
  * @file firebase_api.c
@@ -15,8 +18,19 @@
  * from multiple sensors. The main principles:
  * 
  * 1. All large buffers are allocated through heap_caps_malloc() with subsequent freeing
- * 2. After each HTTP operation, a pause is inserted to release resources
+ * 2. At most UPLOAD_MAX_IN_FLIGHT file buffers exist at the same time
  * 3. Buffers are freed as soon as possible after use
+ * 4. Requests go through the pooled Firestore connection of https_client
+ * 
+ * Uploading is pipelined: a reader task loads the next sensor file while the
+ * current one is sent, so SPIFFS reads overlap with the network round trip.
+ * 
+ * Each file holds one sensor and one local day. The files of a sensor are
+ * sent as one Firestore commit with a write per day document that appends
+ * the measurements (appendMissingElements), so several uploads on the same
+ * day add up instead of overwriting each other, samples buffered over
+ * midnight land in the document of their own day, and a repeated request
+ * after a lost response does not duplicate samples.
  */
 
 #include <stdio.h>
@@ -25,19 +39,24 @@
 #include <inttypes.h>  
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_http_client.h"
 #include "esp_tls.h"
 #include "cJSON.h"
 #include "mbedtls/base64.h"
-#include "lwip/sockets.h"
-#include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
 
 #define ESP_TLS_VER_TLS_1_2 0x0303 /* TLS 1.2 */
 #define ESP_TLS_VER_TLS_1_3 0x0304 /* TLS 1.3 */
 
+#define UPLOAD_FILE_BUFFER_SIZE (18 * 1024)  // Maximum size of one sensor file
+#define UPLOAD_NAME_MAX 256                  // Longest full Firestore document name
+#define UPLOAD_BUFFER_SIZE (UPLOAD_FILE_BUFFER_SIZE + UPLOAD_NAME_MAX + JSON_HELPER_WRITE_OVERHEAD)
+#define FIRESTORE_COLLECTION "daily_measurements_Vladimir"
+
 
 static const char *TAG = "firebase_api";
 
@@ -45,10 +64,12 @@ static const char *TAG = "firebase_api";
 static char jwt_token[2048] = {0};
 static int64_t token_expiration_time = 0;
 
+// Pooled Firestore connection
+static https_client_handle_t s_firestore = NULL;
+
 // Function prototypes to allow to be called before their definitions, static for internal use only
 static esp_err_t create_jwt_token(void);
 static bool is_token_valid(void);
-static esp_err_t firebase_http_event_handler(esp_http_client_event_t *evt);
 //static char* format_firestore_data(const char *json_str);
 
 // Create a JWT token for Firebase authentication
@@ -59,8 +80,10 @@ static esp_err_t create_jwt_token(void) {
     // Token will expire in 1 hour
     token_expiration_time = now + 3600;
 
-    // Generate JWT using the utility function in jwt_util.h
+    // Generate JWT using the utility function in jwt_util.h, the RSA signature runs at full speed
+    phase_begin(PHASE_JWT);
     generate_jwt(now);
+    phase_end(PHASE_JWT);
 
     // Copy the generated JWT to our token buffer
     strncpy(jwt_token, (char*)jwt, sizeof(jwt_token) - 1);
@@ -79,33 +102,6 @@ static bool is_token_valid(void) {
     return (token_expiration_time != 0 && now <= (token_expiration_time - 300));
 }
 
-// HTTP event handler
-static esp_err_t firebase_http_event_handler(esp_http_client_event_t *evt) {
-    switch(evt->event_id) {
-        case HTTP_EVENT_ERROR:
-            ESP_LOGE(TAG, "HTTP_EVENT_ERROR");
-            break;
-        case HTTP_EVENT_ON_CONNECTED:
-            ESP_LOGI(TAG, "HTTP Connected to server");
-            break;
-        case HTTP_EVENT_HEADER_SENT:
-            ESP_LOGI(TAG, "HTTP Header Sent");
-            break;
-        case HTTP_EVENT_ON_DATA:
-            ESP_LOGI(TAG, "HTTP Data received, len=%d", evt->data_len);
-            break;
-        case HTTP_EVENT_ON_FINISH:
-            ESP_LOGI(TAG, "HTTP Event Finished");
-            break;
-        case HTTP_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG, "HTTP Disconnected");
-            break;
-        default:
-            break;
-    }
-    return ESP_OK;
-}
-
 // Public function implementations
 
 esp_err_t firebase_init(void) {
@@ -123,8 +119,23 @@ esp_err_t firebase_init(void) {
     esp_log_level_set("esp-tls-mbedtls", ESP_LOG_DEBUG);
     ESP_LOGI(TAG, "TLS debug logging enabled");
 
+    // Get the pooled connection to Firestore
+    const https_client_host_config_t host_config = {
+        .host = FIREBASE_HOST,
+        .cert_pem = firebase_root_cert,
+        .use_crt_bundle = true,
+        .rx_buffer_size = 4096,
+        .tx_buffer_size = 4096,
+        .timeout_ms = 60000,
+    };
+    esp_err_t err = https_client_open(&host_config, &s_firestore);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open Firestore connection");
+        return err;
+    }
+
     // Generate initial JWT token
-    esp_err_t err = create_jwt_token();
+    err = create_jwt_token();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create initial JWT token");
         return err;
@@ -135,6 +146,55 @@ esp_err_t firebase_init(void) {
 }
 
 
+// Sending one request on the pooled Firestore connection
+static esp_err_t send_firestore_request(esp_http_client_method_t http_method, const char *url,
+                                        const char *body, size_t body_len) {
+    if (s_firestore == NULL) {
+        ESP_LOGE(TAG, "Firebase API not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Check token
+    if (!is_token_valid()) {
+        if (create_jwt_token() != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    
+    // Allocate memory for auth_header in heap
+    size_t auth_header_size = strlen("Bearer ") + strlen(jwt_token) + 1;
+    char *auth_header = heap_caps_malloc(auth_header_size, MALLOC_CAP_8BIT);
+    if (!auth_header) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    snprintf(auth_header, auth_header_size, "Bearer %s", jwt_token);
+    const https_client_header_t headers[] = {
+        {"Authorization", auth_header},
+        {"Content-Type", "application/json"},
+    };
+    
+    // Request, data is sent directly from the caller's buffer
+    const https_client_request_t request = {
+        .method = http_method,
+        .url = url,
+        .headers = headers,
+        .header_count = sizeof(headers) / sizeof(headers[0]),
+        .body = body,
+        .body_len = body_len,
+    };
+    https_client_response_t response = {0};
+    esp_err_t err = https_client_request(s_firestore, &request, &response);
+    int status_code = response.status_code;
+    
+    ESP_LOGI(TAG, "HTTP status: %d, result: %s", 
+             status_code, (err == ESP_OK) ? "OK" : esp_err_to_name(err));
+    
+    free(auth_header);
+    
+    return (status_code == 200 || status_code == 201) ? ESP_OK : ESP_FAIL;
+}
+
 // Simplified version without data provider
 esp_err_t firebase_send_streamed_data(const char *collection, const char *document_id, const char *firestore_data) {
     // Check arguments
@@ -146,13 +206,6 @@ esp_err_t firebase_send_streamed_data(const char *collection, const char *docume
     size_t data_size = strlen(firestore_data);
     ESP_LOGI(TAG, "Total data size: %zu bytes", data_size);
     
-    // Check token
-    if (!is_token_valid()) {
-        if (create_jwt_token() != ESP_OK) {
-            return ESP_FAIL;
-        }
-    }
-    
     // Forming URL - using heap
     char *url = heap_caps_malloc(256, MALLOC_CAP_8BIT);
     if (!url) {
@@ -170,57 +223,22 @@ esp_err_t firebase_send_streamed_data(const char *collection, const char *docume
     esp_http_client_method_t http_method = (document_id && strlen(document_id) > 0) ? 
                                          HTTP_METHOD_PATCH : HTTP_METHOD_POST;
     
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = firebase_http_event_handler,
-        .method = http_method,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .cert_pem = firebase_root_cert,
-        .buffer_size = 4096,        
-        .buffer_size_tx = 4096,     
-        .timeout_ms = 60000,        
-        .crt_bundle_attach = esp_crt_bundle_attach
-    };
-    
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(url);
-        return ESP_FAIL;
-    }
-    
-    // Allocate memory for auth_header in heap
-    size_t auth_header_size = strlen("Bearer ") + strlen(jwt_token) + 1;
-    char *auth_header = heap_caps_malloc(auth_header_size, MALLOC_CAP_8BIT);
-    if (!auth_header) {
-        esp_http_client_cleanup(client);
-        free(url);
-        return ESP_ERR_NO_MEM;
-    }
-    
-    snprintf(auth_header, auth_header_size, "Bearer %s", jwt_token);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    
-    // Setting data directly
-    esp_http_client_set_post_field(client, firestore_data, data_size);
-    
-    // Request
-    esp_err_t err = esp_http_client_perform(client);
-    int status_code = (err == ESP_OK) ? esp_http_client_get_status_code(client) : 0;
-    
-    ESP_LOGI(TAG, "HTTP status: %d, result: %s", 
-             status_code, (err == ESP_OK) ? "OK" : esp_err_to_name(err));
-    
-    // Free memory
-    free(auth_header);
+    esp_err_t ret = send_firestore_request(http_method, url, firestore_data, data_size);
     free(url);
-    esp_http_client_cleanup(client);
-    
-    return (status_code == 200 || status_code == 201) ? ESP_OK : ESP_FAIL;
+    return ret;
+}
+
+// Sending a commit request, the URL is the documents root with ":commit"
+esp_err_t firebase_commit(const char *body, size_t length) {
+    if (!body || length == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "Commit size: %zu bytes", length);
+    return send_firestore_request(HTTP_METHOD_POST, FIREBASE_URL ":commit", body, length);
 }
 
 // Reading the content of a file into a buffer that has already been allocated in memory
-static esp_err_t read_sensor_file_to_buffer(const char *file_path, char *buffer, size_t buffer_size) {
+esp_err_t firebase_read_sensor_file(const char *file_path, char *buffer, size_t buffer_size) {
     if (!file_path || !buffer || buffer_size == 0) {
         ESP_LOGE(TAG, "Invalid arguments for reading file");
         return ESP_ERR_INVALID_ARG;
@@ -267,79 +285,159 @@ static esp_err_t read_sensor_file_to_buffer(const char *file_path, char *buffer,
     return ESP_OK;
 }
 
-// Processing and sending data from sensor
-static esp_err_t process_and_send_sensor_data(const char *json_data) {
-    if (!json_data) {
-        return ESP_ERR_INVALID_ARG;
+// Reading a sensor file and turning it into a write of its day document at the end of the request
+static esp_err_t append_commit_write(const char *file_path, const char *mac_address, char *buffer,
+                                     size_t buffer_size, size_t *pos) {
+    char day[11];
+    char document_id[64];
+    char name[UPLOAD_NAME_MAX];
+    
+    // The day comes from the file name, so samples are routed without parsing the file
+    if (storage_get_sensor_day(file_path, day, sizeof(day)) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid sensor file name: %s", file_path);
+        return ESP_FAIL;
     }
+    json_helper_generate_document_id(day, mac_address, document_id, sizeof(document_id));
+    int name_len = snprintf(name, sizeof(name), "projects/%s/databases/(default)/documents/%s/%s",
+                            FIREBASE_PROJECT_ID, FIRESTORE_COLLECTION, document_id);
     
-    // Allocating memory on heap for MAC address
-    char *mac_address = heap_caps_malloc(18, MALLOC_CAP_8BIT);
-    if (!mac_address) {
-        ESP_LOGE(TAG, "Failed to allocate memory for MAC address");
+    // Room is left for the document name, the write around the file and the end of the request
+    size_t reserved = name_len + JSON_HELPER_WRITE_OVERHEAD + strlen(JSON_HELPER_COMMIT_CLOSE);
+    if (name_len < 0 || (size_t)name_len >= sizeof(name) || buffer_size <= *pos + reserved) {
         return ESP_ERR_NO_MEM;
     }
     
-    // Extracting MAC address from JSON using helper function
-    esp_err_t ret = json_helper_extract_mac_address(json_data, mac_address, 18);
+    char *write = buffer + *pos;
+    esp_err_t ret = firebase_read_sensor_file(file_path, write, buffer_size - *pos - reserved);
     if (ret != ESP_OK) {
-        free(mac_address);
         return ret;
     }
     
-    ESP_LOGI(TAG, "Extracted MAC address: %s", mac_address);
+    size_t length = json_helper_firestore_write_in_place(write, strlen(write),
+                                                         buffer_size - *pos - strlen(JSON_HELPER_COMMIT_CLOSE), name);
+    if (length == 0) {
+        ESP_LOGE(TAG, "Unexpected document layout in %s", file_path);
+        return ESP_FAIL;
+    }
     
-    // Getting current date for creating document ID
-    time_t now;
-    time(&now);
-    struct tm timeinfo;
-    localtime_r(&now, &timeinfo);
-    
-    // Allocating memory on heap for time_str
-    char *time_str = heap_caps_malloc(20, MALLOC_CAP_8BIT);
-    if (!time_str) {
-        ESP_LOGE(TAG, "Failed to allocate memory for time string");
-        free(mac_address);
-        return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Document %s added to the commit", document_id);
+    *pos += length;
+    return ESP_OK;
+}
+
+// Turning the files of one sensor into a commit request with a write per day document
+esp_err_t firebase_prepare_commit(char **file_list, int file_count, char *buffer, size_t buffer_size,
+                                  size_t *length, int *files_used) {
+    if (!file_list || file_count <= 0 || !buffer || !length || !files_used) {
+        return ESP_ERR_INVALID_ARG;
     }
+    *length = 0;
+    *files_used = 1;
     
-    strftime(time_str, 20, "%Y-%m-%d", &timeinfo);
+    char mac_address[18];
+    if (storage_get_sensor_mac(file_list[0], mac_address, sizeof(mac_address)) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid sensor file name: %s", file_list[0]);
+        return ESP_FAIL;
+    }
     
-    // Formatting MAC address (replacing colons with underscores)
-    char *formatted_mac = heap_caps_malloc(18, MALLOC_CAP_8BIT);
-    if (!formatted_mac) {
-        ESP_LOGE(TAG, "Failed to allocate memory for formatted MAC");
-        free(time_str);
-        free(mac_address);
-        return ESP_ERR_NO_MEM;
+    size_t pos = strlen(JSON_HELPER_COMMIT_OPEN);
+    if (buffer_size <= pos) {
+        return ESP_ERR_INVALID_SIZE;
     }
+    memcpy(buffer, JSON_HELPER_COMMIT_OPEN, pos);
     
-    //json_helper_format_mac_address(mac_address, formatted_mac, 18);
+    esp_err_t ret = append_commit_write(file_list[0], mac_address, buffer, buffer_size, &pos);
+    if (ret != ESP_OK) {
+        return ret;
+    }
     
-    // Generating document ID
-    char *document_id = heap_caps_malloc(64, MALLOC_CAP_8BIT);
-    if (!document_id) {
-        ESP_LOGE(TAG, "Failed to allocate memory for document ID");
-        free(formatted_mac);
-        free(time_str);
-        free(mac_address);
-        return ESP_ERR_NO_MEM;
+    // The following days of the same sensor join the request while they fit,
+    // a file that is left out is sent with the next request
+    char next_mac[18];
+    while (*files_used < file_count && *files_used < UPLOAD_MAX_BATCH_FILES &&
+           storage_get_sensor_mac(file_list[*files_used], next_mac, sizeof(next_mac)) == ESP_OK &&
+           strcmp(next_mac, mac_address) == 0) {
+        size_t next = pos + 1;
+        if (append_commit_write(file_list[*files_used], mac_address, buffer, buffer_size, &next) != ESP_OK) {
+            break;
+        }
+        buffer[pos] = ',';
+        pos = next;
+        (*files_used)++;
     }
     
-    // json_helper_generate_document_id(time_str, formatted_mac, document_id, 64);
-    json_helper_generate_document_id(time_str, mac_address, document_id, 64);
+    strcpy(buffer + pos, JSON_HELPER_COMMIT_CLOSE);
+    *length = pos + strlen(JSON_HELPER_COMMIT_CLOSE);
+    return ESP_OK;
+}
+
+// Upload item passed from the reader task to the sender
+typedef struct {
+    int first;              // Index of the first source file in the file list
+    int count;              // Number of source files in the request, 0 marks the end of the list
+    char *data;             // Commit request, NULL if reading failed
+    size_t length;          // Length of the commit request
+} upload_item_t;
+
+// Upload pipeline shared by the reader task and the sender
+typedef struct {
+    char **file_list;
+    int file_count;
+    QueueHandle_t queue;            // Items ready to be sent
+    SemaphoreHandle_t slots;        // Limits the number of file buffers in flight
+    SemaphoreHandle_t reader_done;  // Given when the reader task exits
+} upload_pipeline_t;
+
+// Reader task: reads the next files while the current one is being sent
+static void upload_reader_task(void *pvParameters) {
+    upload_pipeline_t *pipeline = (upload_pipeline_t *)pvParameters;
     
-    ESP_LOGI(TAG, "Using custom document ID: %s", document_id);
+    int i = 0;
+    while (true) {
+        upload_item_t item = {0};
+        
+        if (i < pipeline->file_count) {
+            // Wait for a free slot before allocating the next file buffer
+            xSemaphoreTake(pipeline->slots, portMAX_DELAY);
+            
+            item.first = i;
+            item.count = 1;
+            item.data = heap_caps_malloc(UPLOAD_BUFFER_SIZE, MALLOC_CAP_8BIT);
+            if (!item.data) {
+                ESP_LOGE(TAG, "Failed to allocate memory for file content");
+            } else {
+                phase_begin(PHASE_ENCODE);
+                esp_err_t ret = firebase_prepare_commit(&pipeline->file_list[i], pipeline->file_count - i, item.data,
+                                                        UPLOAD_BUFFER_SIZE, &item.length, &item.count);
+                phase_end(PHASE_ENCODE);
+                if (ret != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to read file: %s", pipeline->file_list[i]);
+                    free(item.data);
+                    item.data = NULL;
+                }
+            }
+            i += item.count;
+        }
+        
+        xQueueSend(pipeline->queue, &item, portMAX_DELAY);
+        if (item.count == 0) {
+            break;
+        }
+    }
     
-    // Sending data to Firestore
-    ret = firebase_send_streamed_data("daily_measurements_Vladimir", document_id, json_data);
+    xSemaphoreGive(pipeline->reader_done);
+    vTaskDelete(NULL);
+}
+
+// Sending one item to Firestore
+static esp_err_t send_upload_item(const upload_item_t *item) {
+    if (!item->data) {
+        return ESP_FAIL;
+    }
     
-    // Freeing allocated memory
-    free(document_id);
-    free(formatted_mac);
-    free(time_str);
-    free(mac_address);
+    ESP_LOGI(TAG, "Committing %d day documents", item->count);
     
+    esp_err_t ret = firebase_commit(item->data, item->length);
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Measurements sent successfully");
     } else {
@@ -361,67 +459,79 @@ esp_err_t send_all_sensor_measurements_to_firebase(void) {
         return ESP_ERR_NOT_FOUND;
     }
     
-    ESP_LOGI(TAG_FIREBASE, "Found %d sensor files to send", file_count);
+    ESP_LOGI(TAG_FIREBASE, "Found %d sensor files to send, %d in flight", file_count, UPLOAD_MAX_IN_FLIGHT);
+    
+    upload_pipeline_t pipeline = {
+        .file_list = file_list,
+        .file_count = file_count,
+        .queue = xQueueCreate(UPLOAD_MAX_IN_FLIGHT, sizeof(upload_item_t)),
+        .slots = xSemaphoreCreateCounting(UPLOAD_MAX_IN_FLIGHT, UPLOAD_MAX_IN_FLIGHT),
+        .reader_done = xSemaphoreCreateBinary(),
+    };
+    
+    if (!pipeline.queue || !pipeline.slots || !pipeline.reader_done ||
+        xTaskCreate(upload_reader_task, "upload_reader", 4096, &pipeline, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG_FIREBASE, "Failed to start upload reader task");
+        if (pipeline.queue) vQueueDelete(pipeline.queue);
+        if (pipeline.slots) vSemaphoreDelete(pipeline.slots);
+        if (pipeline.reader_done) vSemaphoreDelete(pipeline.reader_done);
+        storage_free_sensor_files(file_list, file_count);
+        return ESP_ERR_NO_MEM;
+    }
     
     // Variables for tracking results
     bool any_success = false;
     bool any_failure = false;
     int success_count = 0;
-    
-    // Processing each file separately with pauses between requests
-    for (int i = 0; i < file_count; i++) {
-        ESP_LOGI(TAG_FIREBASE, "Processing file %d/%d: %s", i+1, file_count, file_list[i]);
+    int processed_count = 0;
+    size_t bytes_sent = 0;
+    
+    // Sending the requests in the order the reader task delivers them
+    upload_item_t item;
+    while (xQueueReceive(pipeline.queue, &item, portMAX_DELAY) == pdTRUE && item.count > 0) {
+        const char *first_path = file_list[item.first];
+        processed_count += item.count;
+        ESP_LOGI(TAG_FIREBASE, "Processing files %d-%d/%d: %s", item.first + 1, processed_count,
+                 file_count, first_path);
         
-        // Allocating memory for file content
-        char *file_content = heap_caps_malloc(18 * 1024, MALLOC_CAP_8BIT);
-        if (!file_content) {
-            ESP_LOGE(TAG_FIREBASE, "Failed to allocate memory for file content");
-            any_failure = true;
-            // Continuing to process other files
-            continue;
-        }
-        
-        // Reading file to allocated memory
-        ret = read_sensor_file_to_buffer(file_list[i], file_content, 18 * 1024);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG_FIREBASE, "Failed to read file: %s", file_list[i]);
-            free(file_content);
-            any_failure = true;
-            continue;
-        }
+        ret = send_upload_item(&item);
+        bytes_sent += item.data ? item.length : 0;
         
-        // Processing and sending data
-        ret = process_and_send_sensor_data(file_content);
-        
-        // Freeing file content memory immediately after use
-        free(file_content);
+        // Freeing file content memory immediately after use and releasing the slot
+        free(item.data);
+        xSemaphoreGive(pipeline.slots);
         
         if (ret == ESP_OK) {
-            ESP_LOGI(TAG_FIREBASE, "Successfully sent data from file %s", file_list[i]);
+            ESP_LOGI(TAG_FIREBASE, "Successfully sent data from %d files of %s", item.count, first_path);
             any_success = true;
-            success_count++;
+            success_count += item.count;
             
-            // Deleting file after successful sending
-            if (unlink(file_list[i]) != 0) {
-                ESP_LOGW(TAG_FIREBASE, "Failed to delete file after successful upload: %s", file_list[i]);
-            } else {
-                ESP_LOGI(TAG_FIREBASE, "Deleted file after successful upload: %s", file_list[i]);
+            // Deleting the files after successful sending, the commit applied all of them
+            for (int i = item.first; i < item.first + item.count; i++) {
+                if (unlink(file_list[i]) != 0) {
+                    ESP_LOGW(TAG_FIREBASE, "Failed to delete file after successful upload: %s", file_list[i]);
+                } else {
+                    ESP_LOGI(TAG_FIREBASE, "Deleted file after successful upload: %s", file_list[i]);
+                }
             }
         } else {
-            ESP_LOGE(TAG_FIREBASE, "Failed to send data from file %s", file_list[i]);
+            ESP_LOGE(TAG_FIREBASE, "Failed to send data from file %s", first_path);
             any_failure = true;
         }
-        
-        // Pause between sending gives time to release resources
-        vTaskDelay(pdMS_TO_TICKS(500));
     }
     
+    // Waiting for the reader task before freeing the shared state
+    xSemaphoreTake(pipeline.reader_done, portMAX_DELAY);
+    vQueueDelete(pipeline.queue);
+    vSemaphoreDelete(pipeline.slots);
+    vSemaphoreDelete(pipeline.reader_done);
+    
     // Freeing list of files
     storage_free_sensor_files(file_list, file_count);
     
     // Logging results
-    ESP_LOGI(TAG_FIREBASE, "Sensor data upload summary: %d/%d files successfully sent", 
-             success_count, file_count);
+    ESP_LOGI(TAG_FIREBASE, "Sensor data upload summary: %d/%d files successfully sent, %zu bytes", 
+             success_count, file_count, bytes_sent);
     
     // Defining return status
     if (any_success && !any_failure) {
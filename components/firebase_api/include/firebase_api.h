@@ -22,9 +22,11 @@ esp_err_t firebase_init(void);
  * 
  * This function implements the mechanism for sending data for multiple sensors:
  * 1. Gets the list of all sensor files from storage_get_sensor_files()
- * 2. Processes each file separately, extracting the MAC address from the data
- * 3. Generates a unique document_id for each sensor, including date and MAC
- * 4. Sends data as separate documents in Firestore
+ * 2. A reader task loads the files (at most UPLOAD_MAX_IN_FLIGHT requests at a time),
+ *    taking the MAC address and the day from the file name instead of parsing the data
+ * 3. Generates a document_id for each file from its day and the MAC
+ * 4. Appends the measurements to the day documents in Firestore with one commit
+ *    request per sensor while the next sensor is read
  * 5. Deletes files after successful sending
  * 
  * Note: Before calling this function, Firebase must be initialized via firebase_init()
@@ -47,4 +49,48 @@ esp_err_t send_all_sensor_measurements_to_firebase(void);
  */
 esp_err_t firebase_send_streamed_data(const char *collection, const char *document_id, const char *firestore_data);
 
+/**
+ * @brief Read a sensor file into an upload buffer
+ * 
+ * The buffer is sent to Firestore as the request body. Used by the upload
+ * reader task and by the storage benchmark.
+ * 
+ * @param file_path Path of the sensor file
+ * @param buffer Buffer for the file content, null terminated on success
+ * @param buffer_size Buffer size, must be larger than the file
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NO_MEM if the file does not fit
+ */
+esp_err_t firebase_read_sensor_file(const char *file_path, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Read sensor files and turn them into one Firestore commit request
+ * 
+ * The first file and the following files of the same sensor (other days,
+ * at most UPLOAD_MAX_BATCH_FILES) become one write each. A write updates the
+ * scalar fields of the day document and appends the measurements with
+ * appendMissingElements, so samples uploaded earlier the same day are kept
+ * and a repeated request does not duplicate them. Files that do not fit are
+ * left for the next request.
+ * 
+ * @param file_list Sensor files as returned by storage_get_sensor_files(), starting at the first file to send
+ * @param file_count Number of files in file_list
+ * @param buffer Buffer for the request, about 512 bytes larger than the files
+ * @param buffer_size Buffer size
+ * @param length Pointer to store the request length
+ * @param files_used Pointer to store the number of files in the request, at least 1 also on failure
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NO_MEM if the first file does not fit,
+ *         ESP_FAIL if the first file could not be read or has an unexpected layout
+ */
+esp_err_t firebase_prepare_commit(char **file_list, int file_count, char *buffer, size_t buffer_size,
+                                  size_t *length, int *files_used);
+
+/**
+ * @brief Send a commit request prepared by firebase_prepare_commit()
+ * 
+ * @param body Commit request
+ * @param length Length of the request
+ * @return esp_err_t ESP_OK on success, error code otherwise
+ */
+esp_err_t firebase_commit(const char *body, size_t length);
+
 #endif /* FIREBASE_API_H */
\ No newline at end of file
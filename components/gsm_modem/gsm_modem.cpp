@@ -15,6 +15,7 @@
 #include "my_module_dce.hpp"
 #include "main_config.h"
 #include "gsm_modem.h"
+#include "phase_profiler.h"
 
 #include "esp_netif_ip_addr.h"
 
@@ -27,12 +28,24 @@ static std::string current_command = "";
 static bool response_completed = false;
 static bool modem_initialized = false;
 static bool system_initialized = false;
+static int s_signal_quality = 99;     // Last AT+CSQ rssi, 99 if unknown
+static volatile bool s_abort = false; // Set by gsm_modem_abort(), checked between the AT commands
 //static ModemStatus modem_status;
 
 // Declare static pointers to store modem objects
 static std::unique_ptr<Shiny::DCE> s_dce;
 static esp_netif_t *s_esp_netif = nullptr;
 
+// AT commands outside the modem phases block light sleep until their response is in
+struct at_io_guard {
+    bool held = (power_profile_acquire(POWER_PROFILE_MODEM_IO) == ESP_OK);
+    ~at_io_guard() {
+        if (held) {
+            power_profile_release(POWER_PROFILE_MODEM_IO);
+        }
+    }
+};
+
 #define GPIO_OUTPUT_POWER     (gpio_num_t)MODEM_POWER_PIN
 #define GPIO_OUTPUT_PWRKEY    (gpio_num_t)MODEM_PWRKEY_PIN
 #define GPIO_OUTPUT_RESET     MODEM_RESET_PIN
@@ -85,6 +98,7 @@ void config_modem_gpios()
 
 void power_on_modem()
 {
+    phase_power_on(PHASE_POWER_MODEM);
 
 #ifdef MODEM_RESET_PIN
     // Set modem reset pin ,reset modem
@@ -225,7 +239,7 @@ static bool send_at_command(std::unique_ptr<Shiny::DCE>& dce, const std::string&
     accumulated_response.clear();
     response_completed = false;
     
-    for (int retry = 0; retry < 3; retry++) {
+    for (int retry = 0; retry < 3 && !s_abort; retry++) {
         auto result = dce->command(command + "\r\n", process_line, timeout);
         
         // A small delay to give the modem time to complete its response
@@ -265,7 +279,7 @@ static bool wait_for_modem_ready(std::unique_ptr<Shiny::DCE>& dce)
     
     ESP_LOGI(TAG, "Waiting for modem to be ready...");
     
-    while (retries--) {
+    while (retries-- && !s_abort) {
         accumulated_response.clear();
         response_completed = false;
         
@@ -330,6 +344,9 @@ static bool start_checking(std::unique_ptr<Shiny::DCE>& dce)
     ESP_LOGI(TAG, "Starting modem initialization sequence");
     
     for (const auto& cmd : init_sequence) {
+        if (s_abort) {
+            return false;
+        }
         ESP_LOGI(TAG, "Executing: %s", cmd.second.c_str());
         
         // Special processing for checking the SIM card
@@ -338,7 +355,7 @@ static bool start_checking(std::unique_ptr<Shiny::DCE>& dce)
             bool sim_status_ok = false;
             
             // Give up to 3 attempts to check the SIM status
-            for (int sim_retry = 0; sim_retry < 3 && !sim_status_ok; sim_retry++) {
+            for (int sim_retry = 0; sim_retry < 3 && !sim_status_ok && !s_abort; sim_retry++) {
                 if (send_at_command(dce, cmd.first, 5000)) {
                     sim_status_ok = true;
                     
@@ -374,6 +391,15 @@ static bool start_checking(std::unique_ptr<Shiny::DCE>& dce)
                 ESP_LOGE(TAG, "Failed: %s", cmd.second.c_str());
                 return false;
             }
+            
+            // "+CSQ: <rssi>,<ber>", kept for the send scheduler
+            int rssi, ber;
+            size_t pos = accumulated_response.find("+CSQ:");
+            if (cmd.first == "AT+CSQ" && pos != std::string::npos &&
+                sscanf(accumulated_response.c_str() + pos, "+CSQ: %d,%d", &rssi, &ber) == 2) {
+                s_signal_quality = rssi;
+                ESP_LOGI(TAG, "Signal quality: %d", rssi);
+            }
         }
         
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -405,7 +431,7 @@ static command_result enable_data_mode(std::unique_ptr<Shiny::DCE>& s_dce)
     // Waiting to receive IP address
     int retry = 0;
     esp_netif_ip_info_t ip_info;
-    while(retry < 10) {
+    while(retry < 10 && !s_abort) {
         vTaskDelay(pdMS_TO_TICKS(1000));
         esp_netif_get_ip_info(s_esp_netif, &ip_info);
         if(ip_info.ip.addr != 0) {
@@ -429,10 +455,13 @@ extern "C" {
         }
 
         ESP_LOGI(TAG, "Initializing GSM modem");
+        s_abort = false;
 
         // Modem configuration
+        phase_begin(PHASE_MODEM_BOOT);
         if (configure_modem() != ESP_OK) {
             ESP_LOGE(TAG, "Modem initializing failed: Failed to configure modem");
+            phase_end(PHASE_MODEM_BOOT);
             return ESP_FAIL;
         }
         ESP_LOGI(TAG, "Modem configured successfully");
@@ -440,15 +469,25 @@ extern "C" {
     
         // We give the modem time for initial initialization
         vTaskDelay(pdMS_TO_TICKS(5000));
+        if (s_abort) {
+            ESP_LOGE(TAG, "Modem initializing aborted");
+            phase_end(PHASE_MODEM_BOOT);
+            return ESP_ERR_TIMEOUT;
+        }
     
         // Initial checks
         if (!start_checking(s_dce)) {
             ESP_LOGE(TAG, "Modem initializing failed: Start checking failed");
+            phase_end(PHASE_MODEM_BOOT);
             return ESP_FAIL;
         }
+        phase_end(PHASE_MODEM_BOOT);
 
         // Enabling data transfer mode
-        if (enable_data_mode(s_dce) != command_result::OK) {
+        phase_begin(PHASE_PPP);
+        command_result data_mode = enable_data_mode(s_dce);
+        phase_end(PHASE_PPP);
+        if (data_mode != command_result::OK) {
             ESP_LOGE(TAG, "Modem initializing failed: Failed to enable data mode");
             return ESP_FAIL;
         }
@@ -465,6 +504,7 @@ extern "C" {
             return ESP_ERR_INVALID_STATE;
         }
         ESP_LOGI(TAG, "Deinitializing GSM modem");
+        at_io_guard io;
 
         // Properly turning off the modem before destroying it
         s_dce->set_mode(esp_modem::modem_mode::COMMAND_MODE);
@@ -480,6 +520,7 @@ extern "C" {
             s_esp_netif = nullptr;
         }
 
+        phase_power_off(PHASE_POWER_MODEM);
         ESP_LOGI(TAG, "GSM modem deinitialized successfully");
     
         modem_initialized = false;
@@ -493,6 +534,7 @@ extern "C" {
             return ESP_ERR_INVALID_ARG;
         }
     
+        at_io_guard io;
         int voltage, bcs, bcl;
         if (s_dce->get_battery_status(voltage, bcs, bcl) == command_result::OK) {
             status->voltage = voltage;
@@ -504,6 +546,14 @@ extern "C" {
         return ESP_FAIL;
     }
 
+    void gsm_modem_abort(void) {
+        s_abort = true;
+    }
+
+    int gsm_modem_get_signal_quality(void) {
+        return s_signal_quality;
+    }
+
     time_t gsm_get_network_time(void) {
         esp_netif_ip_info_t ip_info;
         esp_netif_get_ip_info(s_esp_netif, &ip_info);
@@ -514,6 +564,8 @@ extern "C" {
             return 0;
         }
         // Configure NTP
+        s_abort = false;
+        phase_begin(PHASE_TIME_SYNC);
         esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
         esp_sntp_setservername(0, "pool.ntp.org");
         esp_sntp_init();
@@ -521,14 +573,15 @@ extern "C" {
         // Wait for time to be set
         int retry = 0;
         const int max_retry = 10;
-        while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && ++retry < max_retry) {
+        while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && ++retry < max_retry && !s_abort) {
             ESP_LOGI(TAG, "Waiting for NTP time sync... (%d/%d)", retry, max_retry);
             vTaskDelay(pdMS_TO_TICKS(1000));
         }
         
-        if (retry >= max_retry) {
+        if (retry >= max_retry || s_abort) {
             ESP_LOGE(TAG, "NTP time sync failed");
             esp_sntp_stop();
+            phase_end(PHASE_TIME_SYNC);
             return 0;
         }
         
@@ -544,12 +597,14 @@ extern "C" {
         
         // Cleanup
         esp_sntp_stop();
+        phase_end(PHASE_TIME_SYNC);
         return now;
     }
 
     esp_err_t modem_power_off(void)
     {
         ESP_LOGI(TAG, "Power off the modem");
+        at_io_guard io;
 
         // Putting the modem into command mode
         auto result = s_dce->power_down();
@@ -561,6 +616,7 @@ extern "C" {
         // Power off the modem  
         gpio_set_level((gpio_num_t)GPIO_OUTPUT_POWER, 0);
         gpio_set_level((gpio_num_t)GPIO_OUTPUT_PWRKEY, 0);
+        phase_power_off(PHASE_POWER_MODEM);
         
         return ESP_OK;
     }
@@ -0,0 +1,328 @@
+// gsm_modem_sim.c
+// Fake A7670E for the Linux target build.
+//
+// The modem is a thread on the master side of a pseudo terminal that answers
+// the AT commands of the real bring-up sequence. The firmware side talks to
+// the slave side like it talks to the UART on the device. There is no PPP
+// link, once the modem reports CONNECT the host network is used directly.
+//
+// SIM_MODEM_BOOT_MS delays the *ATREADY notification (default 0, on the
+// simulated clock like the ready timeout, see SIM_TIME_SCALE),
+// SIM_MODEM_FAIL_PERCENT makes a share of the bring-ups fail and
+// SIM_MODEM_CSQ sets the reported signal quality (default 21).
+#define _GNU_SOURCE     // posix_openpt() and ptsname()
+#include "gsm_modem.h"
+#include "phase_profiler.h"
+#include "config_manager.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static const char *TAG = "gsm_modem_sim";
+
+#define AT_TIMEOUT_MS       1000
+#define AT_LINE_SIZE        128
+
+static int s_master_fd = -1;   // Fake modem side
+static int s_slave_fd = -1;    // Firmware side (the "UART")
+static pthread_t s_modem_thread;
+static bool s_modem_running = false;
+static bool s_modem_initialized = false;
+static int s_signal_quality = 99;   // Last AT+CSQ rssi, 99 if unknown
+static volatile bool s_abort = false;   // Set by gsm_modem_abort()
+
+// Read an integer from the environment
+static long env_long(const char *name, long default_value) {
+    const char *value = getenv(name);
+    return value ? strtol(value, NULL, 10) : default_value;
+}
+
+// Write a string to a file descriptor
+static void write_all(int fd, const char *text) {
+    size_t len = strlen(text);
+    while (len > 0) {
+        ssize_t n = write(fd, text, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        text += n;
+        len -= n;
+    }
+}
+
+// Read one line, false on timeout or error
+static bool read_line(int fd, char *line, size_t size, int timeout_ms) {
+    size_t len = 0;
+    while (len + 1 < size) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        if (c == '\n') {
+            if (len == 0) {
+                continue;   // Skip empty lines between responses
+            }
+            break;
+        }
+        line[len++] = c;
+    }
+    line[len] = '\0';
+    return true;
+}
+
+// Fake modem: answers AT commands until powered down
+static void *fake_modem_thread(void *arg) {
+    // Boot delay in steps, a power off during the boot stops the thread
+    for (long boot_ms = sim_scaled_ms(env_long("SIM_MODEM_BOOT_MS", 0)); boot_ms > 0 && s_modem_running; boot_ms -= 100) {
+        usleep(100 * 1000);
+    }
+    write_all(s_master_fd, "\r\n*ATREADY: 1\r\n");
+
+    char line[AT_LINE_SIZE];
+    while (s_modem_running) {
+        if (!read_line(s_master_fd, line, sizeof(line), 100)) {
+            continue;
+        }
+
+        if (strcmp(line, "AT") == 0 || strcmp(line, "ATE0") == 0 || strncmp(line, "AT+CGDCONT=", 11) == 0) {
+            write_all(s_master_fd, "\r\nOK\r\n");
+        } else if (strcmp(line, "AT+CPIN?") == 0) {
+            write_all(s_master_fd, "\r\n+CPIN: READY\r\n\r\nOK\r\n");
+        } else if (strcmp(line, "AT+CSQ") == 0) {
+            char response[48];
+            snprintf(response, sizeof(response), "\r\n+CSQ: %ld,99\r\n\r\nOK\r\n", env_long("SIM_MODEM_CSQ", 21));
+            write_all(s_master_fd, response);
+        } else if (strcmp(line, "AT+CBC") == 0) {
+            write_all(s_master_fd, "\r\n+CBC: 4.012V\r\n\r\nOK\r\n");
+        } else if (strncmp(line, "ATD*99", 6) == 0) {
+            write_all(s_master_fd, "\r\nCONNECT 115200\r\n");
+        } else if (strcmp(line, "AT+CPOWD=1") == 0) {
+            write_all(s_master_fd, "\r\nOK\r\n\r\nNORMAL POWER DOWN\r\n");
+            break;
+        } else {
+            write_all(s_master_fd, "\r\nERROR\r\n");
+        }
+    }
+    return NULL;
+}
+
+// Send an AT command and wait for the final result, the last information line is stored in info
+static bool at_command(const char *command, const char *expected, char *info, size_t info_size) {
+    char line[AT_LINE_SIZE];
+    if (s_abort) {
+        return false;
+    }
+    write_all(s_slave_fd, command);
+    write_all(s_slave_fd, "\r\n");
+
+    while (read_line(s_slave_fd, line, sizeof(line), AT_TIMEOUT_MS)) {
+        if (strncmp(line, expected, strlen(expected)) == 0) {
+            return true;
+        }
+        if (strcmp(line, "ERROR") == 0) {
+            return false;
+        }
+        if (info != NULL && line[0] == '+') {
+            snprintf(info, info_size, "%s", line);
+        }
+    }
+    ESP_LOGW(TAG, "No response to %s", command);
+    return false;
+}
+
+// Wait for *ATREADY in short steps, so an abort is noticed
+static bool wait_ready(int timeout_ms) {
+    char line[AT_LINE_SIZE];
+    for (int waited = 0; waited < timeout_ms && !s_abort; waited += 100) {
+        if (read_line(s_slave_fd, line, sizeof(line), 100)) {
+            return strncmp(line, "*ATREADY", 8) == 0;
+        }
+    }
+    return false;
+}
+
+// Power on the fake modem and open the pseudo terminal
+static esp_err_t power_on_modem(void) {
+    phase_power_on(PHASE_POWER_MODEM);
+
+    s_master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (s_master_fd < 0 || grantpt(s_master_fd) != 0 || unlockpt(s_master_fd) != 0) {
+        ESP_LOGE(TAG, "Failed to create pseudo terminal");
+        return ESP_FAIL;
+    }
+    s_slave_fd = open(ptsname(s_master_fd), O_RDWR | O_NOCTTY);
+    if (s_slave_fd < 0) {
+        ESP_LOGE(TAG, "Failed to open pseudo terminal");
+        return ESP_FAIL;
+    }
+
+    // Raw mode, like the UART
+    struct termios tio;
+    tcgetattr(s_slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(s_slave_fd, TCSANOW, &tio);
+
+    s_modem_running = true;
+    if (pthread_create(&s_modem_thread, NULL, fake_modem_thread, NULL) != 0) {
+        s_modem_running = false;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Fake A7670E on %s", ptsname(s_master_fd));
+    return ESP_OK;
+}
+
+// Stop the fake modem and close the pseudo terminal
+static void power_off_modem(void) {
+    if (s_modem_running) {
+        at_command("AT+CPOWD=1", "NORMAL POWER DOWN", NULL, 0);
+        s_modem_running = false;
+        pthread_join(s_modem_thread, NULL);
+    }
+    if (s_slave_fd >= 0) {
+        close(s_slave_fd);
+        s_slave_fd = -1;
+    }
+    if (s_master_fd >= 0) {
+        close(s_master_fd);
+        s_master_fd = -1;
+    }
+    phase_power_off(PHASE_POWER_MODEM);
+}
+
+// Modem initialization
+esp_err_t gsm_modem_init(void) {
+    if (s_modem_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Initializing GSM modem");
+    s_abort = false;
+
+    phase_begin(PHASE_MODEM_BOOT);
+    if (power_on_modem() != ESP_OK) {
+        phase_end(PHASE_MODEM_BOOT);
+        power_off_modem();
+        return ESP_FAIL;
+    }
+
+    // Same bring-up sequence as the real modem
+    bool ready = wait_ready(sim_scaled_ms(30000));
+    ready = ready && at_command("AT", "OK", NULL, 0);
+    ready = ready && at_command("AT+CPIN?", "OK", NULL, 0);
+    char csq[AT_LINE_SIZE] = "";
+    ready = ready && at_command("AT+CSQ", "OK", csq, sizeof(csq));
+    int rssi, ber;
+    if (sscanf(csq, "+CSQ: %d,%d", &rssi, &ber) == 2) {
+        s_signal_quality = rssi;
+    }
+    phase_end(PHASE_MODEM_BOOT);
+
+    if (ready && (rand() % 100) < env_long("SIM_MODEM_FAIL_PERCENT", 0)) {
+        ESP_LOGW(TAG, "Simulated modem failure");
+        ready = false;
+    }
+    if (!ready) {
+        ESP_LOGE(TAG, "Modem initializing failed: Start checking failed");
+        power_off_modem();
+        return ESP_FAIL;
+    }
+
+    // Enabling data transfer mode
+    phase_begin(PHASE_PPP);
+    bool connected = at_command("AT+CGDCONT=1,\"IP\",\"internet\"", "OK", NULL, 0) &&
+                     at_command("ATD*99#", "CONNECT", NULL, 0);
+    phase_end(PHASE_PPP);
+    if (!connected) {
+        ESP_LOGE(TAG, "Modem initializing failed: Failed to enable data mode");
+        power_off_modem();
+        return ESP_FAIL;
+    }
+
+    s_modem_initialized = true;
+    ESP_LOGI(TAG, "Modem initialization completed successfully");
+    return ESP_OK;
+}
+
+// Abort a running bring-up
+void gsm_modem_abort(void) {
+    s_abort = true;
+}
+
+// Getting the signal quality of the last bring-up
+int gsm_modem_get_signal_quality(void) {
+    return s_signal_quality;
+}
+
+// Modem deinitialization
+esp_err_t gsm_modem_deinit(void) {
+    if (!s_modem_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(TAG, "Deinitializing GSM modem");
+    power_off_modem();
+    s_modem_initialized = false;
+    return ESP_OK;
+}
+
+// Getting battery charge status
+esp_err_t gsm_modem_get_battery_status(battery_status_t *status) {
+    if (!status || !s_modem_running) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The data mode is not emulated, the command port stays available
+    char info[AT_LINE_SIZE] = "";
+    float volts = 0;
+    if (!at_command("AT+CBC", "OK", info, sizeof(info)) || sscanf(info, "+CBC: %fV", &volts) != 1) {
+        return ESP_FAIL;
+    }
+    status->voltage = (int)(volts * 1000);
+    status->charge_status = -1;
+    status->level = -1;
+    return ESP_OK;
+}
+
+// The host clock stands in for NTP
+time_t gsm_get_network_time(void) {
+    if (!s_modem_initialized) {
+        ESP_LOGE(TAG, "Network not connected or no IP address");
+        return 0;
+    }
+    phase_begin(PHASE_TIME_SYNC);
+    time_t now = time(NULL);
+    phase_end(PHASE_TIME_SYNC);
+    return now;
+}
+
+esp_err_t modem_power_off(void) {
+    ESP_LOGI(TAG, "Power off the modem");
+    power_off_modem();
+    s_modem_initialized = false;
+    return ESP_OK;
+}
@@ -27,6 +27,14 @@ typedef struct {
 esp_err_t gsm_modem_init(void);
 
 
+/**
+ * @brief Abort a running modem initialization or network time request
+ *
+ * Safe to call from another task. The running function gives up after the
+ * current AT command and returns a failure.
+ */
+void gsm_modem_abort(void);
+
 /**
  * @brief Deinitialization of the GSM modem
  * 
@@ -41,6 +49,13 @@ esp_err_t gsm_modem_deinit(void);
  */
 esp_err_t gsm_modem_get_battery_status(battery_status_t* status);
 
+/**
+ * @brief Get the signal quality reported by AT+CSQ during the last modem initialization
+ * 
+ * @return int RSSI 0-31 (-113 to -51 dBm), 99 if unknown
+ */
+int gsm_modem_get_signal_quality(void);
+
 /**
  * @brief Get current time from GSM network
  * 
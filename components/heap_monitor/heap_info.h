@@ -0,0 +1,23 @@
+// heap_info.h
+// Heap state backend of the heap monitor: heap_caps on the device,
+// malloc interposition in the Linux target build.
+#pragma once
+
+#include "heap_monitor.h"
+
+/**
+ * @brief Initialize the backend
+ */
+void heap_info_init(void);
+
+/**
+ * @brief Read the current heap state
+ *
+ * @param info Pointer to store the heap state
+ */
+void heap_info_get(heap_monitor_info_t *info);
+
+/**
+ * @brief Start a new wake cycle for the lowest free heap
+ */
+void heap_info_cycle_end(void);
@@ -0,0 +1,21 @@
+// heap_info_caps.c
+// Heap state from the ESP-IDF heap capabilities allocator.
+#include "heap_info.h"
+#include "esp_heap_caps.h"
+
+void heap_info_init(void) {
+}
+
+// The lowest free heap starts over with the boot after deep sleep
+void heap_info_cycle_end(void) {
+}
+
+void heap_info_get(heap_monitor_info_t *info) {
+    multi_heap_info_t caps;
+    heap_caps_get_info(&caps, MALLOC_CAP_8BIT);
+
+    info->free_bytes = caps.total_free_bytes;
+    info->min_free_bytes = caps.minimum_free_bytes;
+    info->largest_free_block = caps.largest_free_block;
+    info->allocated_blocks = caps.allocated_blocks;
+}
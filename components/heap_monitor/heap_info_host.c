@@ -0,0 +1,87 @@
+// heap_info_host.c
+// Heap state for the Linux target build. malloc, calloc, realloc and free
+// are wrapped at link time and the usage is subtracted from a heap of the
+// size of the ESP32 data RAM. The host allocator does not fragment like the
+// device heap, so the largest free block is the free heap.
+#include "heap_info.h"
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIM_HEAP_SIZE   (160 * 1024)    // Free heap of the firmware after boot on the device
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static int64_t s_used = 0;
+static int64_t s_peak = 0;
+static int32_t s_blocks = 0;
+
+// Add to the usage and track the peak
+static void account(int64_t delta, int32_t blocks) {
+    int64_t used = __atomic_add_fetch(&s_used, delta, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_blocks, blocks, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&s_peak, __ATOMIC_RELAXED);
+    while (used > peak &&
+           !__atomic_compare_exchange_n(&s_peak, &peak, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if (ptr != NULL) {
+        account((int64_t)malloc_usable_size(ptr), 1);
+    }
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    if (ptr != NULL) {
+        account((int64_t)malloc_usable_size(ptr), 1);
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t old_size = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr != NULL) {
+        account((int64_t)malloc_usable_size(new_ptr) - (int64_t)old_size, (ptr == NULL) ? 1 : 0);
+    } else if (ptr != NULL && size == 0) {
+        account(-(int64_t)old_size, -1);
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) {
+        account(-(int64_t)malloc_usable_size(ptr), -1);
+    }
+    __real_free(ptr);
+}
+
+void heap_info_init(void) {
+}
+
+// The simulated cycles run in one process, the lowest free heap starts over like after a boot
+void heap_info_cycle_end(void) {
+    __atomic_store_n(&s_peak, __atomic_load_n(&s_used, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+// Free heap for a usage, never below zero
+static size_t free_for(int64_t used) {
+    return (used < SIM_HEAP_SIZE) ? (size_t)(SIM_HEAP_SIZE - used) : 0;
+}
+
+void heap_info_get(heap_monitor_info_t *info) {
+    int64_t used = __atomic_load_n(&s_used, __ATOMIC_RELAXED);
+    int32_t blocks = __atomic_load_n(&s_blocks, __ATOMIC_RELAXED);
+
+    info->free_bytes = free_for(used);
+    info->min_free_bytes = free_for(__atomic_load_n(&s_peak, __ATOMIC_RELAXED));
+    info->largest_free_block = info->free_bytes;
+    info->allocated_blocks = (blocks > 0) ? (uint32_t)blocks : 0;
+}
@@ -0,0 +1,329 @@
+/**
+ * @file heap_monitor.c
+ * @brief Heap high-water and fragmentation tracking per wake cycle
+ *
+ * The heap is sampled at every phase profiler boundary. The mbedTLS
+ * allocator is replaced by a counting wrapper, cJSON allocations are counted
+ * by the JSON arena. The worst values of each cycle are folded into
+ * statistics in RTC memory, which survive deep sleep, and are reported
+ * together with the phase statistics.
+ */
+
+#include "heap_monitor.h"
+#include "heap_info.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "json_arena.h"
+#include "mbedtls/platform.h"
+#include "phase_profiler.h"
+
+static const char *TAG = "heap_monitor";
+
+#define HEAP_STATS_MAGIC    0x48504d32  // "HPM2"
+#define NO_PHASE            0xFF
+
+// Heap values of one phase in the current cycle
+typedef struct {
+    bool seen;
+    size_t min_free;
+    size_t min_largest;
+    uint32_t cjson_start;   // Allocation counters when the phase began
+    uint32_t tls_start;
+    uint32_t cjson_allocs;  // Allocations while the phase ran
+    uint32_t tls_allocs;
+} phase_heap_t;
+
+// Worst values of one phase over the reported cycles
+typedef struct {
+    uint32_t min_free;
+    uint32_t min_largest;
+    uint32_t max_cjson_allocs;
+    uint32_t max_tls_allocs;
+} phase_heap_stat_t;
+
+// Worst values kept in RTC memory
+typedef struct {
+    uint32_t magic;
+    uint32_t cycles;
+    uint32_t min_free;              // Lowest free heap since boot, over all cycles
+    uint32_t min_largest;           // Smallest largest free block at a phase boundary
+    uint32_t max_fragmentation;     // Percent of the free heap not in the largest block
+    uint8_t min_largest_phase;      // Phase in which the smallest block was seen
+    uint32_t max_cjson_allocs;      // Most cJSON allocations in one cycle
+    uint32_t max_cjson_live;        // Most cJSON blocks alive at the same time
+    uint32_t max_tls_allocs;
+    uint32_t max_tls_live;
+    phase_heap_stat_t phases[PHASE_COUNT];
+} heap_rtc_stats_t;
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+#define HEAP_PHASE_NAME(id, name, power, profile) [id] = name,
+    PHASE_PROFILER_PHASES(HEAP_PHASE_NAME)
+#undef HEAP_PHASE_NAME
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static heap_monitor_counter_t s_tls;
+static phase_heap_t s_phases[PHASE_COUNT];
+
+RTC_DATA_ATTR static heap_rtc_stats_t s_stats;
+
+// Count an allocation, the counter is updated under the lock
+static void count_alloc(heap_monitor_counter_t *counter, size_t size) {
+    portENTER_CRITICAL(&s_lock);
+    counter->allocs++;
+    counter->bytes += size;
+    uint32_t live = counter->allocs - counter->frees;
+    if (live > counter->peak_live) {
+        counter->peak_live = live;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void count_free(heap_monitor_counter_t *counter) {
+    portENTER_CRITICAL(&s_lock);
+    counter->frees++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// cJSON counters from the JSON arena
+static void get_cjson_counter(heap_monitor_counter_t *counter) {
+    json_arena_stats_t stats;
+    json_arena_get_stats(&stats);
+    counter->allocs = stats.allocs;
+    counter->frees = stats.frees;
+    counter->peak_live = stats.peak_live;
+    counter->bytes = stats.bytes;
+}
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+// mbedTLS allocator
+static void *tls_calloc(size_t count, size_t size) {
+    void *ptr = calloc(count, size);
+    if (ptr != NULL) {
+        count_alloc(&s_tls, count * size);
+    }
+    return ptr;
+}
+
+static void tls_free(void *ptr) {
+    if (ptr != NULL) {
+        count_free(&s_tls);
+    }
+    free(ptr);
+}
+#endif
+
+// Snapshot the heap at a phase boundary
+static void on_phase_boundary(phase_id_t phase, bool begin) {
+    heap_monitor_info_t info;
+    heap_monitor_counter_t cjson;
+    heap_info_get(&info);
+    get_cjson_counter(&cjson);
+
+    portENTER_CRITICAL(&s_lock);
+    phase_heap_t *p = &s_phases[phase];
+    if (!p->seen || info.free_bytes < p->min_free) {
+        p->min_free = info.free_bytes;
+    }
+    if (!p->seen || info.largest_free_block < p->min_largest) {
+        p->min_largest = info.largest_free_block;
+    }
+    p->seen = true;
+
+    if (begin) {
+        p->cjson_start = cjson.allocs;
+        p->tls_start = s_tls.allocs;
+    } else {
+        p->cjson_allocs += cjson.allocs - p->cjson_start;
+        p->tls_allocs += s_tls.allocs - p->tls_start;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Initialize heap tracking
+esp_err_t heap_monitor_init(void) {
+    heap_info_init();
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+    if (mbedtls_platform_set_calloc_free(tls_calloc, tls_free) != 0) {
+        ESP_LOGW(TAG, "Failed to install the mbedTLS allocator");
+    }
+#else
+    ESP_LOGW(TAG, "mbedTLS allocator cannot be replaced, TLS allocations are not counted");
+#endif
+
+    if (s_stats.magic != HEAP_STATS_MAGIC) {
+        heap_monitor_reset_stats();
+    }
+
+    phase_profiler_set_hook(on_phase_boundary);
+    return ESP_OK;
+}
+
+// Read the current heap state
+void heap_monitor_get_info(heap_monitor_info_t *info) {
+    heap_info_get(info);
+}
+
+// Read the allocation counters of this cycle
+void heap_monitor_get_counters(heap_monitor_counter_t *cjson, heap_monitor_counter_t *mbedtls) {
+    if (cjson != NULL) {
+        get_cjson_counter(cjson);
+    }
+    portENTER_CRITICAL(&s_lock);
+    if (mbedtls != NULL) {
+        *mbedtls = s_tls;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Percent of the free heap outside the largest free block
+static uint32_t fragmentation(size_t free_bytes, size_t largest) {
+    return (free_bytes > 0 && largest <= free_bytes) ? (uint32_t)(100 - largest * 100 / free_bytes) : 0;
+}
+
+// End the wake cycle
+void heap_monitor_cycle_end(void) {
+    heap_monitor_info_t info;
+    heap_info_get(&info);
+
+    heap_monitor_counter_t cjson, tls;
+    phase_heap_t phases[PHASE_COUNT];
+    get_cjson_counter(&cjson);
+    portENTER_CRITICAL(&s_lock);
+    tls = s_tls;
+    memcpy(phases, s_phases, sizeof(phases));
+    portEXIT_CRITICAL(&s_lock);
+
+    // Worst block size of the cycle
+    size_t min_largest = info.largest_free_block;
+    uint8_t min_largest_phase = NO_PHASE;
+    uint32_t max_fragmentation = fragmentation(info.free_bytes, info.largest_free_block);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (!phases[i].seen) {
+            continue;
+        }
+        if (phases[i].min_largest < min_largest) {
+            min_largest = phases[i].min_largest;
+            min_largest_phase = i;
+        }
+        uint32_t frag = fragmentation(phases[i].min_free, phases[i].min_largest);
+        if (frag > max_fragmentation) {
+            max_fragmentation = frag;
+        }
+        ESP_LOGI(TAG, "%-10s free %6u B, block %6u B, cJSON %4lu, TLS %4lu allocs", PHASE_NAMES[i],
+                 (unsigned)phases[i].min_free, (unsigned)phases[i].min_largest,
+                 (unsigned long)phases[i].cjson_allocs, (unsigned long)phases[i].tls_allocs);
+    }
+
+    ESP_LOGI(TAG, "Cycle: min free %u B, min block %u B (%s), fragmentation %lu%%, "
+             "cJSON %lu allocs (%lu live), TLS %lu allocs (%lu live)",
+             (unsigned)info.min_free_bytes, (unsigned)min_largest,
+             (min_largest_phase != NO_PHASE) ? PHASE_NAMES[min_largest_phase] : "end",
+             (unsigned long)max_fragmentation, (unsigned long)cjson.allocs, (unsigned long)cjson.peak_live,
+             (unsigned long)tls.allocs, (unsigned long)tls.peak_live);
+
+    // Fold the cycle into the worst values
+    s_stats.cycles++;
+    if (info.min_free_bytes < s_stats.min_free) {
+        s_stats.min_free = info.min_free_bytes;
+    }
+    if (min_largest < s_stats.min_largest) {
+        s_stats.min_largest = min_largest;
+        s_stats.min_largest_phase = min_largest_phase;
+    }
+    if (max_fragmentation > s_stats.max_fragmentation) {
+        s_stats.max_fragmentation = max_fragmentation;
+    }
+    if (cjson.allocs > s_stats.max_cjson_allocs) {
+        s_stats.max_cjson_allocs = cjson.allocs;
+    }
+    if (cjson.peak_live > s_stats.max_cjson_live) {
+        s_stats.max_cjson_live = cjson.peak_live;
+    }
+    if (tls.allocs > s_stats.max_tls_allocs) {
+        s_stats.max_tls_allocs = tls.allocs;
+    }
+    if (tls.peak_live > s_stats.max_tls_live) {
+        s_stats.max_tls_live = tls.peak_live;
+    }
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        phase_heap_stat_t *stat = &s_stats.phases[i];
+        if (!phases[i].seen) {
+            continue;
+        }
+        if (phases[i].min_free < stat->min_free) {
+            stat->min_free = phases[i].min_free;
+        }
+        if (phases[i].min_largest < stat->min_largest) {
+            stat->min_largest = phases[i].min_largest;
+        }
+        if (phases[i].cjson_allocs > stat->max_cjson_allocs) {
+            stat->max_cjson_allocs = phases[i].cjson_allocs;
+        }
+        if (phases[i].tls_allocs > stat->max_tls_allocs) {
+            stat->max_tls_allocs = phases[i].tls_allocs;
+        }
+    }
+
+    // Start the next cycle, normally it begins with a fresh boot after deep sleep
+    portENTER_CRITICAL(&s_lock);
+    memset(&s_tls, 0, sizeof(s_tls));
+    memset(s_phases, 0, sizeof(s_phases));
+    portEXIT_CRITICAL(&s_lock);
+    json_arena_reset_stats();
+    heap_info_cycle_end();
+}
+
+// Format the worst values since the last report as text
+esp_err_t heap_monitor_format_summary(char *buffer, size_t buffer_size) {
+    if (buffer == NULL || buffer_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buffer[0] = '\0';
+    if (s_stats.magic != HEAP_STATS_MAGIC || s_stats.cycles == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int len = snprintf(buffer, buffer_size,
+                       "Heap over %lu cycles: min free %lu B, min block %lu B (%s), fragmentation %lu%%, "
+                       "cJSON max %lu allocs (%lu live), TLS max %lu allocs (%lu live)",
+                       (unsigned long)s_stats.cycles, (unsigned long)s_stats.min_free,
+                       (unsigned long)s_stats.min_largest,
+                       (s_stats.min_largest_phase < PHASE_COUNT) ? PHASE_NAMES[s_stats.min_largest_phase] : "end",
+                       (unsigned long)s_stats.max_fragmentation,
+                       (unsigned long)s_stats.max_cjson_allocs, (unsigned long)s_stats.max_cjson_live,
+                       (unsigned long)s_stats.max_tls_allocs, (unsigned long)s_stats.max_tls_live);
+
+    for (int i = 0; i < PHASE_COUNT && len >= 0 && (size_t)len < buffer_size; i++) {
+        const phase_heap_stat_t *stat = &s_stats.phases[i];
+        if (stat->min_free == UINT32_MAX) {
+            continue;
+        }
+        len += snprintf(buffer + len, buffer_size - len, "\n%s: free %lu B, block %lu B, cJSON %lu, TLS %lu",
+                        PHASE_NAMES[i], (unsigned long)stat->min_free, (unsigned long)stat->min_largest,
+                        (unsigned long)stat->max_cjson_allocs, (unsigned long)stat->max_tls_allocs);
+    }
+
+    // A truncated summary is still useful, it is only cut at the end
+    return ESP_OK;
+}
+
+// Reset the statistics after they were reported
+void heap_monitor_reset_stats(void) {
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.magic = HEAP_STATS_MAGIC;
+    s_stats.min_free = UINT32_MAX;
+    s_stats.min_largest = UINT32_MAX;
+    s_stats.min_largest_phase = NO_PHASE;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        s_stats.phases[i].min_free = UINT32_MAX;
+        s_stats.phases[i].min_largest = UINT32_MAX;
+    }
+}
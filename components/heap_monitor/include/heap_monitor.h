@@ -0,0 +1,81 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Heap state at one point of the cycle
+ */
+typedef struct {
+    size_t free_bytes;          // Free 8-bit capable heap
+    size_t min_free_bytes;      // Lowest free heap since boot
+    size_t largest_free_block;  // Largest allocatable block
+    uint32_t allocated_blocks;  // Blocks in use
+} heap_monitor_info_t;
+
+/**
+ * @brief Allocation counters of the instrumented allocators
+ */
+typedef struct {
+    uint32_t allocs;        // Allocations
+    uint32_t frees;         // Frees
+    uint32_t peak_live;     // Most blocks allocated at the same time
+    uint32_t bytes;         // Bytes requested in total
+} heap_monitor_counter_t;
+
+/**
+ * @brief Initialize heap tracking
+ *
+ * Installs a counting allocator for mbedTLS and snapshots the heap at every
+ * phase profiler boundary. cJSON allocations are counted by the JSON arena.
+ * Must be called before the first mbedTLS allocation.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t heap_monitor_init(void);
+
+/**
+ * @brief Read the current heap state
+ *
+ * @param info Pointer to store the heap state
+ */
+void heap_monitor_get_info(heap_monitor_info_t *info);
+
+/**
+ * @brief Read the allocation counters of this cycle
+ *
+ * @param cjson Pointer to store the cJSON counters, may be NULL
+ * @param mbedtls Pointer to store the mbedTLS counters, may be NULL
+ */
+void heap_monitor_get_counters(heap_monitor_counter_t *cjson, heap_monitor_counter_t *mbedtls);
+
+/**
+ * @brief End the wake cycle
+ *
+ * Logs the worst values of the cycle and folds them into the statistics kept
+ * in RTC memory. Called once before deep sleep, after phase_profiler_cycle_end().
+ */
+void heap_monitor_cycle_end(void);
+
+/**
+ * @brief Format the worst values since the last report as text
+ *
+ * @param buffer Buffer for the summary
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if no cycles were recorded
+ */
+esp_err_t heap_monitor_format_summary(char *buffer, size_t buffer_size);
+
+/**
+ * @brief Reset the statistics after they were reported
+ */
+void heap_monitor_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,393 @@
+/**
+ * @file https_client.c
+ * @brief Shared HTTPS transport with one pooled keep-alive connection per host
+ *
+ * Firebase and Discord used to create a new esp_http_client (and with it a new
+ * DNS lookup and TLS handshake) for every request. Here every host gets one
+ * client that is reused for the whole wake cycle:
+ *
+ * 1. The connection is kept alive, the handshake is done once per host
+ * 2. Root certificates are parsed once into the global CA store
+ * 3. Request bodies are never copied, either a caller buffer or a body provider is used
+ * 4. Every request is timed and counted in a duration histogram
+ */
+
+#include "https_client.h"
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "sdkconfig.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+#include "phase_profiler.h"
+
+static const char *TAG = "https_client";
+
+#define HOST_NAME_MAX_LEN   64
+#define HEADER_NAME_MAX_LEN 32
+#define HISTOGRAM_BASE_US   250000  // Upper bound of the first histogram bucket
+
+// Pooled connection of one host
+struct https_client_host {
+    bool used;
+    char host[HOST_NAME_MAX_LEN];
+    esp_http_client_handle_t client;
+    SemaphoreHandle_t lock;
+    bool connected;
+    // Names of the headers set by the previous request, removed before the next one
+    char set_headers[HTTPS_CLIENT_MAX_HEADERS][HEADER_NAME_MAX_LEN];
+    size_t set_header_count;
+    // State of the request in progress, used by the event handler
+    const https_client_request_t *active;
+    size_t response_len;
+    esp_err_t data_error;       // First error of the body callback
+    https_client_stats_t stats;
+};
+
+static struct https_client_host s_hosts[HTTPS_CLIENT_MAX_HOSTS];
+
+// HTTP event handler shared by all hosts
+static esp_err_t https_client_event_handler(esp_http_client_event_t *evt) {
+    struct https_client_host *host = (struct https_client_host *)evt->user_data;
+    const https_client_request_t *request = host ? host->active : NULL;
+
+    switch (evt->event_id) {
+        case HTTP_EVENT_ERROR:
+            ESP_LOGW(TAG, "HTTP_EVENT_ERROR (%s)", host ? host->host : "?");
+            break;
+        case HTTP_EVENT_ON_CONNECTED:
+            ESP_LOGD(TAG, "Connected to %s", host ? host->host : "?");
+            if (host) {
+                host->stats.connects++;
+                host->connected = true;
+            }
+            phase_end(PHASE_CONNECT);
+            break;
+        case HTTP_EVENT_ON_HEADER:
+            if (request && request->on_header) {
+                request->on_header(request->header_ctx, evt->header_key, evt->header_value);
+            }
+            break;
+        case HTTP_EVENT_ON_DATA:
+            if (host) {
+                host->stats.bytes_received += evt->data_len;
+            }
+            if (request && request->on_data && host->data_error == ESP_OK) {
+                host->data_error = request->on_data(request->data_ctx, esp_http_client_get_status_code(evt->client),
+                                                    (const char *)evt->data, (size_t)evt->data_len);
+            }
+            if (request && request->response_buf && request->response_buf_size > 1) {
+                size_t space = request->response_buf_size - 1 - host->response_len;
+                size_t copy = ((size_t)evt->data_len < space) ? (size_t)evt->data_len : space;
+                memcpy(request->response_buf + host->response_len, evt->data, copy);
+                host->response_len += copy;
+                request->response_buf[host->response_len] = '\0';
+            }
+            break;
+        case HTTP_EVENT_DISCONNECTED:
+            ESP_LOGD(TAG, "Disconnected from %s", host ? host->host : "?");
+            if (host) {
+                host->connected = false;
+            }
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
+
+// Find the pool entry of a host
+static struct https_client_host *find_host(const char *host_name) {
+    for (int i = 0; i < HTTPS_CLIENT_MAX_HOSTS; i++) {
+        if (s_hosts[i].used && strcmp(s_hosts[i].host, host_name) == 0) {
+            return &s_hosts[i];
+        }
+    }
+    return NULL;
+}
+
+// Duration histogram bucket: <250 ms, <500 ms, <1 s, ... , >=16 s
+static int histogram_bucket(int64_t duration_us) {
+    int bucket = 0;
+    int64_t limit = HISTOGRAM_BASE_US;
+    while (bucket < HTTPS_CLIENT_HISTOGRAM_BUCKETS - 1 && duration_us >= limit) {
+        limit *= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+esp_err_t https_client_open(const https_client_host_config_t *config, https_client_handle_t *handle) {
+    if (config == NULL || config->host == NULL || handle == NULL ||
+        strlen(config->host) >= HOST_NAME_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct https_client_host *host = find_host(config->host);
+    if (host != NULL) {
+        *handle = host;
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < HTTPS_CLIENT_MAX_HOSTS && host == NULL; i++) {
+        if (!s_hosts[i].used) {
+            host = &s_hosts[i];
+        }
+    }
+    if (host == NULL) {
+        ESP_LOGE(TAG, "Connection pool is full, cannot add %s", config->host);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(host, 0, sizeof(*host));
+    strncpy(host->host, config->host, sizeof(host->host) - 1);
+
+    host->lock = xSemaphoreCreateMutex();
+    if (host->lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Parse the root certificates once into the shared CA store
+    bool use_global_ca_store = false;
+    if (config->cert_pem != NULL) {
+        esp_err_t ret = esp_tls_set_global_ca_store((const unsigned char *)config->cert_pem,
+                                                    strlen(config->cert_pem) + 1);
+        if (ret == ESP_OK) {
+            use_global_ca_store = true;
+        } else {
+            ESP_LOGW(TAG, "Failed to add certificate of %s to CA store (%s), using it per connection",
+                     config->host, esp_err_to_name(ret));
+        }
+    }
+
+    char url[HOST_NAME_MAX_LEN + 16];
+    snprintf(url, sizeof(url), "https://%s/", config->host);
+
+    esp_http_client_config_t http_config = {
+        .url = url,
+        .event_handler = https_client_event_handler,
+        .user_data = host,
+        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .cert_pem = use_global_ca_store ? NULL : config->cert_pem,
+        .use_global_ca_store = use_global_ca_store,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+        .crt_bundle_attach = config->use_crt_bundle ? esp_crt_bundle_attach : NULL,
+#endif
+        .buffer_size = config->rx_buffer_size,
+        .buffer_size_tx = config->tx_buffer_size,
+        .timeout_ms = config->timeout_ms,
+        .keep_alive_enable = true,
+    };
+
+    host->client = esp_http_client_init(&http_config);
+    if (host->client == NULL) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP client for %s", config->host);
+        vSemaphoreDelete(host->lock);
+        return ESP_FAIL;
+    }
+
+    host->used = true;
+    *handle = host;
+    ESP_LOGI(TAG, "Pooled connection created for %s (rx %d, tx %d bytes)",
+             config->host, config->rx_buffer_size, config->tx_buffer_size);
+    return ESP_OK;
+}
+
+// Replace the headers of the previous request with the headers of this one
+static esp_err_t apply_headers(struct https_client_host *host, const https_client_request_t *request) {
+    for (size_t i = 0; i < host->set_header_count; i++) {
+        esp_http_client_delete_header(host->client, host->set_headers[i]);
+    }
+    host->set_header_count = 0;
+
+    for (size_t i = 0; i < request->header_count; i++) {
+        const https_client_header_t *header = &request->headers[i];
+        if (strlen(header->name) >= HEADER_NAME_MAX_LEN) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        esp_err_t ret = esp_http_client_set_header(host->client, header->name, header->value);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set header %s: %s", header->name, esp_err_to_name(ret));
+            return ret;
+        }
+        strcpy(host->set_headers[host->set_header_count++], header->name);
+    }
+    return ESP_OK;
+}
+
+// Send the body chunk by chunk from the body provider and read the response
+static esp_err_t perform_streamed(struct https_client_host *host, const https_client_request_t *request) {
+    esp_http_client_handle_t client = host->client;
+
+    esp_err_t ret = esp_http_client_open(client, (int)request->body_len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    size_t sent = 0;
+    while (sent < request->body_len) {
+        const char *chunk = NULL;
+        size_t chunk_len = 0;
+        ret = request->body_provider(request->body_ctx, &chunk, &chunk_len);
+        if (ret != ESP_OK) {
+            break;
+        }
+        if (chunk_len == 0 || sent + chunk_len > request->body_len) {
+            ESP_LOGE(TAG, "Body provider returned %zu bytes after %zu of %zu",
+                     chunk_len, sent, request->body_len);
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        size_t written = 0;
+        while (written < chunk_len) {
+            int wlen = esp_http_client_write(client, chunk + written, (int)(chunk_len - written));
+            if (wlen <= 0) {
+                ret = ESP_FAIL;
+                break;
+            }
+            written += wlen;
+        }
+        if (ret != ESP_OK) {
+            break;
+        }
+        sent += chunk_len;
+    }
+
+    if (ret == ESP_OK && esp_http_client_fetch_headers(client) < 0) {
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK) {
+        // Reading the body triggers HTTP_EVENT_ON_DATA, which stores it in response_buf
+        ret = esp_http_client_flush_response(client, NULL);
+    }
+    if (ret != ESP_OK || !esp_http_client_is_complete_data_received(client)) {
+        // The connection is in an unknown state, start over on the next request
+        esp_http_client_close(client);
+    }
+
+    host->stats.bytes_sent += sent;
+    return ret;
+}
+
+esp_err_t https_client_request(https_client_handle_t handle, const https_client_request_t *request,
+                               https_client_response_t *response) {
+    if (handle == NULL || request == NULL || request->url == NULL ||
+        request->header_count > HTTPS_CLIENT_MAX_HEADERS ||
+        (request->body_provider != NULL && request->body_len == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct https_client_host *host = handle;
+    xSemaphoreTake(host->lock, portMAX_DELAY);
+
+    int64_t start_time = esp_timer_get_time();
+    phase_begin(PHASE_HTTP);
+    if (!host->connected) {
+        phase_begin(PHASE_CONNECT);
+    }
+    host->active = request;
+    host->response_len = 0;
+    host->data_error = ESP_OK;
+    if (request->response_buf && request->response_buf_size > 0) {
+        request->response_buf[0] = '\0';
+    }
+
+    esp_http_client_handle_t client = host->client;
+    esp_err_t ret = esp_http_client_set_url(client, request->url);
+    if (ret == ESP_OK) {
+        ret = esp_http_client_set_method(client, request->method);
+    }
+    if (ret == ESP_OK) {
+        ret = apply_headers(host, request);
+    }
+
+    if (ret == ESP_OK) {
+        if (request->body_provider != NULL) {
+            ret = perform_streamed(host, request);
+        } else {
+            // The body is passed by pointer, esp_http_client does not copy it
+            esp_http_client_set_post_field(client, request->body, (int)request->body_len);
+            ret = esp_http_client_perform(client);
+            if (ret == ESP_OK) {
+                host->stats.bytes_sent += request->body_len;
+            }
+        }
+    }
+
+    if (ret == ESP_OK && host->data_error != ESP_OK) {
+        ret = host->data_error;
+    }
+    int status_code = (ret == ESP_OK) ? esp_http_client_get_status_code(client) : 0;
+    int64_t duration_us = esp_timer_get_time() - start_time;
+    phase_end(PHASE_CONNECT);
+    phase_end(PHASE_HTTP);
+
+    // Update statistics
+    host->stats.requests++;
+    if (ret != ESP_OK) {
+        host->stats.failures++;
+    }
+    host->stats.total_us += duration_us;
+    if (duration_us > host->stats.max_us) {
+        host->stats.max_us = duration_us;
+    }
+    host->stats.histogram[histogram_bucket(duration_us)]++;
+
+    if (response) {
+        response->status_code = status_code;
+        response->response_len = host->response_len;
+        response->duration_us = duration_us;
+    }
+
+    host->active = NULL;
+    xSemaphoreGive(host->lock);
+
+    ESP_LOGI(TAG, "%s: status %d, %" PRId64 " ms, result: %s", host->host, status_code,
+             duration_us / 1000, esp_err_to_name(ret));
+    return ret;
+}
+
+esp_err_t https_client_get_stats(https_client_handle_t handle, https_client_stats_t *stats) {
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = handle->stats;
+    return ESP_OK;
+}
+
+void https_client_log_stats(void) {
+    for (int i = 0; i < HTTPS_CLIENT_MAX_HOSTS; i++) {
+        const struct https_client_host *host = &s_hosts[i];
+        if (!host->used || host->stats.requests == 0) {
+            continue;
+        }
+        const https_client_stats_t *s = &host->stats;
+        ESP_LOGI(TAG, "%s: %" PRIu32 " requests, %" PRIu32 " failed, %" PRIu32 " connects, "
+                 "sent %" PRIu64 " B, received %" PRIu64 " B, avg %" PRId64 " ms, max %" PRId64 " ms",
+                 host->host, s->requests, s->failures, s->connects, s->bytes_sent, s->bytes_received,
+                 s->total_us / s->requests / 1000, s->max_us / 1000);
+        ESP_LOGI(TAG, "%s: histogram <0.25s:%" PRIu32 " <0.5s:%" PRIu32 " <1s:%" PRIu32 " <2s:%" PRIu32
+                 " <4s:%" PRIu32 " <8s:%" PRIu32 " <16s:%" PRIu32 " >=16s:%" PRIu32,
+                 host->host, s->histogram[0], s->histogram[1], s->histogram[2], s->histogram[3],
+                 s->histogram[4], s->histogram[5], s->histogram[6], s->histogram[7]);
+    }
+}
+
+void https_client_close_all(void) {
+    for (int i = 0; i < HTTPS_CLIENT_MAX_HOSTS; i++) {
+        struct https_client_host *host = &s_hosts[i];
+        if (host->used) {
+            xSemaphoreTake(host->lock, portMAX_DELAY);
+            esp_http_client_close(host->client);
+            host->connected = false;
+            xSemaphoreGive(host->lock);
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTPS_CLIENT_MAX_HOSTS          3   // Number of pooled host connections
+#define HTTPS_CLIENT_MAX_HEADERS        8   // Maximum request headers per request
+#define HTTPS_CLIENT_HISTOGRAM_BUCKETS  8   // Request duration buckets: <250ms, <500ms, ... , >=16s
+
+/**
+ * @brief Handle of a pooled host connection
+ */
+typedef struct https_client_host *https_client_handle_t;
+
+/**
+ * @brief Host configuration used when the pooled connection is created
+ */
+typedef struct {
+    const char *host;       // Host name, e.g. "discord.com" (used as pool key)
+    const char *cert_pem;   // Root certificate(s) in PEM format, NULL if not used
+    bool use_crt_bundle;    // Attach the ESP x509 certificate bundle
+    int rx_buffer_size;     // Receive buffer size in bytes
+    int tx_buffer_size;     // Transmit buffer size in bytes
+    int timeout_ms;         // Network timeout in milliseconds
+} https_client_host_config_t;
+
+/**
+ * @brief Request header
+ */
+typedef struct {
+    const char *name;
+    const char *value;
+} https_client_header_t;
+
+/**
+ * @brief Body provider callback
+ *
+ * Called repeatedly while the request body is sent. The provider points *chunk
+ * at its own memory (nothing is copied) and sets *chunk_len. It must supply
+ * exactly body_len bytes in total and is not called again after that; a chunk
+ * of 0 bytes or one beyond body_len fails the request with ESP_ERR_INVALID_SIZE.
+ *
+ * @param ctx User context from the request
+ * @param chunk Pointer to the next chunk
+ * @param chunk_len Length of the next chunk
+ * @return esp_err_t ESP_OK to continue, any other value aborts the request
+ */
+typedef esp_err_t (*https_client_body_provider_t)(void *ctx, const char **chunk, size_t *chunk_len);
+
+/**
+ * @brief Response header callback, called once for every response header
+ */
+typedef void (*https_client_header_cb_t)(void *ctx, const char *key, const char *value);
+
+/**
+ * @brief Response body callback, called for every piece of the body as it arrives
+ *
+ * @param ctx User context from the request
+ * @param status_code HTTP status code of the response
+ * @param data Body bytes
+ * @param len Number of bytes
+ * @return esp_err_t ESP_OK to continue, any other value drops the rest of the body and fails the request
+ */
+typedef esp_err_t (*https_client_data_cb_t)(void *ctx, int status_code, const char *data, size_t len);
+
+/**
+ * @brief Request description
+ */
+typedef struct {
+    esp_http_client_method_t method;
+    const char *url;                            // Full URL, host must match the pooled host
+    const https_client_header_t *headers;       // Request headers
+    size_t header_count;                        // Number of request headers
+    const char *body;                           // Body sent as-is (not copied), or NULL
+    size_t body_len;                            // Total body length, also required with body_provider
+    https_client_body_provider_t body_provider; // Alternative to body, streams the body in chunks
+    void *body_ctx;                             // Context for body_provider
+    https_client_header_cb_t on_header;         // Optional response header callback
+    void *header_ctx;                           // Context for on_header
+    https_client_data_cb_t on_data;             // Optional, streams the response body instead of response_buf
+    void *data_ctx;                             // Context for on_data
+    char *response_buf;                         // Optional buffer for the response body
+    size_t response_buf_size;                   // Size of response_buf
+} https_client_request_t;
+
+/**
+ * @brief Result of a request
+ */
+typedef struct {
+    int status_code;        // HTTP status code, 0 if no response was received
+    size_t response_len;    // Bytes stored in response_buf (always null terminated)
+    int64_t duration_us;    // Total request duration
+} https_client_response_t;
+
+/**
+ * @brief Per-host request statistics
+ */
+typedef struct {
+    uint32_t requests;      // Completed requests
+    uint32_t failures;      // Requests that failed on transport level
+    uint32_t connects;      // New TCP/TLS connections (DNS + handshake)
+    uint64_t bytes_sent;    // Request body bytes sent
+    uint64_t bytes_received; // Response body bytes received
+    int64_t total_us;       // Sum of request durations
+    int64_t max_us;         // Longest request
+    uint32_t histogram[HTTPS_CLIENT_HISTOGRAM_BUCKETS]; // Request duration histogram
+} https_client_stats_t;
+
+/**
+ * @brief Get or create the pooled connection for a host
+ *
+ * The connection is kept alive between requests, so the DNS lookup and the TLS
+ * handshake are done once per host instead of once per request. Root certificates
+ * are parsed once into the shared global CA store.
+ *
+ * @param config Host configuration (ignored if the host is already pooled)
+ * @param handle Pointer to store the handle
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t https_client_open(const https_client_host_config_t *config, https_client_handle_t *handle);
+
+/**
+ * @brief Perform a request on a pooled connection
+ *
+ * @param handle Handle returned by https_client_open()
+ * @param request Request description
+ * @param response Pointer to store the result (may be NULL)
+ * @return esp_err_t ESP_OK if a response was received (check status_code)
+ */
+esp_err_t https_client_request(https_client_handle_t handle, const https_client_request_t *request,
+                               https_client_response_t *response);
+
+/**
+ * @brief Get request statistics of a host
+ *
+ * @param handle Handle returned by https_client_open()
+ * @param stats Pointer to store the statistics
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t https_client_get_stats(https_client_handle_t handle, https_client_stats_t *stats);
+
+/**
+ * @brief Log request statistics and duration histograms of all hosts
+ */
+void https_client_log_stats(void);
+
+/**
+ * @brief Close all pooled connections
+ *
+ * Must be called before the network goes down. Handles stay valid and
+ * reconnect on the next request.
+ */
+void https_client_close_all(void);
+
+#ifdef __cplusplus
+}
+#endif
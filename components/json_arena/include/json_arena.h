@@ -0,0 +1,98 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Arena and cJSON allocation statistics
+ */
+typedef struct {
+    size_t capacity;        // Chunk memory currently held by the arena
+    size_t peak_capacity;   // Most chunk memory held at the same time
+    size_t used;            // Bytes handed out in the current scope
+    size_t peak_used;       // Most bytes handed out in one scope
+    uint32_t chunks;        // Chunks allocated from the heap
+    uint32_t allocs;        // cJSON and arena allocations
+    uint32_t frees;         // cJSON frees, frees of arena memory are ignored
+    uint32_t peak_live;     // Most allocations alive at the same time
+    uint32_t bytes;         // Bytes requested in total
+} json_arena_stats_t;
+
+/**
+ * @brief Install the arena as the cJSON allocator
+ *
+ * Must be called before the first cJSON allocation. Outside of an arena
+ * scope cJSON allocates from the heap as before.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t json_arena_init(void);
+
+/**
+ * @brief Begin an arena scope
+ *
+ * Until json_arena_end() all cJSON allocations of the calling task are bump
+ * allocated from chunks of JSON_ARENA_CHUNK_SIZE bytes, and frees are
+ * ignored. Scopes do not nest, other tasks keep using the heap.
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if a scope is already active
+ */
+esp_err_t json_arena_begin(void);
+
+/**
+ * @brief End the arena scope and release all chunks at once
+ *
+ * Nothing allocated in the scope may be used afterwards.
+ */
+void json_arena_end(void);
+
+/**
+ * @brief Allocate a temporary buffer
+ *
+ * Inside a scope the buffer comes from the arena and is released by
+ * json_arena_end(), outside of a scope from the heap. Always release it with
+ * json_arena_free().
+ *
+ * @param size Size in bytes
+ * @return void* Buffer or NULL if out of memory
+ */
+void *json_arena_alloc(size_t size);
+
+/**
+ * @brief Release a buffer from json_arena_alloc(), ignored for arena memory
+ *
+ * @param ptr Buffer or NULL
+ */
+void json_arena_free(void *ptr);
+
+/**
+ * @brief Enable or disable the arena
+ *
+ * When disabled, scopes are accepted but everything is allocated from the
+ * heap. Used to compare both paths.
+ *
+ * @param enabled true to use the arena
+ */
+void json_arena_set_enabled(bool enabled);
+
+/**
+ * @brief Read the statistics
+ *
+ * @param stats Pointer to store the statistics
+ */
+void json_arena_get_stats(json_arena_stats_t *stats);
+
+/**
+ * @brief Reset the counters and peaks, e.g. at the end of a wake cycle
+ */
+void json_arena_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
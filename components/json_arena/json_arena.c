@@ -0,0 +1,202 @@
+/**
+ * @file json_arena.c
+ * @brief Bump arena for cJSON documents
+ *
+ * A Firestore document with a day of samples is several thousand cJSON
+ * nodes and strings. Allocated one by one they are spread over the heap and
+ * freed in cJSON_Delete() just before TLS needs a large contiguous block.
+ * Inside an arena scope they are bump allocated from a few chunks instead,
+ * and the chunks are released together when the scope ends.
+ */
+
+#include "json_arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include "config_manager.h"
+
+static const char *TAG = "json_arena";
+
+#define ARENA_ALIGN 8
+
+// Arena chunk, the head of the list is the chunk being filled
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static arena_chunk_t *s_chunks = NULL;
+static TaskHandle_t volatile s_owner = NULL;    // Task of the active scope
+static bool s_enabled = true;
+static json_arena_stats_t s_stats;
+
+// Count an allocation
+static void count_alloc(size_t size) {
+    portENTER_CRITICAL(&s_lock);
+    s_stats.allocs++;
+    s_stats.bytes += size;
+    // Blocks from before a statistics reset may be freed later
+    uint32_t live = (s_stats.allocs > s_stats.frees) ? s_stats.allocs - s_stats.frees : 0;
+    if (live > s_stats.peak_live) {
+        s_stats.peak_live = live;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Check if the calling task allocates from the arena
+static bool arena_active(void) {
+    return s_enabled && s_owner != NULL && s_owner == xTaskGetCurrentTaskHandle();
+}
+
+// Check if a pointer belongs to an arena chunk
+static bool in_arena(const void *ptr) {
+    bool found = false;
+    portENTER_CRITICAL(&s_lock);
+    for (const arena_chunk_t *c = s_chunks; c != NULL && !found; c = c->next) {
+        found = (const uint8_t *)ptr >= c->data && (const uint8_t *)ptr < c->data + c->size;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return found;
+}
+
+// Bump allocation, only called by the owner task
+static void *arena_alloc(size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_chunk_t *head = s_chunks;
+    if (head == NULL || head->size - head->used < size) {
+        size_t chunk_size = (size > JSON_ARENA_CHUNK_SIZE) ? size : JSON_ARENA_CHUNK_SIZE;
+        arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        portENTER_CRITICAL(&s_lock);
+        if (head != NULL && chunk_size > JSON_ARENA_CHUNK_SIZE) {
+            // Oversized block, the current chunk stays the one being filled
+            chunk->next = head->next;
+            head->next = chunk;
+            head = chunk;
+        } else {
+            chunk->next = head;
+            s_chunks = chunk;
+            head = chunk;
+        }
+        s_stats.chunks++;
+        s_stats.capacity += chunk_size;
+        if (s_stats.capacity > s_stats.peak_capacity) {
+            s_stats.peak_capacity = s_stats.capacity;
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    void *ptr = head->data + head->used;
+    head->used += size;
+
+    s_stats.used += size;
+    if (s_stats.used > s_stats.peak_used) {
+        s_stats.peak_used = s_stats.used;
+    }
+    return ptr;
+}
+
+// Allocate from the arena in a scope, from the heap otherwise
+void *json_arena_alloc(size_t size) {
+    void *ptr = arena_active() ? arena_alloc(size) : malloc(size);
+    if (ptr != NULL) {
+        count_alloc(size);
+    }
+    return ptr;
+}
+
+// Free heap memory, arena memory is released with the scope
+void json_arena_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_stats.frees++;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (s_owner != NULL && in_arena(ptr)) {
+        return;
+    }
+    free(ptr);
+}
+
+// Install the arena as the cJSON allocator
+esp_err_t json_arena_init(void) {
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_arena_alloc,
+        .free_fn = json_arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+    return ESP_OK;
+}
+
+// Begin an arena scope for the calling task
+esp_err_t json_arena_begin(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_owner != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        s_owner = task;
+        s_stats.used = 0;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGD(TAG, "Arena scope already active");
+    }
+    return ret;
+}
+
+// End the arena scope and release the chunks
+void json_arena_end(void) {
+    portENTER_CRITICAL(&s_lock);
+    arena_chunk_t *chunks = s_chunks;
+    s_chunks = NULL;
+    s_owner = NULL;
+    s_stats.capacity = 0;
+    s_stats.used = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    while (chunks != NULL) {
+        arena_chunk_t *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+}
+
+void json_arena_set_enabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+void json_arena_get_stats(json_arena_stats_t *stats) {
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void json_arena_reset_stats(void) {
+    portENTER_CRITICAL(&s_lock);
+    size_t capacity = s_stats.capacity;
+    size_t used = s_stats.used;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.capacity = capacity;
+    s_stats.peak_capacity = capacity;
+    s_stats.used = used;
+    s_stats.peak_used = used;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -41,11 +41,12 @@ void json_helper_generate_document_id(const char *time_str, const char *formatte
  * 
  * @param existing_doc Existing document or NULL
  * @param mac_address MAC address of the tag/device
+ * @param day Date of the document as YYYY-MM-DD, NULL for the current date
  * @param battery_voltage_mv Battery voltage in millivolts
  * @param battery_level Battery level percentage (0-100%)
  * @return cJSON* Firestore document structure
  */
-cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, const char* mac_address, uint32_t battery_voltage_mv, int battery_level);
+cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, const char* mac_address, const char* day, uint32_t battery_voltage_mv, int battery_level);
 
 /**
  * @brief Add a measurement to the Firestore document
@@ -56,5 +57,30 @@ cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, cons
  */
 esp_err_t json_helper_add_measurement_to_firestore(cJSON* firestore_doc, ruuvi_measurement_t* measurement);
 
+/**
+ * @brief Extra buffer space needed by json_helper_firestore_write_in_place() on top of the document name
+ */
+#define JSON_HELPER_WRITE_OVERHEAD 256
+
+/**
+ * @brief Start and end of a Firestore commit request, the writes are separated by commas
+ */
+#define JSON_HELPER_COMMIT_OPEN "{\"writes\":["
+#define JSON_HELPER_COMMIT_CLOSE "]}"
+
+/**
+ * @brief Turn a stored Firestore document into a commit write in place
+ * 
+ * The scalar fields are written with an update mask and the measurements are
+ * added with an appendMissingElements transform, so the write carries only
+ * the samples of this document and samples already in Firestore are kept.
+ * 
+ * @param buffer Buffer holding the document as written by storage
+ * @param length Length of the document
+ * @param buffer_size Buffer size, at least length + strlen(document_name) + JSON_HELPER_WRITE_OVERHEAD
+ * @param document_name Full document name, "projects/<id>/databases/(default)/documents/<collection>/<id>"
+ * @return size_t Length of the write, 0 if the document layout is not recognized or the buffer is too small
+ */
+size_t json_helper_firestore_write_in_place(char *buffer, size_t length, size_t buffer_size, const char *document_name);
 
 #endif // JSON_HELPER_H
\ No newline at end of file
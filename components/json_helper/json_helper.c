@@ -3,9 +3,11 @@
 #include "esp_log.h"
 #include "cJSON.h"
 #include "time_manager.h"
+#include "config_manager.h"
 #include <string.h>
 #include <math.h>
 #include <inttypes.h>
+#include <time.h>
 
 static const char *TAG = "json_helper";
 
@@ -84,8 +86,37 @@ void json_helper_generate_document_id(const char *time_str, const char *formatte
     snprintf(document_id, document_id_len, "%s_%s", time_str, formatted_mac);
 }
 
+// Adds a Firestore field with a single value, e.g. "t": {"doubleValue": 20.1}
+static cJSON *add_value_field(cJSON *fields, const char *name) {
+    cJSON *field = cJSON_CreateObject();
+    cJSON_AddItemToObject(fields, name, field);
+    return field;
+}
+
+#if FIRESTORE_TYPED_VALUES
+// Adds an integerValue field, Firestore sends 64-bit integers as strings
+static void add_integer_field(cJSON *fields, const char *name, long value) {
+    char value_str[24];
+    snprintf(value_str, sizeof(value_str), "%ld", value);
+    cJSON_AddStringToObject(add_value_field(fields, name), "integerValue", value_str);
+}
+
+// Adds a doubleValue field rounded to two decimals
+static void add_double_field(cJSON *fields, const char *name, float value) {
+    cJSON_AddNumberToObject(add_value_field(fields, name), "doubleValue", round(value * 100.0) / 100.0);
+}
+#else
+// Adds a stringValue field with the number rounded to two decimals
+static void add_fixed2_field(cJSON *fields, const char *name, float value) {
+    float rounded = roundf(value * 100) / 100;
+    char value_str[10];
+    snprintf(value_str, sizeof(value_str), "%.2f", rounded);
+    cJSON_AddStringToObject(add_value_field(fields, name), "stringValue", value_str);
+}
+#endif
+
 // Creates a new Firestore document structure or updates an existing one
-cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, const char* mac_address, uint32_t battery_voltage_mv, int battery_level) {
+cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, const char* mac_address, const char* day, uint32_t battery_voltage_mv, int battery_level) {
     cJSON *firestore_doc = existing_doc;
     cJSON *firestore_fields = NULL;
     cJSON *measurements_field = NULL;
@@ -102,22 +133,27 @@ cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, cons
         cJSON_AddStringToObject(tag_id_field, "stringValue", mac_address);
         cJSON_AddItemToObject(firestore_fields, "tag_id", tag_id_field);
         
-        // Add current date as a field
-        char time_str[32];
-        if (time_manager_get_formatted_time(time_str, sizeof(time_str)) != ESP_OK) {
-            strcpy(time_str, "Time not available");
+        // Add the date as a field, the current date if the caller did not give one
+        char today[11] = {0}; // YYYY-MM-DD\0
+        if (day == NULL) {
+            char time_str[32];
+            if (time_manager_get_formatted_time(time_str, sizeof(time_str)) != ESP_OK) {
+                strcpy(time_str, "Time not available");
+            }
+            // Extract only the date (first 10 characters)
+            strncpy(today, time_str, 10);
+            day = today;
         }
         
-        // Extract only the date (first 10 characters)
-        char day[11] = {0}; // YYYY-MM-DD\0
-        strncpy(day, time_str, 10);
-        day[10] = '\0';
-        
         cJSON *day_field = cJSON_CreateObject();
         cJSON_AddStringToObject(day_field, "stringValue", day);
         cJSON_AddItemToObject(firestore_fields, "day", day_field);
         
         // Add battery information
+#if FIRESTORE_TYPED_VALUES
+        add_integer_field(firestore_fields, "battery_voltage", (long)battery_voltage_mv);
+        add_integer_field(firestore_fields, "battery_level", battery_level);
+#else
         char battery_voltage_str[10];
         char battery_level_str[5];
         
@@ -131,6 +167,7 @@ cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, cons
         cJSON *battery_level_field = cJSON_CreateObject();
         cJSON_AddStringToObject(battery_level_field, "stringValue", battery_level_str);
         cJSON_AddItemToObject(firestore_fields, "battery_level", battery_level_field);
+#endif
         
         // Create an array of measurements
         measurements_field = cJSON_CreateObject();
@@ -148,6 +185,11 @@ cJSON* json_helper_create_or_update_firestore_document(cJSON* existing_doc, cons
     return firestore_doc;
 }
 
+// Time the advertisement was received, the current time for a sample without one
+static time_t measurement_time(const ruuvi_measurement_t *measurement) {
+    return (measurement->timestamp_ms > 0) ? (time_t)(measurement->timestamp_ms / 1000) : time(NULL);
+}
+
 // Adds a measurement to the Firestore document
 esp_err_t json_helper_add_measurement_to_firestore(cJSON* firestore_doc, ruuvi_measurement_t* measurement) {
     if (!firestore_doc || !measurement) {
@@ -175,11 +217,17 @@ esp_err_t json_helper_add_measurement_to_firestore(cJSON* firestore_doc, ruuvi_m
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Get the current time
+    // The time of reception is formatted here, when the sample is exported
     char time_str[32];
-    if (time_manager_get_formatted_time(time_str, sizeof(time_str)) != ESP_OK) {
+#if FIRESTORE_TYPED_VALUES
+    if (time_manager_format_rfc3339(measurement_time(measurement), time_str, sizeof(time_str)) != ESP_OK) {
+        strcpy(time_str, "1970-01-01T00:00:00Z");
+    }
+#else
+    if (time_manager_format_local(measurement_time(measurement), time_str, sizeof(time_str)) != ESP_OK) {
         strcpy(time_str, "Time not available");
     }
+#endif
     
     // Create an object for the measurement
     cJSON *measurement_map_obj = cJSON_CreateObject();
@@ -187,28 +235,15 @@ esp_err_t json_helper_add_measurement_to_firestore(cJSON* firestore_doc, ruuvi_m
     cJSON *measurement_map_fields = cJSON_CreateObject();
     
     // Add fields for temperature, humidity and time
-    
-    // Temperature
-    cJSON *temp_field = cJSON_CreateObject();
-    float rounded_temp = roundf(measurement->temperature * 100) / 100;
-    char temp_str[10];
-    sprintf(temp_str, "%.2f", rounded_temp);
-    cJSON_AddStringToObject(temp_field, "stringValue", temp_str);
-    cJSON_AddItemToObject(measurement_map_fields, "t", temp_field);
-    
-    // Humidity
-    cJSON *hum_field = cJSON_CreateObject();
-    float rounded_hum = roundf(measurement->humidity * 100) / 100;
-    char hum_str[10];
-    sprintf(hum_str, "%.2f", rounded_hum);
-    cJSON_AddStringToObject(hum_field, "stringValue", hum_str);
-    cJSON_AddItemToObject(measurement_map_fields, "h", hum_field);
-    
-    // Timestamp
-    cJSON *timestamp_field = cJSON_CreateObject();
-    // cJSON_AddStringToObject(timestamp_field, "stringValue", timestamp);
-    cJSON_AddStringToObject(timestamp_field, "stringValue", time_str);
-    cJSON_AddItemToObject(measurement_map_fields, "ts", timestamp_field);
+#if FIRESTORE_TYPED_VALUES
+    add_double_field(measurement_map_fields, "t", measurement->temperature);
+    add_double_field(measurement_map_fields, "h", measurement->humidity);
+    cJSON_AddStringToObject(add_value_field(measurement_map_fields, "ts"), "timestampValue", time_str);
+#else
+    add_fixed2_field(measurement_map_fields, "t", measurement->temperature);
+    add_fixed2_field(measurement_map_fields, "h", measurement->humidity);
+    cJSON_AddStringToObject(add_value_field(measurement_map_fields, "ts"), "stringValue", time_str);
+#endif
     
     // Add to the structure
     cJSON_AddItemToObject(measurement_map_value, "fields", measurement_map_fields);
@@ -216,4 +251,65 @@ esp_err_t json_helper_add_measurement_to_firestore(cJSON* firestore_doc, ruuvi_m
     cJSON_AddItemToArray(values_array, measurement_map_obj);
     
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+// Stored document: DOCUMENT_OPEN <scalar fields> MEASUREMENTS_OPEN <samples> DOCUMENT_CLOSE
+#define DOCUMENT_OPEN       "{\"fields\":{"
+#define MEASUREMENTS_OPEN   ",\"measurements\":{\"arrayValue\":{\"values\":["
+#define DOCUMENT_CLOSE      "]}}}}"
+
+// Commit write: WRITE_OPEN <name> WRITE_FIELDS <scalar fields> WRITE_APPEND <samples> WRITE_CLOSE
+#define WRITE_OPEN          "{\"update\":{\"name\":\""
+#define WRITE_FIELDS        "\",\"fields\":{"
+#define WRITE_APPEND       "}},\"updateMask\":{\"fieldPaths\":[\"tag_id\",\"day\",\"battery_voltage\",\"battery_level\"]}," \
+                            "\"updateTransforms\":[{\"fieldPath\":\"measurements\",\"appendMissingElements\":{\"values\":["
+#define WRITE_CLOSE         "]}}]}"
+
+// Turns a stored document into a commit write without parsing it
+size_t json_helper_firestore_write_in_place(char *buffer, size_t length, size_t buffer_size, const char *document_name) {
+    const size_t doc_open_len = strlen(DOCUMENT_OPEN);
+    const size_t doc_close_len = strlen(DOCUMENT_CLOSE);
+    if (!buffer || !document_name || length < doc_open_len + doc_close_len ||
+        strncmp(buffer, DOCUMENT_OPEN, doc_open_len) != 0 ||
+        strncmp(buffer + length - doc_close_len, DOCUMENT_CLOSE, doc_close_len) != 0) {
+        return 0;
+    }
+    
+    // The scalar fields come first, the measurements array is the last field
+    char saved = buffer[length];
+    buffer[length] = '\0';
+    const char *marker = strstr(buffer + doc_open_len, MEASUREMENTS_OPEN);
+    buffer[length] = saved;
+    if (!marker) {
+        return 0;
+    }
+    size_t fields_start = doc_open_len;
+    size_t fields_len = (size_t)(marker - buffer) - fields_start;
+    size_t values_start = (size_t)(marker - buffer) + strlen(MEASUREMENTS_OPEN);
+    size_t values_len = length - doc_close_len - values_start;
+    
+    size_t name_len = strlen(document_name);
+    size_t open_len = strlen(WRITE_OPEN) + name_len + strlen(WRITE_FIELDS);
+    size_t append_len = strlen(WRITE_APPEND);
+    size_t total = open_len + fields_len + append_len + values_len + strlen(WRITE_CLOSE);
+    if (total >= buffer_size) {
+        return 0;
+    }
+    
+    // Both parts move towards the end, the measurements first so the fields do not overwrite them
+    memmove(buffer + open_len + fields_len + append_len, buffer + values_start, values_len);
+    memmove(buffer + open_len, buffer + fields_start, fields_len);
+    
+    char *p = buffer;
+    memcpy(p, WRITE_OPEN, strlen(WRITE_OPEN));
+    p += strlen(WRITE_OPEN);
+    memcpy(p, document_name, name_len);
+    p += name_len;
+    memcpy(p, WRITE_FIELDS, strlen(WRITE_FIELDS));
+    p += strlen(WRITE_FIELDS) + fields_len;
+    memcpy(p, WRITE_APPEND, append_len);
+    p += append_len + values_len;
+    strcpy(p, WRITE_CLOSE);
+    
+    return total;
+}
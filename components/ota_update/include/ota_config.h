@@ -0,0 +1,14 @@
+/**
+ * @file ota_config.h
+ * @brief Firmware update server configuration header file
+ */
+
+#ifndef OTA_CONFIG_H
+#define OTA_CONFIG_H
+
+// Deltas are served as https://OTA_HOST/OTA_PATH/<SHA-256 of the source image>.delta,
+// the server must support range requests. An empty host disables the updates.
+#define OTA_HOST ""
+#define OTA_PATH "firmware"
+
+#endif // OTA_CONFIG_H
@@ -0,0 +1,173 @@
+// ota_delta.h
+// Streaming application of a binary delta between two firmware images.
+// Plain byte processing without driver calls, the flash, the download and
+// the checkpoint storage are callbacks, so the host benchmark runs it
+// against images in RAM and a simulated HTTP server.
+//
+// Delta format, little endian:
+//   header  "ODL1", source size (u32), target size (u32),
+//           source hash (32 bytes), target hash (32 bytes)
+//   'A' source offset, length, then runs of (zeros, literals, literal bytes)
+//           covering the length: target = source + difference, the zeros
+//           copy the source unchanged
+//   'I' length, bytes: inserted bytes without a source
+//   'E' end of the delta
+// Offsets, lengths and run counts are unsigned LEB128. The hashes are the
+// SHA-256 digests esptool appends to an app image, the last 32 bytes.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_DELTA_MAGIC         0x314C444F  // "ODL1"
+#define OTA_DELTA_HEADER_SIZE   76
+#define OTA_DELTA_HASH_SIZE     32
+#define OTA_DELTA_WINDOW        4096        // Target bytes written at once, one flash sector
+#define OTA_DELTA_SOURCE_WINDOW 512         // Source bytes read at once
+#define OTA_DELTA_MAX_FAILURES  3           // Range requests in a row without progress before giving up
+
+// Operation codes in the delta stream
+#define OTA_DELTA_OP_ADD        'A'
+#define OTA_DELTA_OP_INSERT     'I'
+#define OTA_DELTA_OP_END        'E'
+
+/**
+ * @brief Header of a delta
+ */
+typedef struct {
+    uint32_t source_size;
+    uint32_t target_size;
+    uint8_t source_hash[OTA_DELTA_HASH_SIZE];   // Image the delta applies to
+    uint8_t target_hash[OTA_DELTA_HASH_SIZE];   // Image the delta produces
+} ota_delta_header_t;
+
+/**
+ * @brief Parser position in the delta
+ */
+typedef enum {
+    OTA_DELTA_PHASE_HEADER = 0,
+    OTA_DELTA_PHASE_OP,             // Next byte is an operation code
+    OTA_DELTA_PHASE_ARGS,           // Reading the numbers of an operation or a run
+    OTA_DELTA_PHASE_ZEROS,          // Copying source bytes, no input needed
+    OTA_DELTA_PHASE_LITERALS,       // Adding difference bytes to the source
+    OTA_DELTA_PHASE_INSERT,         // Copying inserted bytes
+    OTA_DELTA_PHASE_DONE,
+} ota_delta_phase_t;
+
+/**
+ * @brief Complete parser state, plain data that can be stored and restored
+ */
+typedef struct {
+    uint32_t patch_offset;          // Delta bytes consumed
+    uint32_t target_offset;         // Target bytes produced
+    uint8_t phase;                  // ota_delta_phase_t
+    uint8_t op;                     // Operation whose numbers are read
+    uint8_t arg;                    // Index of the number being read
+    uint8_t shift;                  // Bit position in the number being read
+    uint32_t value;                 // Number being read
+    uint32_t source_offset;         // Source position of the add operation
+    uint32_t remaining;             // Bytes of the add operation left
+    uint32_t run;                   // Bytes of the zero, literal or insert run left
+    uint32_t literals;              // Literal run that follows the zero run
+    ota_delta_header_t header;      // Valid after the header phase
+} ota_delta_state_t;
+
+/**
+ * @brief Flash, download and checkpoint callbacks, ctx is passed to each
+ */
+typedef struct {
+    // Header complete, an error stops the delta (wrong source image, target too large)
+    esp_err_t (*begin)(void *ctx, const ota_delta_header_t *header);
+    esp_err_t (*read_source)(void *ctx, uint32_t offset, void *buffer, size_t size);
+    // Offset is a multiple of OTA_DELTA_WINDOW, size is OTA_DELTA_WINDOW except for the last write
+    esp_err_t (*write_target)(void *ctx, uint32_t offset, const void *data, size_t size);
+    // Request delta bytes from offset, the response goes through ota_delta_response() and ota_delta_feed()
+    esp_err_t (*fetch)(void *ctx, uint32_t offset, uint32_t size);
+    // Store a checkpoint, the download resumes from it after a reset
+    esp_err_t (*save)(void *ctx, const ota_delta_state_t *checkpoint);
+    // Optional, true to stop the download between two requests
+    bool (*stop)(void *ctx);
+    void *ctx;
+} ota_delta_io_t;
+
+/**
+ * @brief Delta being applied, about 4.7 kB with the windows
+ */
+typedef struct {
+    const ota_delta_io_t *io;
+    ota_delta_state_t state;
+    ota_delta_state_t checkpoint;   // State at the last window write, nothing of it is lost on a reset
+    esp_err_t error;                // First error of the delta data, ends the download
+    size_t header_len;
+    uint8_t header[OTA_DELTA_HEADER_SIZE];
+    size_t window_len;
+    uint8_t window[OTA_DELTA_WINDOW];
+    uint32_t source_base;
+    size_t source_len;
+    uint8_t source[OTA_DELTA_SOURCE_WINDOW];
+} ota_delta_t;
+
+/**
+ * @brief Start a delta, or resume one from a checkpoint
+ *
+ * A checkpoint past the header calls io->begin() again with its header.
+ *
+ * @param delta Delta to initialize
+ * @param io Callbacks, must stay valid while the delta is used
+ * @param checkpoint Checkpoint from io->save(), NULL to start from the beginning
+ * @return esp_err_t ESP_OK on success, error of io->begin() otherwise
+ */
+esp_err_t ota_delta_init(ota_delta_t *delta, const ota_delta_io_t *io, const ota_delta_state_t *checkpoint);
+
+/**
+ * @brief Check the response to a range request before its body is fed
+ *
+ * @param delta Delta being downloaded
+ * @param status HTTP status code
+ * @param content_range Content-Range header ("bytes 0-16383/300000"), NULL if missing
+ * @return esp_err_t ESP_OK if the body continues the delta, ESP_ERR_NOT_FOUND
+ *         if there is no delta, ESP_ERR_INVALID_RESPONSE if the server
+ *         ignored the range, ESP_ERR_INVALID_SIZE if the range is past the
+ *         end, ESP_FAIL on other statuses
+ */
+esp_err_t ota_delta_response(ota_delta_t *delta, int status, const char *content_range);
+
+/**
+ * @brief Apply the next bytes of the delta
+ *
+ * Processes all bytes. Target bytes are written through io->write_target()
+ * whenever the window is full, the checkpoint follows every write. Bytes
+ * after the end of the delta are ignored.
+ *
+ * @param delta Delta being applied
+ * @param data Delta bytes
+ * @param size Number of bytes
+ * @return esp_err_t ESP_OK on success, the error is also kept in delta->error
+ */
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t size);
+
+/**
+ * @brief Download and apply the delta with range requests
+ *
+ * Requests range_bytes at a time from the current position. A request that
+ * failed is repeated from where its data stopped. The checkpoint is saved
+ * after every request that moved it.
+ *
+ * @param delta Delta being applied
+ * @param range_bytes Bytes per request
+ * @param budget_bytes Delta bytes to download in this call
+ * @return esp_err_t ESP_OK when the whole target is written, ESP_ERR_NOT_FINISHED
+ *         if the budget ran out or io->stop() returned true, the error of
+ *         the delta or of the last request otherwise
+ */
+esp_err_t ota_delta_download(ota_delta_t *delta, uint32_t range_bytes, uint32_t budget_bytes);
+
+#ifdef __cplusplus
+}
+#endif
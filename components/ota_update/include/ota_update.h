@@ -0,0 +1,72 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * @brief Initialize the firmware update
+ *
+ * Reads the state of the running image, the download checkpoint from NVS
+ * and notes an image the bootloader rolled back from, so its delta is not
+ * downloaded again.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t ota_update_init(void);
+
+/**
+ * @brief Check whether the running image is new and not yet confirmed
+ *
+ * Every cycle of a new image connects and uploads until one of them
+ * proves the whole path and the image is kept.
+ *
+ * @return bool true until ota_update_cycle_end() confirms the image
+ */
+bool ota_update_pending_verify(void);
+
+/**
+ * @brief Check whether this send cycle should look for or continue an update
+ *
+ * @return bool true if a download is in progress or OTA_CHECK_INTERVAL_S
+ *         passed since the last check
+ */
+bool ota_update_due(void);
+
+/**
+ * @brief Download the delta for the running image and install it
+ *
+ * Fetches https://OTA_HOST/OTA_PATH/<SHA-256 of the running image>.delta
+ * with range requests and patches it into the inactive app slot. At most
+ * OTA_CYCLE_BYTES are downloaded per cycle, the download resumes from the
+ * NVS checkpoint in the next send cycle. A complete image is verified and
+ * becomes the boot image of the next wake.
+ *
+ * @return esp_err_t ESP_OK if there is no update or it was installed,
+ *         ESP_ERR_NOT_FINISHED if the download continues in a later cycle
+ */
+esp_err_t ota_update_run(void);
+
+/**
+ * @brief Outcome of a cycle of a new image
+ */
+typedef enum {
+    OTA_CYCLE_HEALTHY,      // The cycle uploaded its data
+    OTA_CYCLE_OFFLINE,      // The modem, the network or the server failed, nothing is known about the image
+    OTA_CYCLE_FAULT,        // A local self-test of the image failed
+} ota_cycle_result_t;
+
+/**
+ * @brief Confirm or reject a new image at the end of a cycle
+ *
+ * A healthy cycle cancels the rollback. An offline cycle keeps the image
+ * pending, the next wake tries again. Only a fault restarts the device into
+ * the previous image, which then ignores the delta to the rejected one. A
+ * new image that panics or hits the watchdog before it is confirmed is
+ * rolled back by the bootloader.
+ *
+ * @param result Outcome of the cycle
+ */
+void ota_update_cycle_end(ota_cycle_result_t result);
+
+#endif /* OTA_UPDATE_H */
@@ -0,0 +1,388 @@
+// ota_delta.c
+// Parser and patcher of the firmware delta format in ota_delta.h
+#include "ota_delta.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define OP_RUN  'R'     // Not in the stream: the zero and literal counts of an add operation
+
+static uint32_t read_u32(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+esp_err_t ota_delta_init(ota_delta_t *delta, const ota_delta_io_t *io, const ota_delta_state_t *checkpoint) {
+    if (delta == NULL || io == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(delta, 0, sizeof(*delta));
+    delta->io = io;
+
+    // Nothing is written before the header is complete, so a checkpoint is never inside it
+    if (checkpoint != NULL && checkpoint->phase != OTA_DELTA_PHASE_HEADER) {
+        delta->state = *checkpoint;
+        delta->error = io->begin(io->ctx, &delta->state.header);
+    }
+    delta->checkpoint = delta->state;
+    return delta->error;
+}
+
+esp_err_t ota_delta_response(ota_delta_t *delta, int status, const char *content_range) {
+    switch (status) {
+        case 200:
+            // The whole delta, only usable from the beginning
+            return delta->state.patch_offset == 0 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+        case 206: {
+            static const char prefix[] = "bytes ";
+            if (content_range == NULL || strncmp(content_range, prefix, sizeof(prefix) - 1) != 0) {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            char *end = NULL;
+            unsigned long first = strtoul(content_range + sizeof(prefix) - 1, &end, 10);
+            return (*end == '-' && first == delta->state.patch_offset) ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+        }
+        case 404:
+            return ESP_ERR_NOT_FOUND;
+        case 416:
+            return ESP_ERR_INVALID_SIZE;
+        default:
+            return ESP_FAIL;
+    }
+}
+
+// Write the window, the state after the write is the new checkpoint
+static esp_err_t flush_window(ota_delta_t *delta) {
+    if (delta->window_len > 0) {
+        uint32_t offset = delta->state.target_offset - (uint32_t)delta->window_len;
+        esp_err_t ret = delta->io->write_target(delta->io->ctx, offset, delta->window, delta->window_len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        delta->window_len = 0;
+    }
+    delta->checkpoint = delta->state;
+    return ESP_OK;
+}
+
+// Account for bytes put into the window and write it when it is full
+static esp_err_t produced(ota_delta_t *delta, size_t count) {
+    delta->window_len += count;
+    delta->state.target_offset += (uint32_t)count;
+    return delta->window_len == OTA_DELTA_WINDOW ? flush_window(delta) : ESP_OK;
+}
+
+// Source bytes from the current add position, read from flash when they are not in the window
+static esp_err_t source_bytes(ota_delta_t *delta, const uint8_t **bytes, size_t *available) {
+    uint32_t offset = delta->state.source_offset;
+    if (offset < delta->source_base || offset >= delta->source_base + delta->source_len) {
+        size_t size = min_size(OTA_DELTA_SOURCE_WINDOW, delta->state.header.source_size - offset);
+        esp_err_t ret = delta->io->read_source(delta->io->ctx, offset, delta->source, size);
+        if (ret != ESP_OK) {
+            delta->source_len = 0;
+            return ret;
+        }
+        delta->source_base = offset;
+        delta->source_len = size;
+    }
+    *bytes = delta->source + (offset - delta->source_base);
+    *available = delta->source_base + delta->source_len - offset;
+    return ESP_OK;
+}
+
+static void read_numbers(ota_delta_state_t *state, uint8_t op) {
+    state->op = op;
+    state->arg = 0;
+    state->value = 0;
+    state->shift = 0;
+    state->phase = OTA_DELTA_PHASE_ARGS;
+}
+
+// After a literal run: the next run of the add operation, or the next operation
+static void end_run(ota_delta_state_t *state) {
+    if (state->remaining == 0) {
+        state->phase = OTA_DELTA_PHASE_OP;
+    } else {
+        read_numbers(state, OP_RUN);
+    }
+}
+
+static esp_err_t parse_header(ota_delta_t *delta) {
+    ota_delta_header_t *header = &delta->state.header;
+    if (read_u32(delta->header) != OTA_DELTA_MAGIC) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    header->source_size = read_u32(delta->header + 4);
+    header->target_size = read_u32(delta->header + 8);
+    memcpy(header->source_hash, delta->header + 12, OTA_DELTA_HASH_SIZE);
+    memcpy(header->target_hash, delta->header + 12 + OTA_DELTA_HASH_SIZE, OTA_DELTA_HASH_SIZE);
+    if (header->target_size == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    delta->state.phase = OTA_DELTA_PHASE_OP;
+    return delta->io->begin(delta->io->ctx, header);
+}
+
+static esp_err_t start_op(ota_delta_t *delta, uint8_t op) {
+    ota_delta_state_t *state = &delta->state;
+    switch (op) {
+        case OTA_DELTA_OP_ADD:
+        case OTA_DELTA_OP_INSERT:
+            read_numbers(state, op);
+            return ESP_OK;
+        case OTA_DELTA_OP_END: {
+            if (state->target_offset != state->header.target_size) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            state->phase = OTA_DELTA_PHASE_DONE;
+            return flush_window(delta);
+        }
+        default:
+            return ESP_ERR_INVALID_RESPONSE;
+    }
+}
+
+// A complete number of the operation being read
+static esp_err_t op_number(ota_delta_state_t *state, uint32_t number) {
+    const ota_delta_header_t *header = &state->header;
+    uint32_t target_left = header->target_size - state->target_offset;
+    uint8_t arg = state->arg++;
+
+    switch (state->op) {
+        case OTA_DELTA_OP_ADD:
+            if (arg == 0) {
+                state->source_offset = number;
+                return ESP_OK;
+            }
+            if (number == 0 || state->source_offset > header->source_size ||
+                number > header->source_size - state->source_offset || number > target_left) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            state->remaining = number;
+            read_numbers(state, OP_RUN);
+            return ESP_OK;
+        case OP_RUN:
+            if (arg == 0) {
+                state->run = number;
+                return ESP_OK;
+            }
+            if ((state->run == 0 && number == 0) || state->run > state->remaining ||
+                number > state->remaining - state->run) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            state->literals = number;
+            state->phase = OTA_DELTA_PHASE_ZEROS;
+            return ESP_OK;
+        case OTA_DELTA_OP_INSERT:
+            if (number == 0 || number > target_left) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            state->run = number;
+            state->phase = OTA_DELTA_PHASE_INSERT;
+            return ESP_OK;
+        default:
+            return ESP_ERR_INVALID_RESPONSE;
+    }
+}
+
+// One byte of an unsigned LEB128 number
+static esp_err_t read_arg(ota_delta_state_t *state, uint8_t byte) {
+    if (state->shift == 28 && (byte & 0x70) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;    // More than 32 bits
+    }
+    state->value |= (uint32_t)(byte & 0x7F) << state->shift;
+    if (byte & 0x80) {
+        state->shift += 7;
+        return state->shift > 28 ? ESP_ERR_INVALID_RESPONSE : ESP_OK;
+    }
+    uint32_t number = state->value;
+    state->value = 0;
+    state->shift = 0;
+    return op_number(state, number);
+}
+
+// Source bytes of a zero run, no delta bytes needed
+static esp_err_t copy_zeros(ota_delta_t *delta) {
+    ota_delta_state_t *state = &delta->state;
+    while (state->run > 0) {
+        const uint8_t *source;
+        size_t count;
+        esp_err_t ret = source_bytes(delta, &source, &count);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        count = min_size(min_size(count, state->run), OTA_DELTA_WINDOW - delta->window_len);
+        memcpy(delta->window + delta->window_len, source, count);
+        state->run -= (uint32_t)count;
+        state->remaining -= (uint32_t)count;
+        state->source_offset += (uint32_t)count;
+        ret = produced(delta, count);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    state->run = state->literals;
+    state->literals = 0;
+    state->phase = OTA_DELTA_PHASE_LITERALS;
+    if (state->run == 0) {
+        end_run(state);
+    }
+    return ESP_OK;
+}
+
+// Difference bytes added to the source
+static esp_err_t add_literals(ota_delta_t *delta, const uint8_t *data, size_t size, size_t *used) {
+    ota_delta_state_t *state = &delta->state;
+    const uint8_t *source;
+    size_t count;
+    esp_err_t ret = source_bytes(delta, &source, &count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    count = min_size(min_size(count, size), min_size(state->run, OTA_DELTA_WINDOW - delta->window_len));
+    uint8_t *out = delta->window + delta->window_len;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (uint8_t)(source[i] + data[i]);
+    }
+    *used = count;
+    state->patch_offset += (uint32_t)count;
+    state->run -= (uint32_t)count;
+    state->remaining -= (uint32_t)count;
+    state->source_offset += (uint32_t)count;
+    if (state->run == 0) {
+        end_run(state);
+    }
+    return produced(delta, count);
+}
+
+// Inserted bytes copied as they are
+static esp_err_t insert_bytes(ota_delta_t *delta, const uint8_t *data, size_t size, size_t *used) {
+    ota_delta_state_t *state = &delta->state;
+    size_t count = min_size(size, min_size(state->run, OTA_DELTA_WINDOW - delta->window_len));
+    memcpy(delta->window + delta->window_len, data, count);
+    *used = count;
+    state->patch_offset += (uint32_t)count;
+    state->run -= (uint32_t)count;
+    if (state->run == 0) {
+        state->phase = OTA_DELTA_PHASE_OP;
+    }
+    return produced(delta, count);
+}
+
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t size) {
+    if (delta->error != ESP_OK) {
+        return delta->error;
+    }
+
+    ota_delta_state_t *state = &delta->state;
+    size_t pos = 0;
+    esp_err_t ret = ESP_OK;
+    while (ret == ESP_OK && state->phase != OTA_DELTA_PHASE_DONE) {
+        if (state->phase == OTA_DELTA_PHASE_ZEROS) {
+            ret = copy_zeros(delta);
+            continue;
+        }
+        if (pos == size) {
+            break;
+        }
+
+        size_t used = 1;
+        switch (state->phase) {
+            case OTA_DELTA_PHASE_HEADER:
+                used = min_size(OTA_DELTA_HEADER_SIZE - delta->header_len, size - pos);
+                memcpy(delta->header + delta->header_len, data + pos, used);
+                delta->header_len += used;
+                state->patch_offset += (uint32_t)used;
+                if (delta->header_len == OTA_DELTA_HEADER_SIZE) {
+                    ret = parse_header(delta);
+                }
+                break;
+            case OTA_DELTA_PHASE_OP:
+                state->patch_offset++;
+                ret = start_op(delta, data[pos]);
+                break;
+            case OTA_DELTA_PHASE_ARGS:
+                state->patch_offset++;
+                ret = read_arg(state, data[pos]);
+                break;
+            case OTA_DELTA_PHASE_LITERALS:
+                ret = add_literals(delta, data + pos, size - pos, &used);
+                break;
+            case OTA_DELTA_PHASE_INSERT:
+                ret = insert_bytes(delta, data + pos, size - pos, &used);
+                break;
+            default:
+                ret = ESP_ERR_INVALID_STATE;
+                break;
+        }
+        pos += used;
+    }
+
+    if (ret != ESP_OK) {
+        delta->error = ret;
+    }
+    return ret;
+}
+
+// Store the checkpoint if it moved since the last save
+static esp_err_t save_checkpoint(ota_delta_t *delta, uint32_t *saved_offset) {
+    if (delta->checkpoint.patch_offset == *saved_offset && delta->checkpoint.phase != OTA_DELTA_PHASE_DONE) {
+        return ESP_OK;
+    }
+    *saved_offset = delta->checkpoint.patch_offset;
+    return delta->io->save(delta->io->ctx, &delta->checkpoint);
+}
+
+esp_err_t ota_delta_download(ota_delta_t *delta, uint32_t range_bytes, uint32_t budget_bytes) {
+    if (delta->error != ESP_OK) {
+        return delta->error;
+    }
+    if (range_bytes == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const ota_delta_io_t *io = delta->io;
+    uint32_t start = delta->state.patch_offset;
+    uint32_t saved_offset = delta->checkpoint.patch_offset;
+    int failures = 0;
+    esp_err_t ret = ESP_OK;
+    while (delta->state.phase != OTA_DELTA_PHASE_DONE) {
+        if (delta->state.patch_offset - start >= budget_bytes || (io->stop != NULL && io->stop(io->ctx))) {
+            ret = ESP_ERR_NOT_FINISHED;
+            break;
+        }
+
+        uint32_t offset = delta->state.patch_offset;
+        ret = io->fetch(io->ctx, offset, range_bytes);
+        if (delta->error != ESP_OK) {
+            ret = delta->error;
+            break;
+        }
+        if (ret == ESP_ERR_NOT_FOUND || ret == ESP_ERR_INVALID_RESPONSE || ret == ESP_ERR_INVALID_SIZE) {
+            break;  // No delta, or a server that cannot continue it
+        }
+        if (delta->state.patch_offset != offset) {
+            failures = 0;
+        } else if (ret == ESP_OK) {
+            ret = ESP_ERR_INVALID_SIZE;     // The delta ends before its end operation
+            break;
+        } else if (++failures >= OTA_DELTA_MAX_FAILURES) {
+            break;
+        }
+
+        esp_err_t save_ret = save_checkpoint(delta, &saved_offset);
+        if (save_ret != ESP_OK) {
+            ret = save_ret;
+            break;
+        }
+    }
+
+    if (delta->state.phase == OTA_DELTA_PHASE_DONE) {
+        ret = save_checkpoint(delta, &saved_offset);
+    } else if (delta->error == ESP_OK) {
+        save_checkpoint(delta, &saved_offset);
+    }
+    return ret;
+}
@@ -0,0 +1,420 @@
+/**
+ * @file ota_update.c
+ * @brief Delta firmware updates into the inactive app slot
+ *
+ * A full image over LTE CAT1 keeps the modem on for minutes, a delta
+ * against the running image is a fraction of it. The delta is looked up by
+ * the SHA-256 of the running image, downloaded in range requests over the
+ * pooled HTTPS connection and patched into the other app slot through a
+ * 4 kB window (ota_delta.c):
+ *
+ * 1. The parser state at every sector write is the checkpoint, it is kept in
+ *    NVS, so a reset or the end of the cycle budget costs at most one range
+ * 2. The complete image is checked against the hash in the delta header and
+ *    becomes the boot image of the next wake
+ * 3. The new image stays pending until a cycle has uploaded. If it panics
+ *    or hits the watchdog before that, the bootloader rolls back; if a local
+ *    self-test fails, it rolls back itself. A cycle without network or
+ *    server keeps it pending, a connectivity problem says nothing about the
+ *    image. The previous image remembers a rejected image and does not
+ *    install it again.
+ */
+
+#include "ota_update.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "https_client.h"
+#include "cycle_pipeline.h"
+#include "storage.h"
+#include "config_manager.h"
+#include "ota_config.h"
+#include "ota_delta.h"
+
+static const char *TAG = "OTA";
+
+#define OTA_NAMESPACE       "ota"
+#define OTA_CHECKPOINT_KEY  "delta"
+#define OTA_CHECKED_KEY     "checked"
+#define OTA_REJECTED_KEY    "rejected"
+#define OTA_RECORD_MAGIC    0x4F544131  // "OTA1"
+#define OTA_URL_MAX_LEN     192
+
+// Download checkpoint as stored in NVS
+typedef struct {
+    uint32_t magic;
+    ota_delta_state_t checkpoint;
+} ota_record_t;
+
+// Download of one cycle
+typedef struct {
+    ota_delta_t delta;
+    ota_delta_io_t io;
+    const esp_partition_t *update;
+    https_client_handle_t client;
+    char url[OTA_URL_MAX_LEN];
+    char content_range[64];
+    bool checked;               // The response status of the request was checked
+    esp_err_t response;         // Result of the check
+} ota_download_t;
+
+static nvs_handle_t s_nvs;
+static bool s_initialized = false;
+static bool s_pending_verify = false;
+static bool s_in_progress = false;      // A checkpoint is stored
+static uint32_t s_checked = 0;          // Time of the last completed check
+static const esp_partition_t *s_running;
+static uint8_t s_running_hash[OTA_DELTA_HASH_SIZE];
+static uint8_t s_rejected_hash[OTA_DELTA_HASH_SIZE];
+static bool s_has_rejected = false;
+
+static bool load_record(ota_record_t *record) {
+    size_t size = sizeof(*record);
+    return nvs_get_blob(s_nvs, OTA_CHECKPOINT_KEY, record, &size) == ESP_OK && size == sizeof(*record) &&
+           record->magic == OTA_RECORD_MAGIC;
+}
+
+static void erase_record(void) {
+    if (nvs_erase_key(s_nvs, OTA_CHECKPOINT_KEY) == ESP_OK) {
+        nvs_commit(s_nvs);
+    }
+    s_in_progress = false;
+}
+
+// The next check waits OTA_CHECK_INTERVAL_S
+static void mark_checked(void) {
+    s_checked = (uint32_t)time(NULL);
+    nvs_set_u32(s_nvs, OTA_CHECKED_KEY, s_checked);
+    nvs_commit(s_nvs);
+}
+
+esp_err_t ota_update_init(void) {
+    s_running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    s_pending_verify = esp_ota_get_state_partition(s_running, &state) == ESP_OK &&
+                       state == ESP_OTA_IMG_PENDING_VERIFY;
+
+    esp_err_t ret = nvs_open(OTA_NAMESPACE, NVS_READWRITE, &s_nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    nvs_get_u32(s_nvs, OTA_CHECKED_KEY, &s_checked);
+    ota_record_t record;
+    s_in_progress = load_record(&record);
+    s_initialized = true;
+
+    if (s_pending_verify) {
+        ESP_LOGW(TAG, "Running new firmware from %s, kept after its first upload", s_running->label);
+    } else if (s_in_progress) {
+        ESP_LOGI(TAG, "Firmware update in progress, %" PRIu32 " of %" PRIu32 " bytes written",
+                 record.checkpoint.target_offset, record.checkpoint.header.target_size);
+    }
+    return ESP_OK;
+}
+
+bool ota_update_pending_verify(void) {
+    return s_pending_verify;
+}
+
+bool ota_update_due(void) {
+    // A new image confirms itself before it downloads the next one
+    if (!s_initialized || OTA_HOST[0] == '\0' || s_pending_verify) {
+        return false;
+    }
+    if (s_in_progress) {
+        return true;
+    }
+    int64_t now = (int64_t)time(NULL);
+    return now < (int64_t)s_checked || now - (int64_t)s_checked >= OTA_CHECK_INTERVAL_S;
+}
+
+// Hashes of the running image and of an image the bootloader rolled back from, read from flash once per update cycle
+static esp_err_t read_image_hashes(void) {
+    esp_err_t ret = esp_partition_get_sha256(s_running, s_running_hash);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to hash the running image: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    size_t size = sizeof(s_rejected_hash);
+    s_has_rejected = nvs_get_blob(s_nvs, OTA_REJECTED_KEY, s_rejected_hash, &size) == ESP_OK &&
+                     size == sizeof(s_rejected_hash);
+
+    const esp_partition_t *invalid = esp_ota_get_last_invalid_partition();
+    uint8_t hash[OTA_DELTA_HASH_SIZE];
+    if (invalid != NULL && esp_partition_get_sha256(invalid, hash) == ESP_OK &&
+        (!s_has_rejected || memcmp(hash, s_rejected_hash, sizeof(hash)) != 0)) {
+        memcpy(s_rejected_hash, hash, sizeof(hash));
+        s_has_rejected = true;
+        nvs_set_blob(s_nvs, OTA_REJECTED_KEY, s_rejected_hash, sizeof(s_rejected_hash));
+        nvs_commit(s_nvs);
+        storage_log(LOG_OTA_REJECTED);
+        ESP_LOGW(TAG, "Rolled back from the image in %s, its delta is ignored", invalid->label);
+    }
+    return ESP_OK;
+}
+
+// Delta header: it must start from the running image and fit into the update slot
+static esp_err_t delta_begin(void *ctx, const ota_delta_header_t *header) {
+    ota_download_t *download = ctx;
+    if (memcmp(header->source_hash, s_running_hash, OTA_DELTA_HASH_SIZE) != 0 ||
+        header->source_size > s_running->size) {
+        ESP_LOGE(TAG, "Delta is for another image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (s_has_rejected && memcmp(header->target_hash, s_rejected_hash, OTA_DELTA_HASH_SIZE) == 0) {
+        ESP_LOGW(TAG, "Delta leads to the image that was rolled back");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (header->target_size > download->update->size) {
+        ESP_LOGE(TAG, "New image of %" PRIu32 " bytes does not fit into %s", header->target_size,
+                 download->update->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ESP_LOGI(TAG, "Updating to a %" PRIu32 " byte image in %s", header->target_size, download->update->label);
+    return ESP_OK;
+}
+
+static esp_err_t delta_read_source(void *ctx, uint32_t offset, void *buffer, size_t size) {
+    return esp_partition_read(s_running, offset, buffer, size);
+}
+
+// Every write starts a new sector, the window is one sector
+static esp_err_t delta_write_target(void *ctx, uint32_t offset, const void *data, size_t size) {
+    ota_download_t *download = ctx;
+    if (offset % OTA_DELTA_WINDOW != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = esp_partition_erase_range(download->update, offset, OTA_DELTA_WINDOW);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(download->update, offset, data, size);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write %s at %" PRIu32 ": %s", download->update->label, offset, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static esp_err_t delta_save(void *ctx, const ota_delta_state_t *checkpoint) {
+    ota_record_t record = { .magic = OTA_RECORD_MAGIC, .checkpoint = *checkpoint };
+    esp_err_t ret = nvs_set_blob(s_nvs, OTA_CHECKPOINT_KEY, &record, sizeof(record));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(s_nvs);
+    }
+    s_in_progress = ret == ESP_OK;
+    return ret;
+}
+
+static bool delta_stop(void *ctx) {
+    return cycle_stage_expired();
+}
+
+static void on_header(void *ctx, const char *key, const char *value) {
+    ota_download_t *download = ctx;
+    if (strcasecmp(key, "Content-Range") == 0) {
+        strncpy(download->content_range, value, sizeof(download->content_range) - 1);
+    }
+}
+
+// The body is patched as it arrives, an error page is skipped
+static esp_err_t on_data(void *ctx, int status_code, const char *data, size_t len) {
+    ota_download_t *download = ctx;
+    if (!download->checked) {
+        download->response = ota_delta_response(&download->delta, status_code, download->content_range);
+        download->checked = true;
+    }
+    if (download->response != ESP_OK) {
+        return ESP_OK;
+    }
+    return ota_delta_feed(&download->delta, (const uint8_t *)data, len);
+}
+
+// One range request on the pooled connection
+static esp_err_t delta_fetch(void *ctx, uint32_t offset, uint32_t size) {
+    ota_download_t *download = ctx;
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%" PRIu32 "-%" PRIu32, offset, offset + size - 1);
+    const https_client_header_t headers[] = {
+        { "Range", range },
+    };
+
+    download->checked = false;
+    download->response = ESP_OK;
+    memset(download->content_range, 0, sizeof(download->content_range));
+    const https_client_request_t request = {
+        .method = HTTP_METHOD_GET,
+        .url = download->url,
+        .headers = headers,
+        .header_count = sizeof(headers) / sizeof(headers[0]),
+        .on_header = on_header,
+        .header_ctx = download,
+        .on_data = on_data,
+        .data_ctx = download,
+    };
+    https_client_response_t response;
+    esp_err_t ret = https_client_request(download->client, &request, &response);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!download->checked) {
+        // Response without a body
+        download->response = ota_delta_response(&download->delta, response.status_code, download->content_range);
+    }
+    return download->response;
+}
+
+// Update slot, pooled connection and URL of the delta
+static esp_err_t open_download(ota_download_t *download) {
+    download->update = esp_ota_get_next_update_partition(NULL);
+    if (download->update == NULL) {
+        ESP_LOGE(TAG, "No update slot in the partition table");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const https_client_host_config_t host_config = {
+        .host = OTA_HOST,
+        .use_crt_bundle = true,
+        .rx_buffer_size = 4096,
+        .tx_buffer_size = 1024,
+        .timeout_ms = 30000,
+    };
+    esp_err_t ret = https_client_open(&host_config, &download->client);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char hash_hex[2 * OTA_DELTA_HASH_SIZE + 1];
+    for (int i = 0; i < OTA_DELTA_HASH_SIZE; i++) {
+        snprintf(hash_hex + 2 * i, 3, "%02x", s_running_hash[i]);
+    }
+    int length = snprintf(download->url, sizeof(download->url), "https://%s/%s/%s.delta", OTA_HOST, OTA_PATH,
+                          hash_hex);
+    if (length < 0 || (size_t)length >= sizeof(download->url)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    download->io = (ota_delta_io_t){
+        .begin = delta_begin,
+        .read_source = delta_read_source,
+        .write_target = delta_write_target,
+        .fetch = delta_fetch,
+        .save = delta_save,
+        .stop = delta_stop,
+        .ctx = download,
+    };
+    return ESP_OK;
+}
+
+// The written image must be the one the delta promised, then it boots on the next wake
+static esp_err_t install(ota_download_t *download) {
+    uint8_t hash[OTA_DELTA_HASH_SIZE];
+    esp_err_t ret = esp_partition_get_sha256(download->update, hash);
+    if (ret == ESP_OK && memcmp(hash, download->delta.state.header.target_hash, sizeof(hash)) != 0) {
+        ret = ESP_ERR_INVALID_CRC;
+    }
+    if (ret == ESP_OK) {
+        ret = esp_ota_set_boot_partition(download->update);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "New image in %s failed verification: %s", download->update->label, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t ota_update_run(void) {
+    if (!ota_update_due()) {
+        return ESP_OK;
+    }
+    esp_err_t ret = read_image_hashes();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ota_download_t *download = calloc(1, sizeof(*download));
+    if (download == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = open_download(download);
+
+    // A checkpoint of another source image is from before a serial flash
+    ota_record_t record;
+    bool resume = load_record(&record) && record.checkpoint.phase != OTA_DELTA_PHASE_HEADER &&
+                  memcmp(record.checkpoint.header.source_hash, s_running_hash, OTA_DELTA_HASH_SIZE) == 0;
+    if (s_in_progress && !resume) {
+        erase_record();
+    }
+    if (ret == ESP_OK) {
+        ret = ota_delta_init(&download->delta, &download->io, resume ? &record.checkpoint : NULL);
+    }
+    if (ret == ESP_OK) {
+        ret = ota_delta_download(&download->delta, OTA_RANGE_BYTES, OTA_CYCLE_BYTES);
+    }
+    if (ret == ESP_OK) {
+        ret = install(download);
+    }
+
+    const ota_delta_state_t *state = &download->delta.state;
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Firmware update installed in %s", download->update->label);
+        storage_log(LOG_OTA_INSTALLED, (int)(state->header.target_size / 1024));
+        erase_record();
+        mark_checked();
+    } else if (ret == ESP_ERR_NOT_FOUND) {
+        ESP_LOGI(TAG, "No update for the running image");
+        mark_checked();
+        ret = ESP_OK;
+    } else if (ret == ESP_ERR_NOT_FINISHED) {
+        ESP_LOGI(TAG, "Firmware update continues in the next send cycle");
+        storage_log(LOG_OTA_PROGRESS, (int)(state->patch_offset / 1024), (int)(state->target_offset / 1024),
+                    (int)(state->header.target_size / 1024));
+    } else {
+        // A broken delta or image starts over after the check interval, a lost connection resumes
+        storage_log(LOG_OTA_FAILED, ret);
+        if (download->delta.error != ESP_OK || ret == ESP_ERR_INVALID_RESPONSE || ret == ESP_ERR_INVALID_SIZE ||
+            ret == ESP_ERR_INVALID_CRC) {
+            erase_record();
+            mark_checked();
+        }
+    }
+    free(download);
+    return ret;
+}
+
+void ota_update_cycle_end(ota_cycle_result_t result) {
+    if (!s_pending_verify) {
+        return;
+    }
+    if (result == OTA_CYCLE_OFFLINE) {
+        // The bootloader keeps the pending state over deep sleep, the next cycle uploads again
+        ESP_LOGW(TAG, "New firmware could not upload, confirmed in a later cycle");
+        storage_log(LOG_OTA_VERIFY_DEFERRED);
+        storage_log_flush();
+        return;
+    }
+    if (result == OTA_CYCLE_HEALTHY) {
+        esp_err_t ret = esp_ota_mark_app_valid_cancel_rollback();
+        if (ret == ESP_OK) {
+            s_pending_verify = false;
+            // The log was flushed by the sleep stage, this record needs its own write
+            storage_log(LOG_OTA_VALID);
+            storage_log_flush();
+            ESP_LOGI(TAG, "New firmware confirmed");
+        } else {
+            ESP_LOGE(TAG, "Failed to confirm the new firmware: %s", esp_err_to_name(ret));
+        }
+        return;
+    }
+
+    ESP_LOGE(TAG, "New firmware failed its self-test, rolling back");
+    storage_log(LOG_OTA_ROLLBACK);
+    storage_log_flush();
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
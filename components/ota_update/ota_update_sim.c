@@ -0,0 +1,29 @@
+// ota_update_sim.c
+// Firmware update of the Linux target build. The simulation runs one image
+// without app slots, so there is never an update to download or to confirm.
+// The delta format is tested by the host tests (host_tests/main/test_ota.c).
+#include "ota_update.h"
+#include "esp_log.h"
+
+static const char *TAG = "OTA";
+
+esp_err_t ota_update_init(void) {
+    ESP_LOGI(TAG, "Firmware updates are not simulated");
+    return ESP_OK;
+}
+
+bool ota_update_pending_verify(void) {
+    return false;
+}
+
+bool ota_update_due(void) {
+    return false;
+}
+
+esp_err_t ota_update_run(void) {
+    return ESP_OK;
+}
+
+void ota_update_cycle_end(ota_cycle_result_t result) {
+    (void)result;
+}
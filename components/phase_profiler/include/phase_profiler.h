@@ -0,0 +1,145 @@
+#pragma once
+
+#include "esp_err.h"
+#include "power_management.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Power domains with their own current draw
+ */
+typedef enum {
+    PHASE_POWER_RADIO,  // BLE controller on
+    PHASE_POWER_MODEM,  // A7670E modem powered
+    PHASE_POWER_COUNT
+} phase_power_t;
+
+/**
+ * @brief Wake cycle phase table
+ *
+ * PHASE(id, name, power domain, power profile). The domain selects the
+ * estimated current of the phase on top of the CPU current, -1 for CPU
+ * only. The profile is held while the phase runs, a powered domain holds
+ * its own profile.
+ */
+#define PHASE_PROFILER_PHASES(PHASE) \
+    PHASE(PHASE_INIT,        "init",       -1,                POWER_PROFILE_FAST) \
+    PHASE(PHASE_BLE_INIT,    "ble_init",   PHASE_POWER_RADIO, POWER_PROFILE_RADIO) \
+    PHASE(PHASE_BLE_SCAN,    "ble_scan",   PHASE_POWER_RADIO, POWER_PROFILE_RADIO) \
+    PHASE(PHASE_SPIFFS,      "spiffs",     -1,                POWER_PROFILE_FAST) \
+    PHASE(PHASE_MODEM_BOOT,  "modem_boot", PHASE_POWER_MODEM, POWER_PROFILE_MODEM_IO) \
+    PHASE(PHASE_PPP,         "ppp",        PHASE_POWER_MODEM, POWER_PROFILE_MODEM_IO) \
+    PHASE(PHASE_TIME_SYNC,   "ntp",        PHASE_POWER_MODEM, POWER_PROFILE_MODEM_IO) \
+    PHASE(PHASE_CONNECT,     "tls",        PHASE_POWER_MODEM, POWER_PROFILE_FAST) \
+    PHASE(PHASE_HTTP,        "http",       PHASE_POWER_MODEM, POWER_PROFILE_MODEM_IO) \
+    PHASE(PHASE_UPLOAD,      "upload",     PHASE_POWER_MODEM, POWER_PROFILE_MODEM) \
+    PHASE(PHASE_DISCORD,     "discord",    PHASE_POWER_MODEM, POWER_PROFILE_MODEM) \
+    PHASE(PHASE_JWT,         "jwt",        -1,                POWER_PROFILE_FAST) \
+    PHASE(PHASE_ENCODE,      "encode",     -1,                POWER_PROFILE_FAST) \
+    PHASE(PHASE_LOG_FLUSH,   "log_flush",  -1,                POWER_PROFILE_FAST)
+
+/**
+ * @brief Phase IDs
+ */
+typedef enum {
+#define PHASE_PROFILER_ID(id, name, power, profile) id,
+    PHASE_PROFILER_PHASES(PHASE_PROFILER_ID)
+#undef PHASE_PROFILER_ID
+    PHASE_COUNT
+} phase_id_t;
+
+/**
+ * @brief Phase boundary hook
+ *
+ * Called in the context of the task that marks the phase, outside of any
+ * critical section, after the phase has begun or ended.
+ *
+ * @param phase Phase ID
+ * @param begin true when the phase begins, false when it ends
+ */
+typedef void (*phase_profiler_hook_t)(phase_id_t phase, bool begin);
+
+/**
+ * @brief Install a hook that is called at every phase boundary
+ *
+ * Only one hook is supported, NULL removes it.
+ *
+ * @param hook Hook function
+ */
+void phase_profiler_set_hook(phase_profiler_hook_t hook);
+
+/**
+ * @brief Mark the beginning of a phase
+ *
+ * Phases may nest (HTTP inside upload). Beginning a phase that is already
+ * running is ignored, a phase can run several times per cycle.
+ *
+ * @param phase Phase ID
+ */
+void phase_begin(phase_id_t phase);
+
+/**
+ * @brief Mark the end of a phase
+ *
+ * @param phase Phase ID
+ */
+void phase_end(phase_id_t phase);
+
+/**
+ * @brief Mark a power domain as switched on
+ *
+ * Holds the power profile of the domain until it is switched off, the
+ * modem keeps light sleep blocked so no UART traffic is lost.
+ *
+ * @param power Power domain
+ */
+void phase_power_on(phase_power_t power);
+
+/**
+ * @brief Mark a power domain as switched off
+ *
+ * @param power Power domain
+ */
+void phase_power_off(phase_power_t power);
+
+/**
+ * @brief End the wake cycle
+ *
+ * Closes running phases, logs the cycle trace and adds the cycle to the
+ * rolling statistics kept in RTC memory. Called once before deep sleep.
+ */
+void phase_profiler_cycle_end(void);
+
+/**
+ * @brief Estimated charge of the last ended cycle
+ *
+ * CPU current over the awake time plus the radio and modem currents over
+ * their power-on time, as logged by phase_profiler_cycle_end().
+ *
+ * @param awake_ms Pointer to store the awake time of the cycle, may be NULL
+ * @return float Charge in mAh, 0 before the first cycle ended
+ */
+float phase_profiler_cycle_mah(uint32_t *awake_ms);
+
+/**
+ * @brief Format the rolling statistics as text for the daily report
+ *
+ * @param buffer Buffer for the summary
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if no cycles were recorded
+ */
+esp_err_t phase_profiler_format_summary(char *buffer, size_t buffer_size);
+
+/**
+ * @brief Reset the rolling statistics after they were reported
+ */
+void phase_profiler_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
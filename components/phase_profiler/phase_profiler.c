@@ -0,0 +1,364 @@
+/**
+ * @file phase_profiler.c
+ * @brief Wake cycle phase tracing with estimated energy per phase
+ *
+ * Phase markers are stored with esp_timer timestamps in a fixed RAM trace.
+ * At the end of the cycle the phase durations are folded into rolling
+ * statistics in RTC memory, which survive deep sleep, and are reported
+ * once a day.
+ */
+
+#include "phase_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "config_manager.h"
+
+static const char *TAG = "phase_profiler";
+
+#define PHASE_TRACE_SIZE    96          // Phase markers kept per cycle
+#define PHASE_STATS_MAGIC   0x50485332  // "PHS2"
+#define PHASE_AVG_WEIGHT    8           // Moving average over about 8 cycles
+
+typedef enum {
+    EVENT_BEGIN,
+    EVENT_END,
+    EVENT_POWER_ON,
+    EVENT_POWER_OFF,
+} phase_event_type_t;
+
+// Trace entry
+typedef struct {
+    uint32_t time_us;
+    uint8_t id;     // Phase ID or power domain
+    uint8_t type;   // phase_event_type_t
+} phase_event_t;
+
+// Rolling statistics of one phase
+typedef struct {
+    uint32_t cycles;    // Cycles in which the phase ran
+    uint32_t total_ms;
+    uint32_t max_ms;
+    uint32_t avg_ms;    // Moving average of the cycles in which the phase ran
+} phase_stat_t;
+
+// Rolling statistics kept in RTC memory
+typedef struct {
+    uint32_t magic;
+    uint32_t cycles;
+    uint32_t awake_ms;
+    uint32_t power_ms[PHASE_POWER_COUNT];
+    phase_stat_t phases[PHASE_COUNT];
+} phase_rtc_stats_t;
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+#define PHASE_PROFILER_NAME(id, name, power, profile) [id] = name,
+    PHASE_PROFILER_PHASES(PHASE_PROFILER_NAME)
+#undef PHASE_PROFILER_NAME
+};
+
+static const int8_t PHASE_POWER[PHASE_COUNT] = {
+#define PHASE_PROFILER_POWER(id, name, power, profile) [id] = power,
+    PHASE_PROFILER_PHASES(PHASE_PROFILER_POWER)
+#undef PHASE_PROFILER_POWER
+};
+
+static const uint8_t PHASE_PROFILE[PHASE_COUNT] = {
+#define PHASE_PROFILER_PROFILE(id, name, power, profile) [id] = profile,
+    PHASE_PROFILER_PHASES(PHASE_PROFILER_PROFILE)
+#undef PHASE_PROFILER_PROFILE
+};
+
+static const uint16_t POWER_CURRENT_MA[PHASE_POWER_COUNT] = {
+    [PHASE_POWER_RADIO] = PHASE_CURRENT_RADIO_MA,
+    [PHASE_POWER_MODEM] = PHASE_CURRENT_MODEM_MA,
+};
+
+static const char *const POWER_NAMES[PHASE_POWER_COUNT] = {
+    [PHASE_POWER_RADIO] = "radio",
+    [PHASE_POWER_MODEM] = "modem",
+};
+
+static const uint8_t POWER_PROFILE[PHASE_POWER_COUNT] = {
+    [PHASE_POWER_RADIO] = POWER_PROFILE_RADIO,
+    [PHASE_POWER_MODEM] = POWER_PROFILE_MODEM,
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static phase_event_t s_trace[PHASE_TRACE_SIZE];
+static size_t s_trace_len = 0;
+static uint32_t s_trace_dropped = 0;
+
+// Current cycle, a start time of 0 means not running
+static int64_t s_phase_start_us[PHASE_COUNT];
+static int64_t s_phase_us[PHASE_COUNT];
+static int64_t s_power_start_us[PHASE_POWER_COUNT];
+static int64_t s_power_us[PHASE_POWER_COUNT];
+static int64_t s_cycle_start_us = 0;            // 0 after boot, later cycles only in the host build
+static bool s_phase_profile_held[PHASE_COUNT];     // Released only if the acquire succeeded
+static bool s_power_profile_held[PHASE_POWER_COUNT];
+static phase_profiler_hook_t s_hook = NULL;    // Called at every phase boundary, NULL if not installed
+static float s_last_cycle_mah = 0.0f;
+static uint32_t s_last_awake_ms = 0;
+
+RTC_DATA_ATTR static phase_rtc_stats_t s_stats;
+
+// Estimated charge in mAh for a duration at a current
+static float charge_mah(uint64_t duration_ms, uint32_t current_ma) {
+    return (float)duration_ms * (float)current_ma / 3600000.0f;
+}
+
+// Current drawn during a phase
+static uint32_t phase_current_ma(phase_id_t phase) {
+    int8_t power = PHASE_POWER[phase];
+    return PHASE_CURRENT_CPU_MA + ((power >= 0) ? POWER_CURRENT_MA[power] : 0);
+}
+
+// Add a trace entry, must be called with the lock held
+static void trace_add(int64_t now, uint8_t id, phase_event_type_t type) {
+    if (s_trace_len < PHASE_TRACE_SIZE) {
+        s_trace[s_trace_len++] = (phase_event_t) {
+            .time_us = (uint32_t)now,
+            .id = id,
+            .type = type,
+        };
+    } else {
+        s_trace_dropped++;
+    }
+}
+
+// Install the phase boundary hook
+void phase_profiler_set_hook(phase_profiler_hook_t hook) {
+    s_hook = hook;
+}
+
+// Mark the beginning of a phase
+void phase_begin(phase_id_t phase) {
+    if (phase >= PHASE_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    bool started = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_phase_start_us[phase] == 0) {
+        s_phase_start_us[phase] = now;
+        trace_add(now, phase, EVENT_BEGIN);
+        started = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    // Phases that begin before power_management_init() run without their profile
+    if (started) {
+        s_phase_profile_held[phase] = (power_profile_acquire((power_profile_t)PHASE_PROFILE[phase]) == ESP_OK);
+    }
+
+    phase_profiler_hook_t hook = s_hook;
+    if (started && hook != NULL) {
+        hook(phase, true);
+    }
+}
+
+// Mark the end of a phase
+void phase_end(phase_id_t phase) {
+    if (phase >= PHASE_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    bool ended = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_phase_start_us[phase] != 0) {
+        s_phase_us[phase] += now - s_phase_start_us[phase];
+        s_phase_start_us[phase] = 0;
+        trace_add(now, phase, EVENT_END);
+        ended = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (ended && s_phase_profile_held[phase]) {
+        power_profile_release((power_profile_t)PHASE_PROFILE[phase]);
+        s_phase_profile_held[phase] = false;
+    }
+
+    phase_profiler_hook_t hook = s_hook;
+    if (ended && hook != NULL) {
+        hook(phase, false);
+    }
+}
+
+// Mark a power domain as switched on
+void phase_power_on(phase_power_t power) {
+    if (power >= PHASE_POWER_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    bool switched = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_power_start_us[power] == 0) {
+        s_power_start_us[power] = now;
+        trace_add(now, power, EVENT_POWER_ON);
+        switched = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (switched) {
+        s_power_profile_held[power] = (power_profile_acquire((power_profile_t)POWER_PROFILE[power]) == ESP_OK);
+    }
+}
+
+// Mark a power domain as switched off
+void phase_power_off(phase_power_t power) {
+    if (power >= PHASE_POWER_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    bool switched = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_power_start_us[power] != 0) {
+        s_power_us[power] += now - s_power_start_us[power];
+        s_power_start_us[power] = 0;
+        trace_add(now, power, EVENT_POWER_OFF);
+        switched = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (switched && s_power_profile_held[power]) {
+        power_profile_release((power_profile_t)POWER_PROFILE[power]);
+        s_power_profile_held[power] = false;
+    }
+}
+
+// Log the trace of the cycle
+static void log_trace(void) {
+    for (size_t i = 0; i < s_trace_len; i++) {
+        const phase_event_t *e = &s_trace[i];
+        bool power = (e->type == EVENT_POWER_ON || e->type == EVENT_POWER_OFF);
+        const char *name = power ? POWER_NAMES[e->id] : PHASE_NAMES[e->id];
+        const char *what = (e->type == EVENT_BEGIN || e->type == EVENT_POWER_ON) ? "begin" : "end";
+        power_profile_t profile = (power_profile_t)(power ? POWER_PROFILE[e->id] : PHASE_PROFILE[e->id]);
+        ESP_LOGD(TAG, "%10lu us %s %s [%s]", (unsigned long)e->time_us, name, what, power_profile_name(profile));
+    }
+    if (s_trace_dropped > 0) {
+        ESP_LOGW(TAG, "%lu trace entries dropped", (unsigned long)s_trace_dropped);
+    }
+}
+
+// End the wake cycle
+void phase_profiler_cycle_end(void) {
+    // Close everything that is still running
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        phase_end((phase_id_t)i);
+    }
+    for (int i = 0; i < PHASE_POWER_COUNT; i++) {
+        phase_power_off((phase_power_t)i);
+    }
+
+    log_trace();
+
+    if (s_stats.magic != PHASE_STATS_MAGIC) {
+        memset(&s_stats, 0, sizeof(s_stats));
+        s_stats.magic = PHASE_STATS_MAGIC;
+    }
+
+    int64_t now = esp_timer_get_time();
+    uint32_t awake_ms = (uint32_t)((now - s_cycle_start_us) / 1000);
+    s_stats.cycles++;
+    s_stats.awake_ms += awake_ms;
+
+    float cycle_mah = charge_mah(awake_ms, PHASE_CURRENT_CPU_MA);
+    for (int i = 0; i < PHASE_POWER_COUNT; i++) {
+        uint32_t ms = (uint32_t)(s_power_us[i] / 1000);
+        s_stats.power_ms[i] += ms;
+        cycle_mah += charge_mah(ms, POWER_CURRENT_MA[i]);
+    }
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (s_phase_us[i] == 0) {
+            continue;
+        }
+        uint32_t ms = (uint32_t)(s_phase_us[i] / 1000);
+        phase_stat_t *stat = &s_stats.phases[i];
+        stat->avg_ms = (stat->cycles == 0) ? ms :
+                       stat->avg_ms + ((int32_t)ms - (int32_t)stat->avg_ms) / PHASE_AVG_WEIGHT;
+        stat->cycles++;
+        stat->total_ms += ms;
+        if (ms > stat->max_ms) {
+            stat->max_ms = ms;
+        }
+
+        ESP_LOGI(TAG, "%-10s %6lu ms  ~%.3f mAh  %s", PHASE_NAMES[i], (unsigned long)ms,
+                 charge_mah(ms, phase_current_ma((phase_id_t)i)), power_profile_name((power_profile_t)PHASE_PROFILE[i]));
+    }
+
+    ESP_LOGI(TAG, "Cycle: %lu ms awake, radio %lu ms, modem %lu ms, ~%.3f mAh",
+             (unsigned long)awake_ms, (unsigned long)(s_power_us[PHASE_POWER_RADIO] / 1000),
+             (unsigned long)(s_power_us[PHASE_POWER_MODEM] / 1000), cycle_mah);
+    s_last_cycle_mah = cycle_mah;
+    s_last_awake_ms = awake_ms;
+
+    // Start the next cycle, normally it begins with a fresh boot after deep sleep
+    portENTER_CRITICAL(&s_lock);
+    s_trace_len = 0;
+    s_trace_dropped = 0;
+    memset(s_phase_us, 0, sizeof(s_phase_us));
+    memset(s_power_us, 0, sizeof(s_power_us));
+    s_cycle_start_us = now;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Estimated charge of the last ended cycle
+float phase_profiler_cycle_mah(uint32_t *awake_ms) {
+    if (awake_ms != NULL) {
+        *awake_ms = s_last_awake_ms;
+    }
+    return s_last_cycle_mah;
+}
+
+// Format the rolling statistics as text
+esp_err_t phase_profiler_format_summary(char *buffer, size_t buffer_size) {
+    if (buffer == NULL || buffer_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buffer[0] = '\0';
+    if (s_stats.magic != PHASE_STATS_MAGIC || s_stats.cycles == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    float total_mah = charge_mah(s_stats.awake_ms, PHASE_CURRENT_CPU_MA);
+    for (int i = 0; i < PHASE_POWER_COUNT; i++) {
+        total_mah += charge_mah(s_stats.power_ms[i], POWER_CURRENT_MA[i]);
+    }
+
+    int len = snprintf(buffer, buffer_size,
+                       "Wake cycles: %lu, avg awake %lu ms, radio %lu s, modem %lu s, ~%.1f mAh",
+                       (unsigned long)s_stats.cycles, (unsigned long)(s_stats.awake_ms / s_stats.cycles),
+                       (unsigned long)(s_stats.power_ms[PHASE_POWER_RADIO] / 1000),
+                       (unsigned long)(s_stats.power_ms[PHASE_POWER_MODEM] / 1000), total_mah);
+
+    for (int i = 0; i < PHASE_COUNT && len >= 0 && (size_t)len < buffer_size; i++) {
+        const phase_stat_t *stat = &s_stats.phases[i];
+        if (stat->cycles == 0) {
+            continue;
+        }
+        len += snprintf(buffer + len, buffer_size - len, "\n%s: %lux avg %lu ms max %lu ms ~%.2f mAh",
+                        PHASE_NAMES[i], (unsigned long)stat->cycles, (unsigned long)stat->avg_ms,
+                        (unsigned long)stat->max_ms,
+                        charge_mah(stat->total_ms, phase_current_ma((phase_id_t)i)));
+    }
+
+    // A truncated summary is still useful, it is only cut at the end
+    return ESP_OK;
+}
+
+// Reset the rolling statistics
+void phase_profiler_reset_stats(void) {
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.magic = PHASE_STATS_MAGIC;
+}
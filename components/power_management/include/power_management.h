@@ -2,11 +2,78 @@
 #define POWER_MANAGEMENT_H
 
 #include "esp_err.h"
+
+/**
+ * @brief Power management locks a profile holds
+ */
+#define POWER_LOCK_CPU_MAX      0x01    // CPU at POWER_MAX_FREQ_MHZ
+#define POWER_LOCK_APB_MAX      0x02    // APB clock at 80 MHz, needed by the UART and the radio
+#define POWER_LOCK_NO_SLEEP     0x04    // No automatic light sleep
+
+/**
+ * @brief Power profile table
+ *
+ * POWER_PROFILE(id, name, locks). Without a profile the CPU runs at
+ * POWER_MIN_FREQ_MHZ and the idle task enters light sleep. The modem
+ * profile keeps the UART clock while the modem is powered, light sleep is
+ * still allowed between transfers. The ESP32 loses the UART bytes that
+ * arrive in light sleep, so AT commands, PPP negotiation and requests hold
+ * modem_io on top until their response is in.
+ */
+#define POWER_PROFILES(POWER_PROFILE) \
+    POWER_PROFILE(POWER_PROFILE_IDLE,     "idle",     0) \
+    POWER_PROFILE(POWER_PROFILE_RADIO,    "radio",    POWER_LOCK_APB_MAX) \
+    POWER_PROFILE(POWER_PROFILE_MODEM,    "modem",    POWER_LOCK_APB_MAX) \
+    POWER_PROFILE(POWER_PROFILE_MODEM_IO, "modem_io", POWER_LOCK_APB_MAX | POWER_LOCK_NO_SLEEP) \
+    POWER_PROFILE(POWER_PROFILE_FAST,     "fast",     POWER_LOCK_CPU_MAX)
+
+/**
+ * @brief Power profile IDs
+ */
+typedef enum {
+#define POWER_PROFILE_ID(id, name, locks) id,
+    POWER_PROFILES(POWER_PROFILE_ID)
+#undef POWER_PROFILE_ID
+    POWER_PROFILE_COUNT
+} power_profile_t;
+
 /**
  * @brief Initialize power management
+ *
+ * Enables dynamic frequency scaling between POWER_MIN_FREQ_MHZ and
+ * POWER_MAX_FREQ_MHZ and automatic light sleep when FreeRTOS tickless idle
+ * is enabled, and creates the locks of the power profiles.
  * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t power_management_init(void);
 
-#endif // POWER_MANAGEMENT_H
\ No newline at end of file
+/**
+ * @brief Hold a power profile
+ *
+ * Profiles are counted, every acquire needs a release. Several profiles
+ * can be held at the same time, the locks add up.
+ *
+ * @param profile Power profile
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE before
+ *         power_management_init() or without power management
+ */
+esp_err_t power_profile_acquire(power_profile_t profile);
+
+/**
+ * @brief Release a power profile
+ *
+ * @param profile Power profile
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if the profile is not held
+ */
+esp_err_t power_profile_release(power_profile_t profile);
+
+/**
+ * @brief Name of a power profile
+ *
+ * @param profile Power profile
+ * @return const char* Name, "idle" for an unknown profile
+ */
+const char *power_profile_name(power_profile_t profile);
+
+#endif // POWER_MANAGEMENT_H
@@ -1,17 +1,73 @@
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
 #include "power_management.h"
+#include <stdbool.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_PM_ENABLE
 #include "esp_pm.h"
+#endif
 #include "esp_log.h"
+#include "config_manager.h"
 
 static const char *TAG = "POWER_MANAGEMENT";
 
+static const char *const PROFILE_NAMES[POWER_PROFILE_COUNT] = {
+#define POWER_PROFILE_NAME(id, name, locks) [id] = name,
+    POWER_PROFILES(POWER_PROFILE_NAME)
+#undef POWER_PROFILE_NAME
+};
+
+#ifdef CONFIG_PM_ENABLE
+static const uint8_t PROFILE_LOCKS[POWER_PROFILE_COUNT] = {
+#define POWER_PROFILE_LOCKS(id, name, locks) [id] = (locks),
+    POWER_PROFILES(POWER_PROFILE_LOCKS)
+#undef POWER_PROFILE_LOCKS
+};
+
+// Lock types in the order of the POWER_LOCK_* bits
+static const esp_pm_lock_type_t LOCK_TYPES[] = {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP,
+};
+
+#define LOCK_TYPE_COUNT (sizeof(LOCK_TYPES) / sizeof(LOCK_TYPES[0]))
+
+// One lock per profile and type, so esp_pm_dump_locks() shows the profile names
+static esp_pm_lock_handle_t s_locks[POWER_PROFILE_COUNT][LOCK_TYPE_COUNT];
+static bool s_initialized = false;
+
+// Create the locks of the profiles, only once per boot
+static esp_err_t create_locks(void) {
+    for (int profile = 0; profile < POWER_PROFILE_COUNT; profile++) {
+        for (size_t type = 0; type < LOCK_TYPE_COUNT; type++) {
+            if (!(PROFILE_LOCKS[profile] & (1 << type))) {
+                continue;
+            }
+            esp_err_t ret = esp_pm_lock_create(LOCK_TYPES[type], 0, PROFILE_NAMES[profile], &s_locks[profile][type]);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to create the %s lock: %s", PROFILE_NAMES[profile], esp_err_to_name(ret));
+                return ret;
+            }
+        }
+    }
+    return ESP_OK;
+}
+#endif
+
 // Initialize power management
 esp_err_t power_management_init(void) {
     #ifdef CONFIG_PM_ENABLE
+        if (s_initialized) {
+            return ESP_OK;
+        }
         esp_pm_config_t pm_config = {
-            .max_freq_mhz = 80,  // Maximum CPU frequency      
-            .min_freq_mhz = 80,  // Minimum CPU frequency      
-            .light_sleep_enable = false  
+            .max_freq_mhz = POWER_MAX_FREQ_MHZ,     // Crypto and encoding under the fast profile
+            .min_freq_mhz = POWER_MIN_FREQ_MHZ,     // Waits without a profile
+        #if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+            .light_sleep_enable = true
+        #else
+            .light_sleep_enable = false
+        #endif
         };
         
         esp_err_t ret = esp_pm_configure(&pm_config);
@@ -19,8 +75,69 @@ esp_err_t power_management_init(void) {
             ESP_LOGE(TAG, "Power management configuration failed");
             return ret;
         }
-        ESP_LOGI(TAG, "Power management configured with max frequency: %d MHz", pm_config.max_freq_mhz);
+        ret = create_locks();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        s_initialized = true;
+        ESP_LOGI(TAG, "Power management configured: %d-%d MHz, light sleep %s", pm_config.min_freq_mhz,
+                 pm_config.max_freq_mhz, pm_config.light_sleep_enable ? "on" : "off");
     #endif
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+// Hold the locks of a profile
+esp_err_t power_profile_acquire(power_profile_t profile) {
+    #ifdef CONFIG_PM_ENABLE
+        if (!s_initialized) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (profile >= POWER_PROFILE_COUNT) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (size_t type = 0; type < LOCK_TYPE_COUNT; type++) {
+            if (s_locks[profile][type] == NULL) {
+                continue;
+            }
+            esp_err_t ret = esp_pm_lock_acquire(s_locks[profile][type]);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        return ESP_OK;
+    #else
+        (void)profile;
+        return ESP_ERR_INVALID_STATE;
+    #endif
+}
+
+// Release the locks of a profile
+esp_err_t power_profile_release(power_profile_t profile) {
+    #ifdef CONFIG_PM_ENABLE
+        if (!s_initialized) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (profile >= POWER_PROFILE_COUNT) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (size_t type = 0; type < LOCK_TYPE_COUNT; type++) {
+            if (s_locks[profile][type] == NULL) {
+                continue;
+            }
+            esp_err_t ret = esp_pm_lock_release(s_locks[profile][type]);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        return ESP_OK;
+    #else
+        (void)profile;
+        return ESP_ERR_INVALID_STATE;
+    #endif
+}
+
+// Name of a power profile
+const char *power_profile_name(power_profile_t profile) {
+    return ((unsigned)profile < POWER_PROFILE_COUNT) ? PROFILE_NAMES[profile] : "idle";
+}
@@ -6,8 +6,13 @@
 #include <string.h>
 #include "storage.h"
 #include "discord_api.h"
+#include "phase_profiler.h"
+#include "heap_monitor.h"
+#include "energy_ledger.h"
+#include <stdlib.h>
 
 static const char *TAG = "reporter";
+#define PHASE_SUMMARY_SIZE 1024
 // Safe message initialization
 char message[128];
 
@@ -56,21 +61,42 @@ esp_err_t sending_report_to_discord() {
 
     ret = discord_init();
     if (ret != ESP_OK) {
-        storage_append_log("Discord init failed in first boot");
-        unsuccessful_init(TAG);
+        storage_log(LOG_DISCORD_INIT_FAILED);
+        return ret;
     }
     
     // Format initial message with battery information
     ret = reporter_format_initial_message(message, sizeof(message));
     if (ret != ESP_OK) {
-        storage_append_log("Failed to format initial message");
+        storage_log(LOG_REPORT_FORMAT_FAILED);
     }
     
     // Sending the first message using task
     ret = discord_send_message_safe(message);
     if (ret != ESP_OK) {
-        storage_append_log("Failed to send first boot message");
+        storage_log(LOG_FIRST_BOOT_MESSAGE_FAILED);
     }
     
+    // Wake cycle statistics since the previous report
+    char *summary = malloc(PHASE_SUMMARY_SIZE);
+    if (summary != NULL && phase_profiler_format_summary(summary, PHASE_SUMMARY_SIZE) == ESP_OK) {
+        if (discord_send_message_safe(summary) == ESP_OK) {
+            phase_profiler_reset_stats();
+        }
+    }
+    
+    // State of charge and consumption, the ledger is not reset
+    if (summary != NULL && energy_ledger_format_summary(summary, PHASE_SUMMARY_SIZE) == ESP_OK) {
+        discord_send_message_safe(summary);
+    }
+    
+    // Heap worst values since the previous report
+    if (summary != NULL && heap_monitor_format_summary(summary, PHASE_SUMMARY_SIZE) == ESP_OK) {
+        if (discord_send_message_safe(summary) == ESP_OK) {
+            heap_monitor_reset_stats();
+        }
+    }
+    free(summary);
+    
     return ESP_OK;
 }
\ No newline at end of file
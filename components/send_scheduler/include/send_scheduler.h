@@ -0,0 +1,166 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scheduler tunables
+ *
+ * PARAM(field, NVS key, default). Every tunable can be overridden at runtime
+ * by writing a u32 with its key to the "scheduler" NVS namespace, the
+ * defaults come from config_manager.h.
+ */
+#define SEND_SCHEDULER_PARAMS(PARAM) \
+    PARAM(max_cycles,         "max_cycles",   SEND_DATA_CYCLE) \
+    PARAM(min_cycles,         "min_cycles",   SCHED_MIN_CYCLES) \
+    PARAM(early_bytes,        "early_bytes",  SCHED_EARLY_BYTES) \
+    PARAM(full_bytes,         "full_bytes",   SCHED_FULL_BYTES) \
+    PARAM(good_csq,           "good_csq",     SCHED_GOOD_CSQ) \
+    PARAM(low_battery,        "low_batt",     SCHED_LOW_BATTERY) \
+    PARAM(critical_battery,   "crit_batt",    SCHED_CRITICAL_BATTERY) \
+    PARAM(low_battery_factor, "low_factor",   SCHED_LOW_BATTERY_FACTOR) \
+    PARAM(expensive_ms,       "expensive_ms", SCHED_EXPENSIVE_UPLOAD_MS)
+
+/**
+ * @brief Scheduler policy
+ *
+ * max_cycles          Upload at the latest after this many wake cycles
+ * min_cycles          Earliest early upload
+ * early_bytes         Pending bytes that allow an early upload on a good link
+ * full_bytes          Pending bytes that force an upload whatever the battery, bounds the SPIFFS use
+ * good_csq            Signal quality (AT+CSQ, 0-31) at or above which the link is good
+ * low_battery         Battery level (%) below which uploads are stretched by low_battery_factor
+ * critical_battery    Battery level (%) below which only a full file is uploaded
+ * low_battery_factor  max_cycles multiplier while the battery is low
+ * expensive_ms        Average upload time above which the link is treated as poor
+ */
+typedef struct {
+#define SEND_SCHEDULER_FIELD(field, key, value) uint32_t field;
+    SEND_SCHEDULER_PARAMS(SEND_SCHEDULER_FIELD)
+#undef SEND_SCHEDULER_FIELD
+} send_scheduler_params_t;
+
+/**
+ * @brief Inputs of one decision
+ */
+typedef struct {
+    uint32_t cycles;            // Wake cycles since the last complete upload
+    uint32_t pending_bytes;     // Bytes of all sensor files
+    int battery_level;          // Battery level in %, -1 if unknown
+    int csq;                    // Last signal quality 0-31, 99 if unknown
+    uint32_t upload_ms;         // Average duration of recent uploads, 0 if unknown
+} send_scheduler_input_t;
+
+/**
+ * @brief Decision and its reason
+ */
+typedef enum {
+    SEND_DECISION_WAIT = 0,         // Nothing due yet
+    SEND_DECISION_DEFER_BATTERY,    // Due, deferred for the battery
+    SEND_DECISION_DEADLINE,         // Send: max_cycles reached
+    SEND_DECISION_EARLY,            // Send: good link and enough data
+    SEND_DECISION_FULL,             // Send: the storage is filling up
+} send_decision_t;
+
+/**
+ * @brief Check if a decision is to upload
+ */
+#define SEND_DECISION_IS_SEND(decision) ((decision) >= SEND_DECISION_DEADLINE)
+
+/**
+ * @brief Initialize the scheduler
+ *
+ * Loads the tunables and the recorded link state from NVS. Must be called
+ * after nvs_flash_init().
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t send_scheduler_init(void);
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Close the NVS handle like a wake from deep sleep
+ *
+ * send_scheduler_init() must be called again afterwards.
+ */
+void send_scheduler_sim_reset(void);
+#endif
+
+/**
+ * @brief Get the default policy from config_manager.h
+ *
+ * @param params Pointer to store the policy
+ */
+void send_scheduler_default_params(send_scheduler_params_t *params);
+
+/**
+ * @brief Get the policy in use
+ *
+ * @return const send_scheduler_params_t* Defaults with the NVS overrides applied
+ */
+const send_scheduler_params_t *send_scheduler_get_params(void);
+
+/**
+ * @brief Override a tunable and store it in NVS
+ *
+ * @param key NVS key from SEND_SCHEDULER_PARAMS
+ * @param value New value
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the key is unknown
+ */
+esp_err_t send_scheduler_set_param(const char *key, uint32_t value);
+
+/**
+ * @brief Decide whether to upload
+ *
+ * Pure function of the policy and the inputs, used by the firmware and by
+ * the host replay.
+ *
+ * @param params Policy
+ * @param input Inputs of this wake cycle
+ * @return send_decision_t Decision
+ */
+send_decision_t send_scheduler_decide(const send_scheduler_params_t *params, const send_scheduler_input_t *input);
+
+/**
+ * @brief Decide with the policy in use and the recorded link state
+ *
+ * @param cycles Wake cycles since the last complete upload
+ * @param pending_bytes Bytes of all sensor files
+ * @param battery_level Battery level in %, -1 if unknown
+ * @return send_decision_t Decision
+ */
+send_decision_t send_scheduler_evaluate(uint32_t cycles, uint32_t pending_bytes, int battery_level);
+
+/**
+ * @brief Record the signal quality seen while the modem was on
+ *
+ * @param csq AT+CSQ signal quality 0-31, 99 if unknown
+ */
+void send_scheduler_record_csq(int csq);
+
+/**
+ * @brief Record the duration of an upload
+ *
+ * The scheduler keeps a moving average over the last few uploads.
+ *
+ * @param duration_ms Time from modem power on to the end of the upload
+ */
+void send_scheduler_record_upload(uint32_t duration_ms);
+
+/**
+ * @brief Name of a decision for logs
+ *
+ * @param decision Decision
+ * @return const char* Name
+ */
+const char *send_scheduler_decision_name(send_decision_t decision);
+
+#ifdef __cplusplus
+}
+#endif
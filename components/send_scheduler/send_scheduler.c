@@ -0,0 +1,200 @@
+/**
+ * @file send_scheduler.c
+ * @brief Decides on every wake whether to upload the stored measurements
+ *
+ * The modem is the largest energy cost of the device, so uploads are placed
+ * where they are cheap: earlier when the link is good and there is a lot to
+ * send, later when the battery is low. max_cycles bounds the latency unless
+ * the battery is low, and a filling storage is always emptied so no
+ * samples are lost.
+ */
+
+#include "send_scheduler.h"
+#include <stddef.h>
+#include <string.h>
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "config_manager.h"
+
+static const char *TAG = "send_scheduler";
+
+#define SCHEDULER_NAMESPACE     "scheduler"
+#define CSQ_KEY                 "csq"
+#define UPLOAD_MS_KEY           "upload_ms"
+#define CSQ_UNKNOWN             99
+#define UPLOAD_AVG_WEIGHT       4       // Moving average over about 4 uploads
+
+// Tunable table: NVS key and offset in send_scheduler_params_t
+typedef struct {
+    const char *key;
+    size_t offset;
+} param_entry_t;
+
+static const param_entry_t PARAMS[] = {
+#define SEND_SCHEDULER_ENTRY(field, key, value) { key, offsetof(send_scheduler_params_t, field) },
+    SEND_SCHEDULER_PARAMS(SEND_SCHEDULER_ENTRY)
+#undef SEND_SCHEDULER_ENTRY
+};
+
+static nvs_handle_t s_nvs = 0;
+static send_scheduler_params_t s_params;
+static int s_csq = CSQ_UNKNOWN;
+static uint32_t s_upload_ms = 0;
+
+// Field of the policy by table entry
+static uint32_t *param_field(send_scheduler_params_t *params, const param_entry_t *entry) {
+    return (uint32_t *)((uint8_t *)params + entry->offset);
+}
+
+// Getting the default policy
+void send_scheduler_default_params(send_scheduler_params_t *params) {
+    *params = (send_scheduler_params_t) {
+#define SEND_SCHEDULER_DEFAULT(field, key, value) .field = (value),
+        SEND_SCHEDULER_PARAMS(SEND_SCHEDULER_DEFAULT)
+#undef SEND_SCHEDULER_DEFAULT
+    };
+}
+
+// Loading the policy overrides and the link state
+esp_err_t send_scheduler_init(void) {
+    send_scheduler_default_params(&s_params);
+    
+    esp_err_t ret = nvs_open(SCHEDULER_NAMESPACE, NVS_READWRITE, &s_nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(ret));
+        s_nvs = 0;
+        return ret;
+    }
+    
+    for (size_t i = 0; i < sizeof(PARAMS) / sizeof(PARAMS[0]); i++) {
+        uint32_t value;
+        if (nvs_get_u32(s_nvs, PARAMS[i].key, &value) == ESP_OK) {
+            *param_field(&s_params, &PARAMS[i]) = value;
+            ESP_LOGI(TAG, "%s overridden: %lu", PARAMS[i].key, (unsigned long)value);
+        }
+    }
+    
+    uint8_t csq;
+    if (nvs_get_u8(s_nvs, CSQ_KEY, &csq) == ESP_OK) {
+        s_csq = csq;
+    }
+    nvs_get_u32(s_nvs, UPLOAD_MS_KEY, &s_upload_ms);
+    
+    return ESP_OK;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// The handle is opened again by the next simulated wake
+void send_scheduler_sim_reset(void) {
+    if (s_nvs != 0) {
+        nvs_close(s_nvs);
+        s_nvs = 0;
+    }
+}
+#endif
+
+// Getting the policy in use
+const send_scheduler_params_t *send_scheduler_get_params(void) {
+    return &s_params;
+}
+
+// Overriding a tunable
+esp_err_t send_scheduler_set_param(const char *key, uint32_t value) {
+    for (size_t i = 0; i < sizeof(PARAMS) / sizeof(PARAMS[0]); i++) {
+        if (strcmp(PARAMS[i].key, key) == 0) {
+            *param_field(&s_params, &PARAMS[i]) = value;
+            if (s_nvs == 0) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            esp_err_t ret = nvs_set_u32(s_nvs, key, value);
+            return (ret != ESP_OK) ? ret : nvs_commit(s_nvs);
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// Deciding whether to upload
+send_decision_t send_scheduler_decide(const send_scheduler_params_t *params, const send_scheduler_input_t *input) {
+    bool battery_known = (input->battery_level >= 0);
+    
+    // A filling storage is emptied whatever the battery
+    if (input->pending_bytes >= params->full_bytes) {
+        return SEND_DECISION_FULL;
+    }
+    
+    if (battery_known && input->battery_level < (int)params->critical_battery) {
+        return (input->cycles >= params->max_cycles) ? SEND_DECISION_DEFER_BATTERY : SEND_DECISION_WAIT;
+    }
+    
+    // A low battery stretches the upload interval
+    bool battery_low = battery_known && input->battery_level < (int)params->low_battery;
+    uint32_t deadline = battery_low ? params->max_cycles * params->low_battery_factor : params->max_cycles;
+    if (input->cycles >= deadline) {
+        return SEND_DECISION_DEADLINE;
+    }
+    if (battery_low) {
+        return (input->cycles >= params->max_cycles) ? SEND_DECISION_DEFER_BATTERY : SEND_DECISION_WAIT;
+    }
+    
+    // The link is good if the signal is strong and recent uploads were fast
+    bool link_good = input->csq != CSQ_UNKNOWN && input->csq >= (int)params->good_csq &&
+                     (input->upload_ms == 0 || input->upload_ms <= params->expensive_ms);
+    if (link_good && input->cycles >= params->min_cycles && input->pending_bytes >= params->early_bytes) {
+        return SEND_DECISION_EARLY;
+    }
+    
+    return SEND_DECISION_WAIT;
+}
+
+// Deciding with the policy in use
+send_decision_t send_scheduler_evaluate(uint32_t cycles, uint32_t pending_bytes, int battery_level) {
+    const send_scheduler_input_t input = {
+        .cycles = cycles,
+        .pending_bytes = pending_bytes,
+        .battery_level = battery_level,
+        .csq = s_csq,
+        .upload_ms = s_upload_ms,
+    };
+    send_decision_t decision = send_scheduler_decide(&s_params, &input);
+    
+    ESP_LOGI(TAG, "%s: %lu cycles, %lu bytes, battery %d %%, CSQ %d, upload %lu ms",
+             send_scheduler_decision_name(decision), (unsigned long)cycles, (unsigned long)pending_bytes,
+             battery_level, s_csq, (unsigned long)s_upload_ms);
+    return decision;
+}
+
+// Recording the signal quality
+void send_scheduler_record_csq(int csq) {
+    if (csq < 0 || (csq > 31 && csq != CSQ_UNKNOWN)) {
+        return;
+    }
+    s_csq = csq;
+    if (s_nvs != 0 && nvs_set_u8(s_nvs, CSQ_KEY, (uint8_t)csq) == ESP_OK) {
+        nvs_commit(s_nvs);
+    }
+}
+
+// Recording the duration of an upload into the moving average
+void send_scheduler_record_upload(uint32_t duration_ms) {
+    if (s_upload_ms == 0) {
+        s_upload_ms = duration_ms;
+    } else {
+        s_upload_ms = (s_upload_ms * (UPLOAD_AVG_WEIGHT - 1) + duration_ms) / UPLOAD_AVG_WEIGHT;
+    }
+    if (s_nvs != 0 && nvs_set_u32(s_nvs, UPLOAD_MS_KEY, s_upload_ms) == ESP_OK) {
+        nvs_commit(s_nvs);
+    }
+}
+
+// Getting the name of a decision
+const char *send_scheduler_decision_name(send_decision_t decision) {
+    switch (decision) {
+        case SEND_DECISION_WAIT:            return "wait";
+        case SEND_DECISION_DEFER_BATTERY:   return "defer_battery";
+        case SEND_DECISION_DEADLINE:        return "deadline";
+        case SEND_DECISION_EARLY:           return "early";
+        case SEND_DECISION_FULL:            return "full";
+        default:                            return "unknown";
+    }
+}
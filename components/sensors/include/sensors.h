@@ -10,7 +10,7 @@ typedef struct {
     char mac_address[18];    // MAC address as string "XX:XX:XX:XX:XX:XX"
     float temperature;       // Temperature in Celsius
     float humidity;         // Relative humidity percentage
-    uint64_t timestamp;     // UNIX timestamp of measurement
+    int64_t timestamp_ms;   // UNIX time in milliseconds when the advertisement was received
 } ruuvi_measurement_t;
 
 /**
@@ -2,13 +2,10 @@
 #include <string.h>
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
 #include "esp_log.h"
-#include "nimble/nimble_port.h"
-#include "nimble/nimble_port_freertos.h"
-#include "host/ble_hs.h"
-#include "host/util/util.h"
-#include "console/console.h"
-#include "services/gap/ble_svc_gap.h"
+#include "time_manager.h"
+#include "sensors_radio.h"
 #include "storage.h"
+#include "phase_profiler.h"
 
 static const char *TAG = "SENSORS";
 
@@ -34,7 +31,7 @@ static const char *TARGET_MACS[] = {
 typedef struct {
     char mac_address[18];     // MAC address of the sensor
     bool data_received;       // Flag for data received
-    uint64_t last_timestamp;  // Timestamp of the last data received
+    int64_t last_timestamp_ms;  // Time of the last data received
 } sensor_status_t;
 
 static sensor_status_t sensor_status[MAX_SENSORS];
@@ -47,26 +44,12 @@ static ruuvi_callback_t measurement_callback = NULL;
 static const uint16_t RUUVI_COMPANY_ID = 0x0499;
 static const uint8_t RUUVI_RAW_V2 = 0x05;
 
-// NimBLE scan parameters
-static struct ble_gap_disc_params scan_params = {
-    .itvl = BLE_GAP_SCAN_ITVL_MS(100),      // 100ms scan interval
-    .window = BLE_GAP_SCAN_WIN_MS(75),      // 75ms scan window 
-    .filter_policy = 0,                     // No filter policy
-    .limited = 0,                           // Not limited discovery
-    .passive = 0,                           // Active scanning for better detection
-    .filter_duplicates = 0                  // Do not filter duplicates
-};
-
-// BLE scan parameters
-static void ble_app_on_sync(void);
-static void ble_host_task(void *param);
-
 // Initialize sensor status
 static void init_sensor_status(void) {
     for (int i = 0; i < MAX_SENSORS; i++) {
         strncpy(sensor_status[i].mac_address, TARGET_MACS[i], sizeof(sensor_status[i].mac_address));
         sensor_status[i].data_received = false;
-        sensor_status[i].last_timestamp = 0;
+        sensor_status[i].last_timestamp_ms = 0;
     }
     sensors_received_count = 0;
     any_data_received = false;
@@ -79,7 +62,7 @@ esp_err_t sensors_reset_status(void) {
     // Reset all sensors status
     for (int i = 0; i < MAX_SENSORS; i++) {
         sensor_status[i].data_received = false;
-        sensor_status[i].last_timestamp = 0;
+        sensor_status[i].last_timestamp_ms = 0;
     }
     
     sensors_received_count = 0;
@@ -99,12 +82,12 @@ static bool is_data_received_from_sensor(const char* mac_address) {
 }
 
 // Update sensor status when data is received
-static void update_sensor_received(const char* mac_address, uint64_t timestamp) {
+static void update_sensor_received(const char* mac_address, int64_t timestamp_ms) {
     for (int i = 0; i < MAX_SENSORS; i++) {
         if (strcmp(sensor_status[i].mac_address, mac_address) == 0) {
             if (!sensor_status[i].data_received) {
                 sensor_status[i].data_received = true;
-                sensor_status[i].last_timestamp = timestamp;
+                sensor_status[i].last_timestamp_ms = timestamp_ms;
                 sensors_received_count++;
                 any_data_received = true;
                 ESP_LOGI(TAG, "Received data from sensor %d (%s), total sensors received: %d/%d", 
@@ -144,67 +127,65 @@ static void parse_ruuvi_data(const uint8_t *data, uint8_t len, ruuvi_measurement
     measurement->humidity = (float)humidity * 0.0025;
 }
 
-static int ble_gap_event(struct ble_gap_event *event, void *arg) {
-    struct ble_hs_adv_fields fields;
-
-    switch (event->type) {
-        case BLE_GAP_EVENT_DISC:
-            // Try to parse advertisement data
-            if (ble_hs_adv_parse_fields(&fields, event->disc.data, event->disc.length_data) == 0) {
-                // Check for manufacturer specific data
-                if (fields.mfg_data_len > 0) {
-                    uint16_t company_id = fields.mfg_data[0] | (fields.mfg_data[1] << 8);
-                    if (company_id == RUUVI_COMPANY_ID && measurement_callback) {
-                        ruuvi_measurement_t measurement = {0};
-                        
-                        // Format MAC address
-                        sprintf(measurement.mac_address, "%02X:%02X:%02X:%02X:%02X:%02X",
-                                event->disc.addr.val[5], event->disc.addr.val[4],
-                                event->disc.addr.val[3], event->disc.addr.val[2],
-                                event->disc.addr.val[1], event->disc.addr.val[0]);
-                        
-                        // Check if this is one of our target RuuviTags
-                        bool is_target = false;
-                        for (int i = 0; i < MAX_SENSORS; i++) {
-                            if (strcmp(measurement.mac_address, TARGET_MACS[i]) == 0) {
-                                is_target = true;
-                                break;
-                            }
-                        }
-                        
-                        if (is_target) {
-                            // Check if data has already been received from this sensor
-                            if (is_data_received_from_sensor(measurement.mac_address)) {
-                                ESP_LOGD(TAG, "Already received data from %s in this cycle", measurement.mac_address);
-                                return 0;
-                            }
-
-                            // Parse measurement data
-                            parse_ruuvi_data(fields.mfg_data + 2, fields.mfg_data_len - 2, &measurement);
-                            
-                            // Set timestamp
-                            measurement.timestamp = esp_timer_get_time() / 1000000;
-                            
-                            // Update sensor status
-                            update_sensor_received(measurement.mac_address, measurement.timestamp);
-                            
-                            // Call user callback
-                            measurement_callback(&measurement);
-                        }
-                    }
-                }
-            }
-            break;
-
-        default:
+// Handle manufacturer data of an advertisement received by the radio backend
+void sensors_handle_advertisement(const uint8_t addr[6], const uint8_t *mfg_data, size_t mfg_data_len) {
+    if (mfg_data_len < 2 || measurement_callback == NULL) {
+        return;
+    }
+    
+    uint16_t company_id = mfg_data[0] | (mfg_data[1] << 8);
+    if (company_id != RUUVI_COMPANY_ID) {
+        return;
+    }
+    
+    ruuvi_measurement_t measurement = {0};
+    
+    // Format MAC address
+    sprintf(measurement.mac_address, "%02X:%02X:%02X:%02X:%02X:%02X",
+            addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+    
+    // Check if this is one of our target RuuviTags
+    bool is_target = false;
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        if (strcmp(measurement.mac_address, TARGET_MACS[i]) == 0) {
+            is_target = true;
             break;
+        }
     }
-    return 0;
+    
+    if (!is_target) {
+        return;
+    }
+    
+    // Check if data has already been received from this sensor
+    if (is_data_received_from_sensor(measurement.mac_address)) {
+        ESP_LOGD(TAG, "Already received data from %s in this cycle", measurement.mac_address);
+        return;
+    }
+
+    // Parse measurement data
+    parse_ruuvi_data(mfg_data + 2, mfg_data_len - 2, &measurement);
+    
+    // Wall clock time of the reception, formatted only when the sample is stored
+    measurement.timestamp_ms = time_manager_epoch_ms();
+    
+    // Update sensor status
+    update_sensor_received(measurement.mac_address, measurement.timestamp_ms);
+    
+    // Call user callback
+    measurement_callback(&measurement);
+}
+
+// Get the MAC address of a configured sensor
+const char *sensors_get_target_mac(int index) {
+    return (index >= 0 && index < MAX_SENSORS) ? TARGET_MACS[index] : NULL;
 }
 
 // Internal callback for processing data from RuuviTag
 static void internal_ruuvi_data_callback(ruuvi_measurement_t *measurement) {
+    phase_begin(PHASE_SPIFFS);
     esp_err_t ret = storage_save_measurement(measurement);
+    phase_end(PHASE_SPIFFS);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to save measurement from %s", measurement->mac_address);
     } else {
@@ -228,30 +209,20 @@ void sensors_set_data_received(void) {
 
 // Changed initialization function
 esp_err_t sensors_init(void) {
-    int rc;
-
     // Use internal callback
     measurement_callback = internal_ruuvi_data_callback;
     
     // Initialize sensor status
     init_sensor_status();
 
-    // Initialize NimBLE host stack
-    ESP_LOGI(TAG, "Initializing NimBLE host stack");
-    rc = nimble_port_init();
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to init NimBLE port; rc=%d", rc);
-        return ESP_FAIL;
+    // Initialize the radio, scanning starts as soon as it is ready
+    phase_power_on(PHASE_POWER_RADIO);
+    phase_begin(PHASE_BLE_INIT);
+    esp_err_t ret = sensors_radio_init();
+    phase_end(PHASE_BLE_INIT);
+    if (ret != ESP_OK) {
+        return ret;
     }
-
-    // Initialize NimBLE host configuration
-    ble_hs_cfg.sync_cb = ble_app_on_sync;
-    
-    // Set initial security capabilities
-    ble_hs_cfg.sm_sc = 0;  // Disable secure connections
-    
-    // Initialize the NimBLE host task
-    nimble_port_freertos_init(ble_host_task);
     
     ESP_LOGI(TAG, "Scanning for %d configured sensors", (int)MAX_SENSORS);
     for (int i = 0; i < MAX_SENSORS; i++) {
@@ -261,54 +232,21 @@ esp_err_t sensors_init(void) {
     return ESP_OK;
 }
 
-// Callback when host and controller are in sync
-static void ble_app_on_sync(void) {
-    int rc;
-
-    // Enable BLE scanner with defined parameters
-    rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, BLE_HS_FOREVER, &scan_params,
-                      ble_gap_event, NULL);
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Error initiating GAP discovery procedure; rc=%d", rc);
-    }
-}
-
-// The NimBLE host task
-static void ble_host_task(void *param) {
-    ESP_LOGI(TAG, "BLE Host Task Started");
-    nimble_port_run(); // This function will return only when nimble_port_stop() is executed
-    nimble_port_freertos_deinit();
+esp_err_t sensors_start_scan(uint32_t duration_sec) {
+    return sensors_radio_start_scan(duration_sec);
 }
 
-esp_err_t sensors_start_scan(uint32_t duration_sec) {
-    int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, 
-                         duration_sec ? (duration_sec * 1000) : BLE_HS_FOREVER,
-                         &scan_params,
-                         ble_gap_event, 
-                         NULL);
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Error starting GAP discovery procedure; rc=%d", rc);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
- }
- 
 esp_err_t sensors_stop_scan(void) {
-    int rc = ble_gap_disc_cancel();
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Error canceling GAP discovery procedure; rc=%d", rc);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+    return sensors_radio_stop_scan();
 }
 
 esp_err_t sensors_deinit(void) {
     // Only stop scanning //
-    int rc = ble_gap_disc_cancel();
-    ESP_LOGW(TAG, "Canceling GAP discovery procedure; rc=%d", rc);
+    sensors_radio_stop_scan();
     
     // Clearing callback
     measurement_callback = NULL;
+    phase_power_off(PHASE_POWER_RADIO);
     
     // Do not call nimble_port_stop() and nimble_port_deinit()
     // This will prevent Guru Meditation Error, but may lead to resource leaks
@@ -0,0 +1,107 @@
+// sensors_nimble.c
+// NimBLE radio backend of the sensors component
+#include "sensors_radio.h"
+#include "esp_log.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "console/console.h"
+#include "services/gap/ble_svc_gap.h"
+
+static const char *TAG = "SENSORS";
+
+// NimBLE scan parameters
+static struct ble_gap_disc_params scan_params = {
+    .itvl = BLE_GAP_SCAN_ITVL_MS(100),      // 100ms scan interval
+    .window = BLE_GAP_SCAN_WIN_MS(75),      // 75ms scan window 
+    .filter_policy = 0,                     // No filter policy
+    .limited = 0,                           // Not limited discovery
+    .passive = 0,                           // Active scanning for better detection
+    .filter_duplicates = 0                  // Do not filter duplicates
+};
+
+// BLE scan parameters
+static void ble_app_on_sync(void);
+static void ble_host_task(void *param);
+
+static int ble_gap_event(struct ble_gap_event *event, void *arg) {
+    struct ble_hs_adv_fields fields;
+
+    switch (event->type) {
+        case BLE_GAP_EVENT_DISC:
+            // Try to parse advertisement data
+            if (ble_hs_adv_parse_fields(&fields, event->disc.data, event->disc.length_data) == 0) {
+                // Check for manufacturer specific data
+                if (fields.mfg_data_len > 0) {
+                    sensors_handle_advertisement(event->disc.addr.val, fields.mfg_data, fields.mfg_data_len);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+esp_err_t sensors_radio_init(void) {
+    // Initialize NimBLE host stack
+    ESP_LOGI(TAG, "Initializing NimBLE host stack");
+    int rc = nimble_port_init();
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to init NimBLE port; rc=%d", rc);
+        return ESP_FAIL;
+    }
+
+    // Initialize NimBLE host configuration
+    ble_hs_cfg.sync_cb = ble_app_on_sync;
+    
+    // Set initial security capabilities
+    ble_hs_cfg.sm_sc = 0;  // Disable secure connections
+    
+    // Initialize the NimBLE host task
+    nimble_port_freertos_init(ble_host_task);
+    return ESP_OK;
+}
+
+// Callback when host and controller are in sync
+static void ble_app_on_sync(void) {
+    int rc;
+
+    // Enable BLE scanner with defined parameters
+    rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, BLE_HS_FOREVER, &scan_params,
+                      ble_gap_event, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error initiating GAP discovery procedure; rc=%d", rc);
+    }
+}
+
+// The NimBLE host task
+static void ble_host_task(void *param) {
+    ESP_LOGI(TAG, "BLE Host Task Started");
+    nimble_port_run(); // This function will return only when nimble_port_stop() is executed
+    nimble_port_freertos_deinit();
+}
+
+esp_err_t sensors_radio_start_scan(uint32_t duration_sec) {
+    int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, 
+                         duration_sec ? (duration_sec * 1000) : BLE_HS_FOREVER,
+                         &scan_params,
+                         ble_gap_event, 
+                         NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error starting GAP discovery procedure; rc=%d", rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+ 
+esp_err_t sensors_radio_stop_scan(void) {
+    int rc = ble_gap_disc_cancel();
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Canceling GAP discovery procedure; rc=%d", rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
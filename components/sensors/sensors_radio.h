@@ -0,0 +1,47 @@
+// sensors_radio.h
+// Radio backend of the sensors component. NimBLE on the device, a scripted
+// advertisement source in the Linux target build.
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Initialize the radio and start scanning
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sensors_radio_init(void);
+
+/**
+ * @brief Start scanning
+ *
+ * @param duration_sec Duration in seconds, 0 for continuous scanning
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sensors_radio_start_scan(uint32_t duration_sec);
+
+/**
+ * @brief Stop scanning
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sensors_radio_stop_scan(void);
+
+/**
+ * @brief Handle manufacturer data of a received advertisement (implemented in sensors.c)
+ *
+ * @param addr Advertiser address, least significant byte first
+ * @param mfg_data Manufacturer specific data, starting with the company ID
+ * @param mfg_data_len Length of the manufacturer data
+ */
+void sensors_handle_advertisement(const uint8_t addr[6], const uint8_t *mfg_data, size_t mfg_data_len);
+
+/**
+ * @brief Get the MAC address of a configured sensor (implemented in sensors.c)
+ *
+ * @param index Sensor index
+ * @return const char* MAC address "XX:XX:XX:XX:XX:XX", NULL if out of range
+ */
+const char *sensors_get_target_mac(int index);
@@ -0,0 +1,136 @@
+// sensors_sim.c
+// Scripted advertisement source replacing NimBLE in the Linux target build.
+//
+// Every scan replays one round of RuuviTag RAW v2 advertisements. Without a
+// script each configured sensor advertises once with a temperature that
+// follows a daily curve. SIM_BLE_SCRIPT can name a file with one
+// advertisement per line:
+//
+//     <delay ms> <MAC> <temperature> <humidity>
+//
+// Lines starting with '#' are ignored. SIM_BLE_MISS_PERCENT drops a share of
+// the advertisements to exercise the scan retries. The delays are on the
+// simulated clock (SIM_TIME_SCALE).
+#include "sensors_radio.h"
+#include "sensors.h"
+#include "config_manager.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SENSORS_SIM";
+
+#define SIM_DEFAULT_DELAY_MS    20      // Delay between generated advertisements
+#define SIM_CYCLES_PER_DAY      144     // Temperature curve period in scans
+
+static volatile bool s_scanning = false;
+static TaskHandle_t s_task = NULL;
+static uint32_t s_round = 0;
+
+// Build RuuviTag RAW v2 manufacturer data and pass it to the sensors component
+static void emit_advertisement(const char *mac, float temperature, float humidity) {
+    uint8_t addr[6];
+    unsigned int b[6];
+    if (sscanf(mac, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+        ESP_LOGW(TAG, "Invalid MAC in script: %s", mac);
+        return;
+    }
+    for (int i = 0; i < 6; i++) {
+        addr[5 - i] = (uint8_t)b[i];
+    }
+
+    // Company ID, format 5 and the fields up to the MAC address
+    uint8_t mfg_data[2 + 24] = {0x99, 0x04, 0x05};
+    int16_t temp = (int16_t)lroundf(temperature / 0.005f);
+    uint16_t hum = (uint16_t)lroundf(humidity / 0.0025f);
+    mfg_data[3] = (uint8_t)(temp >> 8);
+    mfg_data[4] = (uint8_t)temp;
+    mfg_data[5] = (uint8_t)(hum >> 8);
+    mfg_data[6] = (uint8_t)hum;
+
+    sensors_handle_advertisement(addr, mfg_data, sizeof(mfg_data));
+}
+
+// Check if an advertisement is dropped
+static bool missed(int miss_percent) {
+    return miss_percent > 0 && (rand() % 100) < miss_percent;
+}
+
+// Replay the script file, returns false if there is no script
+static bool replay_script(int miss_percent) {
+    const char *path = getenv("SIM_BLE_SCRIPT");
+    if (path == NULL) {
+        return false;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open BLE script %s", path);
+        return false;
+    }
+
+    char line[128];
+    while (s_scanning && fgets(line, sizeof(line), f) != NULL) {
+        unsigned int delay_ms;
+        char mac[18];
+        float temperature, humidity;
+        if (line[0] == '#' || sscanf(line, "%u %17s %f %f", &delay_ms, mac, &temperature, &humidity) != 4) {
+            continue;
+        }
+        vTaskDelay(pdMS_TO_TICKS(sim_scaled_ms(delay_ms)));
+        if (s_scanning && !missed(miss_percent)) {
+            emit_advertisement(mac, temperature, humidity);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Advertisement source task, one round per scan
+static void sim_scan_task(void *param) {
+    const char *miss = getenv("SIM_BLE_MISS_PERCENT");
+    int miss_percent = miss ? atoi(miss) : 0;
+
+    if (!replay_script(miss_percent)) {
+        float phase = 2.0f * (float)M_PI * (float)(s_round % SIM_CYCLES_PER_DAY) / SIM_CYCLES_PER_DAY;
+        for (int i = 0; i < sensors_get_total_count() && s_scanning; i++) {
+            vTaskDelay(pdMS_TO_TICKS(sim_scaled_ms(SIM_DEFAULT_DELAY_MS)));
+            if (!missed(miss_percent)) {
+                emit_advertisement(sensors_get_target_mac(i), 20.0f + 5.0f * sinf(phase) + 0.1f * i,
+                                   45.0f + 10.0f * cosf(phase));
+            }
+        }
+    }
+
+    s_round++;
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t sensors_radio_init(void) {
+    return sensors_radio_start_scan(0);
+}
+
+esp_err_t sensors_radio_start_scan(uint32_t duration_sec) {
+    // A round that is still running continues
+    s_scanning = true;
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(sim_scan_task, "ble_sim", 4096, NULL, 5, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create BLE simulation task");
+        s_scanning = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t sensors_radio_stop_scan(void) {
+    s_scanning = false;
+    return ESP_OK;
+}
@@ -2,10 +2,12 @@
 #define STORAGE_H
 
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include <stdbool.h>
 #include "sensors.h"
 #include <stdint.h>
 #include "system_states.h"
+#include "storage_log.h"
 
 
 #ifdef __cplusplus
@@ -16,18 +18,31 @@ extern "C" {
 /**
  * @brief Initialize NVS storage
  * 
+ * Sensor files from before the per-day partitioning are renamed to the
+ * per-day naming, using the day stored in the document.
+ * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t storage_init(void);
 
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Close the NVS handle and drop the buffered log records like a wake from deep sleep
+ *
+ * storage_init() must be called again afterwards.
+ */
+void storage_sim_reset(void);
+#endif
+
 /**
  * @brief Save the sensor measurement to SPIFFS
  * 
  * This function implements the mechanism for saving data for working with multiple sensors:
- * 1. Creates a separate file for each sensor based on the MAC address
- * 2. Files are named as "/spiffs/sensor_XX_XX_XX_XX_XX_XX.json"
+ * 1. Creates a separate file for each sensor and local day, the day is taken
+ *    from the current time in the configured timezone
+ * 2. Files are named as "/spiffs/sXXXXXXXXXXXX_YYYYMMDD.json" (MAC without colons)
  * 3. The function storage_get_sensor_files() will later find these files 
- *    for sending to Firebase
+ *    for sending to Firebase, each file is the document of one day
  * 
  * @param measurement Structure with measurement data
  * @return esp_err_t ESP_OK on success
@@ -35,31 +50,138 @@ esp_err_t storage_init(void);
 esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement);
 
 /**
- * @brief Append a log message to the log file
+ * @brief Log a message by ID
+ * 
+ * Stores the message ID, boot counter, time and arguments in the RAM log buffer.
+ * The buffer is written to flash by storage_log_flush().
+ * 
+ * @param id Message ID from STORAGE_LOG_MESSAGES
+ * @param ... Integer arguments of the message (int)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_log(storage_log_id_t id, ...);
+
+/**
+ * @brief Append a free text log message
+ * 
+ * Prefer storage_log() with a message ID, text takes one record per 20 characters.
  * 
  * @param log_message Log message
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t storage_append_log(const char* log_message);
 
+/**
+ * @brief Write the buffered log records to the log ring in flash
+ * 
+ * Called once per cycle before sleep, the ring keeps the newest 256 records.
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_log_flush(void);
 
+/**
+ * @brief Set the boot counter stamped into log records
+ * 
+ * @param boot_count Current boot counter
+ */
+void storage_log_set_boot_count(uint32_t boot_count);
 
 /**
  * @brief Get the logs from the log file
  * 
- * @return char* Logs
+ * Flushes the RAM buffer and decodes all stored records into text.
+ * 
+ * @return char* Logs (must be freed), NULL if there are no logs
  */
 char* storage_get_logs(void);
 
+/**
+ * @brief Get the range of stored log records
+ * 
+ * Records are numbered by a sequence number that keeps growing while the ring wraps.
+ * 
+ * @param first_seq Pointer to store the sequence number of the oldest stored record
+ * @param end_seq Pointer to store the sequence number of the next record to be written
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if there is no log file
+ */
+esp_err_t storage_log_get_range(uint32_t *first_seq, uint32_t *end_seq);
+
+/**
+ * @brief Read stored log records
+ * 
+ * Reading starts from the oldest stored record if seq was already overwritten or consumed.
+ * 
+ * @param seq Sequence number of the first record to read
+ * @param records Buffer for the records
+ * @param max_records Size of the buffer in records
+ * @param read Pointer to store the number of records read
+ * @param first_seq Pointer to store the sequence number of the first record read (may be NULL)
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_log_read(uint32_t seq, storage_log_record_t *records, size_t max_records,
+                           size_t *read, uint32_t *first_seq);
+
+/**
+ * @brief Drop the stored log records before a sequence number
+ * 
+ * Used to delete only the part of the log that was delivered.
+ * 
+ * @param seq Sequence number of the first record to keep
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_log_consume(uint32_t seq);
+
+/**
+ * @brief Delete the stored logs
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_clear_logs(void);
+
 /**
  * @brief Get a list of all sensor files in SPIFFS
  * 
+ * The list is sorted by MAC address and then by day, so the files of one
+ * sensor are adjacent and the oldest day comes first.
+ * 
  * @param file_list Pointer to array of strings that will be filled with file paths
  * @param file_count Number of files found
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t storage_get_sensor_files(char ***file_list, int *file_count);
 
+/**
+ * @brief Get the sensor MAC address from a sensor file path
+ * 
+ * Reverses the file naming of storage_save_measurement(), so the MAC address
+ * is known without reading or parsing the file.
+ * 
+ * @param file_path Path returned by storage_get_sensor_files()
+ * @param mac_address Buffer to save MAC address ("XX:XX:XX:XX:XX:XX")
+ * @param mac_address_len Buffer size (at least 18)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the name is not a sensor file
+ */
+esp_err_t storage_get_sensor_mac(const char *file_path, char *mac_address, size_t mac_address_len);
+
+/**
+ * @brief Get the local day of a sensor file from its path
+ * 
+ * @param file_path Path returned by storage_get_sensor_files()
+ * @param day Buffer to save the day ("YYYY-MM-DD")
+ * @param day_len Buffer size (at least 11)
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the name is not a per-day sensor file
+ */
+esp_err_t storage_get_sensor_day(const char *file_path, char *day, size_t day_len);
+
+/**
+ * @brief Get the size of the measurements waiting for upload
+ * 
+ * @param total_bytes Pointer to store the size of all sensor files
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t storage_get_pending_bytes(uint32_t *total_bytes);
+
 /**
  * @brief Free the memory allocated for the sensor file list
  * 
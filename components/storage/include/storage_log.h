@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Log message table
+ *
+ * LOG_MESSAGE(id, argument count, format). Only the ID and up to
+ * STORAGE_LOG_MAX_ARGS integer arguments are stored, the text is produced by
+ * the decoder. IDs are stored in flash, so new messages must be appended
+ * at the end of the table.
+ */
+#define STORAGE_LOG_MESSAGES(LOG_MESSAGE) \
+    LOG_MESSAGE(LOG_TEXT,                         0, "%s") \
+    LOG_MESSAGE(LOG_SYSTEM_STATE,                 1, "Current system state: %d") \
+    LOG_MESSAGE(LOG_BOOT_COUNT_START,             1, "Boot count before work cycle: %d") \
+    LOG_MESSAGE(LOG_FIRST_BLOCK_RECOVERY,         0, "Entering first block recovery mode") \
+    LOG_MESSAGE(LOG_SECOND_BLOCK_RECOVERY,        0, "Entering second block recovery mode") \
+    LOG_MESSAGE(LOG_THIRD_BLOCK_RECOVERY,         0, "Entering third block recovery mode") \
+    LOG_MESSAGE(LOG_FIRST_BOOT_START,             0, "First boot operations") \
+    LOG_MESSAGE(LOG_MODEM_INIT_FAILED_FIRST_BOOT, 0, "GSM modem init failed in first boot") \
+    LOG_MESSAGE(LOG_TIME_SYNC_FAILED,             0, "Failed to synchronize time with NTP") \
+    LOG_MESSAGE(LOG_FIRST_BOOT_MESSAGE_FAILED,    0, "Failed to send first boot message") \
+    LOG_MESSAGE(LOG_FIRST_BOOT_DONE,              0, "First boot completed") \
+    LOG_MESSAGE(LOG_DATA_COLLECTION_START,        0, "Starting data collection") \
+    LOG_MESSAGE(LOG_SCAN_RESTART,                 0, "Restarting sensor scan") \
+    LOG_MESSAGE(LOG_SCAN_INCOMPLETE,              3, "Incomplete scan: %d/%d sensors, attempt %d") \
+    LOG_MESSAGE(LOG_NO_SENSOR_DATA,               0, "Failed to receive any sensor data") \
+    LOG_MESSAGE(LOG_SCAN_RESULT,                  3, "Received data from %d/%d sensors after %d attempts") \
+    LOG_MESSAGE(LOG_DONE,                         0, "Done") \
+    LOG_MESSAGE(LOG_PREV_CYCLE_ERROR,             0, "Error in previous cycle was detected, skipping data collection") \
+    LOG_MESSAGE(LOG_SENDING_DATA,                 0, "Sending accumulated data") \
+    LOG_MESSAGE(LOG_MODEM_INIT_FAILED_DATA,       0, "GSM modem init failed for data sending") \
+    LOG_MESSAGE(LOG_FIREBASE_INIT_FAILED,         0, "Firebase init failed for data sending") \
+    LOG_MESSAGE(LOG_UPLOAD_ALL_SENT,              0, "All sensor files sent successfully") \
+    LOG_MESSAGE(LOG_UPLOAD_PARTIAL,               0, "Some sensor files were not sent") \
+    LOG_MESSAGE(LOG_UPLOAD_NO_FILES,              0, "No sensor files found") \
+    LOG_MESSAGE(LOG_UPLOAD_FAILED,                0, "Failed to send any files") \
+    LOG_MESSAGE(LOG_REPORT_FAILED,                0, "Failed to send message about battery status") \
+    LOG_MESSAGE(LOG_FINAL_BOOT_COUNT,             1, "Final boot count: %d") \
+    LOG_MESSAGE(LOG_SENDING_LOGS,                 0, "Sending logs") \
+    LOG_MESSAGE(LOG_MODEM_INIT_FAILED_LOGS,       0, "GSM modem init failed for logs") \
+    LOG_MESSAGE(LOG_DISCORD_INIT_FAILED_LOGS,     0, "Discord API init failed for logs") \
+    LOG_MESSAGE(LOG_SENDING_LOGS_DISCORD,         0, "Sending logs to Discord") \
+    LOG_MESSAGE(LOG_UNSUCCESSFUL_INIT,            0, "Unsuccessful initialization detected") \
+    LOG_MESSAGE(LOG_DISCORD_INIT_FAILED,          0, "Discord init failed in first boot") \
+    LOG_MESSAGE(LOG_REPORT_FORMAT_FAILED,         0, "Failed to format initial message") \
+    LOG_MESSAGE(LOG_SEND_DECISION,                4, "Send decision %d: %d cycles, %d bytes, battery %d %%") \
+    LOG_MESSAGE(LOG_STAGE_RESUME,                 2, "Resuming interrupted stage %d, flags %d") \
+    LOG_MESSAGE(LOG_STAGE_FAILED,                 2, "Stage %d failed: error %d") \
+    LOG_MESSAGE(LOG_STAGE_TIMEOUT,                3, "Stage %d aborted after %d ms, budget %d ms") \
+    LOG_MESSAGE(LOG_STAGE_SKIPPED,                2, "Skipping stage %d stopped by the watchdog, flags %d") \
+    LOG_MESSAGE(LOG_WAKE_SLOTS_SKIPPED,           2, "Wake cycle overran, %d slots skipped, sleeping %d s") \
+    LOG_MESSAGE(LOG_OTA_PROGRESS,                 3, "Firmware update: %d kB of the delta, %d of %d kB of the image") \
+    LOG_MESSAGE(LOG_OTA_INSTALLED,                1, "Firmware update installed (%d kB), active after the next wake") \
+    LOG_MESSAGE(LOG_OTA_FAILED,                   1, "Firmware update failed: error %d") \
+    LOG_MESSAGE(LOG_OTA_VALID,                    0, "Updated firmware completed its first upload") \
+    LOG_MESSAGE(LOG_OTA_ROLLBACK,                 0, "Updated firmware failed its self-test, rolling back") \
+    LOG_MESSAGE(LOG_OTA_REJECTED,                 0, "Rolled back from updated firmware, its delta is ignored") \
+    LOG_MESSAGE(LOG_CYCLE_COMMIT_FAILED,          1, "Cycle state not committed: error %d") \
+    LOG_MESSAGE(LOG_WAKE_PLAN_FAILED,             1, "Wake planner failed: error %d, sleeping the fixed interval") \
+    LOG_MESSAGE(LOG_OTA_VERIFY_DEFERRED,          0, "Updated firmware could not upload, kept pending")
+
+/**
+ * @brief Log message IDs
+ */
+typedef enum {
+#define LOG_MESSAGE_ID(id, argc, format) id,
+    STORAGE_LOG_MESSAGES(LOG_MESSAGE_ID)
+#undef LOG_MESSAGE_ID
+    LOG_MESSAGE_COUNT
+} storage_log_id_t;
+
+#define STORAGE_LOG_MAX_ARGS            5
+#define STORAGE_LOG_TEXT_LEN            (STORAGE_LOG_MAX_ARGS * 4)
+#define STORAGE_LOG_MAX_TEXT_RECORDS    8       // Longest free text message (160 characters)
+
+#define STORAGE_LOG_FLAG_CONTINUES      0x01    // Text continues in the next record
+#define STORAGE_LOG_FLAG_CONTINUATION   0x02    // Record continues the text of the previous one
+
+/**
+ * @brief Binary log record (32 bytes)
+ */
+typedef struct {
+    uint16_t id;            // storage_log_id_t
+    uint8_t flags;          // STORAGE_LOG_FLAG_*
+    uint8_t text_len;       // Text bytes used (LOG_TEXT only)
+    uint32_t boot_count;    // Boot counter when the record was written
+    uint32_t time_ms;       // Milliseconds since boot
+    union {
+        int32_t args[STORAGE_LOG_MAX_ARGS];
+        char text[STORAGE_LOG_TEXT_LEN];
+    };
+} storage_log_record_t;
+
+#define STORAGE_LOG_FILE_MAGIC          0x31474F4C  // "LOG1"
+
+/**
+ * @brief Header at the beginning of the log file, the records follow it
+ */
+typedef struct {
+    uint32_t magic;         // STORAGE_LOG_FILE_MAGIC
+    uint16_t record_size;   // sizeof(storage_log_record_t)
+    uint16_t capacity;      // Records in the ring
+    uint32_t head;          // Records written in total, the next slot is head % capacity
+    uint32_t count;         // Records stored, oldest is at (head - count) % capacity
+} storage_log_file_header_t;
+
+/**
+ * @brief Decode one log line from consecutive records
+ *
+ * Text messages may span several records. The output has the format
+ * "[Boot:N][seconds] message\n" and is always null terminated.
+ *
+ * @param records Records, oldest first
+ * @param count Number of records available
+ * @param used Pointer to store the number of records consumed
+ * @param out Output buffer
+ * @param out_size Output buffer size
+ * @return int Length of the line, 0 if the records hold no complete line,
+ *         -1 if the line does not fit into the buffer
+ */
+int storage_log_decode_line(const storage_log_record_t *records, size_t count, size_t *used,
+                            char *out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
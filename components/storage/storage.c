@@ -9,22 +9,37 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
-#include "esp_spiffs.h" 
+#include "storage_fs.h"
 #include "cJSON.h"
+#include "json_arena.h"
 #include <unistd.h>
 #include <sys/stat.h>
-#include "esp_task_wdt.h" 
 #include "esp_timer.h"
 #include <string.h>
 #include <math.h>
 #include <dirent.h> 
+#include <stdarg.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <inttypes.h>
 #include "battery_monitor.h"
 
 #define FIRST_BOOT_KEY "first_boot"
 
+// Sensor files are partitioned by local day: "s<MAC without colons>_<YYYYMMDD>.json"
+#define SENSOR_FILE_PREFIX      "s"
+#define SENSOR_FILE_SUFFIX      ".json"
+#define SENSOR_FILE_NAME_LEN    (1 + 12 + 1 + 8 + 5)
+// Files written before the partitioning: "sensor_XX_XX_XX_XX_XX_XX.json"
+#define LEGACY_FILE_PREFIX      "sensor_"
+#define LEGACY_FILE_NAME_LEN    (7 + 17 + 5)
+
 static const char *TAG = "STORAGE";
 static nvs_handle_t my_nvs_handle;
 
+static void migrate_legacy_files(void);
+
 esp_err_t storage_init(void) {
    // Initialize NVS
    esp_err_t ret = nvs_flash_init();
@@ -40,27 +55,21 @@ esp_err_t storage_init(void) {
        return ret;
    }
 
-   // Initialize SPIFFS
-   const esp_vfs_spiffs_conf_t conf = {
-       .base_path = "/spiffs",
-       .partition_label = "storage",
-       .max_files = 5,
-       .format_if_mount_failed = true
-   };
-   
-   ret = esp_vfs_spiffs_register(&conf);
+   // Mount the file system of the storage partition
+   ret = STORAGE_FS->mount();
    if (ret != ESP_OK) {
-       ESP_LOGE(TAG, "Failed to mount SPIFFS (%s)", esp_err_to_name(ret));
        return ret;
    }
 
-   // Check SPIFFS status
+   // Check file system status
    size_t total = 0, used = 0;
-   ret = esp_spiffs_info(conf.partition_label, &total, &used);
+   ret = STORAGE_FS->info(&total, &used);
    if (ret == ESP_OK) {
-       ESP_LOGI(TAG, "SPIFFS: total: %d, used: %d", total, used);
+       ESP_LOGI(TAG, "%s: total: %d, used: %d", STORAGE_FS->name, total, used);
    }
 
+   migrate_legacy_files();
+
    return ESP_OK;
 }
 
@@ -68,73 +77,248 @@ esp_err_t storage_init(void) {
 
 // Check SPIFFS status
 static bool check_spiffs_status(void) {
-   if (!esp_spiffs_mounted("storage")) {
-       ESP_LOGE(TAG, "SPIFFS is not mounted");
+   if (!STORAGE_FS->mounted()) {
+       ESP_LOGE(TAG, "%s is not mounted", STORAGE_FS->name);
        return false;
    }
 
    size_t total = 0, used = 0;
-   if (esp_spiffs_info("storage", &total, &used) == ESP_OK && 
+   if (STORAGE_FS->gc != NULL && STORAGE_FS->info(&total, &used) == ESP_OK && 
        used > (total * 0.9)) {
-       esp_spiffs_gc("storage", 4096);
+       STORAGE_FS->gc(4096);
    }
    
    return true;
 }
 
-// function for generating a file name based on the MAC address
-static void generate_sensor_filename(char *filename, size_t max_length, const char *mac_address) {
-    char formatted_mac[18];
-    
-    // Replace colons with underscores to create a valid file name
-    strncpy(formatted_mac, mac_address, sizeof(formatted_mac));
-    for (int i = 0; i < strlen(formatted_mac); i++) {
-        if (formatted_mac[i] == ':') {
-            formatted_mac[i] = '_';
+// Generating the file name from the MAC address and the local day ("YYYY-MM-DD")
+static void generate_sensor_filename(char *filename, size_t max_length, const char *mac_address, const char *day) {
+    char mac_hex[13];
+    int n = 0;
+    
+    // Colons are dropped to keep the name within the SPIFFS object name length
+    for (const char *c = mac_address; *c != '\0' && n < 12; c++) {
+        if (*c != ':') {
+            mac_hex[n++] = toupper((unsigned char)*c);
         }
     }
+    mac_hex[n] = '\0';
     
     // Forming the file path
-    snprintf(filename, max_length, "/spiffs/sensor_%s.json", formatted_mac);
+    snprintf(filename, max_length, STORAGE_BASE_PATH "/" SENSOR_FILE_PREFIX "%s_%.4s%.2s%.2s" SENSOR_FILE_SUFFIX,
+             mac_hex, day, day + 5, day + 8);
 }
 
-
-// Saving the measurement to SPIFFS
-esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement) {
-    if (!check_spiffs_status()) {
-        return ESP_ERR_INVALID_STATE;
+// Parsing a sensor file name into the MAC address and the day, either may be NULL
+static bool parse_sensor_filename(const char *name, char *mac_address, char *day) {
+    if (strlen(name) != SENSOR_FILE_NAME_LEN || name[0] != SENSOR_FILE_PREFIX[0] || name[13] != '_' ||
+        strcmp(name + 22, SENSOR_FILE_SUFFIX) != 0) {
+        return false;
+    }
+    for (int i = 1; i < 22; i++) {
+        if (i != 13 && !isxdigit((unsigned char)name[i])) {
+            return false;
+        }
     }
     
-    if (measurement == NULL) {
-        return ESP_ERR_INVALID_ARG;
+    if (mac_address != NULL) {
+        for (int i = 0; i < 6; i++) {
+            mac_address[i * 3] = name[1 + i * 2];
+            mac_address[i * 3 + 1] = name[2 + i * 2];
+            mac_address[i * 3 + 2] = (i < 5) ? ':' : '\0';
+        }
+    }
+    if (day != NULL) {
+        snprintf(day, 11, "%.4s-%.2s-%.2s", name + 14, name + 18, name + 20);
+    }
+    return true;
+}
+
+// Getting the day of a document written before the partitioning from its "day" field
+static bool read_legacy_day(const char *path, char *day) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
     }
     
-    // Generate filename for the sensor
-    char sensor_filename[64];
-    generate_sensor_filename(sensor_filename, sizeof(sensor_filename), measurement->mac_address);
+    // The scalar fields are written before the measurements, so the head of the file is enough
+    char head[256];
+    size_t len = fread(head, 1, sizeof(head) - 1, f);
+    fclose(f);
+    head[len] = '\0';
     
-    // Try to read existing document
-    cJSON *firestore_doc = NULL;
-    FILE *f = fopen(sensor_filename, "r");
+    const char *value = strstr(head, "\"day\":{\"stringValue\":\"");
+    if (value == NULL) {
+        return false;
+    }
+    value += strlen("\"day\":{\"stringValue\":\"");
+    if (strlen(value) < 10 || value[4] != '-' || value[7] != '-') {
+        return false;
+    }
+    memcpy(day, value, 10);
+    day[10] = '\0';
+    return true;
+}
+
+// Parse a stored sensor document, NULL if it does not exist or is not valid JSON
+static cJSON *read_document(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
     
-    if (f != NULL) {
-        // Get file size
-        fseek(f, 0, SEEK_END);
-        long fsize = ftell(f);
-        fseek(f, 0, SEEK_SET);
+    cJSON *doc = NULL;
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fsize > 0) {
+        char *text = json_arena_alloc(fsize + 1);
+        if (text != NULL) {
+            if (fread(text, 1, fsize, f) == (size_t)fsize) {
+                text[fsize] = '\0';
+                doc = cJSON_Parse(text);
+            }
+            json_arena_free(text);
+        }
+    }
+    fclose(f);
+    return doc;
+}
 
-        if (fsize > 0) {
-            char *firestore_str = malloc(fsize + 1);
-            if (firestore_str != NULL) {
-                if (fread(firestore_str, 1, fsize, f) == (size_t)fsize) {
-                    firestore_str[fsize] = '\0';
-                    firestore_doc = cJSON_Parse(firestore_str);
+// Serialize a sensor document and replace the file with it
+static esp_err_t write_document(const char *path, const cJSON *doc) {
+    char *text = cJSON_PrintUnformatted(doc);
+    if (text == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        cJSON_free(text);
+        return ESP_FAIL;
+    }
+    fprintf(f, "%s", text);
+    fclose(f);
+    cJSON_free(text);
+    return ESP_OK;
+}
+
+// Measurement array of a Firestore document, NULL if the document has none
+static cJSON *document_measurements(cJSON *doc) {
+    cJSON *fields = cJSON_GetObjectItem(doc, "fields");
+    cJSON *measurements = cJSON_GetObjectItem(fields, "measurements");
+    cJSON *array_value = cJSON_GetObjectItem(measurements, "arrayValue");
+    cJSON *values = cJSON_GetObjectItem(array_value, "values");
+    return cJSON_IsArray(values) ? values : NULL;
+}
+
+// Move the measurements of a legacy file into the existing day document and remove the legacy file.
+// Measurements already in the day document are skipped, so a merge interrupted before the remove can run again.
+static esp_err_t merge_legacy_file(const char *legacy_path, const char *day_path) {
+    esp_err_t ret = ESP_FAIL;
+    cJSON *legacy = read_document(legacy_path);
+    cJSON *doc = read_document(day_path);
+    cJSON *legacy_values = document_measurements(legacy);
+    cJSON *values = document_measurements(doc);
+    
+    if (legacy != NULL && legacy_values == NULL) {
+        // A valid document without measurements has nothing to move
+        ret = (remove(legacy_path) == 0) ? ESP_OK : ESP_FAIL;
+    } else if (legacy_values != NULL && values != NULL) {
+        int merged = 0;
+        cJSON *value = legacy_values->child;
+        while (value != NULL) {
+            cJSON *next = value->next;
+            bool present = false;
+            cJSON *existing;
+            cJSON_ArrayForEach(existing, values) {
+                if (cJSON_Compare(existing, value, true)) {
+                    present = true;
+                    break;
                 }
-                free(firestore_str);
             }
+            if (!present) {
+                cJSON_AddItemToArray(values, cJSON_DetachItemViaPointer(legacy_values, value));
+                merged++;
+            }
+            value = next;
         }
-        fclose(f);
+        
+        ret = (merged > 0) ? write_document(day_path, doc) : ESP_OK;
+        if (ret == ESP_OK) {
+            ret = (remove(legacy_path) == 0) ? ESP_OK : ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Merged %d measurements of %s into %s", merged, legacy_path, day_path);
+    }
+    
+    cJSON_Delete(legacy);
+    cJSON_Delete(doc);
+    return ret;
+}
+
+// Renaming the sensor files of the old naming to the per-day naming
+static void migrate_legacy_files(void) {
+    DIR *dir = opendir(STORAGE_BASE_PATH);
+    if (dir == NULL) {
+        return;
+    }
+    
+    char legacy[LEGACY_FILE_NAME_LEN + 1];
+    char old_path[64];
+    char new_path[64];
+    char mac_address[18];
+    char day[11];
+    int migrated = 0;
+    
+    // Renaming while iterating is not safe on every file system, so the directory is read again after each rename
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, LEGACY_FILE_PREFIX, strlen(LEGACY_FILE_PREFIX)) != 0 ||
+            strlen(entry->d_name) != LEGACY_FILE_NAME_LEN) {
+            continue;
+        }
+        strcpy(legacy, entry->d_name);
+        snprintf(old_path, sizeof(old_path), STORAGE_BASE_PATH "/%s", legacy);
+        if (storage_get_sensor_mac(old_path, mac_address, sizeof(mac_address)) != ESP_OK) {
+            continue;
+        }
+        
+        if (!read_legacy_day(old_path, day) &&
+            time_manager_get_local_day(time(NULL), day, sizeof(day)) != ESP_OK) {
+            continue;
+        }
+        
+        // A day document written by newer firmware before a rollback takes the measurements of the legacy file
+        generate_sensor_filename(new_path, sizeof(new_path), mac_address, day);
+        struct stat st;
+        esp_err_t ret = (stat(new_path, &st) == 0) ? merge_legacy_file(old_path, new_path)
+                                                   : (rename(old_path, new_path) == 0 ? ESP_OK : ESP_FAIL);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Could not migrate %s, tried again on the next start", legacy);
+            continue;
+        }
+        migrated++;
+        
+        closedir(dir);
+        dir = opendir(STORAGE_BASE_PATH);
+        if (dir == NULL) {
+            break;
+        }
+    }
+    
+    if (dir != NULL) {
+        closedir(dir);
     }
+    if (migrated > 0) {
+        ESP_LOGI(TAG, "Migrated %d sensor files to per-day names", migrated);
+    }
+}
+
+// Read the sensor document, add the measurement and write it back
+static esp_err_t update_sensor_document(const char *sensor_filename, ruuvi_measurement_t *measurement,
+                                        const char *day) {
+    // Try to read existing document
+    cJSON *firestore_doc = read_document(sensor_filename);
     
     // Get battery information
     battery_info_t battery_info;
@@ -142,11 +326,11 @@ esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement) {
     
     // Creating or updating the Firestore document
     if (battery_result == ESP_OK) {
-        firestore_doc = json_helper_create_or_update_firestore_document(firestore_doc, measurement->mac_address, 
+        firestore_doc = json_helper_create_or_update_firestore_document(firestore_doc, measurement->mac_address, day,
                                                                        battery_info.voltage_mv, battery_info.level);
     } else {
         // If battery info is not available, use default values
-        firestore_doc = json_helper_create_or_update_firestore_document(firestore_doc, measurement->mac_address, 0, 0);
+        firestore_doc = json_helper_create_or_update_firestore_document(firestore_doc, measurement->mac_address, day, 0, 0);
         ESP_LOGW(TAG, "Failed to get battery information, using default values");
     }
     
@@ -164,29 +348,46 @@ esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement) {
     }
    
     // Getting the size of the measurements array for logging
-    cJSON *fields = cJSON_GetObjectItem(firestore_doc, "fields");
-    cJSON *measurements = cJSON_GetObjectItem(fields, "measurements");
-    cJSON *array_value = cJSON_GetObjectItem(measurements, "arrayValue");
-    cJSON *values = cJSON_GetObjectItem(array_value, "values");
-    ESP_LOGI(TAG, "Measurements array size after adding: %d", cJSON_GetArraySize(values));
+    ESP_LOGI(TAG, "Measurements array size after adding: %d",
+             cJSON_GetArraySize(document_measurements(firestore_doc)));
    
     // Saving the updated Firestore structure
-    char *firestore_json_str = cJSON_PrintUnformatted(firestore_doc);
+    result = write_document(sensor_filename, firestore_doc);
     cJSON_Delete(firestore_doc);
-   
-    if (firestore_json_str == NULL) {
-        return ESP_ERR_NO_MEM;
+    return result;
+}
+
+// Saving the measurement to SPIFFS
+esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement) {
+    if (!check_spiffs_status()) {
+        return ESP_ERR_INVALID_STATE;
     }
-   
-    f = fopen(sensor_filename, "w");
-    if (f == NULL) {
-        free(firestore_json_str);
-        return ESP_FAIL;
+    
+    if (measurement == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // The sample goes to the file of the local day it was received on
+    time_t sample_time = (measurement->timestamp_ms > 0) ? (time_t)(measurement->timestamp_ms / 1000) : time(NULL);
+    char day[11];
+    esp_err_t day_ret = time_manager_get_local_day(sample_time, day, sizeof(day));
+    if (day_ret != ESP_OK) {
+        return day_ret;
+    }
+    
+    // Generate filename for the sensor
+    char sensor_filename[64];
+    generate_sensor_filename(sensor_filename, sizeof(sensor_filename), measurement->mac_address, day);
+    
+    // The document is built in the JSON arena and released at once, the heap falls back if it is in use
+    bool arena_scope = (json_arena_begin() == ESP_OK);
+    esp_err_t result = update_sensor_document(sensor_filename, measurement, day);
+    if (arena_scope) {
+        json_arena_end();
+    }
+    if (result != ESP_OK) {
+        return result;
     }
-   
-    fprintf(f, "%s", firestore_json_str);
-    fclose(f);
-    free(firestore_json_str);
    
     // Checking the file
     struct stat st;
@@ -207,130 +408,397 @@ esp_err_t storage_save_measurement(ruuvi_measurement_t *measurement) {
     return ESP_OK;
 }
 
-// Storaging the logs in SPIFFS
+// -------------------- Binary log ring -------------------- //
+
+// Log records are buffered in RAM and written to a fixed-size ring file
+// once per cycle, so logging a line costs a memcpy instead of a SPIFFS
+// open/write/close and an NVS read.
+
+#define LOG_FILE            STORAGE_BASE_PATH "/debug_log.bin"
+#define LOG_FILE_CAPACITY   256         // Records kept in flash (8 KB)
+#define LOG_RAM_RECORDS     64          // Records buffered in RAM between flushes
+
+static storage_log_record_t s_log_buffer[LOG_RAM_RECORDS];
+static size_t s_log_buffered = 0;
+static uint32_t s_log_boot_count = 0;
+
+#if CONFIG_IDF_TARGET_LINUX
+// RAM is lost in deep sleep, the file system stays mounted on the host
+void storage_sim_reset(void) {
+    nvs_close(my_nvs_handle);
+    my_nvs_handle = 0;
+    s_log_buffered = 0;
+}
+#endif
+
+// Set the boot counter stamped into log records
+void storage_log_set_boot_count(uint32_t boot_count) {
+    s_log_boot_count = boot_count;
+}
+
+// Reserve records in the RAM buffer, flushing it if there is no space left
+static storage_log_record_t *log_reserve(size_t records) {
+    if (s_log_buffered + records > LOG_RAM_RECORDS) {
+        storage_log_flush();
+        if (s_log_buffered + records > LOG_RAM_RECORDS) {
+            return NULL;
+        }
+    }
+    storage_log_record_t *rec = &s_log_buffer[s_log_buffered];
+    s_log_buffered += records;
+    return rec;
+}
+
+// Logging a message by ID
+esp_err_t storage_log(storage_log_id_t id, ...) {
+    #if DISCORD_LOGGING
+    static const uint8_t LOG_ARG_COUNTS[LOG_MESSAGE_COUNT] = {
+    #define LOG_MESSAGE_ARGC(msg_id, argc, format) [msg_id] = argc,
+        STORAGE_LOG_MESSAGES(LOG_MESSAGE_ARGC)
+    #undef LOG_MESSAGE_ARGC
+    };
+    
+    if (id <= LOG_TEXT || id >= LOG_MESSAGE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    storage_log_record_t *rec = log_reserve(1);
+    if (rec == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    memset(rec, 0, sizeof(*rec));
+    rec->id = id;
+    rec->boot_count = s_log_boot_count;
+    rec->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    
+    va_list ap;
+    va_start(ap, id);
+    for (int i = 0; i < LOG_ARG_COUNTS[id]; i++) {
+        rec->args[i] = va_arg(ap, int);
+    }
+    va_end(ap);
+    #endif
+    
+    return ESP_OK;
+}
+
+// Logging a free text message, split over as many records as needed
 esp_err_t storage_append_log(const char* log_message) {
     #if DISCORD_LOGGING
+    if (log_message == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    size_t len = strlen(log_message);
+    size_t records = (len + STORAGE_LOG_TEXT_LEN - 1) / STORAGE_LOG_TEXT_LEN;
+    if (records == 0) {
+        records = 1;
+    } else if (records > STORAGE_LOG_MAX_TEXT_RECORDS) {
+        records = STORAGE_LOG_MAX_TEXT_RECORDS;
+        len = records * STORAGE_LOG_TEXT_LEN;
+    }
+    
+    storage_log_record_t *rec = log_reserve(records);
+    if (rec == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Unused text bytes end up in flash and in pulled log images
+    memset(rec, 0, records * sizeof(*rec));
+    uint32_t time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for (size_t i = 0; i < records; i++) {
+        size_t offset = i * STORAGE_LOG_TEXT_LEN;
+        size_t piece = (len - offset < STORAGE_LOG_TEXT_LEN) ? len - offset : STORAGE_LOG_TEXT_LEN;
+        
+        rec[i].id = LOG_TEXT;
+        rec[i].flags = ((i + 1 < records) ? STORAGE_LOG_FLAG_CONTINUES : 0) |
+                       ((i > 0) ? STORAGE_LOG_FLAG_CONTINUATION : 0);
+        rec[i].text_len = piece;
+        rec[i].boot_count = s_log_boot_count;
+        rec[i].time_ms = time_ms;
+        memcpy(rec[i].text, log_message + offset, piece);
+    }
+    #endif
+    
+    return ESP_OK;
+}
+
+// Open the log file and read its header, creating the file if needed
+static FILE *log_file_open(storage_log_file_header_t *header, bool create) {
+    FILE *f = fopen(LOG_FILE, create ? "r+b" : "rb");
+    if (f != NULL) {
+        if (fread(header, sizeof(*header), 1, f) == 1 &&
+            header->magic == STORAGE_LOG_FILE_MAGIC &&
+            header->record_size == sizeof(storage_log_record_t) &&
+            header->capacity == LOG_FILE_CAPACITY) {
+            return f;
+        }
+        ESP_LOGW(TAG, "Log file has an unknown format, starting a new one");
+        fclose(f);
+        f = NULL;
+    }
+    
+    if (!create) {
+        return NULL;
+    }
+    
+    f = fopen(LOG_FILE, "w+b");
+    if (f == NULL) {
+        return NULL;
+    }
+    
+    *header = (storage_log_file_header_t) {
+        .magic = STORAGE_LOG_FILE_MAGIC,
+        .record_size = sizeof(storage_log_record_t),
+        .capacity = LOG_FILE_CAPACITY,
+        .head = 0,
+        .count = 0,
+    };
+    if (fwrite(header, sizeof(*header), 1, f) != 1) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// Writing the buffered log records to the ring file
+esp_err_t storage_log_flush(void) {
+    #if DISCORD_LOGGING
+    if (s_log_buffered == 0) {
+        return ESP_OK;
+    }
+    
     if (!check_spiffs_status()) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    const char* LOG_FILE = "/spiffs/debug_log.txt";
-    
-    // Opening a file in append mode
-    FILE* f = fopen(LOG_FILE, "a");
+    storage_log_file_header_t header;
+    FILE *f = log_file_open(&header, true);
     if (f == NULL) {
         ESP_LOGE(TAG, "Failed to open log file");
         return ESP_FAIL;
     }
     
-    // Adding a timestamp and a message
-    uint32_t boot_count = get_boot_count();
-    fprintf(f, "[Boot:%lu][%lld] %s\n", boot_count, (long long)(esp_timer_get_time() / 1000000), log_message);
+    // Records are written in at most two runs: up to the end of the ring and from its start
+    size_t written = 0;
+    while (written < s_log_buffered) {
+        uint32_t slot = header.head % header.capacity;
+        size_t run = s_log_buffered - written;
+        if (run > header.capacity - slot) {
+            run = header.capacity - slot;
+        }
+        
+        fseek(f, sizeof(header) + slot * sizeof(storage_log_record_t), SEEK_SET);
+        if (fwrite(&s_log_buffer[written], sizeof(storage_log_record_t), run, f) != run) {
+            ESP_LOGE(TAG, "Failed to write log records");
+            fclose(f);
+            return ESP_FAIL;
+        }
+        
+        written += run;
+        header.head += run;
+        header.count = (header.count + run < header.capacity) ? header.count + run : header.capacity;
+    }
+    
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, f);
     fclose(f);
+    
+    ESP_LOGI(TAG, "Flushed %zu log records, %" PRIu32 " stored", s_log_buffered, header.count);
+    s_log_buffered = 0;
     #endif
     
     return ESP_OK;
 }
 
-// Getting the logs from SPIFFS
-char* storage_get_logs(void) {
-    static const char* TAG = "storage";
+// Getting the sequence numbers of the oldest stored record and of the next record to be written
+esp_err_t storage_log_get_range(uint32_t *first_seq, uint32_t *end_seq) {
+    *first_seq = 0;
+    *end_seq = 0;
     
-    if (!check_spiffs_status()) {
-        ESP_LOGE(TAG, "SPIFFS not mounted, cannot read logs");
-        return NULL;
+    storage_log_file_header_t header;
+    FILE *f = log_file_open(&header, false);
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
     }
+    fclose(f);
+    
+    *first_seq = header.head - header.count;
+    *end_seq = header.head;
+    return ESP_OK;
+}
 
-    const char* LOG_FILE = "/spiffs/debug_log.txt";
+// Reading stored log records starting from a sequence number
+esp_err_t storage_log_read(uint32_t seq, storage_log_record_t *records, size_t max_records,
+                           size_t *read, uint32_t *first_seq) {
+    *read = 0;
     
-    // Check if file exists first
-    struct stat st;
-    if (stat(LOG_FILE, &st) != 0) {
-        ESP_LOGE(TAG, "Log file not found");
-        return NULL;
+    storage_log_file_header_t header;
+    FILE *f = log_file_open(&header, false);
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
     }
     
-    // Check file size
-    if (st.st_size <= 0) {
-        ESP_LOGE(TAG, "Log file is empty (size: %ld)", st.st_size);
-        return NULL;
+    // Records older than the ring tail were overwritten or consumed
+    uint32_t tail = header.head - header.count;
+    if ((int32_t)(seq - tail) < 0) {
+        seq = tail;
+    }
+    if (first_seq != NULL) {
+        *first_seq = seq;
     }
     
-    ESP_LOGI(TAG, "Log file size: %ld bytes", st.st_size);
+    size_t available = header.head - seq;
+    size_t count = (available < max_records) ? available : max_records;
     
-    FILE* f = fopen(LOG_FILE, "r");
+    // Records are read in at most two runs, wrapping around the end of the ring
+    uint32_t slot = seq % header.capacity;
+    while (*read < count) {
+        size_t run = count - *read;
+        if (run > header.capacity - slot) {
+            run = header.capacity - slot;
+        }
+        fseek(f, sizeof(header) + slot * sizeof(storage_log_record_t), SEEK_SET);
+        if (fread(&records[*read], sizeof(storage_log_record_t), run, f) != run) {
+            ESP_LOGE(TAG, "Error reading log file");
+            fclose(f);
+            return ESP_FAIL;
+        }
+        *read += run;
+        slot = 0;
+    }
+    fclose(f);
+    
+    return ESP_OK;
+}
+
+// Dropping the stored log records before a sequence number once they are delivered
+esp_err_t storage_log_consume(uint32_t seq) {
+    storage_log_file_header_t header;
+    FILE *f = log_file_open(&header, true);
     if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open log file");
-        return NULL;
+        return ESP_FAIL;
     }
+    
+    uint32_t tail = header.head - header.count;
+    if ((int32_t)(seq - tail) > 0) {
+        if ((int32_t)(header.head - seq) < 0) {
+            seq = header.head;
+        }
+        header.count = header.head - seq;
+        fseek(f, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, f);
+    }
+    fclose(f);
+    
+    return ESP_OK;
+}
 
-    // Get file size using fseek/ftell
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
+// Read all stored log records, oldest first
+static esp_err_t log_read_records(storage_log_record_t **records, size_t *count) {
+    *records = NULL;
+    *count = 0;
+    
+    uint32_t first_seq, end_seq;
+    esp_err_t ret = storage_log_get_range(&first_seq, &end_seq);
+    if (ret != ESP_OK || first_seq == end_seq) {
+        return ret;
+    }
     
-    if (fsize <= 0) {
-        ESP_LOGE(TAG, "Invalid file size: %ld", fsize);
-        fclose(f);
+    storage_log_record_t *buf = malloc((end_seq - first_seq) * sizeof(storage_log_record_t));
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    ret = storage_log_read(first_seq, buf, end_seq - first_seq, count, NULL);
+    if (ret != ESP_OK) {
+        free(buf);
+        *count = 0;
+        return ret;
+    }
+    
+    *records = buf;
+    return ESP_OK;
+}
+
+// Getting the logs from SPIFFS as text
+char* storage_get_logs(void) {
+    if (!check_spiffs_status()) {
+        ESP_LOGE(TAG, "SPIFFS not mounted, cannot read logs");
         return NULL;
     }
     
-    ESP_LOGI(TAG, "Allocating %ld bytes for logs", fsize + 1);
+    storage_log_flush();
     
-    // Allocate memory with safety margin
-    char *log_str = malloc(fsize + 16);
-    if (log_str == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for logs");
-        fclose(f);
+    storage_log_record_t *records = NULL;
+    size_t count = 0;
+    if (log_read_records(&records, &count) != ESP_OK || count == 0) {
+        ESP_LOGE(TAG, "No logs found");
+        free(records);
         return NULL;
     }
-
-    // Read file in chunks to handle large files
-    size_t bytes_read = 0;
-    size_t total_read = 0;
-    const size_t chunk_size = 1024;
     
-    while (total_read < (size_t)fsize) {
-        bytes_read = fread(log_str + total_read, 1, 
-                          ((size_t)fsize - total_read > chunk_size) ? 
-                           chunk_size : ((size_t)fsize - total_read), 
-                          f);
-        
-        if (bytes_read == 0) {
-            if (feof(f)) {
-                ESP_LOGW(TAG, "End of file reached before expected size");
-                break;
-            }
-            if (ferror(f)) {
-                ESP_LOGE(TAG, "Error reading log file");
-                free(log_str);
-                fclose(f);
-                return NULL;
-            }
+    // First pass: size of the decoded text
+    char line[256];
+    size_t text_size = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i += used) {
+        int len = storage_log_decode_line(&records[i], count - i, &used, line, sizeof(line));
+        if (len < 0) {
+            used = 1;   // Skip a record that cannot be decoded
+            continue;
         }
-        
-        total_read += bytes_read;
+        text_size += len;
     }
     
-    fclose(f);
+    ESP_LOGI(TAG, "Decoding %zu log records into %zu bytes", count, text_size);
     
-    // Ensure null termination
-    log_str[total_read] = '\0';
+    char *log_str = malloc(text_size + 1);
+    if (log_str == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for logs");
+        free(records);
+        return NULL;
+    }
     
-    ESP_LOGI(TAG, "Successfully read %zu bytes from log file", total_read);
+    // Second pass: decode into the allocated buffer
+    size_t pos = 0;
+    log_str[0] = '\0';
+    for (size_t i = 0; i < count; i += used) {
+        int len = storage_log_decode_line(&records[i], count - i, &used, log_str + pos, text_size + 1 - pos);
+        if (len < 0) {
+            used = 1;
+            continue;
+        }
+        pos += len;
+    }
     
+    free(records);
     return log_str;
 }
 
+// Deleting the stored logs, records logged after the last read stay in RAM
+esp_err_t storage_clear_logs(void) {
+    if (unlink(LOG_FILE) != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Comparing two file paths for qsort
+static int compare_file_names(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
 // Function for getting a list of sensor files
 esp_err_t storage_get_sensor_files(char ***file_list, int *file_count) {
     if (!check_spiffs_status()) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Temporarily set the maximum number of files
-    const int MAX_FILES = 10;
-    char **files = malloc(MAX_FILES * sizeof(char*));
+    // The list grows as files are found
+    int capacity = 16;
+    char **files = malloc(capacity * sizeof(char*));
     if (files == NULL) {
         return ESP_ERR_NO_MEM;
     }
@@ -339,7 +807,7 @@ esp_err_t storage_get_sensor_files(char ***file_list, int *file_count) {
     *file_count = 0;
     
     // Opening the SPIFFS directory
-    DIR *dir = opendir("/spiffs");
+    DIR *dir = opendir(STORAGE_BASE_PATH);
     if (dir == NULL) {
         ESP_LOGE(TAG, "Failed to open SPIFFS directory");
         free(files);
@@ -348,13 +816,22 @@ esp_err_t storage_get_sensor_files(char ***file_list, int *file_count) {
     
     // Reading the directory content
     struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && *file_count < MAX_FILES) {
-        // Checking if the file starts with "sensor_"
-        if (strncmp(entry->d_name, "sensor_", 7) == 0) {
+    while ((entry = readdir(dir)) != NULL) {
+        // Checking if the file is a per-day sensor file
+        if (parse_sensor_filename(entry->d_name, NULL, NULL)) {
+            if (*file_count == capacity) {
+                char **grown = realloc(files, 2 * capacity * sizeof(char*));
+                if (grown == NULL) {
+                    ESP_LOGW(TAG, "Sensor file list truncated at %d files", *file_count);
+                    break;
+                }
+                files = grown;
+                capacity *= 2;
+            }
             // Allocating memory for the file name and copying it
-            char *filename = malloc(strlen(entry->d_name) + 9); // +9 для "/spiffs/" и '\0'
+            char *filename = malloc(strlen(entry->d_name) + sizeof(STORAGE_BASE_PATH "/"));
             if (filename) {
-                sprintf(filename, "/spiffs/%s", entry->d_name);
+                sprintf(filename, STORAGE_BASE_PATH "/%s", entry->d_name);
                 files[*file_count] = filename;
                 (*file_count)++;
                 ESP_LOGI(TAG, "Found sensor file: %s", filename);
@@ -371,12 +848,93 @@ esp_err_t storage_get_sensor_files(char ***file_list, int *file_count) {
         return ESP_OK;
     }
     
+    // The names sort by MAC address and then by day, so the files of a sensor are adjacent and in order
+    qsort(files, *file_count, sizeof(char*), compare_file_names);
+    
     // Setting the pointer to the list of files
     *file_list = files;
     
     return ESP_OK;
 }
 
+// Getting the MAC address from the sensor file name
+esp_err_t storage_get_sensor_mac(const char *file_path, char *mac_address, size_t mac_address_len) {
+    if (!file_path || !mac_address || mac_address_len < 18) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const char *name = strrchr(file_path, '/');
+    name = name ? name + 1 : file_path;
+    if (parse_sensor_filename(name, mac_address, NULL)) {
+        return ESP_OK;
+    }
+    
+    // "/spiffs/sensor_XX_XX_XX_XX_XX_XX.json" from before the partitioning
+    if (strncmp(name, LEGACY_FILE_PREFIX, 7) != 0 || strlen(name) != LEGACY_FILE_NAME_LEN ||
+        strcmp(name + 7 + 17, SENSOR_FILE_SUFFIX) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    memcpy(mac_address, name + 7, 17);
+    mac_address[17] = '\0';
+    for (int i = 0; i < 17; i++) {
+        if (mac_address[i] == '_') {
+            mac_address[i] = ':';
+        }
+    }
+    
+    return ESP_OK;
+}
+
+// Getting the local day from the sensor file name
+esp_err_t storage_get_sensor_day(const char *file_path, char *day, size_t day_len) {
+    if (!file_path || !day || day_len < 11) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const char *name = strrchr(file_path, '/');
+    name = name ? name + 1 : file_path;
+    if (!parse_sensor_filename(name, NULL, day)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return ESP_OK;
+}
+
+// Getting the size of the stored measurements
+esp_err_t storage_get_pending_bytes(uint32_t *total_bytes) {
+    if (!total_bytes) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *total_bytes = 0;
+    
+    if (!check_spiffs_status()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    DIR *dir = opendir(STORAGE_BASE_PATH);
+    if (dir == NULL) {
+        ESP_LOGE(TAG, "Failed to open SPIFFS directory");
+        return ESP_FAIL;
+    }
+    
+    char path[64];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        if (!parse_sensor_filename(entry->d_name, NULL, NULL)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), STORAGE_BASE_PATH "/%s", entry->d_name);
+        if (stat(path, &st) == 0) {
+            *total_bytes += st.st_size;
+        }
+    }
+    closedir(dir);
+    
+    return ESP_OK;
+}
+
 // Clearing the list of sensor files
 void storage_free_sensor_files(char **file_list, int file_count) {
     if (file_list) {
@@ -392,7 +950,7 @@ void storage_free_sensor_files(char **file_list, int file_count) {
 // Synchronizing the file system
 esp_err_t storage_sync(void) {
     ESP_LOGI(TAG, "Synchronizing file system");
-    FILE *f = fopen("/spiffs/.sync", "w");
+    FILE *f = fopen(STORAGE_BASE_PATH "/.sync", "w");
     if (f == NULL) {
         ESP_LOGE(TAG, "Failed to open file for sync");
         return ESP_FAIL;
@@ -400,7 +958,7 @@ esp_err_t storage_sync(void) {
     fprintf(f, "sync");
     fsync(fileno(f));
     fclose(f);
-    unlink("/spiffs/.sync");
+    unlink(STORAGE_BASE_PATH "/.sync");
     return ESP_OK;
 }
 
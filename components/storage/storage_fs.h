@@ -0,0 +1,59 @@
+// storage_fs.h
+// File system backend of the storage component. SPIFFS or LittleFS on the
+// storage partition of the device (CONFIG_STORAGE_FS_*), a host directory
+// in the Linux target build. The storage_* API reaches the files through
+// STORAGE_BASE_PATH and uses the backend only to mount and maintain them.
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#define STORAGE_BASE_PATH "spiffs_image"    // Relative to the working directory of the simulation
+#elif CONFIG_STORAGE_FS_LITTLEFS
+#define STORAGE_BASE_PATH "/littlefs"
+#else
+#define STORAGE_BASE_PATH "/spiffs"
+#endif
+
+#define STORAGE_PARTITION_LABEL "storage"
+
+/**
+ * @brief Operations of a file system backend
+ */
+typedef struct {
+    const char *name;
+
+    /**
+     * @brief Mount the file system at STORAGE_BASE_PATH, formatting a partition without one
+     */
+    esp_err_t (*mount)(void);
+
+    /**
+     * @brief Check if the file system is mounted
+     */
+    bool (*mounted)(void);
+
+    /**
+     * @brief Get the size and usage of the file system in bytes
+     */
+    esp_err_t (*info)(size_t *total, size_t *used);
+
+    /**
+     * @brief Free up size bytes by garbage collection, NULL if the file system does it while it writes
+     */
+    void (*gc)(size_t size);
+} storage_fs_t;
+
+#if CONFIG_IDF_TARGET_LINUX
+extern const storage_fs_t storage_fs_sim;
+#define STORAGE_FS (&storage_fs_sim)
+#elif CONFIG_STORAGE_FS_LITTLEFS
+extern const storage_fs_t storage_fs_littlefs;
+#define STORAGE_FS (&storage_fs_littlefs)
+#else
+extern const storage_fs_t storage_fs_spiffs;
+#define STORAGE_FS (&storage_fs_spiffs)
+#endif
@@ -0,0 +1,40 @@
+// storage_fs_littlefs.c
+// LittleFS backend of the storage file system. Mounting reads only the
+// superblock and the directories, and a write survives a reset at any point.
+#include "storage_fs.h"
+#include "esp_log.h"
+#include "esp_littlefs.h"
+
+static const char *TAG = "STORAGE_FS";
+
+// A partition with SPIFFS data or none is formatted, measurements not yet uploaded are lost
+static esp_err_t littlefs_mount(void) {
+    const esp_vfs_littlefs_conf_t conf = {
+        .base_path = STORAGE_BASE_PATH,
+        .partition_label = STORAGE_PARTITION_LABEL,
+        .format_if_mount_failed = true,
+        .dont_mount = false,
+    };
+
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount LittleFS (%s)", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static bool littlefs_mounted(void) {
+    return esp_littlefs_mounted(STORAGE_PARTITION_LABEL);
+}
+
+static esp_err_t littlefs_info(size_t *total, size_t *used) {
+    return esp_littlefs_info(STORAGE_PARTITION_LABEL, total, used);
+}
+
+const storage_fs_t storage_fs_littlefs = {
+    .name = "LittleFS",
+    .mount = littlefs_mount,
+    .mounted = littlefs_mounted,
+    .info = littlefs_info,
+    .gc = NULL,
+};
@@ -0,0 +1,61 @@
+// storage_fs_sim.c
+// Host directory backend of the storage file system for the Linux target.
+// The directory stands in for the SPIFFS image, its capacity is the size of
+// the storage partition so full-partition behavior can be simulated.
+#include "storage_fs.h"
+#include "esp_log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+static const char *TAG = "STORAGE_FS";
+
+#define SIM_PARTITION_SIZE  (1024 * 1024)   // Size of the storage partition in partitions.csv
+
+static bool s_mounted = false;
+
+static esp_err_t sim_mount(void) {
+    if (mkdir(STORAGE_BASE_PATH, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Failed to create %s (%d)", STORAGE_BASE_PATH, errno);
+        return ESP_FAIL;
+    }
+    s_mounted = true;
+    ESP_LOGI(TAG, "Simulated SPIFFS image in ./%s", STORAGE_BASE_PATH);
+    return ESP_OK;
+}
+
+static bool sim_mounted(void) {
+    return s_mounted;
+}
+
+static esp_err_t sim_info(size_t *total, size_t *used) {
+    DIR *dir = opendir(STORAGE_BASE_PATH);
+    if (dir == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    *total = SIM_PARTITION_SIZE;
+    *used = 0;
+
+    struct dirent *entry;
+    char path[300];
+    struct stat st;
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", STORAGE_BASE_PATH, entry->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            *used += st.st_size;
+        }
+    }
+    closedir(dir);
+    return ESP_OK;
+}
+
+// Host file systems do not need garbage collection
+const storage_fs_t storage_fs_sim = {
+    .name = "host directory",
+    .mount = sim_mount,
+    .mounted = sim_mounted,
+    .info = sim_info,
+    .gc = NULL,
+};
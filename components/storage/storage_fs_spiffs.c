@@ -0,0 +1,43 @@
+// storage_fs_spiffs.c
+// SPIFFS backend of the storage file system
+#include "storage_fs.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+
+static const char *TAG = "STORAGE_FS";
+
+static esp_err_t spiffs_mount(void) {
+    const esp_vfs_spiffs_conf_t conf = {
+        .base_path = STORAGE_BASE_PATH,
+        .partition_label = STORAGE_PARTITION_LABEL,
+        .max_files = 5,
+        .format_if_mount_failed = true
+    };
+
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount SPIFFS (%s)", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static bool spiffs_mounted(void) {
+    return esp_spiffs_mounted(STORAGE_PARTITION_LABEL);
+}
+
+static esp_err_t spiffs_info(size_t *total, size_t *used) {
+    return esp_spiffs_info(STORAGE_PARTITION_LABEL, total, used);
+}
+
+// SPIFFS only reclaims deleted pages when it runs out of free ones, early collection keeps writes short
+static void spiffs_gc(size_t size) {
+    esp_spiffs_gc(STORAGE_PARTITION_LABEL, size);
+}
+
+const storage_fs_t storage_fs_spiffs = {
+    .name = "SPIFFS",
+    .mount = spiffs_mount,
+    .mounted = spiffs_mounted,
+    .info = spiffs_info,
+    .gc = spiffs_gc,
+};
@@ -0,0 +1,78 @@
+// storage_log.c
+// Decoder of the binary log records. Plain C without ESP-IDF dependencies,
+// so the same code can decode log images on a host.
+#include "storage_log.h"
+#include <stdio.h>
+#include <string.h>
+
+// Format strings indexed by message ID
+static const char *const LOG_FORMATS[LOG_MESSAGE_COUNT] = {
+#define LOG_MESSAGE_FORMAT(id, argc, format) [id] = format,
+    STORAGE_LOG_MESSAGES(LOG_MESSAGE_FORMAT)
+#undef LOG_MESSAGE_FORMAT
+};
+
+int storage_log_decode_line(const storage_log_record_t *records, size_t count, size_t *used,
+                            char *out, size_t out_size) {
+    size_t i = 0;
+    *used = 0;
+    if (out_size == 0) {
+        return -1;
+    }
+    out[0] = '\0';
+
+    // Skip the tail of a text whose beginning was overwritten in the ring
+    while (i < count && (records[i].flags & STORAGE_LOG_FLAG_CONTINUATION)) {
+        i++;
+    }
+    if (i == count) {
+        *used = i;
+        return 0;
+    }
+
+    const storage_log_record_t *first = &records[i];
+    int len = snprintf(out, out_size, "[Boot:%u][%u] ",
+                       (unsigned)first->boot_count, (unsigned)(first->time_ms / 1000));
+    if (len < 0 || (size_t)len >= out_size) {
+        return -1;
+    }
+
+    if (first->id == LOG_TEXT) {
+        // Text spread over one or more records
+        do {
+            const storage_log_record_t *rec = &records[i++];
+            size_t text_len = rec->text_len <= STORAGE_LOG_TEXT_LEN ? rec->text_len : STORAGE_LOG_TEXT_LEN;
+            if ((size_t)len + text_len >= out_size) {
+                return -1;
+            }
+            memcpy(out + len, rec->text, text_len);
+            len += text_len;
+            if (!(rec->flags & STORAGE_LOG_FLAG_CONTINUES)) {
+                break;
+            }
+        } while (i < count && (records[i].flags & STORAGE_LOG_FLAG_CONTINUATION));
+    } else {
+        const char *format = (first->id < LOG_MESSAGE_COUNT) ? LOG_FORMATS[first->id] : NULL;
+        const int32_t *a = first->args;
+        int n;
+        if (format != NULL) {
+            n = snprintf(out + len, out_size - len, format, (int)a[0], (int)a[1], (int)a[2], (int)a[3], (int)a[4]);
+        } else {
+            n = snprintf(out + len, out_size - len, "Unknown log message %u", (unsigned)first->id);
+        }
+        if (n < 0 || (size_t)(len + n) >= out_size) {
+            return -1;
+        }
+        len += n;
+        i++;
+    }
+
+    if ((size_t)len + 1 >= out_size) {
+        return -1;
+    }
+    out[len++] = '\n';
+    out[len] = '\0';
+
+    *used = i;
+    return len;
+}
@@ -2,39 +2,29 @@
 #define SYSTEM_STATES_H
 
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-// System states enum
-typedef enum {
-    STATE_NORMAL = 0,
-    STATE_FIRST_BLOCK_RECOVERY = 1,
-    STATE_SECOND_BLOCK_RECOVERY = 2, 
-    STATE_THIRD_BLOCK_RECOVERY = 3
-} system_state_t;
-
-/**
- * @brief Handles unsuccessful initialization
- * 
- * This function logs an error, sets the error flag, powers off modem, 
- * waits for 10 seconds, and then restarts the system.
- */
-void unsuccessful_init(const char *tag);
-
 /**
- * @brief Set the system state
+ * @brief Set the wake cycle stage to resume after a reset
+ *
+ * Like the other setters this only changes the cached state, it is written
+ * to NVS by system_state_checkpoint().
  * 
- * @param state System state
+ * @param stage Stage of the cycle, 0 when the cycle finished
+ * @param flags Flags of the cycle, restored with the stage
  * @return esp_err_t ESP_OK on success
  */
-esp_err_t set_system_state(system_state_t state);
+esp_err_t system_state_set_stage(uint8_t stage, uint8_t flags);
 
 /**
- * @brief Get the system state
+ * @brief Get the wake cycle stage to resume
  * 
- * @return system_state_t System state
+ * @param flags Pointer to store the flags of the cycle, may be NULL
+ * @return uint8_t Stage of the interrupted cycle, 0 if the last cycle finished
  */
-system_state_t get_system_state(void);
+uint8_t system_state_get_stage(uint8_t *flags);
 
 /**
  * @brief Check if this is the first boot ever
@@ -52,11 +42,36 @@ esp_err_t mark_first_boot_completed(void);
 
 /**
  * @brief Initialize system state module
+ *
+ * Reads the state from NVS unless RTC memory still holds it from the
+ * previous cycle. The separate keys of older firmware are converted.
  * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t system_state_init(void);
 
+/**
+ * @brief Write the cached state to NVS if it changed since the last checkpoint
+ *
+ * One NVS blob write, after a power loss the state is the one of the last
+ * checkpoint. Called before the blocks that may reset the device and
+ * before deep sleep.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t system_state_checkpoint(void);
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Drop the cached state like a reset of the device
+ *
+ * system_state_init() must be called again afterwards.
+ *
+ * @param power_loss true to lose the RTC memory as well, false for a software reset
+ */
+void system_state_sim_reset(bool power_loss);
+#endif
+
 /**
  * @brief Get the boot count
  * 
@@ -1,98 +1,254 @@
 // components/system_states/system_states.c
 #include "system_states.h"
+#include <stddef.h>
+#include <string.h>
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "storage.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "gsm_modem.h"
-#include "esp_system.h"
 #include "config_manager.h"
 
-#define FIRST_BOOT_KEY "first_boot"
+/*
+ * The state is read from NVS once per power-on and cached in RTC memory,
+ * which survives deep sleep and software resets. Getters read the cache,
+ * setters only change it, and system_state_checkpoint() writes the whole
+ * state as one NVS blob. An NVS blob write is atomic, so after a power loss
+ * the state is the last checkpoint and never a mix of two cycles. After a
+ * software reset the cache still holds the changes since the checkpoint.
+ */
+
+#define STATE_NAMESPACE     "system_state"
+#define STATE_KEY           "state"
+#define STATE_MAGIC         0x53545432  // "STT2"
+#define STATE_MAGIC_V1      0x53545431  // "STT1", recovery block instead of the cycle stage
+
+// Keys of the firmware versions that stored every field separately
+#define LEGACY_STATE_KEY        "system_state"    // Recovery block, not converted
+#define LEGACY_FIRST_BOOT_KEY   "first_boot"
+#define LEGACY_BOOT_COUNT_KEY   "boot_count"
+#define LEGACY_ERROR_FLAG_KEY   "error_flag"
+
+// State as stored in NVS
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_count;
+    uint8_t stage;              // Cycle stage to resume, 0 when the cycle finished
+    uint8_t first_boot_done;
+    uint8_t error_flag;
+    uint8_t cycle_flags;        // Flags of the cycle kept with the stage
+    uint32_t checksum;
+} state_record_t;
+
+// Cached state, dirty while it has changes that are not in NVS
+typedef struct {
+    state_record_t record;
+    uint32_t dirty;
+} state_cache_t;
 
 static const char *TAG = "SYSTEM_STATE";
 static nvs_handle_t state_nvs_handle;
+RTC_NOINIT_ATTR static state_cache_t s_state;
+
+// FNV-1a over the record without the checksum
+static uint32_t record_checksum(const state_record_t *record) {
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(state_record_t, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool record_valid(const state_record_t *record) {
+    return (record->magic == STATE_MAGIC || record->magic == STATE_MAGIC_V1) &&
+           record->checksum == record_checksum(record);
+}
+
+// Update the checksum after a change of the cached state
+static void state_changed(void) {
+    s_state.record.checksum = record_checksum(&s_state.record);
+    s_state.dirty = 1;
+}
+
+// The recovery blocks of older firmware have no cycle stage, the cycle starts from the beginning
+static void convert_v1_state(void) {
+    if (s_state.record.magic == STATE_MAGIC_V1) {
+        s_state.record.magic = STATE_MAGIC;
+        s_state.record.stage = 0;
+        s_state.record.cycle_flags = 0;
+        state_changed();
+    }
+}
+
+// Build the state from the separate keys of older firmware, a new device gets the defaults
+static void load_legacy_state(void) {
+    uint8_t first_boot = 0;
+    uint32_t boot_count = 0;
+    uint8_t error_flag = 0;
+
+    nvs_get_u8(state_nvs_handle, LEGACY_FIRST_BOOT_KEY, &first_boot);
+    nvs_get_u32(state_nvs_handle, LEGACY_BOOT_COUNT_KEY, &boot_count);
+    nvs_get_u8(state_nvs_handle, LEGACY_ERROR_FLAG_KEY, &error_flag);
+
+    memset(&s_state.record, 0, sizeof(s_state.record));
+    s_state.record.magic = STATE_MAGIC;
+    s_state.record.first_boot_done = first_boot != 0;
+    s_state.record.boot_count = boot_count;
+    s_state.record.error_flag = error_flag == 1;
+    state_changed();
+}
+
+// Remove the separate keys once the blob is written
+static void erase_legacy_keys(void) {
+    static const char *const keys[] = {
+        LEGACY_STATE_KEY, LEGACY_FIRST_BOOT_KEY, LEGACY_BOOT_COUNT_KEY, LEGACY_ERROR_FLAG_KEY
+    };
+    bool erased = false;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (nvs_erase_key(state_nvs_handle, keys[i]) == ESP_OK) {
+            erased = true;
+        }
+    }
+    if (erased) {
+        nvs_commit(state_nvs_handle);
+    }
+}
+
+// Fill the cache from NVS unless RTC memory still holds it
+static esp_err_t load_state(void) {
+    if (record_valid(&s_state.record)) {
+        ESP_LOGI(TAG, "State kept in RTC memory%s", s_state.dirty ? ", uncommitted changes" : "");
+        convert_v1_state();
+        return ESP_OK;
+    }
+
+    state_record_t record;
+    size_t length = sizeof(record);
+    esp_err_t ret = nvs_get_blob(state_nvs_handle, STATE_KEY, &record, &length);
+    if (ret == ESP_OK && length == sizeof(record) && record_valid(&record)) {
+        s_state.record = record;
+        s_state.dirty = 0;
+        convert_v1_state();
+        erase_legacy_keys();
+        return ESP_OK;
+    }
+    if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Stored state is invalid (%s), using the separate keys", esp_err_to_name(ret));
+    }
+
+    load_legacy_state();
+    ret = system_state_checkpoint();
+    if (ret == ESP_OK) {
+        erase_legacy_keys();
+    }
+    return ret;
+}
 
 // Initialize the system state storage
 esp_err_t system_state_init(void) {
-    esp_err_t ret = nvs_open("system_state", NVS_READWRITE, &state_nvs_handle);
+    esp_err_t ret = nvs_open(STATE_NAMESPACE, NVS_READWRITE, &state_nvs_handle);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error opening NVS handle for system state: %s", esp_err_to_name(ret));
+        return ret;
     }
+    ret = load_state();
+    storage_log_set_boot_count(get_boot_count());
     return ret;
 }
 
-// Restart the system after unsuccessful initialization
-void unsuccessful_init(const char *tag) {
-    ESP_LOGE(tag, "Unsuccessful initialization detected");
-    storage_append_log("Unsuccessful initialization detected");
-    ESP_LOGE(tag, "Restarting modem in 10 seconds");
-    set_error_flag();
-    modem_power_off();
-    vTaskDelay(pdMS_TO_TICKS(10000)); // Restart in 10 seconds
-    esp_restart();
+// Write the cached state to NVS if it changed
+esp_err_t system_state_checkpoint(void) {
+    if (!s_state.dirty) {
+        return ESP_OK;
+    }
+    esp_err_t ret = nvs_set_blob(state_nvs_handle, STATE_KEY, &s_state.record, sizeof(s_state.record));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(state_nvs_handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit system state: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_state.dirty = 0;
+    return ESP_OK;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// Drop the cache like a reset, RTC memory is lost on a power loss
+void system_state_sim_reset(bool power_loss) {
+    if (power_loss) {
+        memset(&s_state, 0, sizeof(s_state));
+    }
+    nvs_close(state_nvs_handle);
 }
+#endif
 
-// Set the system state
-esp_err_t set_system_state(system_state_t state) {
-    esp_err_t ret = nvs_set_u8(state_nvs_handle, "system_state", (uint8_t)state);
-    if (ret != ESP_OK) return ret;
-    return nvs_commit(state_nvs_handle);
+// Set the cycle stage to resume after a reset
+esp_err_t system_state_set_stage(uint8_t stage, uint8_t flags) {
+    if (s_state.record.stage != stage || s_state.record.cycle_flags != flags) {
+        s_state.record.stage = stage;
+        s_state.record.cycle_flags = flags;
+        state_changed();
+    }
+    return ESP_OK;
 }
 
-// Get the system state
-system_state_t get_system_state(void) {
-    uint8_t state = STATE_NORMAL;
-    esp_err_t ret = nvs_get_u8(state_nvs_handle, "system_state", &state);
-    return (ret == ESP_OK) ? (system_state_t)state : STATE_NORMAL;
+// Get the cycle stage to resume
+uint8_t system_state_get_stage(uint8_t *flags) {
+    if (flags) {
+        *flags = s_state.record.cycle_flags;
+    }
+    return s_state.record.stage;
 }
 
 // Check if this is the first boot ever
 bool is_first_boot(void) {
-    uint8_t first_boot = 0;
-    esp_err_t ret = nvs_get_u8(state_nvs_handle, FIRST_BOOT_KEY, &first_boot);
-    return (ret == ESP_ERR_NVS_NOT_FOUND || first_boot == 0);
+    return !s_state.record.first_boot_done;
 }
 
 // Mark that first boot has been completed
 esp_err_t mark_first_boot_completed(void) {
-    esp_err_t ret = nvs_set_u8(state_nvs_handle, FIRST_BOOT_KEY, 1);
-    return (ret != ESP_OK) ? ret : nvs_commit(state_nvs_handle);
+    if (!s_state.record.first_boot_done) {
+        s_state.record.first_boot_done = 1;
+        state_changed();
+    }
+    return ESP_OK;
 }
 
 // Get the boot count
 uint32_t get_boot_count(void) {
-   uint32_t boot_count = 0;
-   if (nvs_get_u32(state_nvs_handle, "boot_count", &boot_count) == ESP_ERR_NVS_NOT_FOUND) {
-       ESP_LOGI(TAG, "Boot count not found, starting from 0");
-   }
-   return boot_count;
+    return s_state.record.boot_count;
 }
 
 // Increment the boot count
 esp_err_t increment_boot_count(void) {
-   uint32_t boot_count = get_boot_count() + 1;
-   esp_err_t ret = nvs_set_u32(state_nvs_handle, "boot_count", boot_count);
-   return (ret != ESP_OK) ? ret : nvs_commit(state_nvs_handle);
+    s_state.record.boot_count++;
+    state_changed();
+    storage_log_set_boot_count(s_state.record.boot_count);
+    return ESP_OK;
 }
 
 // Reset the boot counter to 0
 esp_err_t reset_boot_counter(void) {
-   esp_err_t ret = nvs_set_u32(state_nvs_handle, "boot_count", 0);
-   return (ret != ESP_OK) ? ret : nvs_commit(state_nvs_handle);
+    if (s_state.record.boot_count != 0) {
+        s_state.record.boot_count = 0;
+        state_changed();
+    }
+    storage_log_set_boot_count(0);
+    return ESP_OK;
 }
 
 // Set the error flag
 esp_err_t set_error_flag(void) {
-    esp_err_t ret = nvs_set_u8(state_nvs_handle, "error_flag", 1);
-    return (ret != ESP_OK) ? ret : nvs_commit(state_nvs_handle);
+    if (!s_state.record.error_flag) {
+        s_state.record.error_flag = 1;
+        state_changed();
+    }
+    return ESP_OK;
 }
 
 // Get the error flag
 bool get_error_flag(void) {
-    uint8_t flag = 0;
-    esp_err_t ret = nvs_get_u8(state_nvs_handle, "error_flag", &flag);
-    return (ret == ESP_OK && flag == 1);
-}
\ No newline at end of file
+    return s_state.record.error_flag != 0;
+}
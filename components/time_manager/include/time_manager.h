@@ -1,8 +1,13 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdint.h>
 #include <time.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @brief Set timezone for Finland (EET with DST)
  * 
@@ -11,6 +16,54 @@
 esp_err_t time_manager_set_finland_timezone(void);
 
 
+/**
+ * @brief UTC offset of the Finland timezone at a time
+ * 
+ * Looks the time up in the compile time transition table of time_zone.hpp,
+ * without the libc timezone state.
+ * 
+ * @param time UTC time
+ * @return int Offset in seconds, 7200 (EET) or 10800 (EEST)
+ */
+int time_manager_utc_offset(time_t time);
+
+/**
+ * @brief Format a time as local time "YYYY-MM-DD HH:MM:SS"
+ * 
+ * @param time UTC time
+ * @param buffer Buffer to store formatted time string
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t time_manager_format_local(time_t time, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Format a time as RFC 3339 string in UTC ("2025-01-01T10:00:00Z")
+ * 
+ * @param time UTC time
+ * @param buffer Buffer to store formatted time string
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t time_manager_format_rfc3339(time_t time, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Cache the offset between esp_timer and the system clock
+ * 
+ * Called once per wake and by time_manager_set_from_timestamp(), so
+ * time_manager_epoch_ms() costs one addition to the esp_timer time.
+ */
+void time_manager_update_epoch_offset(void);
+
+/**
+ * @brief Current UNIX time in milliseconds
+ * 
+ * Cheap enough for the BLE advertisement callback.
+ * 
+ * @return int64_t Milliseconds since the epoch
+ */
+int64_t time_manager_epoch_ms(void);
+
 /**
  * @brief Get current time as formatted string
  * 
@@ -20,6 +73,27 @@ esp_err_t time_manager_set_finland_timezone(void);
  */
 esp_err_t time_manager_get_formatted_time(char *buffer, size_t buffer_size);
 
+/**
+ * @brief Get the local date of a time as "YYYY-MM-DD"
+ * 
+ * Uses the Finland timezone.
+ * 
+ * @param time UTC time
+ * @param buffer Buffer to store the date (at least 11 bytes)
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t time_manager_get_local_day(time_t time, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Get current time as RFC 3339 string in UTC ("2025-01-01T10:00:00Z")
+ * 
+ * @param buffer Buffer to store formatted time string
+ * @param buffer_size Size of the buffer
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t time_manager_get_rfc3339_time(char *buffer, size_t buffer_size);
+
 /**
  * @brief Set time from network timestamp (UTC)
  * 
@@ -28,15 +102,26 @@ esp_err_t time_manager_get_formatted_time(char *buffer, size_t buffer_size);
  */
 esp_err_t time_manager_set_from_timestamp(time_t timestamp);
 
+/**
+ * @brief Parse an RFC 3339 time ("2025-01-01T10:00:00Z", "2025-01-01T12:00:00.5+02:00")
+ * 
+ * @param text Time string
+ * @param time Pointer to store the UTC time
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the text is not a valid time
+ */
+esp_err_t time_manager_parse_rfc3339(const char *text, time_t *time);
+
 /**
  * @brief Parse timestamp string to time_t for firebase
  * 
+ * The text is local time in the Finland timezone. In the repeated hour of
+ * October the summer time is taken.
+ * 
  * @param timestamp_str Timestamp string in format "YYYY-MM-DD HH:MM:SS"
- * @return time_t Parsed timestamp
+ * @return time_t Parsed timestamp (UTC), -1 on failure
  */
 time_t parse_timestamp_for_firebase(const char *timestamp_str);
 
-
-
-
-
+#ifdef __cplusplus
+}
+#endif
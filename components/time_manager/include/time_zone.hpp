@@ -0,0 +1,287 @@
+// time_zone.hpp
+// Finland local time without the libc timezone state.
+//
+// The EET/EEST transition instants of first_year to first_year + years - 1
+// are generated into a table at compile time. UTC to local is
+// a binary search in the table, local to UTC tries both offsets. Times
+// outside the table use the EU rule directly. Formatting and parsing of
+// "YYYY-MM-DD HH:MM:SS" and RFC 3339 are plain digit arithmetic, nothing
+// allocates and nothing touches TZ, so every function is reentrant.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tz {
+
+inline constexpr int32_t standard_offset = 7200;    // EET, UTC+2
+inline constexpr int32_t summer_offset = 10800;     // EEST, UTC+3
+inline constexpr int64_t change_utc = 3600;         // Both changes at 01:00 UTC
+inline constexpr int64_t first_year = 2025;
+inline constexpr int years = 30;
+
+// Days since 1970-01-01 of a civil date (H. Hinnant, days_from_civil)
+constexpr int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2 ? 1 : 0;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Broken down time of a second count, without a time zone
+struct civil {
+    int64_t year;
+    unsigned month;
+    unsigned day;
+    unsigned hour;
+    unsigned minute;
+    unsigned second;
+};
+
+// Civil time of seconds since 1970-01-01 (inverse of days_from_civil)
+constexpr civil civil_from_seconds(int64_t seconds) {
+    int64_t days = seconds / 86400;
+    int64_t second_of_day = seconds % 86400;
+    if (second_of_day < 0) {
+        second_of_day += 86400;
+        days--;
+    }
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    unsigned month = static_cast<unsigned>(mp < 10 ? mp + 3 : mp - 9);
+    return civil{ yoe + era * 400 + (month <= 2 ? 1 : 0), month, static_cast<unsigned>(doy - (153 * mp + 2) / 5 + 1),
+                  static_cast<unsigned>(second_of_day / 3600), static_cast<unsigned>(second_of_day / 60 % 60),
+                  static_cast<unsigned>(second_of_day % 60) };
+}
+
+// Days since the epoch of the last Sunday of a month
+constexpr int64_t last_sunday(int64_t year, unsigned month) {
+    int64_t last_day = (month == 12 ? days_from_civil(year + 1, 1, 1) : days_from_civil(year, month + 1, 1)) - 1;
+    int64_t weekday = ((last_day + 4) % 7 + 7) % 7;     // 1970-01-01 was a Thursday, Sunday is 0
+    return last_day - weekday;
+}
+
+constexpr int64_t summer_start(int64_t year) { return last_sunday(year, 3) * 86400 + change_utc; }
+constexpr int64_t summer_end(int64_t year) { return last_sunday(year, 10) * 86400 + change_utc; }
+
+// The EU rule for a UTC time, used outside the table
+constexpr int32_t rule_offset(int64_t utc) {
+    int64_t year = civil_from_seconds(utc).year;
+    return (utc >= summer_start(year) && utc < summer_end(year)) ? summer_offset : standard_offset;
+}
+
+// Offset in effect from a UTC instant to the next transition
+struct transition {
+    int64_t utc;
+    int32_t offset;
+};
+
+struct transition_table {
+    transition entries[2 * years];
+
+    static constexpr std::size_t size() { return 2 * years; }
+};
+
+constexpr transition_table make_table() {
+    transition_table table{};
+    for (int i = 0; i < years; i++) {
+        table.entries[2 * i] = transition{ summer_start(first_year + i), summer_offset };
+        table.entries[2 * i + 1] = transition{ summer_end(first_year + i), standard_offset };
+    }
+    return table;
+}
+
+inline constexpr transition_table transitions = make_table();
+inline constexpr int64_t table_start = days_from_civil(first_year, 1, 1) * 86400;
+inline constexpr int64_t table_end = days_from_civil(first_year + years, 1, 1) * 86400;
+
+static_assert(transitions.entries[0].utc == 1743296400, "2025-03-30 01:00 UTC");
+static_assert(transitions.entries[transition_table::size() - 1].utc == 2676502800, "2054-10-29 01:00 UTC");
+
+// Offset of a UTC time
+constexpr int32_t utc_offset(int64_t utc) {
+    if (utc < table_start || utc >= table_end) {
+        return rule_offset(utc);
+    }
+    // Last transition at or before utc
+    std::size_t low = 0;
+    std::size_t high = transition_table::size();
+    while (low < high) {
+        std::size_t mid = (low + high) / 2;
+        if (transitions.entries[mid].utc <= utc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == 0 ? standard_offset : transitions.entries[low - 1].offset;
+}
+
+constexpr int64_t to_local(int64_t utc) { return utc + utc_offset(utc); }
+
+// UTC of a local time. In the repeated hour of October the summer time
+// (the first occurrence) is taken, a time in the skipped hour of March is
+// read as standard time.
+constexpr int64_t to_utc(int64_t local) {
+    int64_t summer = local - summer_offset;
+    if (to_local(summer) == local) {
+        return summer;
+    }
+    return local - standard_offset;
+}
+
+static_assert(to_utc(to_local(1751328000)) == 1751328000, "2025-07-01 summer time round trip");
+static_assert(to_utc(to_local(1735689600)) == 1735689600, "2025-01-01 standard time round trip");
+
+// Text
+
+constexpr void put_digits(char *out, unsigned value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// "YYYY-MM-DD", 10 characters, years 0 to 9999
+constexpr bool put_date(char *out, const civil &c) {
+    if (c.year < 0 || c.year > 9999) {
+        return false;
+    }
+    put_digits(out, static_cast<unsigned>(c.year), 4);
+    out[4] = '-';
+    put_digits(out + 5, c.month, 2);
+    out[7] = '-';
+    put_digits(out + 8, c.day, 2);
+    return true;
+}
+
+// "YYYY-MM-DD?HH:MM:SS", 19 characters
+constexpr bool put_date_time(char *out, const civil &c, char separator) {
+    if (!put_date(out, c)) {
+        return false;
+    }
+    out[10] = separator;
+    put_digits(out + 11, c.hour, 2);
+    out[13] = ':';
+    put_digits(out + 14, c.minute, 2);
+    out[16] = ':';
+    put_digits(out + 17, c.second, 2);
+    return true;
+}
+
+// Format functions return the length without the terminator, 0 if the
+// buffer is too small or the year has more than four digits
+
+// "2025-01-01T10:00:00Z"
+inline std::size_t format_rfc3339(int64_t utc, char *buffer, std::size_t size) {
+    if (size < 21 || !put_date_time(buffer, civil_from_seconds(utc), 'T')) {
+        return 0;
+    }
+    buffer[19] = 'Z';
+    buffer[20] = '\0';
+    return 20;
+}
+
+// Local time "2025-01-01 12:00:00"
+inline std::size_t format_local(int64_t utc, char *buffer, std::size_t size) {
+    if (size < 20 || !put_date_time(buffer, civil_from_seconds(to_local(utc)), ' ')) {
+        return 0;
+    }
+    buffer[19] = '\0';
+    return 19;
+}
+
+// Local day "2025-01-01"
+inline std::size_t format_local_day(int64_t utc, char *buffer, std::size_t size) {
+    if (size < 11 || !put_date(buffer, civil_from_seconds(to_local(utc)))) {
+        return 0;
+    }
+    buffer[10] = '\0';
+    return 10;
+}
+
+// Fixed width number, false on a non-digit
+constexpr bool read_digits(const char *text, int width, unsigned *value) {
+    unsigned result = 0;
+    for (int i = 0; i < width; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        result = result * 10 + static_cast<unsigned>(text[i] - '0');
+    }
+    *value = result;
+    return true;
+}
+
+// "YYYY-MM-DD?HH:MM:SS" as seconds without a time zone
+constexpr bool read_date_time(const char *text, char separator, int64_t *seconds) {
+    unsigned year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    if (!read_digits(text, 4, &year) || text[4] != '-' || !read_digits(text + 5, 2, &month) || text[7] != '-' ||
+        !read_digits(text + 8, 2, &day) || text[10] != separator || !read_digits(text + 11, 2, &hour) ||
+        text[13] != ':' || !read_digits(text + 14, 2, &minute) || text[16] != ':' ||
+        !read_digits(text + 17, 2, &second)) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    int64_t days = days_from_civil(year, month, day);
+    if (civil_from_seconds(days * 86400).day != day) {
+        return false;   // 31 in a 30 day month, 29 February of a common year
+    }
+    *seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// RFC 3339 with an optional fraction and Z or a numeric offset
+constexpr bool parse_rfc3339(const char *text, int64_t *utc) {
+    int64_t seconds = 0;
+    if (text == nullptr || !(read_date_time(text, 'T', &seconds) || read_date_time(text, 't', &seconds))) {
+        return false;
+    }
+    const char *p = text + 19;
+    if (*p == '.') {
+        do {
+            p++;
+        } while (*p >= '0' && *p <= '9');
+    }
+    if ((*p == 'Z' || *p == 'z') && p[1] == '\0') {
+        *utc = seconds;
+        return true;
+    }
+    unsigned hours = 0, minutes = 0;
+    if ((*p != '+' && *p != '-') || !read_digits(p + 1, 2, &hours) || p[3] != ':' ||
+        !read_digits(p + 4, 2, &minutes) || p[6] != '\0' || hours > 23 || minutes > 59) {
+        return false;
+    }
+    int64_t offset = hours * 3600 + minutes * 60;
+    *utc = (*p == '+') ? seconds - offset : seconds + offset;
+    return true;
+}
+
+// Local "YYYY-MM-DD HH:MM:SS" as UTC
+constexpr bool parse_local(const char *text, int64_t *utc) {
+    int64_t local = 0;
+    if (text == nullptr || !read_date_time(text, ' ', &local)) {
+        return false;
+    }
+    *utc = to_utc(local);
+    return true;
+}
+
+static_assert([] {
+    int64_t utc = 0;
+    return parse_rfc3339("2025-03-30T01:00:00Z", &utc) && utc == 1743296400;
+}(), "RFC 3339 parse");
+static_assert([] {
+    int64_t utc = 0;
+    return parse_local("2025-10-26 03:30:00", &utc) && utc == 1761438600;
+}(), "Repeated hour is read as summer time");
+
+} // namespace tz
@@ -0,0 +1,62 @@
+// time_zone.cpp
+// C interface of the Finland local time table in time_zone.hpp, the
+// declarations in time_manager.h give these functions C linkage
+#include "time_manager.h"
+#include "time_zone.hpp"
+#include "esp_log.h"
+
+static const char *TAG = "TIME_MANAGER";
+
+int time_manager_utc_offset(time_t time) {
+    return tz::utc_offset(static_cast<int64_t>(time));
+}
+
+esp_err_t time_manager_format_local(time_t time, char *buffer, size_t buffer_size) {
+    if (tz::format_local(static_cast<int64_t>(time), buffer, buffer_size) == 0) {
+        ESP_LOGE(TAG, "Failed to format time string");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t time_manager_get_formatted_time(char *buffer, size_t buffer_size) {
+    return time_manager_format_local(::time(NULL), buffer, buffer_size);
+}
+
+esp_err_t time_manager_get_local_day(time_t time, char *buffer, size_t buffer_size) {
+    if (tz::format_local_day(static_cast<int64_t>(time), buffer, buffer_size) == 0) {
+        ESP_LOGE(TAG, "Failed to format day string");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t time_manager_format_rfc3339(time_t time, char *buffer, size_t buffer_size) {
+    if (tz::format_rfc3339(static_cast<int64_t>(time), buffer, buffer_size) == 0) {
+        ESP_LOGE(TAG, "Failed to format RFC 3339 time string");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t time_manager_get_rfc3339_time(char *buffer, size_t buffer_size) {
+    return time_manager_format_rfc3339(::time(NULL), buffer, buffer_size);
+}
+
+esp_err_t time_manager_parse_rfc3339(const char *text, time_t *time) {
+    int64_t utc = 0;
+    if (time == NULL || !tz::parse_rfc3339(text, &utc)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *time = static_cast<time_t>(utc);
+    return ESP_OK;
+}
+
+time_t parse_timestamp_for_firebase(const char *timestamp_str) {
+    int64_t utc = 0;
+    if (!tz::parse_local(timestamp_str, &utc)) {
+        ESP_LOGE(TAG, "Failed to parse timestamp string: %s", timestamp_str ? timestamp_str : "(null)");
+        return (time_t)-1;
+    }
+    return static_cast<time_t>(utc);
+}
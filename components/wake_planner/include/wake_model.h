@@ -0,0 +1,107 @@
+// wake_model.h
+// Slot planning and RTC drift estimate of the wake planner. Plain integer
+// math without driver calls, so the host benchmark runs it against a
+// simulated slow clock.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Planner tunables
+ */
+typedef struct {
+    int64_t interval_us;        // Slot length, slots start at multiples of it since the epoch
+    int64_t min_sleep_us;       // Shortest sleep, a slot closer than this is skipped
+    int64_t drift_min_sleep_us; // Sleep between two time syncs needed to learn the drift
+    int32_t drift_max_ppm;      // Larger measured drifts are rejected as clock jumps
+    int32_t drift_weight;       // Moving average weight of a new drift measurement
+} wake_model_params_t;
+
+/**
+ * @brief Planner state, kept over deep sleep
+ */
+typedef struct {
+    int64_t slot_us;            // Wall clock time of the planned wake, 0 before the first plan
+    int64_t sync_us;            // Wall clock time of the last time sync, 0 before the first
+    int64_t slept_us;           // Requested sleep since the last time sync
+    int32_t drift_ppm;          // Real sleep / requested sleep - 1, positive when the RTC runs slow
+    uint32_t drift_samples;     // Drift measurements averaged into drift_ppm
+    uint32_t skipped_slots;     // Slots missed by overrunning cycles
+} wake_model_t;
+
+/**
+ * @brief Sleep until the next slot
+ */
+typedef struct {
+    int64_t slot_us;            // Wall clock time of the slot
+    int64_t sleep_us;           // Timer duration to request from the RTC
+    uint32_t skipped;           // Slots missed since the last planned one
+} wake_plan_t;
+
+/**
+ * @brief Default tunables from config_manager.h
+ *
+ * @param params Tunables to fill
+ */
+void wake_model_default_params(wake_model_params_t *params);
+
+/**
+ * @brief Start a planner without a drift estimate
+ *
+ * @param model Planner state
+ */
+void wake_model_init(wake_model_t *model);
+
+/**
+ * @brief Wall clock time corrected by the drift since the last time sync
+ *
+ * The system clock is carried over deep sleep by the RTC, so it is off by
+ * the drift of every sleep since the last sync.
+ *
+ * @param model Planner state
+ * @param system_us System clock time
+ * @return int64_t Estimated real time
+ */
+int64_t wake_model_now(const wake_model_t *model, int64_t system_us);
+
+/**
+ * @brief Plan the sleep until the next slot
+ *
+ * The next slot is the first slot boundary after the current time and
+ * after the last planned slot, so an early wake does not serve a slot
+ * twice. A slot closer than min_sleep_us is skipped, a cycle that overran
+ * its slot sleeps until the next free one. The sleep is shortened or
+ * stretched by the learned drift.
+ *
+ * @param params Tunables
+ * @param model Planner state, records the slot and the sleep
+ * @param system_us System clock time
+ * @param plan Pointer to store the plan
+ */
+void wake_model_plan(const wake_model_params_t *params, wake_model_t *model, int64_t system_us, wake_plan_t *plan);
+
+/**
+ * @brief Learn the drift from a time sync
+ *
+ * Compares the system clock with the network time. After enough sleep
+ * since the last sync the error divided by the sleep is a drift
+ * measurement, which is averaged into the estimate. The sleep counter
+ * restarts at every sync.
+ *
+ * @param params Tunables
+ * @param model Planner state
+ * @param system_us System clock time before it is set
+ * @param network_us Network time
+ * @return true if a drift measurement was taken
+ */
+bool wake_model_sync(const wake_model_params_t *params, wake_model_t *model, int64_t system_us,
+                     int64_t network_us);
+
+#ifdef __cplusplus
+}
+#endif
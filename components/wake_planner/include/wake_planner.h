@@ -0,0 +1,44 @@
+#pragma once
+
+#include "esp_err.h"
+#include <time.h>
+#include "wake_model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load the wake planner
+ *
+ * The slot and the drift estimate are kept in RTC memory over deep sleep,
+ * after a power loss the planner starts without a drift estimate.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t wake_planner_init(void);
+
+/**
+ * @brief Learn the RTC drift from a time sync
+ *
+ * Must be called before the system clock is set to the network time.
+ *
+ * @param network_time UTC time from the network
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t wake_planner_clock_sync(time_t network_time);
+
+/**
+ * @brief Plan the deep sleep until the next wake slot
+ *
+ * Wakes are aligned to multiples of TRIGGER_INTERVAL since the epoch,
+ * e.g. every full 10 minutes. The sleep is corrected by the learned drift.
+ *
+ * @param plan Pointer to store the plan
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t wake_planner_next_sleep(wake_plan_t *plan);
+
+#ifdef __cplusplus
+}
+#endif
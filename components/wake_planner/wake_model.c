@@ -0,0 +1,76 @@
+// wake_model.c
+// Slot planning and RTC drift estimate of the wake planner
+#include "wake_model.h"
+#include <string.h>
+#include "config_manager.h"
+
+#define PPM 1000000LL
+
+void wake_model_default_params(wake_model_params_t *params) {
+    params->interval_us = (int64_t)TRIGGER_INTERVAL;
+    params->min_sleep_us = (int64_t)WAKE_MIN_SLEEP_MS * 1000;
+    params->drift_min_sleep_us = (int64_t)WAKE_DRIFT_MIN_SLEEP_S * SECONDS_IN_MICROS;
+    params->drift_max_ppm = WAKE_DRIFT_MAX_PPM;
+    params->drift_weight = WAKE_DRIFT_WEIGHT;
+}
+
+void wake_model_init(wake_model_t *model) {
+    memset(model, 0, sizeof(*model));
+}
+
+// The RTC error grows with the sleep, the awake time runs on the crystal
+int64_t wake_model_now(const wake_model_t *model, int64_t system_us) {
+    return system_us + model->slept_us * model->drift_ppm / PPM;
+}
+
+void wake_model_plan(const wake_model_params_t *params, wake_model_t *model, int64_t system_us, wake_plan_t *plan) {
+    int64_t interval = params->interval_us;
+    int64_t now = wake_model_now(model, system_us);
+
+    // First slot boundary after now, floor division for times before the epoch
+    int64_t slot = now - (now % interval + interval) % interval + interval;
+
+    // A wake before its slot (drift not learned yet) already served that slot
+    if (slot == model->slot_us) {
+        slot += interval;
+    }
+    // Too close to boot, collect and go back to sleep, skip it
+    while (slot - now < params->min_sleep_us) {
+        slot += interval;
+    }
+
+    plan->slot_us = slot;
+    plan->skipped = (model->slot_us != 0 && slot > model->slot_us + interval) ?
+                    (uint32_t)((slot - model->slot_us) / interval - 1) : 0;
+    plan->sleep_us = (slot - now) * PPM / (PPM + model->drift_ppm);
+
+    model->slot_us = slot;
+    model->slept_us += plan->sleep_us;
+    model->skipped_slots += plan->skipped;
+}
+
+bool wake_model_sync(const wake_model_params_t *params, wake_model_t *model, int64_t system_us,
+                     int64_t network_us) {
+    int64_t error_us = network_us - system_us;
+    bool measured = false;
+
+    if (model->sync_us != 0 && model->slept_us >= params->drift_min_sleep_us) {
+        int64_t drift = error_us * PPM / model->slept_us;
+        if (drift >= -params->drift_max_ppm && drift <= params->drift_max_ppm) {
+            model->drift_ppm = (model->drift_samples == 0) ? (int32_t)drift :
+                               model->drift_ppm + (int32_t)((drift - model->drift_ppm) / params->drift_weight);
+            model->drift_samples++;
+            measured = true;
+        }
+    }
+
+    // The slot grid of a clock that jumped, the first sync after a power-on, is meaningless
+    int64_t corrected_error = network_us - wake_model_now(model, system_us);
+    if (corrected_error > params->interval_us || corrected_error < -params->interval_us) {
+        model->slot_us = 0;
+    }
+
+    model->sync_us = network_us;
+    model->slept_us = 0;
+    return measured;
+}
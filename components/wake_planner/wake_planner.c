@@ -0,0 +1,108 @@
+/**
+ * @file wake_planner.c
+ * @brief Wakes aligned to absolute time slots with RTC drift correction
+ *
+ * The deep sleep timer runs on the RTC slow clock, whose error against
+ * the crystal depends on the temperature. Every time sync measures how far
+ * the system clock, carried over the sleeps by that clock, drifted since
+ * the previous sync (wake_model.c). The estimate stays in RTC memory and
+ * corrects both the current time and the requested sleep.
+ */
+
+#include "wake_planner.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+static const char *TAG = "wake_planner";
+
+#define PLANNER_MAGIC       0x57414B31  // "WAK1"
+
+// Planner state as kept in RTC memory
+typedef struct {
+    uint32_t magic;
+    wake_model_t model;
+    uint32_t checksum;
+} planner_record_t;
+
+static wake_model_params_t s_params;
+RTC_NOINIT_ATTR static planner_record_t s_planner;
+
+// FNV-1a over the record without the checksum
+static uint32_t record_checksum(const planner_record_t *record) {
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(planner_record_t, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool record_valid(const planner_record_t *record) {
+    return record->magic == PLANNER_MAGIC && record->checksum == record_checksum(record);
+}
+
+// System clock in microseconds
+static int64_t system_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Load the planner, a power-on starts a new one
+esp_err_t wake_planner_init(void) {
+    wake_model_default_params(&s_params);
+    if (!record_valid(&s_planner)) {
+        memset(&s_planner, 0, sizeof(s_planner));
+        s_planner.magic = PLANNER_MAGIC;
+        wake_model_init(&s_planner.model);
+        s_planner.checksum = record_checksum(&s_planner);
+        ESP_LOGI(TAG, "Wake planner started without a drift estimate");
+    }
+    return ESP_OK;
+}
+
+// Learn the drift from a time sync
+esp_err_t wake_planner_clock_sync(time_t network_time) {
+    if (!record_valid(&s_planner)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (network_time <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    wake_model_t *model = &s_planner.model;
+    int64_t system_us = system_time_us();
+    int64_t network_us = (int64_t)network_time * 1000000;
+    int64_t slept_us = model->slept_us;
+    if (wake_model_sync(&s_params, model, system_us, network_us)) {
+        ESP_LOGI(TAG, "Clock off by %lld ms after %lld s of sleep, RTC drift %ld ppm",
+                 (long long)((network_us - system_us) / 1000), (long long)(slept_us / 1000000),
+                 (long)model->drift_ppm);
+    }
+    s_planner.checksum = record_checksum(&s_planner);
+    return ESP_OK;
+}
+
+// Plan the sleep until the next slot
+esp_err_t wake_planner_next_sleep(wake_plan_t *plan) {
+    if (plan == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!record_valid(&s_planner)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    wake_model_plan(&s_params, &s_planner.model, system_time_us(), plan);
+    s_planner.checksum = record_checksum(&s_planner);
+
+    time_t slot = (time_t)(plan->slot_us / 1000000);
+    struct tm slot_tm;
+    gmtime_r(&slot, &slot_tm);
+    ESP_LOGI(TAG, "Next wake at %02d:%02d:%02d UTC, drift %ld ppm, %lu slots skipped", slot_tm.tm_hour,
+             slot_tm.tm_min, slot_tm.tm_sec, (long)s_planner.model.drift_ppm, (unsigned long)plan->skipped);
+    return ESP_OK;
+}
@@ -0,0 +1,266 @@
+// test_cycle.c
+// Host test of the resume points of the wake cycle pipeline. The stages only
+// count their calls and add their typical duration, the pipeline and the
+// system state are the firmware code.
+#include "test_cycle.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "nvs.h"
+#include "system_states.h"
+#include "cycle_pipeline.h"
+
+#define CYCLE_SEGMENTS      5       // Commit requests of the upload
+#define CYCLE_SEND_COUNT    3       // Boot count that triggers the upload
+#define CYCLE_MAX_EVENTS    32
+
+// Typical stage durations in milliseconds
+#define COST_SCAN_MS        10000
+#define COST_PERSIST_MS     20
+#define COST_DECIDE_MS      10
+#define COST_CONNECT_MS     45000
+#define COST_SYNC_TIME_MS   2000
+#define COST_SEGMENT_MS     3000
+#define COST_REPORT_MS      3000
+#define COST_LOGS_MS        5000
+#define COST_SLEEP_MS       300
+
+// Device model of one trial
+typedef struct {
+    bool network;               // Lost on every reset
+    int segments_left;          // Files not yet deleted after their commit
+    int segments_sent;
+    int scans;
+    int reports;
+    int64_t cost_ms;
+} cycle_model_t;
+
+static cycle_model_t s_model;
+static int s_event;             // Reset points passed in this trial
+static int s_cut_event = -1;    // Reset point where the device resets
+static jmp_buf s_reset;
+static char s_event_names[CYCLE_MAX_EVENTS][24];
+static bool s_recording;
+
+// Reset point, the device resets here if this is the chosen one
+static void reset_point(const char *name) {
+    if (s_recording && s_event < CYCLE_MAX_EVENTS) {
+        snprintf(s_event_names[s_event], sizeof(s_event_names[0]), "%s", name);
+    }
+    if (s_event++ == s_cut_event) {
+        longjmp(s_reset, 1);
+    }
+}
+
+static bool scan_needed(const cycle_context_t *ctx) {
+    return !is_first_boot();
+}
+
+static esp_err_t stage_scan(cycle_context_t *ctx) {
+    reset_point("scan");
+    s_model.scans++;
+    s_model.cost_ms += COST_SCAN_MS;
+    return ESP_OK;
+}
+
+static esp_err_t stage_persist(cycle_context_t *ctx) {
+    reset_point("persist");
+    s_model.cost_ms += COST_PERSIST_MS;
+    return increment_boot_count();
+}
+
+static esp_err_t stage_decide(cycle_context_t *ctx) {
+    reset_point("decide");
+    s_model.cost_ms += COST_DECIDE_MS;
+    if (get_boot_count() >= CYCLE_SEND_COUNT) {
+        ctx->flags |= CYCLE_FLAG_SEND;
+    }
+    return ESP_OK;
+}
+
+static bool connect_needed(const cycle_context_t *ctx) {
+    return !s_model.network && cycle_stage_pending(ctx, CYCLE_STAGE_LOGS) &&
+           (ctx->flags & (CYCLE_FLAG_SEND | CYCLE_FLAG_SENT | CYCLE_FLAG_ERROR));
+}
+
+static esp_err_t stage_connect(cycle_context_t *ctx) {
+    reset_point("connect");
+    s_model.cost_ms += COST_CONNECT_MS;
+    s_model.network = true;
+    return ESP_OK;
+}
+
+static bool sync_time_needed(const cycle_context_t *ctx) {
+    return s_model.network;
+}
+
+static esp_err_t stage_sync_time(cycle_context_t *ctx) {
+    reset_point("sync_time");
+    s_model.cost_ms += COST_SYNC_TIME_MS;
+    return ESP_OK;
+}
+
+static bool upload_needed(const cycle_context_t *ctx) {
+    return s_model.network && (ctx->flags & CYCLE_FLAG_SEND);
+}
+
+// Like send_all_sensor_measurements_to_firebase(), the files of a commit are deleted after it
+static esp_err_t stage_upload(cycle_context_t *ctx) {
+    reset_point("upload");
+    while (s_model.segments_left > 0) {
+        char name[24];
+        snprintf(name, sizeof(name), "segment %d", CYCLE_SEGMENTS - s_model.segments_left + 1);
+        reset_point(name);
+        s_model.cost_ms += COST_SEGMENT_MS;
+        s_model.segments_sent++;
+        s_model.segments_left--;
+    }
+    ctx->flags |= CYCLE_FLAG_SENT;
+    return reset_boot_counter();
+}
+
+static bool report_needed(const cycle_context_t *ctx) {
+    return s_model.network && (ctx->flags & CYCLE_FLAG_SEND);
+}
+
+static esp_err_t stage_report(cycle_context_t *ctx) {
+    reset_point("report");
+    s_model.cost_ms += COST_REPORT_MS;
+    s_model.reports++;
+    return ESP_OK;
+}
+
+// The modelled device has no firmware update to download
+static bool ota_needed(const cycle_context_t *ctx) {
+    return false;
+}
+
+static esp_err_t stage_ota(cycle_context_t *ctx) {
+    reset_point("ota");
+    return ESP_OK;
+}
+
+static bool logs_needed(const cycle_context_t *ctx) {
+    return s_model.network && (ctx->flags & (CYCLE_FLAG_SENT | CYCLE_FLAG_ERROR));
+}
+
+static esp_err_t stage_logs(cycle_context_t *ctx) {
+    reset_point("logs");
+    s_model.cost_ms += COST_LOGS_MS;
+    return ESP_OK;
+}
+
+static esp_err_t stage_sleep(cycle_context_t *ctx) {
+    reset_point("sleep");
+    s_model.cost_ms += COST_SLEEP_MS;
+    s_model.network = false;
+    return ESP_OK;
+}
+
+static const cycle_stage_ops_t s_stages[CYCLE_STAGE_COUNT] = {
+    [CYCLE_STAGE_SCAN]      = { scan_needed,      stage_scan },
+    [CYCLE_STAGE_PERSIST]   = { scan_needed,      stage_persist },
+    [CYCLE_STAGE_DECIDE]    = { NULL,             stage_decide },
+    [CYCLE_STAGE_CONNECT]   = { connect_needed,   stage_connect },
+    [CYCLE_STAGE_SYNC_TIME] = { sync_time_needed, stage_sync_time },
+    [CYCLE_STAGE_UPLOAD]    = { upload_needed,    stage_upload },
+    [CYCLE_STAGE_REPORT]    = { report_needed,    stage_report },
+    [CYCLE_STAGE_OTA]       = { ota_needed,       stage_ota },
+    [CYCLE_STAGE_LOGS]      = { logs_needed,      stage_logs },
+    [CYCLE_STAGE_SLEEP]     = { NULL,             stage_sleep },
+};
+
+// Installed device one cycle before an upload
+static esp_err_t prepare_device(void) {
+    system_state_sim_reset(true);
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open("system_state", NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    ret = system_state_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    mark_first_boot_completed();
+    for (int i = 1; i < CYCLE_SEND_COUNT; i++) {
+        increment_boot_count();
+    }
+    memset(&s_model, 0, sizeof(s_model));
+    s_model.segments_left = CYCLE_SEGMENTS;
+    return system_state_checkpoint();
+}
+
+// Restart after a reset, the network connection is gone
+static void restart_device(bool power_loss) {
+    system_state_sim_reset(power_loss);
+    system_state_init();
+    s_model.network = false;
+}
+
+esp_err_t test_cycle_run(cJSON *resets) {
+    // Uninterrupted cycle
+    if (prepare_device() != ESP_OK) {
+        printf("Failed to prepare the system state for the cycle test\n");
+        return ESP_FAIL;
+    }
+    cycle_context_t ctx;
+    s_event = 0;
+    s_cut_event = -1;
+    s_recording = true;
+    cycle_pipeline_run(s_stages, &ctx);
+    s_recording = false;
+    int events = (s_event < CYCLE_MAX_EVENTS) ? s_event : CYCLE_MAX_EVENTS;
+    int64_t clean_ms = s_model.cost_ms;
+    uint32_t clean_boot_count = get_boot_count();
+
+    printf("%-12s %-9s %-10s %10s\n", "reset at", "reset", "resumed at", "rerun_ms");
+    int failures = 0;
+    int64_t worst_ms = 0;
+    for (int event = 0; event < events; event++) {
+        for (int power_loss = 0; power_loss < 2; power_loss++) {
+            prepare_device();
+            s_event = 0;
+            s_cut_event = event;
+            if (setjmp(s_reset) == 0) {
+                cycle_pipeline_run(s_stages, &ctx);
+            }
+            s_cut_event = -1;
+
+            restart_device(power_loss);
+            cycle_pipeline_run(s_stages, &ctx);
+
+            int64_t rerun_ms = s_model.cost_ms - clean_ms;
+            bool ok = s_model.segments_left == 0 && s_model.segments_sent == CYCLE_SEGMENTS &&
+                      s_model.reports == 1 && get_boot_count() == clean_boot_count &&
+                      system_state_get_stage(NULL) == CYCLE_STAGE_NONE;
+            if (!ok) {
+                failures++;
+            }
+            if (rerun_ms > worst_ms) {
+                worst_ms = rerun_ms;
+            }
+
+            printf("%-12s %-9s %-10s %10lld%s\n", s_event_names[event], power_loss ? "power" : "software",
+                   cycle_stage_name(ctx.resumed), (long long)rerun_ms, ok ? "" : "  inconsistent");
+
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "at", s_event_names[event]);
+            cJSON_AddStringToObject(item, "reset", power_loss ? "power" : "software");
+            cJSON_AddStringToObject(item, "resumed_at", cycle_stage_name(ctx.resumed));
+            cJSON_AddNumberToObject(item, "rerun_ms", (double)rerun_ms);
+            cJSON_AddNumberToObject(item, "scans", s_model.scans);
+            cJSON_AddBoolToObject(item, "ok", ok);
+            cJSON_AddItemToArray(resets, item);
+        }
+    }
+
+    printf("Cycle resume: %d reset points, clean cycle %lld ms, worst rerun %lld ms, %d inconsistent\n",
+           events * 2, (long long)clean_ms, (long long)worst_ms, failures);
+    return failures == 0 ? ESP_OK : ESP_FAIL;
+}
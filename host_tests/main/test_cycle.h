@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Reset injection for the wake cycle stages
+ *
+ * Runs a send cycle through cycle_pipeline_run() with stages that model
+ * the firmware stages and their duration, then repeats it with a software
+ * reset and with a power loss at the start of every stage and before every
+ * upload segment. After each reset the cycle is run again and must end
+ * with the state of the uninterrupted cycle and every segment uploaded.
+ * The extra stage time of the two runs is the resume cost.
+ *
+ * @param resets Array for one result object per reset point
+ * @return esp_err_t ESP_OK if every resumed cycle completed correctly
+ */
+esp_err_t test_cycle_run(cJSON *resets);
@@ -0,0 +1,253 @@
+// test_discord.c
+// Host test of the Discord log shipping. discord_api and discord_tasks run
+// unchanged, their requests go through the https_client_request() wrapper
+// below (-Wl,--wrap=https_client_request), which points the Discord URL to
+// the local stand-in server over plain HTTP.
+#include "test_discord.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "https_client.h"
+#include "discord_api.h"
+#include "discord_config.h"
+#include "storage.h"
+#include "config_manager.h"
+#include "test_http_server.h"
+
+#define DISCORD_URL_PREFIX  "https://" DISCORD_HOST
+#define DISCORD_TEST_LINES  150             // Log lines, every TEXT_EVERY one is a free text
+#define DISCORD_TEXT_EVERY  15
+#define DISCORD_TEXT_LEN    120             // Free text spanning several records
+#define DISCORD_MAX_MSGS    16
+#define DISCORD_RETRIES     2
+#define DISCORD_RESET_MS    200             // X-RateLimit-Reset-After of the first response
+#define DISCORD_RETRY_MS    300             // Retry-After of the 429
+#define DISCORD_BACKOFF_MS  1000            // Wait after the first failure of a message
+
+// First run: the bucket runs empty, the second message gets a 429, the third fails with 500
+static const test_http_response_t s_limited_script[] = {
+    { .status = 200, .headers = "X-RateLimit-Remaining: 0\r\nX-RateLimit-Reset-After: 0.2\r\n", .body = "{}" },
+    { .status = 429, .headers = "Retry-After: 0.3\r\n", .body = "{\"retry_after\":0.3}" },
+    { .status = 200, .headers = "X-RateLimit-Remaining: 4\r\n", .body = "{}" },
+    { .status = 500, .body = "{}" },
+};
+
+// Second run: a wait longer than DISCORD_LOG_MAX_WAIT_MS keeps the log for the next cycle
+static const test_http_response_t s_long_wait_script[] = {
+    { .status = 429, .headers = "Retry-After: 60\r\n", .body = "{\"retry_after\":60}" },
+};
+
+// Third run: everything is accepted
+static const test_http_response_t s_accept_script[] = {
+    { .status = 200, .body = "{}" },
+};
+
+// Message the shipping should produce, and the sequence number after its last record
+typedef struct {
+    char text[DISCORD_MESSAGE_LIMIT + 1];
+    uint32_t end_seq;
+} expected_message_t;
+
+static expected_message_t s_expected[DISCORD_MAX_MSGS];
+static int s_expected_count;
+static uint32_t s_first_seq;
+static int s_port;
+static int s_failures;
+
+esp_err_t __real_https_client_request(https_client_handle_t handle, const https_client_request_t *request,
+                                      https_client_response_t *response);
+
+// Discord requests go to the stand-in server, all others pass through
+esp_err_t __wrap_https_client_request(https_client_handle_t handle, const https_client_request_t *request,
+                                      https_client_response_t *response) {
+    size_t prefix = strlen(DISCORD_URL_PREFIX);
+    if (s_port == 0 || request == NULL || request->url == NULL ||
+        strncmp(request->url, DISCORD_URL_PREFIX, prefix) != 0) {
+        return __real_https_client_request(handle, request, response);
+    }
+    char url[160];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d%s", s_port, request->url + prefix);
+    https_client_request_t local = *request;
+    local.url = url;
+    return __real_https_client_request(handle, &local, response);
+}
+
+// Record a failed check
+static void check(cJSON *failed, bool ok, const char *what) {
+    if (!ok) {
+        printf("discord: %s\n", what);
+        cJSON_AddItemToArray(failed, cJSON_CreateString(what));
+        s_failures++;
+    }
+}
+
+// Log lines of one and of several records, each with its own number
+static void fill_log(void) {
+    storage_log_flush();
+    storage_clear_logs();
+    storage_log_set_boot_count(7);
+    for (int i = 0; i < DISCORD_TEST_LINES; i++) {
+        if (i % DISCORD_TEXT_EVERY == DISCORD_TEXT_EVERY - 1) {
+            char text[DISCORD_TEXT_LEN + 1];
+            int length = snprintf(text, sizeof(text), "Free text line %d ", i);
+            memset(text + length, 'x', DISCORD_TEXT_LEN - length);
+            text[DISCORD_TEXT_LEN] = '\0';
+            storage_append_log(text);
+        } else {
+            storage_log(LOG_SCAN_INCOMPLETE, i, DISCORD_TEST_LINES, 1);
+        }
+    }
+    storage_log_flush();
+}
+
+// Pack the decoded lines greedily into messages, the way they should be sent
+static esp_err_t pack_expected(void) {
+    uint32_t end_seq;
+    if (storage_log_get_range(&s_first_seq, &end_seq) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    size_t total = end_seq - s_first_seq;
+    storage_log_record_t *records = malloc(total * sizeof(*records));
+    size_t read = 0;
+    if (records == NULL || storage_log_read(s_first_seq, records, total, &read, NULL) != ESP_OK || read != total) {
+        free(records);
+        return ESP_FAIL;
+    }
+
+    memset(s_expected, 0, sizeof(s_expected));
+    s_expected_count = 0;
+    size_t len = 0;
+    uint32_t seq = s_first_seq;
+    for (size_t i = 0; i < total;) {
+        char line[256];
+        size_t used = 0;
+        int line_len = storage_log_decode_line(&records[i], total - i, &used, line, sizeof(line));
+        if (line_len <= 0 || used == 0) {
+            break;
+        }
+        if (s_expected_count == 0 || len + line_len > DISCORD_MESSAGE_LIMIT) {
+            if (s_expected_count == DISCORD_MAX_MSGS) {
+                break;
+            }
+            s_expected_count++;
+            len = 0;
+        }
+        expected_message_t *message = &s_expected[s_expected_count - 1];
+        memcpy(message->text + len, line, line_len + 1);
+        len += line_len;
+        i += used;
+        seq += used;
+        message->end_seq = seq;
+    }
+    free(records);
+    return (s_expected_count > 0 && s_expected[s_expected_count - 1].end_seq == end_seq) ? ESP_OK : ESP_FAIL;
+}
+
+// Ship the log against one server script
+static int ship(const test_http_response_t *script, size_t count, esp_err_t *ret,
+                test_http_request_t **requests) {
+    *requests = NULL;
+    if (test_http_server_start(script, count, &s_port) != ESP_OK) {
+        printf("Failed to start the stand-in server\n");
+        s_port = 0;
+        return -1;
+    }
+    // A fresh pooled connection, the previous server is gone
+    https_client_close_all();
+    *ret = discord_init();
+    if (*ret == ESP_OK) {
+        *ret = send_logs_with_task_retries(DISCORD_RETRIES);
+    }
+    int received = test_http_server_stop(requests);
+    s_port = 0;
+    return received;
+}
+
+// Check that a request carries expected message n as its content
+static bool has_message(const test_http_request_t *request, int n) {
+    if (n >= s_expected_count) {
+        return false;
+    }
+    cJSON *json = cJSON_Parse(request->body);
+    const cJSON *content = cJSON_GetObjectItem(json, "content");
+    bool ok = cJSON_IsString(content) && strlen(content->valuestring) <= DISCORD_MESSAGE_LIMIT &&
+              strcmp(content->valuestring, s_expected[n].text) == 0 &&
+              strcmp(request->method, "POST") == 0 && strstr(request->headers, "Authorization: Bot") != NULL;
+    cJSON_Delete(json);
+    return ok;
+}
+
+// Check that two requests are at least a wait apart, vTaskDelay may end up to a tick early
+static bool waited(const test_http_request_t *before, const test_http_request_t *after, uint32_t wait_ms) {
+    return after->time_us - before->time_us >= (int64_t)(wait_ms - portTICK_PERIOD_MS) * 1000;
+}
+
+// First log record that is still stored
+static uint32_t log_first_seq(void) {
+    uint32_t first = 0, end = 0;
+    storage_log_get_range(&first, &end);
+    return first;
+}
+
+esp_err_t test_discord_run(cJSON *result) {
+    cJSON *failed = cJSON_AddArrayToObject(result, "failed");
+    s_failures = 0;
+
+    fill_log();
+    if (pack_expected() != ESP_OK) {
+        printf("Failed to read back the test log\n");
+        return ESP_FAIL;
+    }
+    check(failed, s_expected_count >= 4 && s_expected_count <= DISCORD_LOG_MAX_MESSAGES,
+          "test log does not need several messages");
+    cJSON_AddNumberToObject(result, "records", s_expected[s_expected_count - 1].end_seq - s_first_seq);
+    cJSON_AddNumberToObject(result, "messages", s_expected_count);
+
+    // Rate limited run: two messages are acknowledged, the third fails twice
+    esp_err_t ret = ESP_OK;
+    test_http_request_t *requests = NULL;
+    int count = ship(s_limited_script, sizeof(s_limited_script) / sizeof(s_limited_script[0]), &ret, &requests);
+    check(failed, ret != ESP_OK, "failed message reported as sent");
+    check(failed, count == 5, "rate limited run sent a wrong number of requests");
+    if (count == 5) {
+        check(failed, has_message(&requests[0], 0), "first message differs");
+        check(failed, has_message(&requests[1], 1) && has_message(&requests[2], 1),
+              "rate limited message not sent again unchanged");
+        check(failed, has_message(&requests[3], 2) && has_message(&requests[4], 2),
+              "failed message not sent again unchanged");
+        check(failed, waited(&requests[0], &requests[1], DISCORD_RESET_MS), "empty bucket did not wait for the reset");
+        check(failed, waited(&requests[1], &requests[2], DISCORD_RETRY_MS), "429 did not wait for Retry-After");
+        check(failed, waited(&requests[3], &requests[4], DISCORD_BACKOFF_MS), "server error did not back off");
+        cJSON_AddNumberToObject(result, "reset_wait_ms", (requests[1].time_us - requests[0].time_us) / 1000.0);
+        cJSON_AddNumberToObject(result, "retry_wait_ms", (requests[2].time_us - requests[1].time_us) / 1000.0);
+        cJSON_AddNumberToObject(result, "backoff_ms", (requests[4].time_us - requests[3].time_us) / 1000.0);
+    }
+    test_http_server_free(requests, count);
+    check(failed, log_first_seq() == s_expected[1].end_seq, "log not consumed up to the acknowledged messages");
+
+    // A wait beyond the limit gives up at once and keeps the log
+    uint32_t kept = log_first_seq();
+    count = ship(s_long_wait_script, 1, &ret, &requests);
+    check(failed, ret == ESP_ERR_TIMEOUT && count == 1, "long Retry-After not left for the next cycle");
+    check(failed, count == 1 && has_message(&requests[0], 2), "long wait run sent the wrong message");
+    test_http_server_free(requests, count);
+    check(failed, log_first_seq() == kept, "log consumed without an acknowledgement");
+
+    // The next cycle continues after the last acknowledged message
+    count = ship(s_accept_script, 1, &ret, &requests);
+    check(failed, ret == ESP_OK && count == s_expected_count - 2, "remaining log not sent");
+    for (int i = 0; i < count && i + 2 < s_expected_count; i++) {
+        check(failed, has_message(&requests[i], i + 2), "resumed message differs");
+    }
+    test_http_server_free(requests, count);
+    uint32_t first_seq, end_seq;
+    check(failed, storage_log_get_range(&first_seq, &end_seq) == ESP_OK && first_seq == end_seq,
+          "acknowledged log not consumed");
+
+    https_client_close_all();
+    printf("discord: %d messages of %lu records, %d checks failed\n", s_expected_count,
+           (unsigned long)(s_expected[s_expected_count - 1].end_seq - s_first_seq), s_failures);
+    return (s_failures == 0) ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Discord log shipping against a local stand-in server
+ *
+ * Fills the log ring with one-record and multi-record lines, then ships it
+ * with send_logs_with_task_retries() three times: against a server that
+ * empties the rate limit bucket, answers a 429 with Retry-After and then
+ * fails with 500, against one that asks for a wait longer than
+ * DISCORD_LOG_MAX_WAIT_MS, and against one that accepts everything. Checks
+ * that every message holds whole lines up to DISCORD_MESSAGE_LIMIT
+ * characters in log order, that the reset, Retry-After and backoff waits
+ * are kept, that a failed message is sent again unchanged and that only the
+ * records of acknowledged messages leave the log.
+ *
+ * @param result Object for the message counts and the failed checks
+ * @return esp_err_t ESP_OK if every check passed
+ */
+esp_err_t test_discord_run(cJSON *result);
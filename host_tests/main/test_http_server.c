@@ -0,0 +1,243 @@
+// test_http_server.c
+// Local HTTP/1.1 stand-in for the Firestore and Discord endpoints. The child
+// process logs every complete request to a temporary file before it answers,
+// the parent reads the log back after stopping it.
+#include "test_http_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SERVER_BUFFER_SIZE  (64 * 1024)     // Largest request, headers and body
+#define SERVER_HEADER_SIZE  1024
+
+static pid_t s_pid = -1;
+static FILE *s_log = NULL;
+
+// Child state, the child never returns to the test
+static const test_http_response_t *s_script;
+static size_t s_script_count;
+static size_t s_served;
+static char s_buffer[SERVER_BUFFER_SIZE + 1];   // Null terminated for the header search
+static char s_body[SERVER_BUFFER_SIZE];
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool write_all(int fd, const void *data, size_t length, int flags) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = (flags >= 0) ? send(fd, p, length, flags) : write(fd, p, length);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Value of a header in a header block, -1 if missing
+static long header_value(const char *headers, const char *name) {
+    size_t length = strlen(name);
+    for (const char *line = headers; line != NULL && *line != '\0'; ) {
+        if (strncasecmp(line, name, length) == 0 && line[length] == ':') {
+            return strtol(line + length + 1, NULL, 10);
+        }
+        line = strstr(line, "\r\n");
+        line = line ? line + 2 : NULL;
+    }
+    return -1;
+}
+
+// Answer a request with the next script entry
+static bool respond(int fd, const test_http_response_t *response) {
+    if (response->delay_ms > 0) {
+        usleep(response->delay_ms * 1000);
+    }
+
+    const char *body = response->body;
+    size_t body_len = body ? strlen(body) : response->body_len;
+    if (body == NULL) {
+        body_len = (body_len < sizeof(s_body)) ? body_len : sizeof(s_body);
+        for (size_t i = 0; i < body_len; i++) {
+            s_body[i] = (char)('a' + i % 26);
+        }
+        body = s_body;
+    }
+
+    char header[SERVER_HEADER_SIZE];
+    int length = snprintf(header, sizeof(header), "HTTP/1.1 %d Stand-in\r\nContent-Length: %zu\r\n%s%s\r\n",
+                          response->status, body_len, response->headers ? response->headers : "",
+                          response->close ? "Connection: close\r\n" : "");
+    return length > 0 && (size_t)length < sizeof(header) &&
+           write_all(fd, header, (size_t)length, MSG_NOSIGNAL) &&
+           write_all(fd, body, body_len, MSG_NOSIGNAL) && !response->close;
+}
+
+// Serve the requests of one connection until it is closed
+static void serve_connection(int fd, int connection, int log_fd) {
+    size_t have = 0;
+    while (true) {
+        // Headers, then the body announced by Content-Length
+        char *end = NULL;
+        s_buffer[have] = '\0';
+        while ((end = strstr(s_buffer, "\r\n\r\n")) == NULL) {
+            ssize_t n = recv(fd, s_buffer + have, SERVER_BUFFER_SIZE - have, 0);
+            if (n <= 0) {
+                return;
+            }
+            have += (size_t)n;
+            s_buffer[have] = '\0';
+        }
+        size_t header_len = (size_t)(end - s_buffer) + 4;
+        *end = '\0';
+        const char *lines = strstr(s_buffer, "\r\n");
+        lines = lines ? lines + 2 : "";
+        long content_length = header_value(lines, "Content-Length");
+        size_t body_len = content_length > 0 ? (size_t)content_length : 0;
+        if (header_len + body_len > SERVER_BUFFER_SIZE) {
+            return;
+        }
+        while (have < header_len + body_len) {
+            ssize_t n = recv(fd, s_buffer + have, SERVER_BUFFER_SIZE - have, 0);
+            if (n <= 0) {
+                return;     // Incomplete body, the request is dropped
+            }
+            have += (size_t)n;
+        }
+
+        test_http_request_t record = {
+            .connection = connection,
+            .time_us = monotonic_us(),
+            .body_len = body_len,
+        };
+        sscanf(s_buffer, "%7s %127s", record.method, record.path);
+        strncpy(record.headers, lines, sizeof(record.headers) - 1);
+        if (!write_all(log_fd, &record, sizeof(record), -1) ||
+            !write_all(log_fd, s_buffer + header_len, body_len, -1)) {
+            return;
+        }
+
+        size_t index = (s_served < s_script_count) ? s_served : s_script_count - 1;
+        s_served++;
+        if (!respond(fd, &s_script[index])) {
+            return;
+        }
+
+        // Keep the bytes of a request sent right behind this one
+        have -= header_len + body_len;
+        memmove(s_buffer, s_buffer + header_len + body_len, have);
+    }
+}
+
+esp_err_t test_http_server_start(const test_http_response_t *script, size_t count, int *port) {
+    if (script == NULL || count == 0 || port == NULL || s_pid >= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 4) != 0 || getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return ESP_FAIL;
+    }
+
+    s_log = tmpfile();
+    if (s_log == NULL) {
+        close(listen_fd);
+        return ESP_FAIL;
+    }
+
+    fflush(stdout);
+    s_pid = fork();
+    if (s_pid == 0) {
+        // Child: the scheduler timer is not inherited, only this thread runs
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);   // Do not outlive a test that crashed
+        s_script = script;
+        s_script_count = count;
+        for (int connection = 0; ; connection++) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0) {
+                _exit(1);
+            }
+            serve_connection(fd, connection, fileno(s_log));
+            close(fd);
+        }
+    }
+
+    close(listen_fd);
+    if (s_pid < 0) {
+        fclose(s_log);
+        s_log = NULL;
+        return ESP_FAIL;
+    }
+    *port = ntohs(addr.sin_port);
+    return ESP_OK;
+}
+
+int test_http_server_stop(test_http_request_t **requests) {
+    if (s_pid < 0 || requests == NULL) {
+        return -1;
+    }
+    kill(s_pid, SIGKILL);
+    waitpid(s_pid, NULL, 0);
+    s_pid = -1;
+
+    // Every record was written before its response, so the log is complete
+    int count = 0;
+    int capacity = 0;
+    *requests = NULL;
+    test_http_request_t record;
+    fseek(s_log, 0, SEEK_SET);
+    while (fread(&record, sizeof(record), 1, s_log) == 1) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            test_http_request_t *grown = realloc(*requests, capacity * sizeof(record));
+            if (grown == NULL) {
+                break;
+            }
+            *requests = grown;
+        }
+        record.body = malloc(record.body_len + 1);
+        if (record.body == NULL || fread(record.body, 1, record.body_len, s_log) != record.body_len) {
+            free(record.body);
+            break;
+        }
+        record.body[record.body_len] = '\0';
+        (*requests)[count++] = record;
+    }
+    fclose(s_log);
+    s_log = NULL;
+    return count;
+}
+
+void test_http_server_free(test_http_request_t *requests, int count) {
+    for (int i = 0; i < count; i++) {
+        free(requests[i].body);
+    }
+    free(requests);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Scripted response of the stand-in server
+ */
+typedef struct {
+    int status;             // HTTP status code
+    const char *headers;    // Extra header lines, each ending with "\r\n", or NULL
+    const char *body;       // Response body, or NULL
+    size_t body_len;        // Generated body of this many letters when body is NULL
+    uint32_t delay_ms;      // Wait before the response is sent
+    bool close;             // Close the connection after the response
+} test_http_response_t;
+
+/**
+ * @brief Request received by the stand-in server
+ */
+typedef struct {
+    char method[8];
+    char path[128];
+    char headers[512];      // Request header lines, truncated
+    int connection;         // Index of the accepted connection, from 0
+    int64_t time_us;        // Arrival time on CLOCK_MONOTONIC
+    size_t body_len;
+    char *body;             // Body, null terminated
+} test_http_request_t;
+
+/**
+ * @brief Start a local HTTP/1.1 server on 127.0.0.1
+ *
+ * The server runs in a child process, so its blocking socket calls do not
+ * stall the FreeRTOS scheduler of the test. Request n gets script[n], the
+ * last entry answers all further requests. A request whose body does not
+ * arrive completely is dropped and does not use a script entry.
+ *
+ * @param script Responses in request order
+ * @param count Number of responses, at least 1
+ * @param port Pointer to store the port the server listens on
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t test_http_server_start(const test_http_response_t *script, size_t count, int *port);
+
+/**
+ * @brief Stop the server and get the requests it received
+ *
+ * @param requests Pointer to store the requests, free with test_http_server_free()
+ * @return int Number of requests, -1 on error
+ */
+int test_http_server_stop(test_http_request_t **requests);
+
+/**
+ * @brief Free the requests returned by test_http_server_stop()
+ *
+ * @param requests Requests
+ * @param count Number of requests
+ */
+void test_http_server_free(test_http_request_t *requests, int count);
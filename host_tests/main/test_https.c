@@ -0,0 +1,304 @@
+// test_https.c
+// Host test of the pooled transport: https_client talks plain HTTP to the
+// local stand-in server, the pooling and the body paths are the same code
+// as over TLS on the device.
+#include "test_https.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include "https_client.h"
+#include "test_http_server.h"
+
+#define HTTPS_HOST          "127.0.0.1"
+#define HTTPS_BUFFER        1024            // Receive and transmit buffers of the pooled connection
+#define HTTPS_LARGE_BODY    (10 * 1024)     // Response larger than the receive buffer
+#define HTTPS_SHORT_BUFFER  16              // Response buffer shorter than the body
+#define HTTPS_SLOW_MS       300             // Delay of the slow response, outside the first histogram bucket
+#define HTTPS_REQUESTS      8               // Requests sent, one fails in the body provider
+#define HTTPS_RECEIVED      7               // Requests that reach the server completely
+#define HTTPS_CONNECTIONS   3
+
+// Responses in request order, the failed request does not use one
+static const test_http_response_t s_script[] = {
+    { .status = 200, .headers = "X-Test: first\r\n", .body = "hello" },
+    { .status = 201, .body = "created" },
+    { .status = 200, .body_len = HTTPS_LARGE_BODY },
+    { .status = 200, .body = "streamed" },
+    { .status = 200, .body = "slow", .delay_ms = HTTPS_SLOW_MS, .close = true },
+    { .status = 404, .body = "missing" },
+    { .status = 200, .body = "again" },
+};
+
+// Path, method and connection of each request the server receives
+static const struct {
+    const char *path;
+    const char *method;
+    int connection;
+} s_expected[HTTPS_RECEIVED] = {
+    { "/first",       "POST",  0 },
+    { "/second",      "PATCH", 0 },
+    { "/large",       "GET",   0 },
+    { "/stream",      "POST",  0 },
+    { "/slow",        "GET",   0 },
+    { "/after_close", "GET",   1 },
+    { "/again",       "GET",   2 },
+};
+
+static const char *const s_chunks[] = { "{\"part\":1,", "\"part\":2,", "\"part\":3}" };
+#define HTTPS_CHUNKS    (sizeof(s_chunks) / sizeof(s_chunks[0]))
+
+static const char s_first_body[] = "{\"n\":0}";
+static const char s_second_body[] = "{\"n\":1}";
+
+static int s_failures;
+
+// Record a failed check
+static void check(cJSON *failed, bool ok, const char *what) {
+    if (!ok) {
+        printf("https_client: %s\n", what);
+        cJSON_AddItemToArray(failed, cJSON_CreateString(what));
+        s_failures++;
+    }
+}
+
+// Body provider that hands out the chunks of s_chunks in order
+static esp_err_t chunk_provider(void *ctx, const char **chunk, size_t *chunk_len) {
+    size_t *next = ctx;
+    if (*next >= HTTPS_CHUNKS) {
+        return ESP_FAIL;
+    }
+    *chunk = s_chunks[*next];
+    *chunk_len = strlen(*chunk);
+    (*next)++;
+    return ESP_OK;
+}
+
+// Body provider that runs out of data right away
+static esp_err_t empty_provider(void *ctx, const char **chunk, size_t *chunk_len) {
+    *chunk = "";
+    *chunk_len = 0;
+    return ESP_OK;
+}
+
+// Body callback that checks the letters of a generated body
+typedef struct {
+    size_t received;
+    bool matches;
+} body_check_t;
+
+static esp_err_t check_body(void *ctx, int status_code, const char *data, size_t len) {
+    body_check_t *body = ctx;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != (char)('a' + (body->received + i) % 26)) {
+            body->matches = false;
+        }
+    }
+    body->received += len;
+    return ESP_OK;
+}
+
+static void find_test_header(void *ctx, const char *key, const char *value) {
+    if (strcasecmp(key, "X-Test") == 0) {
+        strncpy((char *)ctx, value, 15);
+    }
+}
+
+// Send one request to a path of the stand-in server
+static esp_err_t send_request(https_client_handle_t handle, int port, https_client_request_t *request,
+                              const char *path, https_client_response_t *response) {
+    char url[64];
+    snprintf(url, sizeof(url), "http://%s:%d%s", HTTPS_HOST, port, path);
+    request->url = url;
+    memset(response, 0, sizeof(*response));
+    return https_client_request(handle, request, response);
+}
+
+// Check what the server received
+static void check_server(cJSON *failed, const test_http_request_t *requests, int count) {
+    check(failed, count == HTTPS_RECEIVED, "server received a wrong number of requests");
+    for (int i = 0; i < count && i < HTTPS_RECEIVED; i++) {
+        check(failed, strcmp(requests[i].path, s_expected[i].path) == 0 &&
+                      strcmp(requests[i].method, s_expected[i].method) == 0,
+              "server received requests out of order");
+        check(failed, requests[i].connection == s_expected[i].connection,
+              "request did not use the expected connection");
+    }
+    if (count < 4) {
+        return;
+    }
+    check(failed, strcmp(requests[0].body, s_first_body) == 0, "buffered body differs");
+    check(failed, strstr(requests[0].headers, "X-Only-First: 1") != NULL, "request header missing");
+    check(failed, strcmp(requests[1].body, s_second_body) == 0, "second buffered body differs");
+    check(failed, strstr(requests[1].headers, "X-Only-First") == NULL, "header of the previous request sent again");
+
+    char streamed[64] = "";
+    for (size_t i = 0; i < HTTPS_CHUNKS; i++) {
+        strcat(streamed, s_chunks[i]);
+    }
+    check(failed, strcmp(requests[3].body, streamed) == 0, "streamed body differs");
+}
+
+esp_err_t test_https_run(cJSON *result) {
+    cJSON *failed = cJSON_AddArrayToObject(result, "failed");
+    s_failures = 0;
+
+    int port = 0;
+    if (test_http_server_start(s_script, sizeof(s_script) / sizeof(s_script[0]), &port) != ESP_OK) {
+        printf("Failed to start the stand-in server\n");
+        return ESP_FAIL;
+    }
+
+    const https_client_host_config_t config = {
+        .host = HTTPS_HOST,
+        .rx_buffer_size = HTTPS_BUFFER,
+        .tx_buffer_size = HTTPS_BUFFER,
+        .timeout_ms = 5000,
+    };
+    https_client_handle_t handle = NULL;
+    esp_err_t ret = https_client_open(&config, &handle);
+    check(failed, ret == ESP_OK, "pooled connection not created");
+
+    if (ret == ESP_OK) {
+        https_client_response_t response;
+        char buffer[64];
+        size_t bytes_sent = 0;
+
+        // Buffered bodies on one connection, the headers are replaced between requests
+        char test_header[16] = "";
+        const https_client_header_t first_headers[] = {
+            {"Content-Type", "application/json"},
+            {"X-Only-First", "1"},
+        };
+        https_client_request_t first = {
+            .method = HTTP_METHOD_POST,
+            .headers = first_headers,
+            .header_count = 2,
+            .body = s_first_body,
+            .body_len = strlen(s_first_body),
+            .on_header = find_test_header,
+            .header_ctx = test_header,
+            .response_buf = buffer,
+            .response_buf_size = sizeof(buffer),
+        };
+        ret = send_request(handle, port, &first, "/first", &response);
+        check(failed, ret == ESP_OK && response.status_code == 200 && strcmp(buffer, "hello") == 0,
+              "buffered request failed");
+        check(failed, strcmp(test_header, "first") == 0, "response header not reported");
+        bytes_sent += first.body_len;
+
+        https_client_request_t second = {
+            .method = HTTP_METHOD_PATCH,
+            .headers = first_headers,
+            .header_count = 1,
+            .body = s_second_body,
+            .body_len = strlen(s_second_body),
+            .response_buf = buffer,
+            .response_buf_size = sizeof(buffer),
+        };
+        ret = send_request(handle, port, &second, "/second", &response);
+        check(failed, ret == ESP_OK && response.status_code == 201 && strcmp(buffer, "created") == 0,
+              "second buffered request failed");
+        bytes_sent += second.body_len;
+
+        // Large response through the body callback and into a short buffer
+        char short_buffer[HTTPS_SHORT_BUFFER];
+        body_check_t body = { .matches = true };
+        https_client_request_t large = {
+            .method = HTTP_METHOD_GET,
+            .on_data = check_body,
+            .data_ctx = &body,
+            .response_buf = short_buffer,
+            .response_buf_size = sizeof(short_buffer),
+        };
+        ret = send_request(handle, port, &large, "/large", &response);
+        check(failed, ret == ESP_OK && body.received == HTTPS_LARGE_BODY && body.matches,
+              "large response not streamed completely");
+        check(failed, response.response_len == HTTPS_SHORT_BUFFER - 1 &&
+                      strlen(short_buffer) == HTTPS_SHORT_BUFFER - 1,
+              "short response buffer overrun or not terminated");
+
+        // Streamed body from the provider
+        size_t next_chunk = 0;
+        size_t streamed_len = 0;
+        for (size_t i = 0; i < HTTPS_CHUNKS; i++) {
+            streamed_len += strlen(s_chunks[i]);
+        }
+        https_client_request_t stream = {
+            .method = HTTP_METHOD_POST,
+            .body_len = streamed_len,
+            .body_provider = chunk_provider,
+            .body_ctx = &next_chunk,
+            .response_buf = buffer,
+            .response_buf_size = sizeof(buffer),
+        };
+        ret = send_request(handle, port, &stream, "/stream", &response);
+        check(failed, ret == ESP_OK && response.status_code == 200 && strcmp(buffer, "streamed") == 0 &&
+                      next_chunk == HTTPS_CHUNKS,
+              "streamed request failed");
+        bytes_sent += streamed_len;
+
+        // Slow response that closes the connection, the next request reconnects
+        https_client_request_t slow = { .method = HTTP_METHOD_GET };
+        ret = send_request(handle, port, &slow, "/slow", &response);
+        check(failed, ret == ESP_OK && response.duration_us >= HTTPS_SLOW_MS * 1000LL,
+              "slow request failed or timed too short");
+
+        https_client_request_t after_close = {
+            .method = HTTP_METHOD_GET,
+            .response_buf = buffer,
+            .response_buf_size = sizeof(buffer),
+        };
+        ret = send_request(handle, port, &after_close, "/after_close", &response);
+        check(failed, ret == ESP_OK && response.status_code == 404 && strcmp(buffer, "missing") == 0,
+              "request after a closed connection failed");
+
+        // A provider without data fails the request and drops the connection
+        https_client_request_t empty = {
+            .method = HTTP_METHOD_POST,
+            .body_len = 10,
+            .body_provider = empty_provider,
+        };
+        ret = send_request(handle, port, &empty, "/fail", &response);
+        check(failed, ret == ESP_ERR_INVALID_SIZE && response.status_code == 0,
+              "empty body provider not rejected");
+
+        https_client_request_t again = { .method = HTTP_METHOD_GET };
+        ret = send_request(handle, port, &again, "/again", &response);
+        check(failed, ret == ESP_OK && response.status_code == 200, "request after a failure failed");
+
+        https_client_stats_t stats = {0};
+        https_client_get_stats(handle, &stats);
+        uint32_t histogram_total = 0;
+        for (int i = 0; i < HTTPS_CLIENT_HISTOGRAM_BUCKETS; i++) {
+            histogram_total += stats.histogram[i];
+        }
+        check(failed, stats.requests == HTTPS_REQUESTS && stats.failures == 1, "request counts wrong");
+        check(failed, stats.connects == HTTPS_CONNECTIONS, "connection was not reused");
+        check(failed, stats.bytes_sent == bytes_sent, "sent byte count wrong");
+        check(failed, stats.bytes_received == strlen("hello") + strlen("created") + HTTPS_LARGE_BODY +
+                                              strlen("streamed") + strlen("slow") + strlen("missing") + strlen("again"),
+              "received byte count wrong");
+        check(failed, histogram_total == HTTPS_REQUESTS && stats.histogram[0] < HTTPS_REQUESTS,
+              "duration histogram wrong");
+
+        cJSON_AddNumberToObject(result, "requests", stats.requests);
+        cJSON_AddNumberToObject(result, "failures", stats.failures);
+        cJSON_AddNumberToObject(result, "connects", stats.connects);
+        cJSON_AddNumberToObject(result, "bytes_sent", (double)stats.bytes_sent);
+        cJSON_AddNumberToObject(result, "bytes_received", (double)stats.bytes_received);
+        cJSON *histogram = cJSON_AddArrayToObject(result, "histogram");
+        for (int i = 0; i < HTTPS_CLIENT_HISTOGRAM_BUCKETS; i++) {
+            cJSON_AddItemToArray(histogram, cJSON_CreateNumber(stats.histogram[i]));
+        }
+        https_client_close_all();
+    }
+
+    test_http_request_t *requests = NULL;
+    int count = test_http_server_stop(&requests);
+    check_server(failed, requests, count);
+    test_http_server_free(requests, count);
+
+    printf("https_client: %d requests, %d checks failed\n", HTTPS_REQUESTS, s_failures);
+    return (s_failures == 0) ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief https_client against a local stand-in server
+ *
+ * Sends buffered and streamed bodies over one pooled connection, receives
+ * a response larger than the receive buffer through the body callback and
+ * into a short buffer, gets a slow response that closes the connection and
+ * lets a body provider fail. Checks that the requests reuse the connection
+ * until the server closes it, that the server receives the bodies and only
+ * the headers of its own request, and the connection, byte, failure and
+ * histogram counts of the host statistics.
+ *
+ * @param result Object for the statistics and the failed checks
+ * @return esp_err_t ESP_OK if every check passed
+ */
+esp_err_t test_https_run(cJSON *result);
@@ -0,0 +1,110 @@
+// test_main.c
+// Pass/fail host tests of the firmware components on the Linux target. The
+// timing benchmarks are in benchmark/, these tests only check behavior:
+//   state    power loss at every NVS write of the system state checkpoints (test_state.c)
+//   cycle    reset at every stage of a send cycle and before every upload segment (test_cycle.c)
+//   time     Finland time table against the libc time zone from 1970 to 2100 (test_time.cpp)
+//   ota      delta firmware updates through a simulated range server (test_ota.c)
+//   https    pooled connections and body paths of https_client against a local server (test_https.c)
+//   discord  log shipping with rate limits, 429 and server errors against a local server (test_discord.c)
+//
+// Every test prints what it checked and its failures, the process exits
+// with 1 if a test failed. TEST_OUTPUT names a file for the details as JSON.
+//
+// Environment: TEST_SUITES (comma separated test names, default all),
+// TEST_OUTPUT and the TEST_OTA_* variables.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "cJSON.h"
+#include "storage.h"
+#include "test_state.h"
+#include "test_cycle.h"
+#include "test_time.h"
+#include "test_ota.h"
+#include "test_https.h"
+#include "test_discord.h"
+
+// A test and the member of the JSON output it fills
+typedef struct {
+    const char *name;
+    bool array;                     // The test fills an array, otherwise an object
+    esp_err_t (*run)(cJSON *result);
+} host_test_t;
+
+static const host_test_t s_tests[] = {
+    { "state", false, test_state_run },
+    { "cycle", true,  test_cycle_run },
+    { "time",  false, test_time_run },
+    { "ota",   true,  test_ota_run },
+    { "https", false, test_https_run },
+    { "discord", false, test_discord_run },
+};
+
+// Check whether a name is in the comma separated TEST_SUITES list, all run without it
+static bool test_selected(const char *name) {
+    const char *list = getenv("TEST_SUITES");
+    if (list == NULL || *list == '\0') {
+        return true;
+    }
+    size_t length = strlen(name);
+    for (const char *item = list; item != NULL; item = strchr(item, ',')) {
+        item += (*item == ',') ? 1 : 0;
+        if (strncmp(item, name, length) == 0 && (item[length] == ',' || item[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Write the details file
+static esp_err_t write_results(cJSON *root, const char *path) {
+    char *text = cJSON_Print(root);
+    FILE *f = fopen(path, "w");
+    if (text == NULL || f == NULL) {
+        free(text);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return ESP_FAIL;
+    }
+    fputs(text, f);
+    fclose(f);
+    free(text);
+    printf("Details written to %s\n", path);
+    return ESP_OK;
+}
+
+void app_main(void)
+{
+    // The cycle pipeline and the system state log through the storage component
+    ESP_ERROR_CHECK(storage_init());
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    cJSON *root = cJSON_CreateObject();
+    int failed = 0;
+    int run = 0;
+    for (size_t i = 0; i < sizeof(s_tests) / sizeof(s_tests[0]); i++) {
+        const host_test_t *test = &s_tests[i];
+        if (!test_selected(test->name)) {
+            continue;
+        }
+        cJSON *result = test->array ? cJSON_AddArrayToObject(root, test->name)
+                                    : cJSON_AddObjectToObject(root, test->name);
+        esp_err_t ret = test->run(result);
+        printf("%s: %s\n", test->name, (ret == ESP_OK) ? "passed" : "FAILED");
+        failed += (ret != ESP_OK) ? 1 : 0;
+        run++;
+    }
+    printf("\n%d of %d tests passed\n", run - failed, run);
+
+    const char *path = getenv("TEST_OUTPUT");
+    if (path != NULL && write_results(root, path) != ESP_OK) {
+        printf("Failed to write %s\n", path);
+        failed++;
+    }
+    cJSON_Delete(root);
+    exit((failed == 0 && run > 0) ? 0 : 1);
+}
@@ -0,0 +1,671 @@
+// test_ota.c
+// Host run of the delta firmware update: synthetic images, a delta encoder
+// and an in-process range server with dropped connections and resets.
+#include "test_ota.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ota_delta.h"
+#include "config_manager.h"
+
+#define IMAGE_WORDS         (256 * 1024 - 8)    // About 1 MB with the appended hash
+#define IMAGE_BASE          0x400D0000u         // Address of the first word, pointers are relocated with it
+#define POINTER_EVERY       24                  // One word in 24 is a pointer into the image
+#define CODE_WORDS          4096                // Instruction patterns, code repeats them
+#define SLOT_SIZE           0x170000            // App slot of partitions.csv
+
+#define MATCH_BYTES         16                  // Exact match that starts an add operation
+#define INDEX_BITS          18
+#define EXTEND_WINDOW       32                  // An add goes on while half of a window matches
+#define ZERO_GAP            4                   // Shorter zero runs stay in the literals
+
+#define MAX_CYCLES          200
+#define MAX_CHUNK           1460                // Body bytes per callback, one TCP segment
+#define VARIANT_SHIFT       1                   // Index in s_variants
+#define VARIANT_UNRELATED   3
+
+// Change from the old image to the new one
+typedef struct {
+    const char *name;
+    uint32_t inserts;           // Insertions of new code
+    uint32_t insert_words;      // Words of a single insertion, the maximum of several
+    uint32_t changes;           // Code words changed in place
+    bool unrelated;             // New image from another build
+} ota_variant_t;
+
+static const ota_variant_t s_variants[] = {
+    { "patch",      0,   0,  24, false },
+    { "shift",      1, 256,   0, false },
+    { "rebuild",   40,  64, 400, false },
+    { "unrelated",  0,   0,   0, true  },
+};
+
+// Link between the device and the server
+typedef struct {
+    const char *name;
+    uint32_t drop_every;        // One request in N loses its connection in the body, 0 never
+    uint32_t reset_every;       // One request in N resets the device in the body, 0 never
+    bool ignore_range;          // Server answers every request with the whole delta
+} ota_link_t;
+
+static const ota_link_t s_links[] = {
+    { "clean",  0,  0, false },
+    { "faulty", 5,  7, false },
+};
+
+static const ota_link_t s_no_range_link = { "no_range", 1, 0, true };
+
+// Words of an image before serialization, a pointer holds the index of its target word
+typedef struct {
+    uint32_t *words;
+    uint8_t *pointer;
+    size_t count;
+} image_model_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} image_t;
+
+// Server, flash and NVS of one simulated update
+typedef struct {
+    const ota_link_t *link;
+    uint32_t seed;
+    const uint8_t *patch;
+    size_t patch_size;
+    const image_t *source;
+    uint8_t *target;            // Update slot
+    ota_delta_t *delta;
+    bool reset;                 // Power lost, nothing more is written or saved
+    bool has_saved;
+    ota_delta_state_t saved;    // Checkpoint in NVS
+    uint32_t requests;
+    uint32_t drops;
+    uint32_t resets;
+    uint32_t saves;
+    uint64_t downloaded;
+    uint64_t source_read;
+} ota_sim_t;
+
+// Result of one update
+typedef struct {
+    esp_err_t ret;
+    uint32_t cycles;
+    bool image_ok;
+} ota_outcome_t;
+
+// Integer hash, the same images for every run with a seed
+static uint32_t mix(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    *state = mix(*state + 1, 0x2545F491u);
+    return *state;
+}
+
+static void put_u32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+static bool model_create(image_model_t *model, uint32_t seed) {
+    model->count = IMAGE_WORDS;
+    model->words = malloc(model->count * sizeof(uint32_t));
+    model->pointer = malloc(model->count);
+    if (model->words == NULL || model->pointer == NULL) {
+        return false;
+    }
+    uint32_t state = seed;
+    for (size_t i = 0; i < model->count; i++) {
+        uint32_t r = next_random(&state);
+        model->pointer[i] = (r % POINTER_EVERY) == 0;
+        model->words[i] = model->pointer[i] ? (uint32_t)(next_random(&state) % model->count) :
+                          mix(next_random(&state) % CODE_WORDS, seed);
+    }
+    return true;
+}
+
+static void model_free(image_model_t *model) {
+    free(model->words);
+    free(model->pointer);
+}
+
+// Image bytes with the inserted and changed words, pointers follow their moved targets
+static bool image_build(image_t *image, const image_model_t *model, const uint32_t *inserted,
+                        const uint8_t *changed, uint32_t seed) {
+    uint32_t *position = malloc(model->count * sizeof(uint32_t));
+    size_t words = 0;
+    for (size_t i = 0; i < model->count; i++) {
+        words += inserted ? inserted[i] : 0;
+        if (position != NULL) {
+            position[i] = (uint32_t)words;
+        }
+        words++;
+    }
+    image->size = words * 4 + OTA_DELTA_HASH_SIZE;
+    image->data = malloc(image->size);
+    if (position == NULL || image->data == NULL) {
+        free(position);
+        return false;
+    }
+
+    uint32_t state = seed;
+    uint8_t *out = image->data;
+    for (size_t i = 0; i < model->count; i++) {
+        for (uint32_t k = 0; inserted && k < inserted[i]; k++, out += 4) {
+            put_u32(out, mix(next_random(&state) % CODE_WORDS, seed));
+        }
+        uint32_t word = model->words[i];
+        if (model->pointer[i]) {
+            word = IMAGE_BASE + 4 * position[word];
+        } else if (changed && changed[i]) {
+            word = next_random(&state);
+        }
+        put_u32(out, word);
+        out += 4;
+    }
+
+    // Stand-in for the SHA-256 esptool appends, it only has to differ between images
+    uint32_t hash = seed;
+    for (size_t i = 0; i < words * 4; i += 4) {
+        hash = mix(hash ^ image->data[i] ^ ((uint32_t)image->data[i + 1] << 8) ^
+                   ((uint32_t)image->data[i + 2] << 16) ^ ((uint32_t)image->data[i + 3] << 24), 1);
+    }
+    for (int i = 0; i < OTA_DELTA_HASH_SIZE; i += 4, out += 4) {
+        hash = mix(hash, (uint32_t)i);
+        put_u32(out, hash);
+    }
+    free(position);
+    return true;
+}
+
+// New image of a variant from the model of the old one
+static bool variant_build(image_t *image, const ota_variant_t *variant, const image_model_t *model, uint32_t seed) {
+    if (variant->unrelated) {
+        image_model_t other;
+        bool ok = model_create(&other, seed + 1) && image_build(image, &other, NULL, NULL, seed + 1);
+        model_free(&other);
+        return ok;
+    }
+
+    uint32_t *inserted = calloc(model->count, sizeof(uint32_t));
+    uint8_t *changed = calloc(model->count, 1);
+    bool ok = inserted != NULL && changed != NULL;
+    uint32_t state = seed ^ 0xA5A5A5A5u;
+    for (uint32_t i = 0; ok && i < variant->inserts; i++) {
+        size_t at = (variant->inserts == 1) ? model->count * 3 / 10 : next_random(&state) % model->count;
+        inserted[at] += (variant->inserts == 1) ? variant->insert_words :
+                        1 + next_random(&state) % variant->insert_words;
+    }
+    for (uint32_t i = 0; ok && i < variant->changes; i++) {
+        changed[next_random(&state) % model->count] = 1;
+    }
+    ok = ok && image_build(image, model, inserted, changed, seed + 2);
+    free(inserted);
+    free(changed);
+    return ok;
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} patch_t;
+
+static void put_byte(patch_t *patch, uint8_t byte) {
+    patch->data[patch->size++] = byte;
+}
+
+// Unsigned LEB128
+static void put_number(patch_t *patch, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        put_byte(patch, value ? (byte | 0x80) : byte);
+    } while (value);
+}
+
+static void put_insert(patch_t *patch, const uint8_t *bytes, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    put_byte(patch, OTA_DELTA_OP_INSERT);
+    put_number(patch, (uint32_t)size);
+    memcpy(patch->data + patch->size, bytes, size);
+    patch->size += size;
+}
+
+// Add operation as runs of unchanged bytes and differences
+static void put_add(patch_t *patch, uint32_t source_offset, const uint8_t *source, const uint8_t *target,
+                    size_t length) {
+    put_byte(patch, OTA_DELTA_OP_ADD);
+    put_number(patch, source_offset);
+    put_number(patch, (uint32_t)length);
+    size_t i = 0;
+    while (i < length) {
+        size_t zeros = 0;
+        while (i + zeros < length && source[i + zeros] == target[i + zeros]) {
+            zeros++;
+        }
+        size_t start = i + zeros;
+        size_t end = start;
+        while (end < length) {
+            size_t gap = 0;
+            while (end + gap < length && source[end + gap] == target[end + gap]) {
+                gap++;
+            }
+            if (gap >= ZERO_GAP || end + gap == length) {
+                break;
+            }
+            end += gap + 1;
+        }
+        put_number(patch, (uint32_t)zeros);
+        put_number(patch, (uint32_t)(end - start));
+        for (size_t k = start; k < end; k++) {
+            put_byte(patch, (uint8_t)(target[k] - source[k]));
+        }
+        i = end;
+    }
+}
+
+static uint32_t block_hash(const uint8_t *bytes) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MATCH_BYTES; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash >> (32 - INDEX_BITS);
+}
+
+// Length of an add from a match, it continues over changed bytes while half of a window matches
+static size_t add_length(const uint8_t *source, size_t source_left, const uint8_t *target, size_t target_left) {
+    size_t max = min_size(source_left, target_left);
+    size_t length = 0;
+    while (length < max) {
+        size_t window = min_size(EXTEND_WINDOW, max - length);
+        size_t equal = 0;
+        for (size_t i = 0; i < window; i++) {
+            equal += source[length + i] == target[length + i];
+        }
+        if (equal * 2 < window) {
+            break;
+        }
+        length += window;
+    }
+    while (length > 0 && source[length - 1] != target[length - 1]) {
+        length--;
+    }
+    return length;
+}
+
+// Greedy delta: word aligned source blocks in a hash index, add operations from matches, the rest inserted
+static bool delta_encode(patch_t *patch, const image_t *source, const image_t *target) {
+    patch->data = malloc(2 * target->size + 1024);
+    int32_t *index = malloc(sizeof(int32_t) << INDEX_BITS);
+    if (patch->data == NULL || index == NULL) {
+        free(index);
+        return false;
+    }
+    patch->size = 0;
+    put_u32(patch->data, OTA_DELTA_MAGIC);
+    put_u32(patch->data + 4, (uint32_t)source->size);
+    put_u32(patch->data + 8, (uint32_t)target->size);
+    memcpy(patch->data + 12, source->data + source->size - OTA_DELTA_HASH_SIZE, OTA_DELTA_HASH_SIZE);
+    memcpy(patch->data + 12 + OTA_DELTA_HASH_SIZE, target->data + target->size - OTA_DELTA_HASH_SIZE,
+           OTA_DELTA_HASH_SIZE);
+    patch->size = OTA_DELTA_HEADER_SIZE;
+
+    memset(index, 0xFF, sizeof(int32_t) << INDEX_BITS);
+    for (size_t o = 0; o + MATCH_BYTES <= source->size; o += 4) {
+        index[block_hash(source->data + o)] = (int32_t)o;
+    }
+
+    const uint8_t *old = source->data;
+    const uint8_t *new = target->data;
+    size_t n = 0;
+    size_t pending = 0;     // Start of the bytes without a match
+    while (n < target->size) {
+        int32_t match = -1;
+        if (n + MATCH_BYTES <= target->size) {
+            match = index[block_hash(new + n)];
+            if (match >= 0 && memcmp(old + match, new + n, MATCH_BYTES) != 0) {
+                match = -1;
+            }
+        }
+        if (match < 0) {
+            n++;
+            continue;
+        }
+        size_t o = (size_t)match;
+        while (n > pending && o > 0 && old[o - 1] == new[n - 1]) {
+            n--;
+            o--;
+        }
+        size_t length = add_length(old + o, source->size - o, new + n, target->size - n);
+        put_insert(patch, new + pending, n - pending);
+        put_add(patch, (uint32_t)o, old + o, new + n, length);
+        n += length;
+        pending = n;
+    }
+    put_insert(patch, new + pending, target->size - pending);
+    put_byte(patch, OTA_DELTA_OP_END);
+    free(index);
+    return true;
+}
+
+static esp_err_t sim_begin(void *ctx, const ota_delta_header_t *header) {
+    ota_sim_t *sim = ctx;
+    const uint8_t *source_hash = sim->source->data + sim->source->size - OTA_DELTA_HASH_SIZE;
+    if (memcmp(header->source_hash, source_hash, OTA_DELTA_HASH_SIZE) != 0 || header->source_size > SLOT_SIZE) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return header->target_size > SLOT_SIZE ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+static esp_err_t sim_read_source(void *ctx, uint32_t offset, void *buffer, size_t size) {
+    ota_sim_t *sim = ctx;
+    if (offset + size > sim->source->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buffer, sim->source->data + offset, size);
+    sim->source_read += size;
+    return ESP_OK;
+}
+
+static esp_err_t sim_write_target(void *ctx, uint32_t offset, const void *data, size_t size) {
+    ota_sim_t *sim = ctx;
+    if (offset % OTA_DELTA_WINDOW != 0 || offset + size > SLOT_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(sim->target + offset, data, size);
+    return ESP_OK;
+}
+
+// The device saves to NVS, unless it lost power in the request
+static esp_err_t sim_save(void *ctx, const ota_delta_state_t *checkpoint) {
+    ota_sim_t *sim = ctx;
+    if (!sim->reset) {
+        sim->saved = *checkpoint;
+        sim->has_saved = true;
+        sim->saves++;
+    }
+    return ESP_OK;
+}
+
+static bool sim_stop(void *ctx) {
+    return ((ota_sim_t *)ctx)->reset;
+}
+
+// One range request: status and Content-Range, then the body in segments until the link fails
+static esp_err_t sim_fetch(void *ctx, uint32_t offset, uint32_t size) {
+    ota_sim_t *sim = ctx;
+    const ota_link_t *link = sim->link;
+    uint32_t r = mix(++sim->requests, sim->seed);
+    char content_range[48];
+    if (offset >= sim->patch_size && !link->ignore_range) {
+        snprintf(content_range, sizeof(content_range), "bytes */%zu", sim->patch_size);
+        return ota_delta_response(sim->delta, 416, content_range);
+    }
+
+    size_t first = link->ignore_range ? 0 : offset;
+    size_t end = link->ignore_range ? sim->patch_size : min_size((size_t)offset + size, sim->patch_size);
+    snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu", first, end - 1, sim->patch_size);
+    esp_err_t ret = ota_delta_response(sim->delta, link->ignore_range ? 200 : 206,
+                                       link->ignore_range ? NULL : content_range);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    bool drop = link->drop_every > 0 && r % link->drop_every == 0;
+    bool reset = !drop && link->reset_every > 0 && (r >> 8) % link->reset_every == 0;
+    size_t cut = (drop || reset) && end - first > 1 ? first + 1 + (r >> 16) % (end - first - 1) : end;
+    for (size_t pos = first; pos < cut;) {
+        size_t chunk = min_size(1 + mix((uint32_t)pos, sim->seed) % MAX_CHUNK, cut - pos);
+        sim->downloaded += chunk;
+        ret = ota_delta_feed(sim->delta, sim->patch + pos, chunk);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        pos += chunk;
+    }
+    if (cut < end) {
+        sim->drops += drop;
+        sim->resets += reset;
+        sim->reset = reset;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Send cycles until the update is installed or fails, every cycle boots from the NVS checkpoint
+static ota_outcome_t sim_update(ota_sim_t *sim, const image_t *target) {
+    const ota_delta_io_t io = {
+        .begin = sim_begin,
+        .read_source = sim_read_source,
+        .write_target = sim_write_target,
+        .fetch = sim_fetch,
+        .save = sim_save,
+        .stop = sim_stop,
+        .ctx = sim,
+    };
+    ota_outcome_t outcome = { .ret = ESP_FAIL };
+    while (outcome.cycles < MAX_CYCLES) {
+        sim->reset = false;
+        outcome.cycles++;
+        outcome.ret = ota_delta_init(sim->delta, &io, sim->has_saved ? &sim->saved : NULL);
+        if (outcome.ret == ESP_OK) {
+            outcome.ret = ota_delta_download(sim->delta, OTA_RANGE_BYTES, OTA_CYCLE_BYTES);
+        }
+        // A lost connection resumes in the next send cycle, like ota_update_run()
+        if (outcome.ret != ESP_ERR_NOT_FINISHED && outcome.ret != ESP_FAIL) {
+            break;
+        }
+    }
+
+    // The install check compares the written image with the hash of the delta header
+    const ota_delta_header_t *header = &sim->delta->state.header;
+    outcome.image_ok = outcome.ret == ESP_OK && target != NULL && header->target_size == target->size &&
+                       memcmp(sim->target, target->data, target->size) == 0 &&
+                       memcmp(sim->target + target->size - OTA_DELTA_HASH_SIZE, header->target_hash,
+                              OTA_DELTA_HASH_SIZE) == 0;
+    return outcome;
+}
+
+static void sim_init(ota_sim_t *sim, const ota_link_t *link, uint32_t seed, const patch_t *patch,
+                     const image_t *source, uint8_t *slot, ota_delta_t *delta) {
+    memset(sim, 0, sizeof(*sim));
+    sim->link = link;
+    sim->seed = seed;
+    sim->patch = patch->data;
+    sim->patch_size = patch->size;
+    sim->source = source;
+    sim->target = slot;
+    sim->delta = delta;
+    memset(slot, 0xFF, SLOT_SIZE);
+}
+
+static void report_result(cJSON *results, const char *variant, const image_t *target, const patch_t *patch,
+                          const ota_sim_t *sim, const ota_outcome_t *outcome) {
+    uint64_t redownloaded = sim->downloaded > patch->size ? sim->downloaded - patch->size : 0;
+    double ratio = 100.0 * (double)patch->size / (double)target->size;
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "variant", variant);
+    cJSON_AddStringToObject(item, "link", sim->link->name);
+    cJSON_AddNumberToObject(item, "image_bytes", (double)target->size);
+    cJSON_AddNumberToObject(item, "delta_bytes", (double)patch->size);
+    cJSON_AddNumberToObject(item, "delta_percent", ratio);
+    cJSON_AddNumberToObject(item, "cycles", outcome->cycles);
+    cJSON_AddNumberToObject(item, "requests", sim->requests);
+    cJSON_AddNumberToObject(item, "downloaded_bytes", (double)sim->downloaded);
+    cJSON_AddNumberToObject(item, "redownloaded_bytes", (double)redownloaded);
+    cJSON_AddNumberToObject(item, "drops", sim->drops);
+    cJSON_AddNumberToObject(item, "resets", sim->resets);
+    cJSON_AddNumberToObject(item, "checkpoint_saves", sim->saves);
+    cJSON_AddNumberToObject(item, "source_read_bytes", (double)sim->source_read);
+    cJSON_AddNumberToObject(item, "patcher_ram_bytes", sizeof(ota_delta_t));
+    cJSON_AddNumberToObject(item, "result", outcome->ret);
+    cJSON_AddBoolToObject(item, "image_ok", outcome->image_ok);
+    cJSON_AddItemToArray(results, item);
+
+    printf("%-9s %-9s %8zu %8zu %6.2f %6lu %8lu %10llu %9llu %5lu %5lu ", variant, sim->link->name, target->size,
+           patch->size, ratio, (unsigned long)outcome->cycles, (unsigned long)sim->requests,
+           (unsigned long long)sim->downloaded, (unsigned long long)redownloaded, (unsigned long)sim->drops,
+           (unsigned long)sim->resets);
+    if (outcome->image_ok) {
+        printf("ok\n");
+    } else {
+        printf("0x%x\n", outcome->ret);
+    }
+}
+
+// Delta of an image pair over every link, false if a written image differs
+static bool run_pair(cJSON *results, const char *variant, const image_t *source, const image_t *target,
+                     const patch_t *patch, uint32_t seed, uint8_t *slot, ota_delta_t *delta) {
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(s_links) / sizeof(s_links[0]); i++) {
+        ota_sim_t sim;
+        sim_init(&sim, &s_links[i], seed, patch, source, slot, delta);
+        ota_outcome_t outcome = sim_update(&sim, target);
+        report_result(results, variant, target, patch, &sim, &outcome);
+        if (!outcome.image_ok) {
+            printf("Delta update %s over the %s link failed: 0x%x\n", variant, s_links[i].name, outcome.ret);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Bad updates must stop with the expected error and never complete the slot
+static bool run_rejections(cJSON *results, const image_t *source, const image_t *other, const image_t *target,
+                           const patch_t *patch, uint32_t seed, uint8_t *slot, ota_delta_t *delta) {
+    static const ota_link_t wrong_source_link = { "wrong_src", 0, 0, false };
+    struct {
+        const ota_link_t *link;
+        const image_t *source;
+        esp_err_t expected;
+    } cases[] = {
+        { &s_no_range_link, source, ESP_ERR_INVALID_RESPONSE },
+        { &wrong_source_link, other, ESP_ERR_INVALID_VERSION },
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ota_sim_t sim;
+        sim_init(&sim, cases[i].link, seed, patch, cases[i].source, slot, delta);
+        ota_outcome_t outcome = sim_update(&sim, NULL);
+        report_result(results, "shift", target, patch, &sim, &outcome);
+        if (outcome.ret != cases[i].expected) {
+            printf("Delta update over the %s link returned 0x%x, expected 0x%x\n", cases[i].link->name,
+                   outcome.ret, cases[i].expected);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool read_file(const char *path, image_t *image) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    image->data = size > OTA_DELTA_HASH_SIZE ? malloc((size_t)size) : NULL;
+    image->size = image->data ? fread(image->data, 1, (size_t)size, file) : 0;
+    fclose(file);
+    return image->size == (size_t)size && size > OTA_DELTA_HASH_SIZE;
+}
+
+// Delta between two real app images, written for publishing and checked like the synthetic ones
+static bool run_files(cJSON *results, const char *old_path, const char *new_path, uint32_t seed, uint8_t *slot,
+                      ota_delta_t *delta) {
+    image_t source = { 0 };
+    image_t target = { 0 };
+    patch_t patch = { 0 };
+    bool ok = read_file(old_path, &source) && read_file(new_path, &target) && target.size <= SLOT_SIZE &&
+              delta_encode(&patch, &source, &target);
+    if (!ok) {
+        printf("Cannot make a delta from %s to %s\n", old_path, new_path);
+    }
+    const char *delta_path = getenv("TEST_OTA_DELTA");
+    if (ok && delta_path != NULL) {
+        FILE *file = fopen(delta_path, "wb");
+        ok = file != NULL && fwrite(patch.data, 1, patch.size, file) == patch.size;
+        if (file != NULL) {
+            fclose(file);
+        }
+        printf("%s %s\n", ok ? "Delta written to" : "Failed to write the delta to", delta_path);
+    }
+    ok = ok && run_pair(results, "files", &source, &target, &patch, seed, slot, delta);
+    free(source.data);
+    free(target.data);
+    free(patch.data);
+    return ok;
+}
+
+esp_err_t test_ota_run(cJSON *results) {
+    uint32_t seed = getenv("TEST_OTA_SEED") ? (uint32_t)atoi(getenv("TEST_OTA_SEED")) : 1;
+    image_model_t model;
+    image_t source = { 0 };
+    uint8_t *slot = malloc(SLOT_SIZE);
+    ota_delta_t *delta = malloc(sizeof(ota_delta_t));
+    if (slot == NULL || delta == NULL || !model_create(&model, seed) ||
+        !image_build(&source, &model, NULL, NULL, seed)) {
+        free(slot);
+        free(delta);
+        return ESP_ERR_NO_MEM;
+    }
+
+    printf("\nDelta update: %zu byte image, %u byte ranges, %u bytes per cycle, %zu byte patcher\n", source.size,
+           OTA_RANGE_BYTES, OTA_CYCLE_BYTES, sizeof(ota_delta_t));
+    printf("%-9s %-9s %8s %8s %6s %6s %8s %10s %9s %5s %5s %s\n", "variant", "link", "image", "delta", "%", "cycles",
+           "requests", "downloaded", "again", "drops", "reset", "image");
+    bool ok = true;
+    image_t images[sizeof(s_variants) / sizeof(s_variants[0])] = { 0 };
+    patch_t patches[sizeof(s_variants) / sizeof(s_variants[0])] = { 0 };
+    for (size_t i = 0; i < sizeof(s_variants) / sizeof(s_variants[0]); i++) {
+        if (!variant_build(&images[i], &s_variants[i], &model, seed) ||
+            !delta_encode(&patches[i], &source, &images[i])) {
+            ok = false;
+            break;
+        }
+        if (!run_pair(results, s_variants[i].name, &source, &images[i], &patches[i], seed, slot, delta)) {
+            ok = false;
+        }
+    }
+    // The shift delta from a server without ranges, and applied to the unrelated image
+    if (ok && !run_rejections(results, &source, &images[VARIANT_UNRELATED], &images[VARIANT_SHIFT],
+                                  &patches[VARIANT_SHIFT], seed, slot, delta)) {
+        ok = false;
+    }
+
+    const char *old_path = getenv("TEST_OTA_OLD");
+    const char *new_path = getenv("TEST_OTA_NEW");
+    if (old_path != NULL && new_path != NULL && !run_files(results, old_path, new_path, seed, slot, delta)) {
+        ok = false;
+    }
+
+    for (size_t i = 0; i < sizeof(s_variants) / sizeof(s_variants[0]); i++) {
+        free(images[i].data);
+        free(patches[i].data);
+    }
+    model_free(&model);
+    free(source.data);
+    free(slot);
+    free(delta);
+    return ok ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Delta firmware update against a simulated range server
+ *
+ * Builds synthetic 1 MB app images with code words and relocated pointers,
+ * encodes deltas for a small patch, a 1 kB insertion that moves the rest of
+ * the image, a rebuild with many changes and an unrelated image, and applies
+ * them with ota_delta.c through an in-process server that answers range
+ * requests in random chunk sizes. Each delta runs once on a clean link and
+ * once with dropped connections and resets that restart from the saved
+ * checkpoint. Reports the delta size against the image, the cycles and
+ * requests, the re-downloaded bytes and the RAM of the patcher. The run
+ * fails if a written image differs from the new image, or if a server that
+ * ignores the range or a delta for another image is not rejected.
+ *
+ * Environment: TEST_OTA_SEED, TEST_OTA_OLD and TEST_OTA_NEW (app images,
+ * also checked as the "files" variant) with TEST_OTA_DELTA (file for their
+ * delta, the one to publish).
+ *
+ * @param results Array for one result object per variant and link
+ * @return esp_err_t ESP_OK if all checks passed
+ */
+esp_err_t test_ota_run(cJSON *results);
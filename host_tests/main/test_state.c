@@ -0,0 +1,214 @@
+// test_state.c
+// Power loss injection for the system state checkpoints. The NVS writes of
+// the linked code go through the wrappers below (-Wl,--wrap=nvs_set_blob
+// and friends), which can cut the power before or after any write.
+#include "test_state.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "nvs.h"
+#include "system_states.h"
+#include "cycle_pipeline.h"
+
+#define STATE_CYCLES        8
+#define STATE_SEND_CYCLE    3       // Boot count that triggers the send block
+#define STATE_MAX_WRITES    64
+
+// Legacy keys of an installed device, converted by the first init
+#define STATE_LEGACY_BOOT_COUNT 5
+
+// Durable part of the state
+typedef struct {
+    uint8_t stage;
+    bool first_boot;
+    uint32_t boot_count;
+    bool error_flag;
+} state_snapshot_t;
+
+typedef enum {
+    CUT_NONE,
+    CUT_BEFORE,     // The write does not reach flash
+    CUT_AFTER,      // The write reaches flash, the power fails right after it
+} cut_mode_t;
+
+esp_err_t __real_nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t __real_nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t __real_nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length);
+
+static int s_writes;
+static int s_reads;
+static int s_cut_at = -1;
+static cut_mode_t s_cut_mode = CUT_NONE;
+static jmp_buf s_power_fail;
+
+// Expected durable state after every write of the clean run
+static state_snapshot_t s_durable[STATE_MAX_WRITES];
+static bool s_recording;
+
+static state_snapshot_t snapshot(void) {
+    state_snapshot_t s = {
+        .stage = system_state_get_stage(NULL),
+        .first_boot = is_first_boot(),
+        .boot_count = get_boot_count(),
+        .error_flag = get_error_flag(),
+    };
+    return s;
+}
+
+static bool same(const state_snapshot_t *a, const state_snapshot_t *b) {
+    return a->stage == b->stage && a->first_boot == b->first_boot &&
+           a->boot_count == b->boot_count && a->error_flag == b->error_flag;
+}
+
+// Cut the power before the write if requested
+static void write_begin(void) {
+    if (s_cut_mode == CUT_BEFORE && s_writes == s_cut_at) {
+        longjmp(s_power_fail, 1);
+    }
+}
+
+// Count the write and cut the power after it if requested
+static void write_end(bool blob) {
+    if (s_recording && s_writes < STATE_MAX_WRITES) {
+        // The blob holds the cached state, erasing a legacy key after it changes nothing
+        s_durable[s_writes] = (blob || s_writes == 0) ? snapshot() : s_durable[s_writes - 1];
+    }
+    int index = s_writes++;
+    if (s_cut_mode == CUT_AFTER && index == s_cut_at) {
+        longjmp(s_power_fail, 1);
+    }
+}
+
+esp_err_t __wrap_nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    write_begin();
+    esp_err_t ret = __real_nvs_set_blob(handle, key, value, length);
+    write_end(true);
+    return ret;
+}
+
+esp_err_t __wrap_nvs_erase_key(nvs_handle_t handle, const char *key) {
+    if (nvs_find_key(handle, key, NULL) != ESP_OK) {
+        return __real_nvs_erase_key(handle, key);   // Nothing to write
+    }
+    write_begin();
+    esp_err_t ret = __real_nvs_erase_key(handle, key);
+    write_end(false);
+    return ret;
+}
+
+esp_err_t __wrap_nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length) {
+    s_reads++;
+    return __real_nvs_get_blob(handle, key, value, length);
+}
+
+// Start from the separate keys of older firmware
+static esp_err_t seed_legacy_keys(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open("system_state", NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    nvs_erase_all(handle);
+    nvs_set_u8(handle, "first_boot", 1);
+    nvs_set_u32(handle, "boot_count", STATE_LEGACY_BOOT_COUNT);
+    nvs_set_u8(handle, "system_state", 0);
+    ret = nvs_commit(handle);
+    nvs_close(handle);
+    return ret;
+}
+
+// State changes of the wake cycles in main.c, deep sleep keeps the RTC memory
+static void run_cycles(void) {
+    system_state_init();
+    for (int cycle = 0; cycle < STATE_CYCLES; cycle++) {
+        if (get_boot_count() >= STATE_SEND_CYCLE) {
+            reset_boot_counter();
+        }
+        increment_boot_count();
+        if (get_boot_count() >= STATE_SEND_CYCLE) {
+            system_state_set_stage(CYCLE_STAGE_CONNECT, CYCLE_FLAG_SEND);
+            system_state_checkpoint();
+            system_state_set_stage(CYCLE_STAGE_REPORT, CYCLE_FLAG_SEND | CYCLE_FLAG_SENT);
+            if (cycle == STATE_CYCLES / 2) {
+                set_error_flag();
+            }
+        }
+        system_state_set_stage(CYCLE_STAGE_NONE, 0);
+        system_state_checkpoint();
+        system_state_sim_reset(false);
+        system_state_init();
+    }
+}
+
+esp_err_t test_state_run(cJSON *result) {
+    static const state_snapshot_t legacy = {
+        .stage = CYCLE_STAGE_NONE, .first_boot = false, .boot_count = STATE_LEGACY_BOOT_COUNT, .error_flag = false,
+    };
+
+    // Clean run
+    system_state_sim_reset(true);
+    if (seed_legacy_keys() != ESP_OK) {
+        printf("Failed to prepare the system state namespace\n");
+        return ESP_FAIL;
+    }
+    s_writes = 0;
+    s_reads = 0;
+    s_recording = true;
+    run_cycles();
+    s_recording = false;
+    int writes = s_writes;
+    int reads = s_reads;
+    if (writes > STATE_MAX_WRITES) {
+        printf("Too many NVS writes for the power loss test: %d\n", writes);
+        return ESP_FAIL;
+    }
+
+    int failures = 0;
+    int cuts = 0;
+    for (int cut = 0; cut < writes; cut++) {
+        for (int mode = 0; mode < 3; mode++) {
+            // Mode 2 is a software reset before the write, RTC memory keeps the uncommitted changes
+            bool power_loss = mode != 2;
+            system_state_sim_reset(true);
+            seed_legacy_keys();
+            s_writes = 0;
+            s_cut_at = cut;
+            s_cut_mode = (mode == 1) ? CUT_AFTER : CUT_BEFORE;
+            if (setjmp(s_power_fail) == 0) {
+                run_cycles();
+            }
+            state_snapshot_t cached = snapshot();
+            s_cut_mode = CUT_NONE;
+
+            system_state_sim_reset(power_loss);
+            system_state_init();
+            state_snapshot_t got = snapshot();
+            const state_snapshot_t *expected;
+            if (!power_loss) {
+                expected = &cached;
+            } else if (mode == 1) {
+                expected = &s_durable[cut];
+            } else {
+                expected = (cut > 0) ? &s_durable[cut - 1] : &legacy;
+            }
+            cuts++;
+            if (!same(&got, expected)) {
+                failures++;
+                printf("State after %s at write %d: stage %d boot_count %lu error %d, expected %d %lu %d\n",
+                       mode == 0 ? "power loss before" : mode == 1 ? "power loss after" : "reset",
+                       cut, got.stage, (unsigned long)got.boot_count, got.error_flag,
+                       expected->stage, (unsigned long)expected->boot_count, expected->error_flag);
+            }
+        }
+    }
+
+    cJSON_AddNumberToObject(result, "cycles", STATE_CYCLES);
+    cJSON_AddNumberToObject(result, "nvs_writes", writes);
+    cJSON_AddNumberToObject(result, "nvs_reads", reads);
+    cJSON_AddNumberToObject(result, "cut_points", cuts);
+    cJSON_AddNumberToObject(result, "failures", failures);
+    printf("System state: %d cycles, %d NVS writes, %d NVS reads, %d of %d cuts inconsistent\n",
+           STATE_CYCLES, writes, reads, failures, cuts);
+    return failures == 0 ? ESP_OK : ESP_FAIL;
+}
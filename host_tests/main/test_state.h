@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/**
+ * @brief Power loss test of the system state checkpoints
+ *
+ * Runs a few wake cycles of system state changes, starting from the NVS
+ * keys of older firmware, and counts the NVS reads and writes. The cycles
+ * are then repeated with the power failing before and after every NVS
+ * write, and with a software reset at every write. After the restart the
+ * state must be the last checkpoint, after a software reset the state
+ * cached in RTC memory.
+ *
+ * @param result Object for the counts and the failed cut points
+ * @return esp_err_t ESP_OK if the state was consistent after every cut
+ */
+esp_err_t test_state_run(cJSON *result);
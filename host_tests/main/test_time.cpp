@@ -0,0 +1,137 @@
+// test_time.cpp
+// Host check of the Finland time table against the libc time zone.
+#include "test_time.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "time_manager.h"
+#include "time_zone.hpp"
+
+#define TIME_FIRST_YEAR         1970
+#define TIME_LAST_YEAR          2100
+#define TIME_STEP_S             907         // Not a divisor of an hour, every second of the minute gets hit
+#define TIME_CHANGE_WINDOW_S    3600        // Checked every second on both sides of a change
+#define TIME_MAX_REPORTS        10
+
+typedef struct {
+    long checked;
+    long mismatches;
+} time_check_t;
+
+static void mismatch(time_check_t *check, time_t utc, const char *what, const char *expected, const char *actual) {
+    if (check->mismatches++ < TIME_MAX_REPORTS) {
+        printf("Time mismatch at %lld (%s): libc \"%s\", table \"%s\"\n", (long long)utc, what, expected, actual);
+    }
+}
+
+// One UTC time through every conversion of both implementations
+static void check_time(time_check_t *check, time_t utc) {
+    struct tm local_tm;
+    struct tm utc_tm;
+    char expected[32];
+    char actual[32];
+    check->checked++;
+
+    localtime_r(&utc, &local_tm);
+    strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &local_tm);
+    if (tz::format_local(utc, actual, sizeof(actual)) == 0 || strcmp(expected, actual) != 0) {
+        mismatch(check, utc, "local", expected, actual);
+        return;
+    }
+    if (time_manager_utc_offset(utc) != local_tm.tm_gmtoff) {
+        snprintf(expected, sizeof(expected), "%ld", (long)local_tm.tm_gmtoff);
+        snprintf(actual, sizeof(actual), "%d", time_manager_utc_offset(utc));
+        mismatch(check, utc, "offset", expected, actual);
+        return;
+    }
+
+    // Parsing the local text gives the time back, except for the second pass of the repeated hour
+    int64_t parsed = 0;
+    bool repeated = tz::utc_offset(utc - 3600) != tz::utc_offset(utc) && tz::utc_offset(utc) == tz::standard_offset;
+    if (!tz::parse_local(actual, &parsed) || (parsed != utc && !(repeated && parsed == utc - 3600))) {
+        snprintf(expected, sizeof(expected), "%lld", (long long)utc);
+        snprintf(actual, sizeof(actual), "%lld", (long long)parsed);
+        mismatch(check, utc, "parse_local", expected, actual);
+        return;
+    }
+
+    gmtime_r(&utc, &utc_tm);
+    strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%SZ", &utc_tm);
+    if (tz::format_rfc3339(utc, actual, sizeof(actual)) == 0 || strcmp(expected, actual) != 0) {
+        mismatch(check, utc, "rfc3339", expected, actual);
+        return;
+    }
+    if (!tz::parse_rfc3339(actual, &parsed) || parsed != utc) {
+        snprintf(expected, sizeof(expected), "%lld", (long long)utc);
+        snprintf(actual, sizeof(actual), "%lld", (long long)parsed);
+        mismatch(check, utc, "parse_rfc3339", expected, actual);
+    }
+}
+
+// Every second around the spring and autumn changes of a year
+static void check_changes(time_check_t *check, int64_t year) {
+    const int64_t changes[] = { tz::summer_start(year), tz::summer_end(year) };
+    for (int64_t change : changes) {
+        for (int64_t t = change - TIME_CHANGE_WINDOW_S; t < change + TIME_CHANGE_WINDOW_S; t++) {
+            check_time(check, (time_t)t);
+        }
+    }
+}
+
+// The accepted input forms of the RFC 3339 parser
+static void check_parse_forms(time_check_t *check) {
+    static const struct {
+        const char *text;
+        bool valid;
+        int64_t utc;
+    } cases[] = {
+        { "2025-01-01T10:00:00Z", true, 1735725600 },
+        { "2025-01-01t10:00:00z", true, 1735725600 },
+        { "2025-01-01T10:00:00.123456789Z", true, 1735725600 },
+        { "2025-01-01T12:00:00+02:00", true, 1735725600 },
+        { "2025-01-01T07:30:00-02:30", true, 1735725600 },
+        { "2024-02-29T00:00:00Z", true, 1709164800 },
+        { "2025-02-29T00:00:00Z", false, 0 },
+        { "2025-04-31T00:00:00Z", false, 0 },
+        { "2025-01-01T24:00:00Z", false, 0 },
+        { "2025-01-01 10:00:00Z", false, 0 },
+        { "2025-01-01T10:00:00", false, 0 },
+        { "2025-01-01T10:00:00+0200", false, 0 },
+        { "2025-01-01T10:00:00Zjunk", false, 0 },
+        { "", false, 0 },
+    };
+    for (const auto &c : cases) {
+        int64_t utc = 0;
+        bool valid = tz::parse_rfc3339(c.text, &utc);
+        check->checked++;
+        if (valid != c.valid || (valid && utc != c.utc)) {
+            char expected[32];
+            char actual[32];
+            snprintf(expected, sizeof(expected), c.valid ? "%lld" : "invalid", (long long)c.utc);
+            snprintf(actual, sizeof(actual), valid ? "%lld" : "invalid", (long long)utc);
+            mismatch(check, (time_t)c.utc, c.text, expected, actual);
+        }
+    }
+}
+
+esp_err_t test_time_run(cJSON *result) {
+    // The reference is the libc time zone of the firmware TZ string
+    time_manager_set_finland_timezone();
+
+    time_check_t check = {};
+    time_t end = (time_t)(tz::days_from_civil(TIME_LAST_YEAR + 1, 1, 1) * 86400);
+    for (time_t t = (time_t)(tz::days_from_civil(TIME_FIRST_YEAR, 1, 1) * 86400); t < end; t += TIME_STEP_S) {
+        check_time(&check, t);
+    }
+    for (int64_t year = TIME_FIRST_YEAR + 1; year <= TIME_LAST_YEAR; year++) {
+        check_changes(&check, year);
+    }
+    check_parse_forms(&check);
+
+    cJSON_AddNumberToObject(result, "checked", check.checked);
+    cJSON_AddNumberToObject(result, "mismatches", check.mismatches);
+
+    printf("\nTime table: %ld times checked against libc %d-%d, %ld mismatches\n", check.checked,
+           TIME_FIRST_YEAR, TIME_LAST_YEAR, check.mismatches);
+    return check.mismatches == 0 ? ESP_OK : ESP_FAIL;
+}
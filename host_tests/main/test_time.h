@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Finland time table against the libc time zone
+ *
+ * Compares the local time, the RFC 3339 time, the UTC offset and the parsing
+ * of time_zone.hpp with localtime_r(), gmtime_r() and mktime() under the
+ * firmware TZ string every 907 s from 1970 to 2100 and every second in the
+ * two hours around each daylight saving time change. The run fails on any
+ * difference.
+ *
+ * @param result Object for the checked times and mismatches
+ * @return esp_err_t ESP_OK if every time matched
+ */
+esp_err_t test_time_run(cJSON *result);
+
+#ifdef __cplusplus
+}
+#endif
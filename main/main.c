@@ -1,16 +1,19 @@
 #include <stdio.h>
 #include "esp_log.h"
-#include "esp_sleep.h"
-#include "esp_pm.h" 
+#include "sdkconfig.h"
 #include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_sleep.h"
 #include "soc/rtc_cntl_reg.h"
+#endif
 #include <time.h>
 #include <sys/time.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include "cJSON.h"
 
 #include "power_management.h"
@@ -25,416 +28,521 @@
 #include "time_manager.h"
 #include "battery_monitor.h"
 #include "firebase_api.h"
+#include "https_client.h"
 #include "config_manager.h"
+#include "phase_profiler.h"
+#include "heap_monitor.h"
+#include "json_arena.h"
+#include "send_scheduler.h"
+#include "cycle_pipeline.h"
+#include "energy_ledger.h"
+#include "wake_planner.h"
+#include "ota_update.h"
 
 
 static const char *TAG = "main";
 
-// Main function
-void app_main(void)
-{   
-    #if !SYSTEM_LOGGING
-        ESP_LOGI(TAG, "Logging is disabled");
-        ESP_LOGI(TAG, "Program started");
-        esp_log_level_set("*", ESP_LOG_NONE);
-    #endif
+#if CONFIG_IDF_TARGET_LINUX
+#define SIM_DEFAULT_CYCLES  288     // One day of 5 minute wake cycles
+#define SCAN_WAIT_MS(ms)    sim_scaled_ms(ms)   // Scan waits on the simulated clock
+#else
+#define SCAN_WAIT_MS(ms)    (ms)
+#endif
 
-    // Save start time and trigger time
-    int64_t start_time = esp_timer_get_time();
-    vTaskDelay(pdMS_TO_TICKS(100)); // Give time for NVS to save
-
-    // Variables
-    esp_err_t ret;
-    char log_buf[64];
-    bool network_initialized = false;
-    bool data_from_storage_sent = false;
-    bool first_boot = false;
-    bool error = false;
-    //WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);
-    
-    // Power management initialization
-    ESP_ERROR_CHECK(power_management_init());
+// Ask the send scheduler whether the stored data is uploaded in this cycle
+static bool should_send_data(uint32_t boot_count)
+{
+    uint32_t pending_bytes = 0;
+    storage_get_pending_bytes(&pending_bytes);
     
-    // Initialize battery monitor
-    ESP_ERROR_CHECK(battery_monitor_init());
-    
-    // Time manager initialization
-    time_manager_set_finland_timezone();
+    battery_info_t battery;
+    int battery_level = (battery_monitor_read(&battery) == ESP_OK) ? battery.level : -1;
     
-    // Storage initialization
-    ESP_ERROR_CHECK(storage_init());
-    ESP_ERROR_CHECK(system_state_init());
+    send_decision_t decision = send_scheduler_evaluate(boot_count, pending_bytes, battery_level);
+    storage_log(LOG_SEND_DECISION, decision, (int)boot_count, (int)pending_bytes, battery_level);
+    return SEND_DECISION_IS_SEND(decision);
+}
 
-    // Get the current system state
-    system_state_t current_state = get_system_state();
-    
-    // For debugging, add a log about the current state
-    snprintf(log_buf, sizeof(log_buf), "Current system state: %d", current_state);
-    storage_append_log(log_buf);
+// Connection of this boot, lost on every reset
+typedef struct {
+    bool network_initialized;
+    bool time_synced;
+    bool upload_done;           // The upload reached Firestore, also with nothing to send
+    bool local_fault;           // Radio, NVS or file system failed, a new image fails its self-test
+    int64_t upload_start_time;
+} cycle_session_t;
 
-    // Counter checking
-    uint32_t boot_count = get_boot_count();
-    sniprintf(log_buf, sizeof(log_buf), "Boot count before work cycle: %lu", boot_count);
-    storage_append_log(log_buf);
+static cycle_session_t s_session;
+
+// Logs are sent after an upload or an error
+static bool logs_wanted(const cycle_context_t *ctx)
+{
+#if DISCORD_LOGGING
+    return (ctx->flags & (CYCLE_FLAG_SENT | CYCLE_FLAG_ERROR)) != 0;
+#else
+    (void)ctx;
+    return false;
+#endif
+}
+
+// No samples before the first boot has set the clock
+static bool scan_needed(const cycle_context_t *ctx)
+{
+    return !is_first_boot();
+}
+
+// Scan the sensors, their callbacks store the measurements
+static esp_err_t stage_scan(cycle_context_t *ctx)
+{
+    storage_log(LOG_DATA_COLLECTION_START);
+    
+    // Declaration of variables for the retry mechanism
+    const int MAX_SCAN_ATTEMPTS = 3;
+    int scan_attempt = 0;
+    const int TOTAL_SENSORS = sensors_get_total_count();
+    bool all_sensors_received = false;
     
-    // Processing system states
-    switch (current_state) {
-        case STATE_FIRST_BLOCK_RECOVERY:
-            storage_append_log("Entering first block recovery mode");
-            goto first_block_init;
+    // Cycle of repeated attempts to scan
+    while (scan_attempt < MAX_SCAN_ATTEMPTS && !all_sensors_received && !cycle_stage_expired()) {
+        if (scan_attempt > 0) {
+            ESP_LOGI(TAG, "Starting scan attempt %d of %d", scan_attempt + 1, MAX_SCAN_ATTEMPTS);
+            storage_log(LOG_SCAN_RESTART);
             
-        case STATE_SECOND_BLOCK_RECOVERY:
-            storage_append_log("Entering second block recovery mode");
-            goto second_block_init;
+            // Stop the previous scan and reinitialize the sensors
+            sensors_deinit();
             
-        #if DISCORD_LOGGING
-            case STATE_THIRD_BLOCK_RECOVERY:
-                storage_append_log("Entering third block recovery mode");
-                goto third_block_init;
-        #endif
+            // Reset the sensor status
+            sensors_reset_status();
+            // Reset the data received flag
+            sensors_reset_data_received_flag();
             
-        case STATE_NORMAL:
-        default:
-            // Continue normal execution //
-            break;
-    }
-
-    // --- BLOCK 1: Special operations for the first boot ---
-    if (is_first_boot()) {
-        first_boot = true; 
-
-        storage_append_log("First boot operations");
-        
-        // Setting the state for the first block
-        set_system_state(STATE_FIRST_BLOCK_RECOVERY);
-        ESP_ERROR_CHECK(storage_sync());
-        vTaskDelay(pdMS_TO_TICKS(500));
-
-first_block_init:
-        // Modem initialization for the first message
-        ret = gsm_modem_init();
-        if (ret != ESP_OK) {
-            storage_append_log("GSM modem init failed in first boot");
-            error = true;
-            unsuccessful_init(TAG);
-        } else {
-            network_initialized = true;
-
-            // Add time synchronization
-            time_t network_time = gsm_get_network_time();
-            if (network_time > 0) {
-                time_manager_set_from_timestamp(network_time); // Synchronize time
-            } else {
-                storage_append_log("Failed to synchronize time with NTP");
-                error = true;
-            }
+            vTaskDelay(pdMS_TO_TICKS(SCAN_WAIT_MS(500))); // Small pause between attempts
         }
-
-        // Setting the normal state
-        set_system_state(STATE_NORMAL);
-        storage_sync();
-        vTaskDelay(pdMS_TO_TICKS(500));
-
-        // Discord API initialization for the first message
-        ret = sending_report_to_discord();
+        
+        // Sensors initialization, a radio that does not start fails the stage and the cycle goes on
+        esp_err_t ret = sensors_init();
         if (ret != ESP_OK) {
-            storage_append_log("Failed to send first boot message");
-            error = true;
+            ESP_LOGE(TAG, "Sensor initialization failed: %s", esp_err_to_name(ret));
+            s_session.local_fault = true;
+            sensors_deinit();
+            return ret;
         }
         
-        // Mark first boot as completed
-        mark_first_boot_completed();
-        storage_append_log("First boot completed");
-    }
-    
-// --- BLOCK 2: Data collection (for all cycles) ---
-// data_collection:
-    // Mark that there was an error in the previous cycle
-    bool error_in_prev_cycle = get_error_flag();    
-    if(!error_in_prev_cycle) {
-        storage_append_log("Starting data collection");
-        
-        // Declaration of variables for the retry mechanism
-        const int MAX_SCAN_ATTEMPTS = 3;
-        int scan_attempt = 0;
-        const int TOTAL_SENSORS = sensors_get_total_count();
-        bool all_sensors_received = false;
+        // Waiting for data
+        const int MAX_WAIT_TIME_MS = 10000;
+        int waited_ms = 0;
+        const int CHECK_INTERVAL_MS = 500;
         
-        // Cycle of repeated attempts to scan
-        while (scan_attempt < MAX_SCAN_ATTEMPTS && !all_sensors_received) {
-            if (scan_attempt > 0) {
-                ESP_LOGI(TAG, "Starting scan attempt %d of %d", scan_attempt + 1, MAX_SCAN_ATTEMPTS);
-                storage_append_log("Restarting sensor scan");
-                
-                // Stop the previous scan and reinitialize the sensors
-                sensors_deinit();
-                
-                // Reset the sensor status
-                sensors_reset_status();
-                // Reset the data received flag
-                sensors_reset_data_received_flag();
-                
-                vTaskDelay(pdMS_TO_TICKS(500)); // Small pause between attempts
-            }
-            
-            // Sensors initialization 
-            ESP_ERROR_CHECK(sensors_init());
-            
-            // Waiting for data
-            const int MAX_WAIT_TIME_MS = 10000;
-            int waited_ms = 0;
-            const int CHECK_INTERVAL_MS = 500;
+        // Wait until all sensors have sent data or the timeout expires
+        phase_begin(PHASE_BLE_SCAN);
+        while (sensors_get_received_count() < TOTAL_SENSORS && waited_ms < MAX_WAIT_TIME_MS &&
+               !cycle_stage_expired()) {
+            vTaskDelay(pdMS_TO_TICKS(SCAN_WAIT_MS(CHECK_INTERVAL_MS)));
+            waited_ms += CHECK_INTERVAL_MS;
             
-            // Wait until all sensors have sent data or the timeout expires
-            while (sensors_get_received_count() < TOTAL_SENSORS && waited_ms < MAX_WAIT_TIME_MS) {
-                vTaskDelay(pdMS_TO_TICKS(CHECK_INTERVAL_MS));
-                waited_ms += CHECK_INTERVAL_MS;
-                
-                // Log progress every 2.5 seconds
-                if (waited_ms % 2500 == 0) {
-                    ESP_LOGI(TAG, "Waiting for sensors: %d/%d received, waited %d ms", 
-                             sensors_get_received_count(), TOTAL_SENSORS, waited_ms);
-                }
+            // Log progress every 2.5 seconds
+            if (waited_ms % 2500 == 0) {
+                ESP_LOGI(TAG, "Waiting for sensors: %d/%d received, waited %d ms", 
+                         sensors_get_received_count(), TOTAL_SENSORS, waited_ms);
             }
-            
-            // Check if all sensors are detected
-            all_sensors_received = (sensors_get_received_count() == TOTAL_SENSORS);
-            
-            if (!all_sensors_received) {
-                char log_message[64];
-                snprintf(log_message, sizeof(log_message), "Incomplete scan: %d/%d sensors, attempt %d", 
-                        sensors_get_received_count(), TOTAL_SENSORS, scan_attempt + 1);
-                storage_append_log(log_message);
-                ESP_LOGW(TAG, "%s", log_message);
-            }
-            
-            scan_attempt++;
         }
         
-        // Write to log information about received sensors
-        if (!sensors_any_data_received()) {
-            storage_append_log("Failed to receive any sensor data");
-            error = true;
-        } else {
-            char log_message[64];
-            snprintf(log_message, sizeof(log_message), "Received data from %d/%d sensors after %d attempts", 
-                    sensors_get_received_count(), TOTAL_SENSORS, scan_attempt);
-            storage_append_log(log_message);
-            ESP_LOGI(TAG, "%s", log_message);
-            
-            if (sensors_get_received_count() == TOTAL_SENSORS) {
-                ESP_LOGI(TAG, "Successfully received data from all sensors");
-            } else {
-                ESP_LOGW(TAG, "Some sensors did not respond: %d/%d received", 
-                         sensors_get_received_count(), TOTAL_SENSORS);
-            }
-            
-            // Check data reception through the sensors function
-            if (!sensors_is_data_received()) {
-                sensors_set_data_received();
-            }
+        phase_end(PHASE_BLE_SCAN);
+        
+        // Check if all sensors are detected
+        all_sensors_received = (sensors_get_received_count() == TOTAL_SENSORS);
+        
+        if (!all_sensors_received) {
+            storage_log(LOG_SCAN_INCOMPLETE, sensors_get_received_count(), TOTAL_SENSORS, scan_attempt + 1);
+            ESP_LOGW(TAG, "Incomplete scan: %d/%d sensors, attempt %d", 
+                    sensors_get_received_count(), TOTAL_SENSORS, scan_attempt + 1);
         }
-
-        // Increment the counter 
-        ESP_ERROR_CHECK(increment_boot_count());
-          
-        storage_append_log("Done");
-
+        
+        scan_attempt++;
+    }
+    
+    // Deinitialization of sensors
+    sensors_deinit();
+    
+    // Write to log information about received sensors
+    if (!sensors_any_data_received()) {
+        storage_log(LOG_NO_SENSOR_DATA);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    storage_log(LOG_SCAN_RESULT, sensors_get_received_count(), TOTAL_SENSORS, scan_attempt);
+    ESP_LOGI(TAG, "Received data from %d/%d sensors after %d attempts", 
+            sensors_get_received_count(), TOTAL_SENSORS, scan_attempt);
+    
+    if (sensors_get_received_count() == TOTAL_SENSORS) {
+        ESP_LOGI(TAG, "Successfully received data from all sensors");
     } else {
+        ESP_LOGW(TAG, "Some sensors did not respond: %d/%d received", 
+                 sensors_get_received_count(), TOTAL_SENSORS);
+    }
+    
+    // Check data reception through the sensors function
+    if (!sensors_is_data_received()) {
+        sensors_set_data_received();
+    }
+    return ESP_OK;
+}
+
+// Every cycle after the first boot is counted
+static bool persist_needed(const cycle_context_t *ctx)
+{
+    return !is_first_boot();
+}
 
-        storage_append_log("Error in previous cycle was detected, skipping data collection");
-        error = true;
+// Count the cycle, the measurements are already stored
+static esp_err_t stage_persist(cycle_context_t *ctx)
+{
+    esp_err_t ret = increment_boot_count();
+    storage_log(LOG_DONE);
+    if (ret != ESP_OK) {
+        s_session.local_fault = true;
     }
+    return ret;
+}
 
-    boot_count = get_boot_count();
+// Decide whether the stored data is uploaded in this cycle
+static esp_err_t stage_decide(cycle_context_t *ctx)
+{
+    if (is_first_boot()) {
+        storage_log(LOG_FIRST_BOOT_START);
+    } else if (ota_update_pending_verify() || should_send_data(get_boot_count())) {
+        // New firmware uploads on every wake until an upload confirms it
+        storage_log(LOG_SENDING_DATA);
+        ctx->flags |= CYCLE_FLAG_SEND;
+    }
+    return ESP_OK;
+}
 
-// --- BLOCK 3: Send accumulated data if target value is reached ---
-    if (boot_count >= SEND_DATA_CYCLE) {
-        storage_append_log("Sending accumulated data");
+// Logs are the last stage that uses the network
+static bool connect_needed(const cycle_context_t *ctx)
+{
+    return !s_session.network_initialized && cycle_stage_pending(ctx, CYCLE_STAGE_LOGS) &&
+           ((ctx->flags & CYCLE_FLAG_SEND) || is_first_boot() || logs_wanted(ctx));
+}
 
-        // Setting the state for the second block
-        set_system_state(STATE_SECOND_BLOCK_RECOVERY);
-        ESP_ERROR_CHECK(storage_sync());
-        vTaskDelay(pdMS_TO_TICKS(500));
+// Modem initialization, on failure the data stays stored and the cycle goes to sleep
+static esp_err_t stage_connect(cycle_context_t *ctx)
+{
+    s_session.upload_start_time = esp_timer_get_time();
+    esp_err_t ret = gsm_modem_init();
+    if (ret == ESP_OK) {
+        s_session.network_initialized = true;
+        return ESP_OK;
+    }
+    
+    if (is_first_boot()) {
+        storage_log(LOG_MODEM_INIT_FAILED_FIRST_BOOT);
+    } else if (ctx->flags & CYCLE_FLAG_SEND) {
+        storage_log(LOG_MODEM_INIT_FAILED_DATA);
+    } else {
+        storage_log(LOG_MODEM_INIT_FAILED_LOGS);
+    }
+    return ret;
+}
 
-second_block_init:
-        // Modem initialization for data sending
-        ret = gsm_modem_init();
-        if (ret != ESP_OK) {
-            storage_append_log("GSM modem init failed for data sending");
-            error = true;
-            unsuccessful_init(TAG);
-        } else {
-            network_initialized = true;
-        }
+static bool sync_time_needed(const cycle_context_t *ctx)
+{
+    return s_session.network_initialized && !s_session.time_synced;
+}
 
-        // Add time synchronization
-        time_t network_time = gsm_get_network_time();
-        if (network_time > 0) {
-            time_manager_set_from_timestamp(network_time); // Synchronize time
-        } else {
-            storage_append_log("Failed to synchronize time with NTP");
-            error = true;
-        }
+// Add time synchronization
+static esp_err_t stage_sync_time(cycle_context_t *ctx)
+{
+    time_t network_time = gsm_get_network_time();
+    if (network_time <= 0) {
+        storage_log(LOG_TIME_SYNC_FAILED);
+        return ESP_FAIL;
+    }
+    s_session.time_synced = true;
+    wake_planner_clock_sync(network_time); // Drift of the RTC since the last sync, before the clock is set
+    return time_manager_set_from_timestamp(network_time); // Synchronize time
+}
 
-        // Setting the normal state
-        set_system_state(STATE_NORMAL);
-        ESP_ERROR_CHECK(storage_sync());
-        vTaskDelay(pdMS_TO_TICKS(500));
+static bool upload_needed(const cycle_context_t *ctx)
+{
+    return s_session.network_initialized && (ctx->flags & CYCLE_FLAG_SEND);
+}
 
-        // Firebase API initialization 
-        ret = firebase_init();
-        if (ret != ESP_OK) {
-            storage_append_log("Firebase init failed for data sending");
-            error = true;
-            unsuccessful_init(TAG);
-        }
+// Send the stored files, every commit deletes its files so a resumed upload sends only the rest
+static esp_err_t stage_upload(cycle_context_t *ctx)
+{
+    // Firebase API initialization 
+    esp_err_t ret = firebase_init();
+    if (ret != ESP_OK) {
+        storage_log(LOG_FIREBASE_INIT_FAILED);
+        return ret;
+    }
     
-        // Getting measurements from storage and sending them
-        if (network_initialized) {
-            // Send data from all sensors to the server
-            ret = send_all_sensor_measurements_to_firebase();
-            
-            if (ret == ESP_OK) {
-                // All files sent successfully
-                storage_append_log("All sensor files sent successfully");
-                ESP_ERROR_CHECK(reset_boot_counter());
-                data_from_storage_sent = true;
-            } else if (ret == ESP_ERR_INVALID_STATE) {
-                // Some files were sent
-                storage_append_log("Some sensor files were not sent");
-                data_from_storage_sent = true;
-            } else if (ret == ESP_ERR_NOT_FOUND) {
-                // Files not found
-                storage_append_log("No sensor files found");
-                error = true;
-            } else {
-                // General error
-                storage_append_log("Failed to send any files");
-                error = true;
-            }
-        }
-
-        // Discord message about battery status
-        ret = sending_report_to_discord();
-        if (ret != ESP_OK) {
-            storage_append_log("Failed to send message about battery status");
-            error = true;
-        }
-            
-        storage_append_log("Done");
-        
+    phase_begin(PHASE_UPLOAD);
+    ret = send_all_sensor_measurements_to_firebase();
+    phase_end(PHASE_UPLOAD);
+    
+    s_session.upload_done = (ret == ESP_OK || ret == ESP_ERR_INVALID_STATE || ret == ESP_ERR_NOT_FOUND);
+    
+    // Modem on time of the upload, the scheduler avoids early uploads on a slow link
+    if (ret == ESP_OK || ret == ESP_ERR_INVALID_STATE) {
+        send_scheduler_record_upload((uint32_t)((esp_timer_get_time() - s_session.upload_start_time) / 1000));
     }
     
-// --- BLOCK 4: Terminate the loop and send logs ---
-// end_cycle:
-    // Deinitialization of sensors
-    sensors_deinit();
-
-    // Safe string formatting with boot count
-    int written = snprintf(log_buf, sizeof(log_buf), "Final boot count: %" PRIu32, get_boot_count());
-    if (written < 0 || written >= (int)sizeof(log_buf)) {
-        ESP_LOGE(TAG, "Error formatting boot count log");
-        storage_append_log("Error logging final boot count");
-        error = true;
+    if (ret == ESP_OK) {
+        // All files sent successfully
+        storage_log(LOG_UPLOAD_ALL_SENT);
+        ctx->flags |= CYCLE_FLAG_SENT;
+        return reset_boot_counter();
+    } else if (ret == ESP_ERR_INVALID_STATE) {
+        // Some files were sent
+        storage_log(LOG_UPLOAD_PARTIAL);
+        ctx->flags |= CYCLE_FLAG_SENT;
+        return ESP_OK;
+    } else if (ret == ESP_ERR_NOT_FOUND) {
+        // Files not found
+        storage_log(LOG_UPLOAD_NO_FILES);
     } else {
-        storage_append_log(log_buf);
+        // General error
+        storage_log(LOG_UPLOAD_FAILED);
+    }
+    return ret;
+}
+
+static bool report_needed(const cycle_context_t *ctx)
+{
+    return s_session.network_initialized && ((ctx->flags & CYCLE_FLAG_SEND) || is_first_boot());
+}
+
+// Discord message about battery status, the first one announces the device
+static esp_err_t stage_report(cycle_context_t *ctx)
+{
+    bool first_boot = is_first_boot();
+    esp_err_t ret = sending_report_to_discord();
+    if (ret != ESP_OK) {
+        storage_log(first_boot ? LOG_FIRST_BOOT_MESSAGE_FAILED : LOG_REPORT_FAILED);
     }
     
+    if (first_boot) {
+        // Mark first boot as completed
+        mark_first_boot_completed();
+        storage_log(LOG_FIRST_BOOT_DONE);
+    }
+    return ret;
+}
+
+// Firmware updates use the connection of a send cycle, the check needs the synchronized time
+static bool ota_needed(const cycle_context_t *ctx)
+{
+    return s_session.network_initialized && s_session.time_synced && (ctx->flags & CYCLE_FLAG_SEND) &&
+           ota_update_due();
+}
+
+// Download the next part of a firmware delta, the rest resumes in a later send cycle
+static esp_err_t stage_ota(cycle_context_t *ctx)
+{
+    esp_err_t ret = ota_update_run();
+    return (ret == ESP_ERR_NOT_FINISHED) ? ESP_OK : ret;
+}
+
+static bool logs_needed(const cycle_context_t *ctx)
+{
+    return s_session.network_initialized && logs_wanted(ctx);
+}
+
+// Sending logs if data was sent or a stage failed
+static esp_err_t stage_logs(cycle_context_t *ctx)
+{
+    storage_log(LOG_SENDING_LOGS);
     
-    // Sending logs if data was sent
-    #if DISCORD_LOGGING
-        if (data_from_storage_sent || error) {
-            storage_append_log("Sending logs");
-
-            // Setting the state for the third block
-            set_system_state(STATE_THIRD_BLOCK_RECOVERY);
-            ESP_ERROR_CHECK(storage_sync());
-            vTaskDelay(pdMS_TO_TICKS(500));
-
-    third_block_init:
-            // Only initialize modem if not already initialized
-            if (!network_initialized) {
-                // Modem initialization for logs sending
-                ret = gsm_modem_init();
-                if (ret != ESP_OK) {
-                    storage_append_log("GSM modem init failed for logs");
-                    error = true;
-                    goto sleep_prepare;
-                } else {
-                    network_initialized = true;
-
-                    // Add time synchronization
-                    time_t network_time = gsm_get_network_time();
-                    if (network_time > 0) {
-                        time_manager_set_from_timestamp(network_time); // Synchronize time
-                    } else {
-                        storage_append_log("Failed to synchronize time with NTP");
-                        error = true;
-                    }
-                }
-            }
+    // Discord API initialization for logs sending
+    esp_err_t ret = discord_init();
+    if (ret != ESP_OK) {
+        storage_log(LOG_DISCORD_INIT_FAILED_LOGS);
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Sending logs to Discord");
+    storage_log(LOG_SENDING_LOGS_DISCORD);
+    send_logs_with_task_retries(3);
+    return ESP_OK;
+}
 
-            // Setting the normal state
-            set_system_state(STATE_NORMAL);
-            ESP_ERROR_CHECK(storage_sync());
-            vTaskDelay(pdMS_TO_TICKS(500));
-            
-            // Discord API initialization for logs sending
-            ret = discord_init();
-            if (ret != ESP_OK) {
-                storage_append_log("Discord API init failed for logs");
-                error = true;
-                gsm_modem_deinit();
-                goto sleep_prepare;
-            } else {
-                ESP_LOGI(TAG, "Sending logs to Discord");
-                storage_append_log("Sending logs to Discord");
-                send_logs_with_task_retries(3);
-            }
-        }
-    #endif
+// Close the connection and write the buffered log records before sleep
+static esp_err_t stage_sleep(cycle_context_t *ctx)
+{
+    storage_log(LOG_FINAL_BOOT_COUNT, (int)get_boot_count());
     
-    esp_err_t clear_ret = clear_discord_logs();
-    if (clear_ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to clear Discord logs");
-    } else {
-        ESP_LOGI(TAG, "Discord logs cleared successfully");
+    // Close pooled HTTPS connections while the network is still up
+    if (s_session.network_initialized) {
+        send_scheduler_record_csq(gsm_modem_get_signal_quality());
+        https_client_log_stats();
+        https_client_close_all();
+        gsm_modem_deinit();
+        s_session.network_initialized = false;
     }
+    
+    // Writing the buffered log records and synchronizing the file system before sleep
+    phase_begin(PHASE_LOG_FLUSH);
+    storage_log_flush();
+    esp_err_t ret = storage_sync();
+    phase_end(PHASE_LOG_FLUSH);
+    if (ret != ESP_OK) {
+        s_session.local_fault = true;
+    }
+    return ret;
+}
 
+// Stages of the wake cycle, the order, resume flags and budgets are in CYCLE_STAGES.
+// The abort hook stops the blocking modem calls of a stage that ran out of time.
+static const cycle_stage_ops_t s_cycle_stages[CYCLE_STAGE_COUNT] = {
+    [CYCLE_STAGE_SCAN]      = { scan_needed,      stage_scan,      NULL },
+    [CYCLE_STAGE_PERSIST]   = { persist_needed,   stage_persist,   NULL },
+    [CYCLE_STAGE_DECIDE]    = { NULL,             stage_decide,    NULL },
+    [CYCLE_STAGE_CONNECT]   = { connect_needed,   stage_connect,   gsm_modem_abort },
+    [CYCLE_STAGE_SYNC_TIME] = { sync_time_needed, stage_sync_time, gsm_modem_abort },
+    [CYCLE_STAGE_UPLOAD]    = { upload_needed,    stage_upload,    NULL },
+    [CYCLE_STAGE_REPORT]    = { report_needed,    stage_report,    NULL },
+    [CYCLE_STAGE_OTA]       = { ota_needed,       stage_ota,       NULL },
+    [CYCLE_STAGE_LOGS]      = { logs_needed,      stage_logs,      NULL },
+    [CYCLE_STAGE_SLEEP]     = { NULL,             stage_sleep,     NULL },
+};
+
+// One wake cycle, returns the time to sleep in microseconds
+static int64_t wake_cycle(void)
+{   
+    #if !SYSTEM_LOGGING
+        ESP_LOGI(TAG, "Logging is disabled");
+        ESP_LOGI(TAG, "Program started");
+        esp_log_level_set("*", ESP_LOG_NONE);
+    #endif
 
-    // Final deinitialization of GSM modem
-    if (first_boot && network_initialized) {
-        gsm_modem_deinit();
-    } else if (network_initialized && data_from_storage_sent) {
-        gsm_modem_deinit();
+    // Save start time and trigger time
+    int64_t start_time = esp_timer_get_time();
+    memset(&s_session, 0, sizeof(s_session));
+    //WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);
+    
+    phase_begin(PHASE_INIT);
+    
+    // Power management initialization
+    ESP_ERROR_CHECK(power_management_init());
+    
+    // Initialize battery monitor and measure once for the whole cycle, before the modem load
+    ESP_ERROR_CHECK(battery_monitor_init());
+    if (battery_monitor_update() != ESP_OK) {
+        ESP_LOGW(TAG, "Battery measurement failed");
     }
     
-    set_system_state(STATE_NORMAL);
+    // Time manager initialization, the epoch offset stamps the samples of this wake
+    time_manager_set_finland_timezone();
+    time_manager_update_epoch_offset();
     
-#if DISCORD_LOGGING
-    // Preparing for sleep
-    sleep_prepare:
-#endif
+    // Storage initialization
+    ESP_ERROR_CHECK(storage_init());
+    ESP_ERROR_CHECK(system_state_init());
+    if (send_scheduler_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Send scheduler uses the default policy");
+    }
+    if (energy_ledger_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Energy ledger not loaded");
+    }
+    if (wake_planner_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Wake planner not initialized, sleeping the fixed interval");
+    }
+    if (ota_update_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Firmware update state not loaded");
+    }
+    phase_end(PHASE_INIT);
 
-    // Synchronizing the file system before sleep to ensure the saving of all data
-    ESP_ERROR_CHECK(storage_sync());
+    // Counter checking
+    storage_log(LOG_BOOT_COUNT_START, (int)get_boot_count());
+    
+    // Scan, upload and report, resuming at the stage a reset interrupted
+    cycle_context_t cycle;
+    esp_err_t ret = cycle_pipeline_run(s_cycle_stages, &cycle);
+    if (ret != ESP_OK) {
+        // The next wake may repeat stages of this cycle, sleeping is still better than a restart
+        ESP_LOGE(TAG, "Cycle state not committed: %s", esp_err_to_name(ret));
+        storage_log(LOG_CYCLE_COMMIT_FAILED, ret);
+        storage_log_flush();
+        s_session.local_fault = true;
+    }
+    
+    // New firmware is kept after an upload and restarts into the previous one on a local fault.
+    // A failed connection or upload is no verdict on the image, it stays pending.
+    ota_update_cycle_end(s_session.local_fault ? OTA_CYCLE_FAULT :
+                         s_session.upload_done ? OTA_CYCLE_HEALTHY : OTA_CYCLE_OFFLINE);
+    
+    // Phase durations and heap worst values of this cycle into the rolling statistics
+    phase_profiler_cycle_end();
+    heap_monitor_cycle_end();
     
-    // Calculate execution time and remaining sleep time
+    // Calculate execution time and the sleep until the next wake slot
     int64_t current_time = esp_timer_get_time();
     int64_t execution_time = current_time - start_time;
-    int64_t sleep_time = TRIGGER_INTERVAL - execution_time + COMPENSATION_INTERVAL;
-    if (sleep_time < 0) {
-        sleep_time = 0;
+    wake_plan_t plan;
+    ret = wake_planner_next_sleep(&plan);
+    if (ret != ESP_OK) {
+        // Without a plan the device sleeps the fixed interval
+        ESP_LOGE(TAG, "Wake planner failed: %s", esp_err_to_name(ret));
+        storage_log(LOG_WAKE_PLAN_FAILED, ret);
+        storage_log_flush();
+        memset(&plan, 0, sizeof(plan));
+        plan.sleep_us = TRIGGER_INTERVAL;
     }
+    int64_t sleep_time = plan.sleep_us;
+    if (plan.skipped > 0) {
+        // The log was flushed by the sleep stage, this record needs its own write
+        storage_log(LOG_WAKE_SLOTS_SKIPPED, (int)plan.skipped, (int)(sleep_time / 1000000));
+        storage_log_flush();
+    }
+    
+    // Charge of the cycle and the coming sleep into the energy ledger
+    uint32_t awake_ms = 0;
+    float awake_mah = phase_profiler_cycle_mah(&awake_ms);
+    battery_info_t battery;
+    bool battery_ok = battery_monitor_read(&battery) == ESP_OK;
+    energy_ledger_cycle_end(awake_mah, awake_ms, (uint32_t)(sleep_time / 1000), battery_ok ? &battery : NULL);
     
     ESP_LOGI(TAG, "Trigger interval: %.2f seconds", (float)TRIGGER_INTERVAL / 1000000.0f);
     ESP_LOGI(TAG, "Execution time: %.2f seconds", (float)execution_time / 1000000.0f);
     ESP_LOGI(TAG, "Going to sleep for %.2f seconds", (float)sleep_time / 1000000.0f);
     
-    
+    return sleep_time;
+}
+
+// Main function
+void app_main(void)
+{
+    // Before the first cJSON or mbedTLS allocation
+    json_arena_init();
+    heap_monitor_init();
+
+#if CONFIG_IDF_TARGET_LINUX
+    // Host simulation: the wake cycles run back to back, deep sleep is skipped.
+    // RAM is not cleared between cycles, so the per-boot state is reset here like a wake from
+    // deep sleep: the RTC copy of the system state stays, the NVS handles are closed.
+    const char *cycles_env = getenv("SIM_CYCLES");
+    int cycles = cycles_env ? atoi(cycles_env) : SIM_DEFAULT_CYCLES;
+
+    for (int cycle = 1; cycle <= cycles; cycle++) {
+        ESP_LOGI(TAG, "Simulated wake cycle %d/%d", cycle, cycles);
+        sensors_reset_status();
+        sensors_reset_data_received_flag();
+        wake_cycle();
+        send_scheduler_sim_reset();
+        system_state_sim_reset(false);
+        storage_sim_reset();
+    }
+
+    ESP_LOGI(TAG, "Simulation finished after %d cycles", cycles);
+    exit(0);
+#else
+    int64_t sleep_time = wake_cycle();
+
     esp_sleep_enable_timer_wakeup(sleep_time);
     esp_deep_sleep_start();
+#endif
 }
 
 
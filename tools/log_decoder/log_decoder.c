@@ -0,0 +1,112 @@
+// log_decoder.c
+// Decodes a log ring file pulled from the device (debug_log.bin of the
+// storage partition, or spiffs_image/debug_log.bin of the host simulation)
+// into the lines the firmware sends to Discord, oldest first.
+//
+// Usage: log_decoder [-a] debug_log.bin
+//   -a  also print the records already delivered that are still in the ring
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "storage_log.h"
+
+#define DECODER_LINE_SIZE   512
+
+static int usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-a] debug_log.bin\n", name);
+    return 2;
+}
+
+// Records of the ring from sequence number first to end, oldest first
+static storage_log_record_t *read_records(FILE *f, const storage_log_file_header_t *header,
+                                          uint32_t first, uint32_t end) {
+    size_t count = end - first;
+    storage_log_record_t *records = calloc(count ? count : 1, sizeof(*records));
+    if (records == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t slot = (first + i) % header->capacity;
+        if (fseek(f, sizeof(*header) + slot * sizeof(*records), SEEK_SET) != 0 ||
+            fread(&records[i], sizeof(*records), 1, f) != 1) {
+            free(records);
+            return NULL;
+        }
+    }
+    return records;
+}
+
+int main(int argc, char **argv) {
+    bool all = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0) {
+            all = true;
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        return usage(argv[0]);
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    storage_log_file_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != STORAGE_LOG_FILE_MAGIC) {
+        fprintf(stderr, "%s: not a log ring file\n", path);
+        fclose(f);
+        return 1;
+    }
+    if (header.record_size != sizeof(storage_log_record_t) || header.capacity == 0 ||
+        header.count > header.capacity) {
+        fprintf(stderr, "%s: unsupported header (record size %u, capacity %u, count %" PRIu32 ")\n",
+                path, header.record_size, header.capacity, header.count);
+        fclose(f);
+        return 1;
+    }
+
+    // Consumed records stay in their slots until the ring overwrites them
+    uint32_t stored = header.count;
+    if (all) {
+        stored = (header.head < header.capacity) ? header.head : header.capacity;
+    }
+    uint32_t first = header.head - stored;
+    storage_log_record_t *records = read_records(f, &header, first, header.head);
+    fclose(f);
+    if (records == NULL) {
+        fprintf(stderr, "%s: truncated, %" PRIu32 " records expected\n", path, stored);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %" PRIu32 " records written, %" PRIu32 " undelivered, printing %" PRIu32 "\n",
+            path, header.head, header.count, stored);
+
+    char line[DECODER_LINE_SIZE];
+    size_t offset = 0;
+    while (offset < stored) {
+        size_t used = 0;
+        int length = storage_log_decode_line(&records[offset], stored - offset, &used, line, sizeof(line));
+        if (length < 0) {
+            fprintf(stderr, "Record %" PRIu32 " does not fit into the line buffer\n", first + (uint32_t)offset);
+            used = used ? used : 1;
+        } else if (length > 0) {
+            fputs(line, stdout);
+        }
+        if (used == 0) {
+            break;      // Incomplete text at the end of the ring
+        }
+        offset += used;
+    }
+
+    free(records);
+    return 0;
+}